@@ -8,13 +8,15 @@
  * Description: HTTP/Websocket frontend
  */
 
-var pl = [], fb_dir = [], mb = [];
+var pl = [], pl_length = [], fb_dir = [], mb = [];
 var dir;
 var selected_tab = 'pl';
 
 var con = null;
 var plt, fbt, mbt;
 var playmode = 0;
+var track_length = 0; // in seconds
+var pl_rows = 0, pl_time = 0, pl_time_unknown = 0; // pl_time in seconds
 
 window.onload = function() { init(); }
 
@@ -67,6 +69,7 @@ function Connection()
 							dir = undefined;
 							c.do_send('{"cmd":"dir_read","dir":"' + cur_dir + '"}');
 							mlib_browse('artist');
+							c.do_send('{"cmd":"medialib_info"}');
 						}
 						break;
 					case 'time':
@@ -97,6 +100,7 @@ function Connection()
 					case 'trackinfo':
 						write_to_screen('Track:' + jmsg['artist'] + ' - ' + jmsg['title']);
 						set_trackinfo(jmsg['artist'], jmsg['title'], jmsg['album']);
+						track_length = jmsg['length_min'] * 60 + jmsg['length_sec'];
 						break;
 					case 'track_change':
 						set_trackinfo_playlist_pos("" + jmsg['playlist_pos']);
@@ -106,9 +110,16 @@ function Connection()
 						t = document.getElementById("playlisttable");
 						rows = jmsg['length'];
 						pl_set_number_of_items(rows);
-						for (var i = jmsg['changed_at_position']; i < rows; i++)
+						for (var i = jmsg['changed_at_position']; i < rows; i++) {
 							pl[i] = undefined;
-						document.getElementById('tpl').innerHTML = 'Playlist ('+rows+')';
+							pl_length[i] = undefined;
+						}
+						pl_rows = rows;
+						if (jmsg['time'] !== undefined) {
+							pl_time = jmsg['time'];
+							pl_time_unknown = jmsg['unknown'];
+						}
+						update_playlist_title();
 						toggle_state = false;
 						current_length = t.rows.length;
 						for (id = 0; (r = t.rows[id]); id++) {
@@ -117,8 +128,14 @@ function Connection()
 						}
 						handle_playlist_scroll();
 						break;
+					case 'playlist_time':
+						pl_time = jmsg['time'];
+						pl_time_unknown = jmsg['unknown'];
+						update_playlist_title();
+						break;
 					case 'playlist_item':
 						pl[jmsg['position']] = jmsg['title'];
+						pl_length[jmsg['position']] = jmsg['length'];
 						if (jmsg['position']-plt.first_visible_line >= 0)
 							plt.set_row_data(jmsg['position']-plt.first_visible_line);
 						break;
@@ -126,6 +143,7 @@ function Connection()
 						min = parseInt((jmsg['time'] / 1000) / 60);
 						sec = parseInt((jmsg['time'] / 1000) - min * 60);
 						write_to_time_display(min + ':' + (sec < 10 ? '0' : '') + sec);
+						set_progress(jmsg['time']);
 						break;
 					case 'dir_read':
 						if (jmsg['res'] == 'ok') {
@@ -184,27 +202,47 @@ function Connection()
 								break;
 						}
 						break;
-					case 'mlib_browse_result':
-						if (jmsg['pos'] != undefined) {
-							mb[jmsg['pos']] = [];
-							mb[jmsg['pos']]['artist'] = jmsg['artist'];
-							if (jmsg['pos']-mbt.first_visible_line >= 0)
-								mbt.set_row_data(jmsg['pos']-mbt.first_visible_line);
-							mbt.set_length(mb.length);
+					case 'mlib_browse_results':
+						if (jmsg['pos'] == 0) mb.length = 0;
+						for (var i = 0; i < jmsg['items'].length; i++) {
+							var pos = jmsg['pos'] + i;
+							mb[pos] = [];
+							mb[pos]['artist'] = jmsg['items'][i]['artist'];
+							if (pos-mbt.first_visible_line >= 0)
+								mbt.set_row_data(pos-mbt.first_visible_line);
 						}
+						mbt.set_length(mb.length);
 						break;
-					case 'mlib_result':
+					case 'mlib_results':
 						if (jmsg['pos'] == 0) mb.length = 0;
 						handle_mb_scroll();
-						mb[jmsg['pos']] = [];
-						mb[jmsg['pos']]['artist'] = jmsg['artist'];
-						mb[jmsg['pos']]['title'] = jmsg['title'];
-						mb[jmsg['pos']]['album'] = jmsg['album'];
-						mb[jmsg['pos']]['file'] = jmsg['file'];
-						if (jmsg['pos']-mbt.first_visible_line >= 0)
-							mbt.set_row_data(jmsg['pos']-mbt.first_visible_line);
+						for (var i = 0; i < jmsg['items'].length; i++) {
+							var pos = jmsg['pos'] + i;
+							var item = jmsg['items'][i];
+							mb[pos] = [];
+							mb[pos]['id'] = item['id'];
+							mb[pos]['artist'] = item['artist'];
+							mb[pos]['title'] = item['title'];
+							mb[pos]['album'] = item['album'];
+							mb[pos]['file'] = item['file'];
+							if (pos-mbt.first_visible_line >= 0)
+								mbt.set_row_data(pos-mbt.first_visible_line);
+						}
 						mbt.set_length(mb.length);
 						break;
+					case 'mlib_search_done':
+						/* Fetch the next page, if there is one */
+						if (jmsg['cursor'] != undefined)
+							mlib_find(jmsg['str'], jmsg['cursor']);
+						break;
+					case 'mlib_browse_done':
+						if (jmsg['cursor'] != undefined)
+							mlib_browse(jmsg['column'], jmsg['cursor']);
+						break;
+					case 'mlib_info':
+						if (jmsg['index_max_kb'] > 0)
+							write_to_screen('Medialib memory index: ' + jmsg['index_kb'] + ' of ' + jmsg['index_max_kb'] + ' KiB');
+						break;
 					default:
 						if (msg.data != undefined) write_to_screen('msg='+msg.data);
 						break;
@@ -370,6 +408,14 @@ function write_to_time_display(message)
 	output.innerHTML = message;
 }
 
+function set_progress(time_ms)
+{
+	var percent = 0;
+	if (track_length > 0)
+		percent = Math.min(100, time_ms / (track_length * 10));
+	document.getElementById('progressmarker').style.width = percent + '%';
+}
+
 function set_trackinfo(artist, title, album)
 {
 	document.getElementById('ti-artist').innerHTML = html_entity_encode(artist);
@@ -480,6 +526,18 @@ function handle_btn_stop(e)
 	con.do_send('{"cmd":"stop"}');
 }
 
+function handle_progressbar_click(e)
+{
+	if (!e) var e = window.event;
+	var bar = document.getElementById('progressbar');
+	var x = e.clientX - bar.getBoundingClientRect().left;
+	if (track_length > 0 && bar.clientWidth > 0) {
+		var time_ms = Math.round(x / bar.clientWidth * track_length * 1000);
+		set_progress(time_ms);
+		con.do_send('{"cmd":"seek","time":' + time_ms + '}');
+	}
+}
+
 function handle_btn_clear(e)
 {
 	con.do_send('{"cmd":"playlist_clear"}');
@@ -598,6 +656,23 @@ function handle_login(e)
 	return false;
 }
 
+// Formats a time given in seconds as h:mm:ss or m:ss
+function format_time(seconds)
+{
+	var h = parseInt(seconds / 3600), m = parseInt(seconds / 60) % 60, s = seconds % 60;
+	var res = (h > 0 ? h + ":" + (m < 10 ? '0' : '') : '') + m + ":";
+	return res + (s < 10 ? '0' : '') + s;
+}
+
+// The total time is marked with a '+' as long as some lengths are unknown
+function update_playlist_title()
+{
+	var title = 'Playlist (' + pl_rows;
+	if (pl_rows > 0 && pl_time > 0)
+		title += ', ' + format_time(pl_time) + (pl_time_unknown > 0 ? '+' : '');
+	document.getElementById('tpl').innerHTML = title + ')';
+}
+
 function pl_item_row_construct(item, col)
 {
 	var res;
@@ -609,6 +684,8 @@ function pl_item_row_construct(item, col)
 		case 1:
 			res = "<a href=\"javascript:play("+item+");\">"+
 			      html_entity_encode(pl[item])+"</a>";
+			if (pl_length[item] > 0)
+				res += " (" + format_time(pl_length[item]) + ")";
 			break;
 		case 2:
 			res = "<a title=\"Remove item\" class=\"icon\" href=\"javascript:remove("+item+");\">&#10007;</a>";
@@ -675,6 +752,8 @@ function mb_item_row_construct(item, col)
 				if (mb[item]['title'] !== undefined && mb[item]['file'] != undefined) {
 					var path_mask = str_escape(mb[item]['file']);
 					res = "<a href=\"javascript:add_file('"+html_entity_encode(path_mask)+"');\">" + html_entity_encode(mb[item]['title']) + "</a>";
+					if (mb[item]['id'] !== undefined)
+						res += " <a href=\"javascript:mlib_similar(" + mb[item]['id'] + ");\" title=\"Similar tracks\">&#8776;</a>";
 				}
 				break;
 			case 2:
@@ -706,14 +785,21 @@ function add_dir(path)
 	c.do_send('{"cmd":"playlist_add","path":"' + str_escape(path) + '","type":"dir"}');
 }
 
-function mlib_find(str)
+function mlib_find(str, cursor)
+{
+	var c_str = cursor !== undefined ? ',"cursor":"' + str_escape(cursor) + '"' : '';
+	c.do_send('{"cmd":"medialib_search","str":"' + str_escape(str) + '","type":"0"' + c_str + '}');
+}
+
+function mlib_similar(id)
 {
-	c.do_send('{"cmd":"medialib_search","str":"' + str_escape(str) + '","type":"0"}');
+	c.do_send('{"cmd":"medialib_similar","id":' + id + '}');
 }
 
-function mlib_browse(str)
+function mlib_browse(str, cursor)
 {
-	c.do_send('{"cmd":"medialib_browse","column":"' + str_escape(str) + '"}');
+	var c_str = cursor !== undefined ? ',"cursor":"' + str_escape(cursor) + '"' : '';
+	c.do_send('{"cmd":"medialib_browse","column":"' + str_escape(str) + '"' + c_str + '}');
 }
 
 function html_entity_encode(str)
@@ -765,6 +851,7 @@ function init()
 	add_event_handler('btn-play',    'click',  handle_btn_play);
 	add_event_handler('btn-pause',   'click',  handle_btn_pause);
 	add_event_handler('btn-stop',    'click',  handle_btn_stop);
+	add_event_handler('progressbar', 'click',  handle_progressbar_click);
 	add_event_handler('plscrollbar', 'scroll', handle_playlist_scroll);
 	add_event_handler('fbscrollbar', 'scroll', handle_fb_scroll);
 	add_event_handler('mbscrollbar', 'scroll', handle_mb_scroll);
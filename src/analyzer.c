@@ -0,0 +1,170 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: analyzer.c  Created: 210918
+ *
+ * Description: Control of the background medialib analyzer process
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "analyzer.h"
+#include "core.h"
+#include "debug.h"
+
+static pid_t pid;
+static int   paused;
+static int   fd = -1;
+static char  line[128];
+static int   line_len;
+static int   total, done, progress = -1;
+
+int analyzer_start(const char *decoder_dir, int cpu_limit, int jobs, int flags)
+{
+	char        tool[300], limit[16], njobs[16];
+	const char *stages, *tags = (flags & ANALYZER_LOUDNESS_TAGS) ? "-t" : NULL;
+	int         pipefd[2];
+
+	if (pid > 0) return 1;
+	snprintf(tool, 299, "%s/gmu-analyze", gmu_core_get_base_dir());
+	snprintf(limit, 15, "%d", cpu_limit);
+	snprintf(njobs, 15, "%d", jobs);
+	if ((flags & ANALYZER_FEATURES) && (flags & ANALYZER_LOUDNESS))
+		stages = "features,loudness";
+	else
+		stages = (flags & ANALYZER_LOUDNESS) ? "loudness" : "features";
+
+	if (pipe(pipefd) != 0) {
+		wdprintf(V_WARNING, "analyzer", "Unable to create pipe.\n");
+		return 0;
+	}
+	pid = fork();
+	if (pid == 0) {
+		/* The analyzer and its worker processes get their own process
+		 * group, so they can be paused and stopped together */
+		setpgid(0, 0);
+		close(pipefd[0]);
+		dup2(pipefd[1], STDOUT_FILENO);
+		close(pipefd[1]);
+		/* Try the tool next to Gmu's binary first, then the one in the PATH */
+		if (access(tool, X_OK) == 0)
+			execl(tool, "gmu-analyze", "-d", decoder_dir, "-c", limit, "-j", njobs,
+			      "-s", stages, "-p", tags, (char *)NULL);
+		execlp("gmu-analyze", "gmu-analyze", "-d", decoder_dir, "-c", limit, "-j", njobs,
+		       "-s", stages, "-p", tags, (char *)NULL);
+		_exit(EXIT_FAILURE);
+	}
+	close(pipefd[1]);
+	if (pid < 0) {
+		wdprintf(V_WARNING, "analyzer", "Unable to start the medialib analyzer.\n");
+		close(pipefd[0]);
+		pid = 0;
+	} else {
+		/* Also set here, so there is no race with the first kill() */
+		setpgid(pid, pid);
+		fd = pipefd[0];
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		line_len = 0;
+		total = done = 0;
+		progress = 0;
+		wdprintf(V_INFO, "analyzer", "Medialib analyzer started (pid %d).\n", (int)pid);
+	}
+	paused = 0;
+	return pid > 0;
+}
+
+static void parse_line(const char *str)
+{
+	int n;
+
+	if (sscanf(str, "total %d", &n) == 1) {
+		total = n;
+	} else if (strncmp(str, "done ", 5) == 0) {
+		done++;
+	}
+	/* Everything else is log output of the analyzer */
+	if (total > 0) progress = done >= total ? 100 : done * 100 / total;
+}
+
+static void read_progress(void)
+{
+	char    buf[256];
+	ssize_t len;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		ssize_t i;
+
+		for (i = 0; i < len; i++) {
+			if (buf[i] == '\n') {
+				line[line_len] = '\0';
+				parse_line(line);
+				line_len = 0;
+			} else if (line_len < (int)sizeof(line) - 1) {
+				line[line_len++] = buf[i];
+			}
+		}
+	}
+}
+
+static void close_pipe(void)
+{
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+}
+
+void analyzer_update(size_t buffer_fill, size_t buffer_size, int playing)
+{
+	if (pid > 0) {
+		int status;
+
+		if (fd >= 0) read_progress();
+		if (waitpid(pid, &status, WNOHANG) == pid) {
+			wdprintf(V_INFO, "analyzer", "Medialib analyzer finished (status %d).\n",
+			         WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+			if (fd >= 0) read_progress();
+			close_pipe();
+			progress = 100;
+			pid = 0;
+		} else if (!paused && playing && buffer_fill < buffer_size / 4) {
+			/* Playback has priority, the analyzer continues once the buffer is refilled.
+			 * SIGTSTP instead of SIGSTOP, so it is deferred while the analyzer
+			 * holds a database transaction. */
+			if (kill(-pid, SIGTSTP) == 0) paused = 1;
+		} else if (paused && (!playing || buffer_fill > buffer_size / 2)) {
+			if (kill(-pid, SIGCONT) == 0) paused = 0;
+		}
+	}
+}
+
+int analyzer_get_progress(void)
+{
+	return progress;
+}
+
+void analyzer_stop(void)
+{
+	if (pid > 0) {
+		wdprintf(V_INFO, "analyzer", "Stopping medialib analyzer...\n");
+		kill(-pid, SIGTERM);
+		if (paused) kill(-pid, SIGCONT);
+		waitpid(pid, NULL, 0);
+		close_pipe();
+		pid = 0;
+		paused = 0;
+	}
+}
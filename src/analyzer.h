@@ -0,0 +1,40 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: analyzer.h  Created: 210918
+ *
+ * Description: Control of the background medialib analyzer process
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#ifndef _ANALYZER_H
+#define _ANALYZER_H
+#include <stddef.h>
+
+#define ANALYZER_FEATURES       1 /* Feature vectors for the similar tracks query */
+#define ANALYZER_LOUDNESS       2 /* EBU R128 loudness and true peak */
+#define ANALYZER_LOUDNESS_TAGS  4 /* Also store the loudness as ReplayGain tags */
+
+/* Starts the gmu-analyze tool, which analyzes all tracks of the medialib
+ * that have not been analyzed yet and then exits. The analyzer runs as a
+ * separate process, since the decoders can only decode one file at a time.
+ * 'cpu_limit' is the maximum CPU usage of each analyzer process in percent,
+ * 'jobs' the number of analyzer processes (0 = one per CPU core) and 'flags'
+ * a combination of the ANALYZER_* flags above.
+ * Returns 1 on success, 0 otherwise. */
+int  analyzer_start(const char *decoder_dir, int cpu_limit, int jobs, int flags);
+/* Pauses the analyzer while the audio buffer runs low during playback and
+ * resumes it once the buffer has been refilled. Can be called frequently. */
+void analyzer_update(size_t buffer_fill, size_t buffer_size, int playing);
+/* Returns the progress of the analyzer in percent, or -1 if it has not
+ * been started. Updated by analyzer_update(). */
+int  analyzer_get_progress(void);
+/* Stops the analyzer. Tracks being analyzed will be analyzed again on the next start. */
+void analyzer_stop(void);
+#endif
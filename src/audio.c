@@ -13,6 +13,7 @@
  * the License. See the file COPYING in the Gmu's main directory
  * for details.
  */
+#include <stdlib.h>
 #include <math.h>
 #include <SDL2/SDL.h>
 #include "ringbuffer.h"
@@ -23,9 +24,11 @@
 #include "gmuerror.h"
 #include "core.h"
 #include FILE_HW_H
-#define RINGBUFFER_SIZE 131072
+#define DECLICK_RAMP_MS 5
 
 static RingBuffer    audio_rb;
+static size_t        buffer_limit = AUDIO_BUFFER_SIZE;
+static int           deep_buffer_seconds;
 static unsigned int  volume_fade_percent = 100;
 
 static unsigned long buf_read_counter;
@@ -44,13 +47,76 @@ static int           device_open;
 
 static unsigned int  volume, volume_internal;
 
+/* De-click state after a buffer flush; only accessed with the audio lock held */
+static char          declick_tail[16384];
+static size_t        declick_skip, declick_pos, declick_len, declick_frame_size;
 
-int audio_fill_buffer(char *data, size_t size)
+
+/**
+ * Returns the ring buffer size needed for the current buffering mode.
+ * Must be called with the audio lock held.
+ */
+static size_t get_wanted_buffer_size(void)
 {
-	int result = 0;
+	size_t size = AUDIO_BUFFER_SIZE;
+
+	if (deep_buffer_seconds > 0) {
+		size_t deep_size = (size_t)deep_buffer_seconds * have_samplerate * have_channels * 2;
+		if (deep_size > size) size = deep_size;
+	}
+	return size;
+}
+
+/**
+ * Sets the usable buffer size according to the buffering mode. The ring
+ * buffer itself is resized by audio_fill_buffer(), since allocating the
+ * new buffer must not happen with the audio lock held.
+ * Must be called with the audio lock held.
+ */
+static void update_buffer_limit(void)
+{
+	size_t size = get_wanted_buffer_size();
+
+	if (size > ringbuffer_get_size(&audio_rb)) size = ringbuffer_get_size(&audio_rb);
+	buffer_limit = size;
+}
+
+int audio_fill_buffer(const char *data, size_t size)
+{
+	static size_t failed_size;
+	int           result = 0;
+	size_t        wanted, current, fill;
+	char         *buffer = NULL;
+
+	SDL_LockAudio();
+	wanted  = get_wanted_buffer_size();
+	current = ringbuffer_get_size(&audio_rb);
+	fill    = ringbuffer_get_fill(&audio_rb);
+	SDL_UnlockAudio();
+	/* Grow the ring buffer for deep buffering, or shrink it back once the
+	 * excess data has been played. Only this function resizes the ring
+	 * buffer, so its size cannot change in the meantime. */
+	if (wanted != current && wanted != failed_size && (wanted > current || fill <= wanted)) {
+		buffer = malloc(wanted);
+		if (!buffer) {
+			wdprintf(V_WARNING, "audio", "Unable to resize buffer to %lu bytes.\n", (unsigned long)wanted);
+			failed_size = wanted;
+		}
+	}
 	SDL_LockAudio();
-	result = ringbuffer_write(&audio_rb, data, size);
+	/* The buffering mode might have been changed in the meantime, in which
+	 * case the new buffer is dropped and allocated again with the next call */
+	if (buffer && wanted == get_wanted_buffer_size()) {
+		/* Only copies the buffered data, which is at most the smaller of both sizes */
+		ringbuffer_swap_buffer(&audio_rb, &buffer, wanted);
+		failed_size = 0;
+	}
+	if (buffer_limit != get_wanted_buffer_size()) update_buffer_limit();
+	if (ringbuffer_get_fill(&audio_rb) + size <= buffer_limit)
+		result = ringbuffer_write(&audio_rb, data, size);
 	SDL_UnlockAudio();
+	/* Either the old buffer or the unused new one */
+	free(buffer);
 	return result;
 }
 
@@ -102,6 +168,27 @@ void audio_spectrum_read_unlock(void)
 	SDL_UnlockMutex(spectrum_mutex);
 }
 
+/**
+ * Scales 'size' bytes of 16 bit samples in 'buf' linearly. 'pos' is the
+ * byte position of 'buf' within a ramp of 'len' bytes. The gain rises from
+ * 0 to 1 over the ramp, or falls from 1 to 0 if 'fade_out' is set.
+ */
+static void declick_ramp(char *buf, size_t size, size_t frame_size,
+                         size_t pos, size_t len, int fade_out)
+{
+	size_t i;
+
+	for (i = 0; i + 1 < size; i += 2) {
+		int16_t sample;
+		long    p = (long)(pos + i - i % frame_size);
+		long    gain = fade_out ? (long)len - p : p;
+
+		memcpy(&sample, buf + i, 2);
+		sample = (int16_t)(sample * gain / (long)len);
+		memcpy(buf + i, &sample, 2);
+	}
+}
+
 static void fill_audio(void *udata, Uint8 *stream, int len)
 {
 	static Uint8 buf[65536];
@@ -116,6 +203,22 @@ static void fill_audio(void *udata, Uint8 *stream, int len)
 			add = avail;
 	}
 
+	/* Fade in the data following a buffer flush, after the faded out
+	 * remains of the previous data have been played */
+	if (declick_len > 0) {
+		size_t start = declick_skip < add ? declick_skip : add;
+
+		declick_skip -= start;
+		if (start < add) {
+			size_t n = add - start;
+
+			if (n > declick_len - declick_pos) n = declick_len - declick_pos;
+			declick_ramp((char *)buf + start, n, declick_frame_size, declick_pos, declick_len, 0);
+			declick_pos += n;
+			if (declick_pos >= declick_len) declick_len = 0;
+		}
+	}
+
 	if (SDL_LockMutex(audio_mutex2) == 0) {
 		buf_read_counter += add;
 		SDL_UnlockMutex(audio_mutex2);
@@ -183,14 +286,18 @@ int audio_device_open(int samplerate, int channels)
 			} else {
 				result = 0;
 				device_open = 1;
+				/* Used by get_wanted_buffer_size() */
+				SDL_LockAudio();
 				have_samplerate = samplerate;
 				have_channels   = channels;
+				SDL_UnlockAudio();
 				wdprintf(V_INFO, "audio", "Device opened with %d Hz, %d channels and sample buffer w/ %d samples.\n",
 						 obtained.freq, obtained.channels, obtained.samples);
 			}
 			if (SDL_UnlockMutex(audio_mutex2) != -1) {
 				SDL_LockAudio();
 				ringbuffer_clear(&audio_rb);
+				update_buffer_limit();
 				SDL_UnlockAudio();
 				SDL_LockMutex(audio_mutex2);
 			}
@@ -273,6 +380,20 @@ int audio_get_playtime(void)
 	return res;
 }
 
+/**
+ * Like audio_get_playtime(), but with millisecond precision instead of
+ * being truncated to whole seconds.
+ */
+long audio_get_playtime_ms(void)
+{
+	long res = 0;
+	if (SDL_LockMutex(audio_mutex2) != -1) {
+		res = (long)((long long)buf_read_counter * 1000 / (have_samplerate * 2 * have_channels));
+		SDL_UnlockMutex(audio_mutex2);
+	}
+	return res;
+}
+
 size_t audio_buffer_get_fill(void)
 {
 	size_t res = 0;
@@ -286,7 +407,49 @@ size_t audio_buffer_get_size(void)
 {
 	size_t res = 0;
 	SDL_LockAudio();
-	res = ringbuffer_get_size(&audio_rb);
+	res = buffer_limit;
+	SDL_UnlockAudio();
+	return res;
+}
+
+/**
+ * Returns the buffer fill level at which the decoder should resume
+ * filling the buffer once it is full. In low latency mode this is the
+ * buffer size. With deep buffering the buffer is allowed to drain to a
+ * quarter of its size, so that decoding happens in long bursts with the
+ * CPU idling inbetween.
+ */
+size_t audio_buffer_get_refill_level(void)
+{
+	size_t res = 0;
+	SDL_LockAudio();
+	res = deep_buffer_seconds > 0 ? buffer_limit / 4 : buffer_limit;
+	SDL_UnlockAudio();
+	return res;
+}
+
+/**
+ * Enables deep buffering with a buffer of 'seconds' seconds of audio data,
+ * or switches back to the normal low latency buffer when 'seconds' is 0.
+ * Meant for situations where nobody needs low latency, e.g. while the
+ * display is turned off.
+ */
+void audio_set_deep_buffering(int seconds)
+{
+	SDL_LockAudio();
+	if (deep_buffer_seconds != seconds) {
+		deep_buffer_seconds = seconds > 0 ? seconds : 0;
+		update_buffer_limit();
+		wdprintf(V_DEBUG, "audio", "Buffer size: %lu bytes\n", (unsigned long)buffer_limit);
+	}
+	SDL_UnlockAudio();
+}
+
+int audio_get_deep_buffering(void)
+{
+	int res;
+	SDL_LockAudio();
+	res = deep_buffer_seconds;
 	SDL_UnlockAudio();
 	return res;
 }
@@ -300,7 +463,9 @@ void audio_buffer_init(void)
 	device_open = 0;
 	have_samplerate = 1;
 	have_channels = 1;
-	ringbuffer_init(&audio_rb, RINGBUFFER_SIZE);
+	deep_buffer_seconds = 0;
+	buffer_limit = AUDIO_BUFFER_SIZE;
+	ringbuffer_init(&audio_rb, AUDIO_BUFFER_SIZE);
 	spectrum_mutex = SDL_CreateMutex();
 	audio_mutex2 = SDL_CreateMutex();
 	pause_mutex = SDL_CreateMutex();
@@ -314,6 +479,43 @@ void audio_buffer_clear(void)
 	SDL_UnlockAudio();
 }
 
+/**
+ * Discards the buffered audio data without pausing playback, e.g. after
+ * seeking. 'sample' is the position of the data written next, the playback
+ * clock is set accordingly. To avoid clicks, the first few milliseconds of
+ * the old data are kept and faded out, followed by a fade-in of the new data.
+ */
+void audio_buffer_flush(long sample)
+{
+	size_t frame_size, ramp, keep;
+
+	SDL_LockAudio();
+	frame_size = 2 * have_channels;
+	ramp = (size_t)have_samplerate * DECLICK_RAMP_MS / 1000 * frame_size;
+	if (ramp > sizeof(declick_tail)) ramp = sizeof(declick_tail) / frame_size * frame_size;
+	keep = ringbuffer_get_fill(&audio_rb);
+	if (keep > ramp) keep = ramp;
+	keep -= keep % frame_size;
+	if (keep > 0 && ringbuffer_read(&audio_rb, declick_tail, keep))
+		declick_ramp(declick_tail, keep, frame_size, 0, keep, 1);
+	else
+		keep = 0;
+	ringbuffer_clear(&audio_rb);
+	if (keep > 0) ringbuffer_write(&audio_rb, declick_tail, keep);
+	declick_skip = keep;
+	declick_pos = 0;
+	declick_len = ramp;
+	declick_frame_size = frame_size;
+	/* The kept data is still played, so the clock has to lag behind by its length */
+	if (SDL_LockMutex(audio_mutex2) != -1) {
+		unsigned long pos = (unsigned long)(sample > 0 ? sample : 0) * frame_size;
+		buf_read_counter = pos > keep ? pos - keep : 0;
+		SDL_UnlockMutex(audio_mutex2);
+	}
+	SDL_UnlockAudio();
+	wdprintf(V_DEBUG, "audio", "Buffer flushed, continuing at sample %ld.\n", sample);
+}
+
 void audio_buffer_free(void)
 {
 	ringbuffer_free(&audio_rb);
@@ -14,20 +14,27 @@
  * for details.
  */
 #define MIN_BUFFER_FILL 32768
+/* Buffer size for normal (low latency) operation */
+#define AUDIO_BUFFER_SIZE 131072
 #define AUDIO_MAX_SW_VOLUME 16
 #ifndef _AUDIO_H
 #define _AUDIO_H
 #include <sys/types.h>
 
 int      audio_device_open(int samplerate, int channels);
-int      audio_fill_buffer(char *data, size_t size);
+int      audio_fill_buffer(const char *data, size_t size);
 int      audio_get_playtime(void);
+long     audio_get_playtime_ms(void);
 void     audio_buffer_init(void);
 void     audio_buffer_clear(void);
+void     audio_buffer_flush(long sample);
 void     audio_buffer_free(void);
 void     audio_device_close(void);
 size_t   audio_buffer_get_fill(void);
 size_t   audio_buffer_get_size(void);
+size_t   audio_buffer_get_refill_level(void);
+void     audio_set_deep_buffering(int seconds);
+int      audio_get_deep_buffering(void);
 int      audio_get_status(void);
 void     audio_force_pause(int pause);
 int      audio_set_pause(int pause_state);
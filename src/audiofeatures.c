@@ -0,0 +1,536 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: audiofeatures.c  Created: 210918
+ *
+ * Description: Acoustic feature vectors for track similarity
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "audiofeatures.h"
+#include "pcmconv.h"
+#include "debug.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define AUDIOFEATURES_HAVE_SSE2 1
+#include <emmintrin.h>
+#define SSE2_FUNC __attribute__((target("sse2")))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AUDIOFEATURES_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Spectra are computed from overlapping frames of FFT_SIZE samples (about
+ * 46 ms at 11 kHz); The onsets of successive frames are used for finding
+ * the tempo. */
+#define FFT_SIZE      512
+#define FFT_BITS      9
+#define HOP_SIZE      256
+#define BINS          (FFT_SIZE / 2 + 1)
+#define BANDS         16
+#define BAND_MIN_FREQ 60.0
+#define BAND_MAX_FREQ 5000.0
+/* Frames with less energy than this (about -60 dBFS) are considered silent */
+#define SILENCE_POWER 0.01f
+#define TEMPO_MIN     60.0
+#define TEMPO_MAX     200.0
+/* Locality sensitive hashing: Each hash combines LSH_PROJECTIONS random
+ * projections quantized to buckets of LSH_BUCKET_WIDTH. Tracks that sound
+ * alike are about 2-5 apart, unrelated ones 15-20. With these values
+ * tracks 2 apart share at least one hash in 97% of the cases, tracks 4
+ * apart in 74%, unrelated tracks in about 2%. */
+#define LSH_PROJECTIONS  4
+#define LSH_BUCKET_WIDTH 12.0f
+
+struct AudioFeatures
+{
+	int     channels, decimation;
+	float   rate;           /* Sample rate after decimation */
+	float   acc;            /* Decimation accumulator */
+	int     acc_n;
+	float   buf[FFT_SIZE];
+	int     buf_len;
+	size_t  samples;        /* Analyzed samples (after decimation) */
+	int     band_start[BANDS + 1];
+	float   band_prev[BANDS];
+	double  band_sum[BANDS], band_sq[BANDS];
+	double  centroid_sum, centroid_sq, flux_sum;
+	size_t  frames;         /* Non-silent frames */
+	float  *onsets;         /* Onset strength of every frame */
+	size_t  onsets_len, onsets_size;
+};
+
+/*
+ * Kernels operating on float arrays. Like the pcmconv kernels, they take a
+ * start offset, so the SIMD versions can hand over the remaining elements
+ * that do not fill a whole vector to the scalar ones.
+ */
+typedef struct AudioFeaturesKernels
+{
+	const char *name;
+	/* target[i] = a[i] * b[i] */
+	void  (*mul)(float *, const float *, const float *, size_t, size_t);
+	/* target[i] = re[i]^2 + im[i]^2 */
+	void  (*power)(float *, const float *, const float *, size_t, size_t);
+	float (*dot)(const float *, const float *, size_t, size_t);
+	float (*sqdist)(const float *, const float *, size_t, size_t);
+} AudioFeaturesKernels;
+
+static void mul_c(float *target, const float *a, const float *b, size_t start, size_t n)
+{
+	size_t i;
+
+	for (i = start; i < n; i++)
+		target[i] = a[i] * b[i];
+}
+
+static void power_c(float *target, const float *re, const float *im, size_t start, size_t n)
+{
+	size_t i;
+
+	for (i = start; i < n; i++)
+		target[i] = re[i] * re[i] + im[i] * im[i];
+}
+
+static float dot_c(const float *a, const float *b, size_t start, size_t n)
+{
+	float  res = 0.0f;
+	size_t i;
+
+	for (i = start; i < n; i++)
+		res += a[i] * b[i];
+	return res;
+}
+
+static float sqdist_c(const float *a, const float *b, size_t start, size_t n)
+{
+	float  res = 0.0f;
+	size_t i;
+
+	for (i = start; i < n; i++)
+		res += (a[i] - b[i]) * (a[i] - b[i]);
+	return res;
+}
+
+static const AudioFeaturesKernels kernels_scalar = {
+	"scalar",
+	mul_c,
+	power_c,
+	dot_c,
+	sqdist_c
+};
+
+#ifdef AUDIOFEATURES_HAVE_SSE2
+static SSE2_FUNC float hsum_sse2(__m128 v)
+{
+	v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+	v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+	return _mm_cvtss_f32(v);
+}
+
+static SSE2_FUNC void mul_sse2(float *target, const float *a, const float *b, size_t start, size_t n)
+{
+	size_t i = start;
+
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(target + i, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+	mul_c(target, a, b, i, n);
+}
+
+static SSE2_FUNC void power_sse2(float *target, const float *re, const float *im, size_t start, size_t n)
+{
+	size_t i = start;
+
+	for (; i + 4 <= n; i += 4) {
+		__m128 r = _mm_loadu_ps(re + i);
+		__m128 m = _mm_loadu_ps(im + i);
+		_mm_storeu_ps(target + i, _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m)));
+	}
+	power_c(target, re, im, i, n);
+}
+
+static SSE2_FUNC float dot_sse2(const float *a, const float *b, size_t start, size_t n)
+{
+	size_t i = start;
+	__m128 sum = _mm_setzero_ps();
+
+	for (; i + 4 <= n; i += 4)
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+	return hsum_sse2(sum) + dot_c(a, b, i, n);
+}
+
+static SSE2_FUNC float sqdist_sse2(const float *a, const float *b, size_t start, size_t n)
+{
+	size_t i = start;
+	__m128 sum = _mm_setzero_ps();
+
+	for (; i + 4 <= n; i += 4) {
+		__m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+		sum = _mm_add_ps(sum, _mm_mul_ps(d, d));
+	}
+	return hsum_sse2(sum) + sqdist_c(a, b, i, n);
+}
+
+static const AudioFeaturesKernels kernels_sse2 = {
+	"SSE2",
+	mul_sse2,
+	power_sse2,
+	dot_sse2,
+	sqdist_sse2
+};
+#endif
+
+#ifdef AUDIOFEATURES_HAVE_NEON
+static float hsum_neon(float32x4_t v)
+{
+	float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+	return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+
+static void mul_neon(float *target, const float *a, const float *b, size_t start, size_t n)
+{
+	size_t i = start;
+
+	for (; i + 4 <= n; i += 4)
+		vst1q_f32(target + i, vmulq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+	mul_c(target, a, b, i, n);
+}
+
+static void power_neon(float *target, const float *re, const float *im, size_t start, size_t n)
+{
+	size_t i = start;
+
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t r = vld1q_f32(re + i);
+		float32x4_t m = vld1q_f32(im + i);
+		vst1q_f32(target + i, vmlaq_f32(vmulq_f32(r, r), m, m));
+	}
+	power_c(target, re, im, i, n);
+}
+
+static float dot_neon(const float *a, const float *b, size_t start, size_t n)
+{
+	size_t      i = start;
+	float32x4_t sum = vdupq_n_f32(0.0f);
+
+	for (; i + 4 <= n; i += 4)
+		sum = vmlaq_f32(sum, vld1q_f32(a + i), vld1q_f32(b + i));
+	return hsum_neon(sum) + dot_c(a, b, i, n);
+}
+
+static float sqdist_neon(const float *a, const float *b, size_t start, size_t n)
+{
+	size_t      i = start;
+	float32x4_t sum = vdupq_n_f32(0.0f);
+
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t d = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+		sum = vmlaq_f32(sum, d, d);
+	}
+	return hsum_neon(sum) + sqdist_c(a, b, i, n);
+}
+
+static const AudioFeaturesKernels kernels_neon = {
+	"NEON",
+	mul_neon,
+	power_neon,
+	dot_neon,
+	sqdist_neon
+};
+#endif
+
+static const AudioFeaturesKernels *kernels = &kernels_scalar;
+
+/* Tables shared by all instances */
+static float    window[FFT_SIZE];
+static float    twiddle_re[FFT_SIZE / 2], twiddle_im[FFT_SIZE / 2];
+static uint16_t bit_reverse[FFT_SIZE];
+static float    lsh_proj[AUDIOFEATURES_LSH_TABLES][LSH_PROJECTIONS][AUDIOFEATURES_DIM];
+static float    lsh_offset[AUDIOFEATURES_LSH_TABLES][LSH_PROJECTIONS];
+
+/* The LSH projections have to be the same in every run, since the hashes
+ * are stored in the medialib, so a fixed pseudo random sequence is used */
+static float lsh_random(unsigned int *state)
+{
+	*state = *state * 1103515245U + 12345U;
+	return ((*state >> 8) & 0xFFFFFF) / 16777216.0f;
+}
+
+void audiofeatures_init(void)
+{
+	unsigned int state = 20210918;
+	int          i, t, p;
+
+	kernels = &kernels_scalar;
+#ifdef AUDIOFEATURES_HAVE_NEON
+	if (pcmconv_cpu_supports(PCMCONV_IMPL_NEON)) kernels = &kernels_neon;
+#endif
+#ifdef AUDIOFEATURES_HAVE_SSE2
+	if (pcmconv_cpu_supports(PCMCONV_IMPL_SSE2)) kernels = &kernels_sse2;
+#endif
+	wdprintf(V_DEBUG, "audiofeatures", "Using %s kernels.\n", kernels->name);
+
+	for (i = 0; i < FFT_SIZE; i++) {
+		int j, r = 0;
+		window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / FFT_SIZE);
+		for (j = 0; j < FFT_BITS; j++)
+			if (i & (1 << j)) r |= 1 << (FFT_BITS - 1 - j);
+		bit_reverse[i] = r;
+	}
+	for (i = 0; i < FFT_SIZE / 2; i++) {
+		twiddle_re[i] = cosf(2.0f * (float)M_PI * i / FFT_SIZE);
+		twiddle_im[i] = -sinf(2.0f * (float)M_PI * i / FFT_SIZE);
+	}
+	for (t = 0; t < AUDIOFEATURES_LSH_TABLES; t++) {
+		for (p = 0; p < LSH_PROJECTIONS; p++) {
+			/* Gaussian projections (Box-Muller), as needed for Euclidean distances */
+			for (i = 0; i < AUDIOFEATURES_DIM; i++) {
+				float u1 = lsh_random(&state) + 1e-7f, u2 = lsh_random(&state);
+				lsh_proj[t][p][i] = sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float)M_PI * u2);
+			}
+			lsh_offset[t][p] = lsh_random(&state) * LSH_BUCKET_WIDTH;
+		}
+	}
+}
+
+const char *audiofeatures_get_implementation_name(void)
+{
+	return kernels->name;
+}
+
+AudioFeatures *audiofeatures_new(int samplerate, int channels)
+{
+	AudioFeatures *af = NULL;
+
+	if (samplerate > 0 && channels > 0 && (af = calloc(1, sizeof(AudioFeatures)))) {
+		double bin_width;
+		int    b;
+
+		af->channels   = channels;
+		af->decimation = (samplerate + AUDIOFEATURES_SAMPLERATE / 2) / AUDIOFEATURES_SAMPLERATE;
+		if (af->decimation < 1) af->decimation = 1;
+		af->rate = (float)samplerate / af->decimation;
+		/* Logarithmically spaced bands, each at least one bin wide */
+		bin_width = af->rate / FFT_SIZE;
+		for (b = 0; b <= BANDS; b++) {
+			double max_freq = BAND_MAX_FREQ < af->rate / 2 ? BAND_MAX_FREQ : af->rate / 2;
+			double freq = BAND_MIN_FREQ * pow(max_freq / BAND_MIN_FREQ, (double)b / BANDS);
+			int    bin = (int)(freq / bin_width + 0.5);
+			if (b > 0 && bin <= af->band_start[b - 1]) bin = af->band_start[b - 1] + 1;
+			af->band_start[b] = bin < BINS ? bin : BINS;
+		}
+	}
+	return af;
+}
+
+void audiofeatures_free(AudioFeatures *af)
+{
+	if (af) free(af->onsets);
+	free(af);
+}
+
+/* In-place radix-2 FFT of a real signal; im has to be zeroed */
+static void fft(float *re, float *im)
+{
+	int i, size;
+
+	for (i = 0; i < FFT_SIZE; i++) {
+		int j = bit_reverse[i];
+		if (j > i) {
+			float tmp = re[i];
+			re[i] = re[j];
+			re[j] = tmp;
+		}
+	}
+	for (size = 2; size <= FFT_SIZE; size *= 2) {
+		int half = size / 2, step = FFT_SIZE / size, start;
+		for (start = 0; start < FFT_SIZE; start += size) {
+			int k;
+			for (k = 0; k < half; k++) {
+				float wr = twiddle_re[k * step], wi = twiddle_im[k * step];
+				int   a = start + k, b = a + half;
+				float tr = re[b] * wr - im[b] * wi;
+				float ti = re[b] * wi + im[b] * wr;
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+static void add_onset(AudioFeatures *af, float onset)
+{
+	if (af->onsets_len == af->onsets_size) {
+		size_t size = af->onsets_size ? af->onsets_size * 2 : 1024;
+		float *tmp = realloc(af->onsets, size * sizeof(float));
+		if (!tmp) return;
+		af->onsets = tmp;
+		af->onsets_size = size;
+	}
+	af->onsets[af->onsets_len++] = onset;
+}
+
+static void analyze_frame(AudioFeatures *af)
+{
+	float re[FFT_SIZE], im[FFT_SIZE], power[BINS];
+	float total = 0.0f, weighted = 0.0f, flux = 0.0f;
+	int   b, i;
+
+	kernels->mul(re, af->buf, window, 0, FFT_SIZE);
+	memset(im, 0, sizeof(im));
+	fft(re, im);
+	kernels->power(power, re, im, 0, BINS);
+	for (i = 0; i < BINS; i++) {
+		total += power[i];
+		weighted += power[i] * i;
+	}
+	if (total < SILENCE_POWER) {
+		add_onset(af, 0.0f);
+		return;
+	}
+	for (b = 0; b < BANDS; b++) {
+		float sum = 0.0f, e;
+		for (i = af->band_start[b]; i < af->band_start[b + 1]; i++)
+			sum += power[i];
+		e = logf(sum + 1e-6f);
+		af->band_sum[b] += e;
+		af->band_sq[b] += e * e;
+		if (af->frames > 0 && e > af->band_prev[b]) flux += e - af->band_prev[b];
+		af->band_prev[b] = e;
+	}
+	/* Spectral centroid, relative to the upper band limit */
+	weighted = weighted / total * (af->rate / FFT_SIZE) / (float)BAND_MAX_FREQ;
+	af->centroid_sum += weighted;
+	af->centroid_sq += weighted * weighted;
+	af->flux_sum += flux;
+	af->frames++;
+	add_onset(af, flux);
+}
+
+void audiofeatures_add_samples(AudioFeatures *af, const int16_t *samples, size_t frames)
+{
+	size_t i;
+	float  scale = 1.0f / (32768.0f * af->channels * af->decimation);
+
+	for (i = 0; i < frames; i++) {
+		int ch, sum = 0;
+		/* Downmix and decimate; Averaging the samples is a crude low pass
+		 * filter, but good enough for the features */
+		for (ch = 0; ch < af->channels; ch++)
+			sum += samples[i * af->channels + ch];
+		af->acc += sum;
+		if (++af->acc_n < af->decimation) continue;
+		af->buf[af->buf_len++] = af->acc * scale;
+		af->acc = 0.0f;
+		af->acc_n = 0;
+		af->samples++;
+		if (af->buf_len == FFT_SIZE) {
+			analyze_frame(af);
+			memmove(af->buf, af->buf + HOP_SIZE, (FFT_SIZE - HOP_SIZE) * sizeof(float));
+			af->buf_len = FFT_SIZE - HOP_SIZE;
+		}
+	}
+}
+
+double audiofeatures_get_seconds(const AudioFeatures *af)
+{
+	return af->samples / af->rate;
+}
+
+/* Finds the tempo through the autocorrelation of the onset strengths,
+ * preferring tempos around 120 BPM to reduce octave errors */
+static double find_tempo(AudioFeatures *af)
+{
+	double fps = af->rate / HOP_SIZE, best_bpm = 0.0, best_score = 0.0, mean = 0.0, energy;
+	int    lag_min = (int)(60.0 * fps / TEMPO_MAX), lag_max = (int)(60.0 * fps / TEMPO_MIN + 1.0);
+	int    lag, n = (int)af->onsets_len;
+
+	if (n < lag_max * 4) return 0.0;
+	for (lag = 0; lag < n; lag++) mean += af->onsets[lag];
+	mean /= n;
+	for (lag = 0; lag < n; lag++) af->onsets[lag] -= (float)mean;
+	energy = kernels->dot(af->onsets, af->onsets, 0, n) / n;
+	if (energy <= 0.0) return 0.0;
+	for (lag = lag_min; lag <= lag_max; lag++) {
+		double bpm = 60.0 * fps / lag;
+		double r = kernels->dot(af->onsets, af->onsets + lag, 0, n - lag) / (n - lag) / energy;
+		double octave = log2(bpm / 120.0);
+		double score = r * exp(-0.5 * octave * octave);
+		if (score > best_score) {
+			best_score = score;
+			best_bpm = bpm;
+		}
+	}
+	/* A weak periodicity is not a beat */
+	return best_score > 0.1 ? best_bpm : 0.0;
+}
+
+int audiofeatures_compute(AudioFeatures *af, float *vector, double *bpm)
+{
+	double fps = af->rate / HOP_SIZE, mean[BANDS], mean_all = 0.0, c_mean, c_var;
+	int    b;
+
+	/* At least a few seconds of sound are needed */
+	if (af->frames < fps * 5) return 0;
+	for (b = 0; b < BANDS; b++) {
+		mean[b] = af->band_sum[b] / af->frames;
+		mean_all += mean[b] / BANDS;
+	}
+	/* The vector elements are scaled to roughly comparable ranges. The
+	 * band means are taken relative to their average, so the vector
+	 * describes the timbre regardless of the loudness. */
+	for (b = 0; b < BANDS; b++) {
+		double var = af->band_sq[b] / af->frames - mean[b] * mean[b];
+		vector[b] = (float)((mean[b] - mean_all) * 0.5);
+		vector[BANDS + b] = (float)sqrt(var > 0.0 ? var : 0.0);
+	}
+	c_mean = af->centroid_sum / af->frames;
+	c_var = af->centroid_sq / af->frames - c_mean * c_mean;
+	vector[2 * BANDS]     = (float)(c_mean * 4.0);
+	vector[2 * BANDS + 1] = (float)(sqrt(c_var > 0.0 ? c_var : 0.0) * 4.0);
+	vector[2 * BANDS + 2] = (float)(af->flux_sum / af->frames / 4.0);
+	*bpm = find_tempo(af);
+	vector[2 * BANDS + 3] = *bpm > 0.0 ? (float)(log2(*bpm / 120.0) * 2.0) : 0.0f;
+	return 1;
+}
+
+float audiofeatures_distance(const float *a, const float *b)
+{
+	return sqrtf(kernels->sqdist(a, b, 0, AUDIOFEATURES_DIM));
+}
+
+int audiofeatures_similarity(float distance)
+{
+	return (int)(1000.0f / (1.0f + distance));
+}
+
+void audiofeatures_lsh(const float *vector, int *hashes)
+{
+	int t, p;
+
+	for (t = 0; t < AUDIOFEATURES_LSH_TABLES; t++) {
+		unsigned int h = 2166136261U;
+		for (p = 0; p < LSH_PROJECTIONS; p++) {
+			float proj = kernels->dot(lsh_proj[t][p], vector, 0, AUDIOFEATURES_DIM) + lsh_offset[t][p];
+			h = (h ^ (unsigned int)(int)floorf(proj / LSH_BUCKET_WIDTH)) * 16777619U;
+		}
+		hashes[t] = (int)(h & 0x7FFFFFFF);
+	}
+}
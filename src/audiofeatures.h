@@ -0,0 +1,58 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: audiofeatures.h  Created: 210918
+ *
+ * Description: Acoustic feature vectors for track similarity
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#ifndef _AUDIOFEATURES_H
+#define _AUDIOFEATURES_H
+#include <stddef.h>
+#include <stdint.h>
+
+/* Needs to be increased whenever the feature vectors change, so tracks
+ * analyzed by an older version get analyzed again */
+#define AUDIOFEATURES_VERSION    1
+/* Number of elements of a feature vector: The mean and the standard
+ * deviation of 16 spectral bands, the spectral centroid (mean and standard
+ * deviation), the mean spectral flux and the tempo */
+#define AUDIOFEATURES_DIM        36
+/* Number of locality sensitive hashes per feature vector */
+#define AUDIOFEATURES_LSH_TABLES 4
+/* Audio is downmixed and decimated to (about) this sample rate */
+#define AUDIOFEATURES_SAMPLERATE 11025
+
+typedef struct AudioFeatures AudioFeatures;
+
+/* Selects the fastest kernel set supported by the CPU and sets up the
+ * shared tables. Must be called once before any other function. */
+void           audiofeatures_init(void);
+const char    *audiofeatures_get_implementation_name(void);
+AudioFeatures *audiofeatures_new(int samplerate, int channels);
+void           audiofeatures_free(AudioFeatures *af);
+/* Analyzes interleaved signed 16 bit samples */
+void           audiofeatures_add_samples(AudioFeatures *af, const int16_t *samples, size_t frames);
+/* Returns the length of the audio analyzed so far in seconds */
+double         audiofeatures_get_seconds(const AudioFeatures *af);
+/* Computes the feature vector (AUDIOFEATURES_DIM elements) and the tempo
+ * in BPM (0 if there is no clear beat). Returns 1 on success, 0 if there
+ * was too little (non-silent) audio for a meaningful result. */
+int            audiofeatures_compute(AudioFeatures *af, float *vector, double *bpm);
+/* Euclidean distance of two feature vectors */
+float          audiofeatures_distance(const float *a, const float *b);
+/* Maps a distance to a similarity value between 0 and 1000 */
+int            audiofeatures_similarity(float distance);
+/* Computes AUDIOFEATURES_LSH_TABLES hashes of a feature vector. Vectors
+ * close to each other are likely to share at least one of their hashes,
+ * so those are used to find neighbour candidates without comparing all
+ * vectors with each other. */
+void           audiofeatures_lsh(const float *vector, int *hashes);
+#endif
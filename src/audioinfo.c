@@ -0,0 +1,420 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: audioinfo.c  Created: 210828
+ *
+ * Description: Reads the technical properties (length, sample rate,
+ *              channels, bitrate) of audio files from their headers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "trackinfo.h"
+#include "seekindex.h"
+#include "debug.h"
+#include "audioinfo.h"
+
+/* Size of the region searched for the first MPEG frame, and of the region
+ * at the end of Ogg files searched for the last page */
+#define AUDIOINFO_BUF_SIZE 65536
+
+typedef enum {
+	AUDIO_TYPE_NONE, AUDIO_TYPE_MPEG, AUDIO_TYPE_OGG, AUDIO_TYPE_FLAC, AUDIO_TYPE_WAV, AUDIO_TYPE_MP4
+} AudioType;
+
+static const struct {
+	const char *extension;
+	AudioType   type;
+} audio_types[] = {
+	{ "mp3",  AUDIO_TYPE_MPEG },
+	{ "mp2",  AUDIO_TYPE_MPEG },
+	{ "mp1",  AUDIO_TYPE_MPEG },
+	{ "ogg",  AUDIO_TYPE_OGG },
+	{ "oga",  AUDIO_TYPE_OGG },
+	{ "opus", AUDIO_TYPE_OGG },
+	{ "spx",  AUDIO_TYPE_OGG },
+	{ "flac", AUDIO_TYPE_FLAC },
+	{ "wav",  AUDIO_TYPE_WAV },
+	{ "m4a",  AUDIO_TYPE_MP4 },
+	{ "m4b",  AUDIO_TYPE_MP4 },
+	{ "mp4",  AUDIO_TYPE_MP4 },
+	{ NULL,   AUDIO_TYPE_NONE }
+};
+
+static AudioType get_audio_type(const char *file_type)
+{
+	AudioType type = AUDIO_TYPE_NONE;
+
+	if (file_type) {
+		int i;
+
+		if (file_type[0] == '.') file_type++;
+		for (i = 0; audio_types[i].extension; i++) {
+			if (strcasecmp(file_type, audio_types[i].extension) == 0) {
+				type = audio_types[i].type;
+				break;
+			}
+		}
+	}
+	return type;
+}
+
+static unsigned long get_le16(const unsigned char *b)
+{
+	return (unsigned long)b[0] | ((unsigned long)b[1] << 8);
+}
+
+static unsigned long get_le32(const unsigned char *b)
+{
+	return get_le16(b) | (get_le16(b + 2) << 16);
+}
+
+static long long get_le64(const unsigned char *b)
+{
+	return (long long)((unsigned long long)get_le32(b) | ((unsigned long long)get_le32(b + 4) << 32));
+}
+
+static unsigned long get_be32(const unsigned char *b)
+{
+	return (unsigned long)b[3] | ((unsigned long)b[2] << 8) |
+	       ((unsigned long)b[1] << 16) | ((unsigned long)b[0] << 24);
+}
+
+static size_t read_at(FILE *file, long offset, unsigned char *buf, size_t size)
+{
+	size_t res = 0;
+	if (offset >= 0 && fseek(file, offset, SEEK_SET) == 0)
+		res = fread(buf, 1, size, file);
+	return res;
+}
+
+/* Returns the size of an ID3v2 tag at the beginning of the file, if any */
+static long get_id3v2_size(FILE *file)
+{
+	unsigned char h[10];
+	long          size = 0;
+
+	if (read_at(file, 0, h, 10) == 10 && memcmp(h, "ID3", 3) == 0) {
+		size = 10 + ((h[6] & 0x7F) << 21 | (h[7] & 0x7F) << 14 | (h[8] & 0x7F) << 7 | (h[9] & 0x7F));
+		if (h[5] & 0x10) size += 10; /* Footer */
+	}
+	return size;
+}
+
+/* Sets the length (rounded to seconds) and derives the average bitrate
+ * from the file size, unless the bitrate is already known */
+static int set_length(TrackInfo *ti, long long samples, int samplerate, long long audio_bytes)
+{
+	if (samples <= 0 || samplerate <= 0) return 0;
+	ti->length = (size_t)((samples + samplerate / 2) / samplerate);
+	if (ti->bitrate <= 0 && audio_bytes > 0)
+		ti->bitrate = (long)(audio_bytes * 8 * samplerate / samples);
+	return 1;
+}
+
+int audioinfo_parse_mpeg_header(const unsigned char *h, MpegFrameHeader *f)
+{
+	static const int bitrates[2][3][15] = {
+		{ /* MPEG 1 */
+			{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+			{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+			{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 }
+		},
+		{ /* MPEG 2 and 2.5 */
+			{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+			{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+			{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }
+		}
+	};
+	static const int samplerates[3] = { 44100, 48000, 32000 };
+	int version, layer, br_index, sr_index, padding, lsf;
+
+	if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) return 0;
+	version  = (h[1] >> 3) & 3;
+	layer    = 4 - ((h[1] >> 1) & 3);
+	br_index = h[2] >> 4;
+	sr_index = (h[2] >> 2) & 3;
+	padding  = (h[2] >> 1) & 1;
+	if (version == 1 || layer == 4 || br_index == 0 || br_index == 15 || sr_index == 3) return 0;
+	lsf = version != 3;
+	f->version    = version;
+	f->layer      = layer;
+	f->bitrate    = bitrates[lsf][layer - 1][br_index] * 1000;
+	f->samplerate = samplerates[sr_index] >> (version == 3 ? 0 : (version == 2 ? 1 : 2));
+	f->channels   = (h[3] >> 6) == 3 ? 1 : 2;
+	switch (layer) {
+		case 1:
+			f->samples = 384;
+			f->size = (12 * f->bitrate / f->samplerate + padding) * 4;
+			break;
+		case 2:
+			f->samples = 1152;
+			f->size = 144 * f->bitrate / f->samplerate + padding;
+			break;
+		default:
+			f->samples = lsf ? 576 : 1152;
+			f->size = (lsf ? 72 : 144) * f->bitrate / f->samplerate + padding;
+			break;
+	}
+	return f->size > 4;
+}
+
+int audioinfo_get_mpeg_xing_offset(const MpegFrameHeader *f)
+{
+	/* Frame header plus side information */
+	if (f->version == 3)
+		return 4 + (f->channels == 1 ? 17 : 32);
+	return 4 + (f->channels == 1 ? 9 : 17);
+}
+
+static int audioinfo_read_mpeg(FILE *file, const char *filename, unsigned char *buf, long file_size, TrackInfo *ti)
+{
+	MpegFrameHeader      h, next;
+	const unsigned char *frame = NULL;
+	long                 start = get_id3v2_size(file), audio_bytes;
+	long long            frames = 0;
+	size_t               i, len = read_at(file, start, buf, AUDIOINFO_BUF_SIZE);
+	int                  result = 0;
+
+	/* The first frame header is only trusted if it is followed by another one */
+	for (i = 0; i + 4 <= len; i++) {
+		if (audioinfo_parse_mpeg_header(buf + i, &h) && i + h.size + 4 <= len &&
+		    audioinfo_parse_mpeg_header(buf + i + h.size, &next) &&
+		    next.version == h.version && next.layer == h.layer && next.samplerate == h.samplerate) {
+			frame = buf + i;
+			break;
+		}
+	}
+	if (!frame) return 0;
+	ti->samplerate = h.samplerate;
+	ti->channels   = h.channels;
+	audio_bytes = file_size - start - (long)i;
+	{
+		unsigned char tag[3];
+		if (file_size >= 128 && read_at(file, file_size - 128, tag, 3) == 3 && memcmp(tag, "TAG", 3) == 0)
+			audio_bytes -= 128; /* ID3v1 */
+	}
+	if (h.layer == 3 && (size_t)h.size <= len - i) {
+		const unsigned char *x = frame + audioinfo_get_mpeg_xing_offset(&h);
+		const unsigned char *v = frame + 36;
+
+		if ((memcmp(x, "Xing", 4) == 0 || memcmp(x, "Info", 4) == 0) && h.size >= x - frame + 16) {
+			unsigned long flags = get_be32(x + 4);
+			x += 8;
+			if (flags & 1) {
+				frames = get_be32(x);
+				x += 4;
+			}
+			if (flags & 2) audio_bytes = (long)get_be32(x);
+			ti->vbr = memcmp(frame + audioinfo_get_mpeg_xing_offset(&h), "Xing", 4) == 0;
+		} else if (memcmp(v, "VBRI", 4) == 0 && h.size >= 36 + 18) {
+			audio_bytes = (long)get_be32(v + 10);
+			frames = get_be32(v + 14);
+			ti->vbr = 1;
+		}
+	}
+	if (frames > 0) {
+		result = set_length(ti, frames * h.samples, h.samplerate, audio_bytes);
+	} else {
+		/* Without a VBR header, a cached seek index knows the exact length;
+		 * otherwise the length is estimated from the first frame's bitrate */
+		SeekIndex *si = seekindex_load(filename);
+		if (si && si->type == SEEKINDEX_MPEG && si->samplerate == h.samplerate) {
+			result = set_length(ti, si->total_samples, h.samplerate, audio_bytes);
+		} else if (audio_bytes > 0) {
+			ti->bitrate = h.bitrate;
+			result = set_length(ti, (long long)audio_bytes * 8 * h.samplerate / h.bitrate, h.samplerate, 0);
+		}
+		seekindex_free(si);
+	}
+	return result;
+}
+
+static int audioinfo_read_ogg(FILE *file, unsigned char *buf, long file_size, TrackInfo *ti)
+{
+	const unsigned char *p;
+	size_t               len = read_at(file, 0, buf, 27 + 255 + 64);
+	unsigned long        serial;
+	long long            granule = -1, pre_skip = 0;
+	long                 offset, i;
+	int                  samplerate = 0;
+
+	if (len < 27 || memcmp(buf, "OggS", 4) != 0 || !(buf[5] & 2) || len < 27 + (size_t)buf[26] + 52)
+		return 0;
+	serial = get_le32(buf + 14);
+	p = buf + 27 + buf[26]; /* First packet of the first logical stream */
+	if (memcmp(p, "\001vorbis", 7) == 0) {
+		long nominal = (long)(int)get_le32(p + 20);
+		ti->channels = p[11];
+		samplerate = (int)get_le32(p + 12);
+		if (nominal > 0) ti->bitrate = nominal;
+		ti->vbr = 1;
+	} else if (memcmp(p, "OpusHead", 8) == 0) {
+		ti->channels = p[9];
+		pre_skip = (long long)get_le16(p + 10);
+		samplerate = 48000; /* Opus is always decoded at 48 kHz */
+		ti->vbr = 1;
+	} else if (memcmp(p, "Speex   ", 8) == 0) {
+		samplerate = (int)get_le32(p + 36);
+		ti->channels = (int)get_le32(p + 48);
+	} else if (p[0] == 0x7F && memcmp(p + 1, "FLAC", 4) == 0 && memcmp(p + 9, "fLaC", 4) == 0) {
+		const unsigned char *d = p + 17; /* STREAMINFO */
+		samplerate = (d[10] << 12) | (d[11] << 4) | (d[12] >> 4);
+		ti->channels = ((d[12] >> 1) & 7) + 1;
+	}
+	ti->samplerate = samplerate;
+	if (samplerate <= 0) return 0;
+
+	/* The granule position of the stream's last page is its length in samples */
+	offset = file_size > AUDIOINFO_BUF_SIZE ? file_size - AUDIOINFO_BUF_SIZE : 0;
+	len = read_at(file, offset, buf, AUDIOINFO_BUF_SIZE);
+	for (i = (long)len - 27; i >= 0; i--) {
+		if (memcmp(buf + i, "OggS", 4) == 0 && get_le32(buf + i + 14) == serial &&
+		    (granule = get_le64(buf + i + 6)) != -1)
+			break;
+	}
+	return set_length(ti, granule - pre_skip, samplerate, file_size);
+}
+
+static int audioinfo_read_flac(FILE *file, unsigned char *buf, long file_size, TrackInfo *ti)
+{
+	long                 start = get_id3v2_size(file);
+	const unsigned char *d = buf + 8;
+	long long            samples;
+
+	if (read_at(file, start, buf, 42) != 42 || memcmp(buf, "fLaC", 4) != 0 || (buf[4] & 0x7F) != 0)
+		return 0;
+	ti->samplerate = (d[10] << 12) | (d[11] << 4) | (d[12] >> 4);
+	ti->channels = ((d[12] >> 1) & 7) + 1;
+	samples = ((long long)(d[13] & 0x0F) << 32) | (long long)get_be32(d + 14);
+	return set_length(ti, samples, ti->samplerate, file_size - start);
+}
+
+static int audioinfo_read_wav(FILE *file, unsigned char *buf, long file_size, TrackInfo *ti)
+{
+	long          offset = 12;
+	unsigned long byte_rate = 0;
+
+	if (read_at(file, 0, buf, 12) != 12 || memcmp(buf, "RIFF", 4) != 0 || memcmp(buf + 8, "WAVE", 4) != 0)
+		return 0;
+	while (offset + 8 <= file_size && read_at(file, offset, buf, 8) == 8) {
+		unsigned long size = get_le32(buf + 4);
+
+		if (memcmp(buf, "fmt ", 4) == 0 && size >= 16 && read_at(file, offset + 8, buf, 16) == 16) {
+			ti->channels   = (int)get_le16(buf + 2);
+			ti->samplerate = (int)get_le32(buf + 4);
+			byte_rate      = get_le32(buf + 8);
+		} else if (memcmp(buf, "data", 4) == 0) {
+			long long frames;
+			/* Some writers leave the size of the data chunk at 0 or 0xFFFFFFFF */
+			if (size == 0 || (long long)size > file_size - offset - 8) size = file_size - offset - 8;
+			if (byte_rate == 0 || ti->samplerate <= 0) break;
+			ti->bitrate = (long)byte_rate * 8;
+			frames = (long long)size * ti->samplerate / byte_rate;
+			return set_length(ti, frames, ti->samplerate, 0);
+		}
+		offset += 8 + (long)size + (size & 1);
+	}
+	return 0;
+}
+
+/* Finds the first atom of type 'type' between file offsets 'offset' and 'end' */
+static int mp4_find_atom(FILE *file, long offset, long end, const char *type, long *payload_offset)
+{
+	unsigned char h[16];
+
+	while (end - offset >= 8 && read_at(file, offset, h, 16) >= 8) {
+		unsigned long long size = get_be32(h);
+		int                header_len = 8;
+
+		if (size == 1) {
+			size = ((unsigned long long)get_be32(h + 8) << 32) | get_be32(h + 12);
+			header_len = 16;
+		} else if (size == 0) {
+			size = end - offset;
+		}
+		if (size < (unsigned long long)header_len || size > (unsigned long long)(end - offset)) break;
+		if (memcmp(h + 4, type, 4) == 0) {
+			*payload_offset = offset + header_len;
+			return 1;
+		}
+		offset += (long)size;
+	}
+	return 0;
+}
+
+static int audioinfo_read_mp4(FILE *file, unsigned char *buf, long file_size, TrackInfo *ti)
+{
+	long      moov, mvhd;
+	long long duration = 0;
+	int       timescale = 0;
+
+	if (!mp4_find_atom(file, 0, file_size, "moov", &moov) ||
+	    !mp4_find_atom(file, moov, file_size, "mvhd", &mvhd) ||
+	    read_at(file, mvhd, buf, 32) != 32)
+		return 0;
+	if (buf[0] == 1) { /* 64 bit times */
+		timescale = (int)get_be32(buf + 20);
+		duration  = ((long long)get_be32(buf + 24) << 32) | (long long)get_be32(buf + 28);
+	} else {
+		timescale = (int)get_be32(buf + 12);
+		duration  = (long long)get_be32(buf + 16);
+	}
+	/* The movie time scale is not necessarily the sample rate, so
+	 * only the length and average bitrate are taken from here */
+	return set_length(ti, duration, timescale, file_size);
+}
+
+int audioinfo_read(const char *file, const char *file_type, TrackInfo *ti)
+{
+	AudioType type = get_audio_type(file_type);
+	int       result = 0;
+
+	if (type != AUDIO_TYPE_NONE) {
+		FILE          *f = fopen(file, "rb");
+		unsigned char *buf = f ? malloc(AUDIOINFO_BUF_SIZE) : NULL;
+		long           file_size = -1;
+
+		if (buf && fseek(f, 0, SEEK_END) == 0) file_size = ftell(f);
+		if (file_size > 0) {
+			ti->length = 0;
+			ti->samplerate = 0;
+			ti->channels = 0;
+			ti->bitrate = 0;
+			ti->vbr = 0;
+			ti->file_size = (size_t)file_size;
+			switch (type) {
+				case AUDIO_TYPE_MPEG:
+					result = audioinfo_read_mpeg(f, file, buf, file_size, ti);
+					break;
+				case AUDIO_TYPE_OGG:
+					result = audioinfo_read_ogg(f, buf, file_size, ti);
+					break;
+				case AUDIO_TYPE_FLAC:
+					result = audioinfo_read_flac(f, buf, file_size, ti);
+					break;
+				case AUDIO_TYPE_WAV:
+					result = audioinfo_read_wav(f, buf, file_size, ti);
+					break;
+				case AUDIO_TYPE_MP4:
+					result = audioinfo_read_mp4(f, buf, file_size, ti);
+					break;
+				default:
+					break;
+			}
+			if (!result) wdprintf(V_DEBUG, "audioinfo", "Unable to determine the length of %s.\n", file);
+		}
+		free(buf);
+		if (f) fclose(f);
+	}
+	return result;
+}
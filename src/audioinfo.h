@@ -0,0 +1,42 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: audioinfo.h  Created: 210828
+ *
+ * Description: Reads the technical properties (length, sample rate,
+ *              channels, bitrate) of audio files from their headers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#ifndef _AUDIOINFO_H
+#define _AUDIOINFO_H
+#include "trackinfo.h"
+
+typedef struct MpegFrameHeader
+{
+	int version;    /* 0 = MPEG 2.5, 2 = MPEG 2, 3 = MPEG 1 */
+	int layer;
+	int samplerate;
+	int channels;
+	int bitrate;    /* in bits per second */
+	int samples;    /* per frame */
+	int size;       /* of the whole frame in bytes, including the header */
+} MpegFrameHeader;
+
+/* Parses the 4 byte MPEG audio frame header at 'h'. Returns 1 on success,
+ * 0 if 'h' does not point to a valid header. Free format is unsupported. */
+int audioinfo_parse_mpeg_header(const unsigned char *h, MpegFrameHeader *f);
+/* Offset of a Xing/Info header from the start of a layer III frame */
+int audioinfo_get_mpeg_xing_offset(const MpegFrameHeader *f);
+/* Fills the length, sample rate, channels, bitrate and vbr fields of 'ti'
+ * for MPEG audio, Ogg (Vorbis, Opus, Speex, FLAC), FLAC, WAV and MP4 files
+ * without initializing a decoder. Other fields of 'ti' are left untouched.
+ * Returns 1 if at least the length could be determined, 0 otherwise. */
+int audioinfo_read(const char *file, const char *file_type, TrackInfo *ti);
+#endif
@@ -34,10 +34,15 @@
 #include "wejconfig.h"
 #include FILE_HW_H
 #include "util.h"
-#include "reader.h" /* for reader_set_cache_size_kb() */
+#include "reader.h" /* for reader_set_cache_size_kb() and reader_set_timeshift() */
 #include "medialib.h"
 #include "debug.h"
 #include "gmuerror.h"
+#include "pcmconv.h"
+#include "cpufreq.h"
+#include "prefetch.h"
+#include "seekindex.h"
+#include "analyzer.h"
 #define MAX_FILE_EXTENSIONS 255
 
 typedef enum GlobalCommand { NO_CMD, PLAY, PAUSE, STOP, NEXT, 
@@ -69,6 +74,9 @@ static char cmdline[CMDLINE_SIZE];
 #ifdef GMU_MEDIALIB
 static GmuMedialib     gm;
 #endif
+/* Total length of the playlist entries with a known length, and the number
+ * of entries whose length is unknown; protected by the playlist lock */
+static int             playlist_total_time, playlist_unknown_time_entries;
 
 static void init_sdl(void)
 {
@@ -157,6 +165,21 @@ static int check_fade_out_on_skip(void)
 	return res;
 }
 
+/* Lets the prefetch thread warm up the page cache for the upcoming tracks */
+static void prefetch_upcoming_tracks(void)
+{
+	Entry      *entries[PREFETCH_MAX_FILES];
+	const char *files[PREFETCH_MAX_FILES];
+	size_t      i, n;
+
+	playlist_get_lock(&pl);
+	n = playlist_get_upcoming(&pl, entries, PREFETCH_MAX_FILES);
+	for (i = 0; i < n; i++)
+		files[i] = playlist_get_entry_filename(&pl, entries[i]);
+	prefetch_files(files, n);
+	playlist_release_lock(&pl);
+}
+
 static int play_next(Playlist *pl, int skip_current)
 {
 	int result = 0;
@@ -237,11 +260,43 @@ static void add_default_cfg_settings(ConfigFile *config)
 	cfg_key_add_presets(config, "Gmu.ReaderCache", "256", "512", "1024", NULL);
 	cfg_add_key(config, "Gmu.ReaderCachePrebufferSize", "256");
 	cfg_key_add_presets(config, "Gmu.ReaderCachePrebufferSize", "128", "256", "512", "768", NULL);
+	cfg_add_key(config, "Gmu.Timeshift", "no");
+	cfg_key_add_presets(config, "Gmu.Timeshift", "yes", "no", NULL);
+	cfg_add_key(config, "Gmu.TimeshiftCacheSize", "16384");
+	cfg_key_add_presets(config, "Gmu.TimeshiftCacheSize", "8192", "16384", "32768", "65536", NULL);
+	cfg_add_key(config, "Gmu.TimeshiftDirectory", "/tmp");
 	cfg_add_key(config, "Gmu.LyricsFilePattern", "*.txt");
+	cfg_add_key(config, "Gmu.Prefetch", "yes");
+	cfg_key_add_presets(config, "Gmu.Prefetch", "yes", "no", NULL);
+	cfg_add_key(config, "Gmu.PrefetchBudget", "8192");
+	cfg_key_add_presets(config, "Gmu.PrefetchBudget", "2048", "4096", "8192", "16384", NULL);
+	cfg_add_key(config, "Gmu.SeekIndex", "yes");
+	cfg_key_add_presets(config, "Gmu.SeekIndex", "yes", "no", NULL);
+	cfg_add_key(config, "Gmu.MedialibAnalysis", "no");
+	cfg_key_add_presets(config, "Gmu.MedialibAnalysis", "yes", "no", NULL);
+	cfg_add_key(config, "Gmu.MedialibAnalysisCpuLimit", "25");
+	cfg_key_add_presets(config, "Gmu.MedialibAnalysisCpuLimit", "10", "25", "50", "100", NULL);
+	cfg_add_key(config, "Gmu.MedialibAnalysisJobs", "0");
+	cfg_key_add_presets(config, "Gmu.MedialibAnalysisJobs", "0", "1", "2", "4", NULL);
+	cfg_add_key(config, "Gmu.MedialibLoudnessScan", "no");
+	cfg_key_add_presets(config, "Gmu.MedialibLoudnessScan", "yes", "no", NULL);
+	cfg_add_key(config, "Gmu.MedialibLoudnessTags", "no");
+	cfg_key_add_presets(config, "Gmu.MedialibLoudnessTags", "yes", "no", NULL);
+	cfg_add_key(config, "Gmu.MedialibMemoryIndex", "no");
+	cfg_key_add_presets(config, "Gmu.MedialibMemoryIndex", "yes", "no", NULL);
+	cfg_add_key(config, "Gmu.MedialibMemoryIndexMaxKB", "16384");
+	cfg_key_add_presets(config, "Gmu.MedialibMemoryIndexMaxKB", "4096", "8192", "16384", "32768", "65536", NULL);
 	cfg_add_key(config, "Gmu.FadeOutOnSkip", "no");
 	cfg_key_add_presets(config, "Gmu.FadeOutOnSkip", "yes", "no", NULL);
 	cfg_add_key(config, "Gmu.DeviceCloseASAP", "no");
 	cfg_key_add_presets(config, "Gmu.DeviceCloseASAP", "yes", "no", NULL);
+	cfg_add_key(config, "Gmu.DeepBufferingWhenDisplayOff", "yes");
+	cfg_key_add_presets(config, "Gmu.DeepBufferingWhenDisplayOff", "yes", "no", NULL);
+	cfg_add_key(config, "Gmu.DeepBufferSeconds", "20");
+	cfg_key_add_presets(config, "Gmu.DeepBufferSeconds", "10", "20", "30", "60", NULL);
+	cfg_add_key(config, "Gmu.CpuFreqScaling", "no");
+	cfg_key_add_presets(config, "Gmu.CpuFreqScaling", "yes", "no", NULL);
+	cfg_add_key(config, "Gmu.CpuFreqSysfsPath", CPUFREQ_DEFAULT_SYSFS_PATH);
 }
 
 int gmu_core_export_playlist(const char *file)
@@ -358,6 +413,38 @@ int gmu_core_previous(void)
 	return res;
 }
 
+/**
+ * To be called by frontends when the display is turned off (enable=1) and
+ * back on (enable=0). While the display is off, a large audio buffer is
+ * used (if enabled in the config), so the decoder can work in long bursts
+ * and let the CPU idle inbetween, which saves power.
+ */
+void gmu_core_set_power_save_mode(int enable)
+{
+	int seconds = 0;
+
+	if (enable) {
+		gmu_core_config_acquire_lock();
+		if (cfg_get_boolean_value(config, "Gmu.DeepBufferingWhenDisplayOff"))
+			seconds = cfg_get_int_value(config, "Gmu.DeepBufferSeconds");
+		gmu_core_config_release_lock();
+	}
+	audio_set_deep_buffering(seconds);
+	cpufreq_set_ui_active(!enable);
+}
+
+/* Seek to the absolute position 'position_ms' (in milliseconds) in the current track */
+int gmu_core_seek(long position_ms)
+{
+	return file_player_seek_to_ms(position_ms);
+}
+
+/* Seek by 'offset_ms' milliseconds relative to the current playback position */
+int gmu_core_seek_relative(long offset_ms)
+{
+	return file_player_seek_to_ms(audio_get_playtime_ms() + offset_ms);
+}
+
 static int stop_playback(void)
 {
 	int res = 0;
@@ -416,8 +503,10 @@ int gmu_core_play_medialib_item(size_t id)
 {
 	int res = 0;
 #ifdef GMU_MEDIALIB
-	TrackInfo ti = medialib_get_data_for_id(&gm, id);
-	if (ti.id > 0 && ti.file_name[0]) {
+	TrackInfo ti;
+
+	trackinfo_init(&ti, 0);
+	if (medialib_get_data_for_id(&gm, id, &ti) && ti.file_name[0]) {
 		res = gmu_core_play_file(ti.file_name);
 	}
 	wdprintf(V_DEBUG, "core", "Playing track from media library with ID %d...\n", id);
@@ -648,6 +737,107 @@ int gmu_core_playlist_entry_get_queue_pos(Entry *entry)
 	return playlist_entry_get_queue_pos(entry);
 }
 
+/* The length is looked up in the medialib on first access, so playlist
+ * entries never have to be opened just to show their length. Files not
+ * found in the medialib are remembered as well, until the next refresh.
+ * The medialib is queried without holding the playlist lock, so a busy
+ * database cannot block the player. */
+int gmu_core_playlist_get_entry_length(int item)
+{
+	Entry *entry;
+	char  *file = NULL;
+	int    length;
+
+	playlist_get_lock(&pl);
+	entry = playlist_get_entry(&pl, item);
+	length = playlist_entry_get_length(entry);
+#ifdef GMU_MEDIALIB
+	if (entry && length < 0 && !playlist_entry_is_length_looked_up(entry)) {
+		const char *f = playlist_get_entry_filename(&pl, entry);
+		if (f && (file = malloc(strlen(f) + 1))) strcpy(file, f);
+	}
+#endif
+	playlist_release_lock(&pl);
+#ifdef GMU_MEDIALIB
+	if (file) {
+		length = medialib_get_length_for_file(&gm, file);
+		playlist_get_lock(&pl);
+		/* The playlist might have been changed in the meantime */
+		entry = playlist_get_entry(&pl, item);
+		if (entry && !playlist_entry_is_length_looked_up(entry) &&
+		    strcmp(playlist_get_entry_filename(&pl, entry), file) == 0)
+			playlist_entry_set_length(entry, length);
+		playlist_release_lock(&pl);
+		free(file);
+	}
+#endif
+	return length;
+}
+
+int gmu_core_playlist_get_total_time(int *unknown_entries)
+{
+	int res;
+
+	playlist_get_lock(&pl);
+	res = playlist_total_time;
+	if (unknown_entries) *unknown_entries = playlist_unknown_time_entries;
+	playlist_release_lock(&pl);
+	return res;
+}
+
+#define PLAYLIST_LENGTH_LOOKUPS 32
+
+/* Looks up the lengths of up to PLAYLIST_LENGTH_LOOKUPS playlist entries
+ * in the medialib and updates the playlist's total time. Like in
+ * gmu_core_playlist_get_entry_length(), the lookups are done without
+ * holding the playlist lock. Called from the main loop until it returns 0,
+ * which is when there are no more entries to be looked up. */
+static int update_playlist_total_time(void)
+{
+	char  *files[PLAYLIST_LENGTH_LOOKUPS];
+	int    lengths[PLAYLIST_LENGTH_LOOKUPS];
+	int    i, n = 0, total = 0, unknown = 0, changed;
+	Entry *entry;
+
+#ifdef GMU_MEDIALIB
+	playlist_get_lock(&pl);
+	for (entry = playlist_get_first(&pl); entry && n < PLAYLIST_LENGTH_LOOKUPS; entry = playlist_get_next(entry)) {
+		if (!playlist_entry_is_length_looked_up(entry)) {
+			const char *f = playlist_get_entry_filename(&pl, entry);
+			if (f && (files[n] = malloc(strlen(f) + 1))) strcpy(files[n++], f);
+		}
+	}
+	playlist_release_lock(&pl);
+	for (i = 0; i < n; i++)
+		lengths[i] = medialib_get_length_for_file(&gm, files[i]);
+#endif
+	playlist_get_lock(&pl);
+	for (i = 0, entry = playlist_get_first(&pl); entry; entry = playlist_get_next(entry)) {
+		int length;
+		if (i < n && !playlist_entry_is_length_looked_up(entry)) {
+			int j;
+			/* Entries might have been removed in the meantime */
+			for (j = i; j < n && strcmp(playlist_get_entry_filename(&pl, entry), files[j]) != 0; j++);
+			if (j < n) {
+				playlist_entry_set_length(entry, lengths[j]);
+				i = j + 1;
+			}
+		}
+		length = playlist_entry_get_length(entry);
+		if (length >= 0)
+			total += length;
+		else
+			unknown++;
+	}
+	changed = total != playlist_total_time || unknown != playlist_unknown_time_entries;
+	playlist_total_time = total;
+	playlist_unknown_time_entries = unknown;
+	playlist_release_lock(&pl);
+	for (i = 0; i < n; i++) free(files[i]);
+	if (changed) event_queue_push_with_parameter(&event_queue, GMU_PLAYLIST_TIME_CHANGE, total);
+	return n > 0;
+}
+
 int gmu_core_get_length_current_track(void)
 {
 	int len = 0;
@@ -800,6 +990,10 @@ char *gmu_core_get_command_line(void)
 static void medialib_refresh_finish_callback(void)
 {
 	wdprintf(V_DEBUG, "gmu", "In callback: Medialib refresh done.\n");
+	/* Files unknown so far might have been added to the medialib */
+	gmu_core_playlist_acquire_lock();
+	playlist_reset_length_lookups(&pl);
+	gmu_core_playlist_release_lock();
 	event_queue_push(&event_queue, GMU_MEDIALIB_REFRESH_DONE);
 }
 #endif
@@ -811,23 +1005,24 @@ void gmu_core_medialib_start_refresh(void)
 #endif
 }
 
-int gmu_core_medialib_search_find(GmuMedialibDataType type, const char *str)
+int gmu_core_medialib_search_find(GmuMedialibDataType type, const char *str, int after_id, int limit)
 {
 #ifdef GMU_MEDIALIB
 	event_queue_push(&event_queue, GMU_MEDIALIB_SEARCH_START);
-	return medialib_search_find(&gm, type, str);
+	return medialib_search_find(&gm, type, str, after_id, limit);
 #else
 	return 0;
 #endif
 }
 
-TrackInfo gmu_core_medialib_search_fetch_next_result(void)
+TrackSummary gmu_core_medialib_search_fetch_next_result(void)
 {
-	TrackInfo res;
+	TrackSummary res;
 #ifdef GMU_MEDIALIB
 	res = medialib_search_fetch_next_result(&gm);
 #else
-	trackinfo_init(&res, 0);
+	memset(&res, 0, sizeof(TrackSummary));
+	res.id = -1;
 #endif
 	return res;
 }
@@ -840,12 +1035,35 @@ void gmu_core_medialib_search_finish(void)
 #endif
 }
 
+int gmu_core_medialib_similar_tracks(int id, int limit)
+{
+#ifdef GMU_MEDIALIB
+	event_queue_push(&event_queue, GMU_MEDIALIB_SEARCH_START);
+	return medialib_similar_tracks(&gm, id, limit);
+#else
+	return 0;
+#endif
+}
+
+size_t gmu_core_medialib_get_index_memory_usage(size_t *max_bytes)
+{
+#ifdef GMU_MEDIALIB
+	if (max_bytes) *max_bytes = gm.index_enabled ? gm.index_max_bytes : 0;
+	return medialib_get_index_memory_usage(&gm);
+#else
+	if (max_bytes) *max_bytes = 0;
+	return 0;
+#endif
+}
+
 int gmu_core_medialib_add_id_to_playlist(size_t id)
 {
 	int res = 0;
 #ifdef GMU_MEDIALIB
-	TrackInfo ti = medialib_get_data_for_id(&gm, id);
-	if (ti.id > 0 && ti.file_name[0]) {
+	TrackInfo ti;
+
+	trackinfo_init(&ti, 0);
+	if (medialib_get_data_for_id(&gm, id, &ti) && ti.file_name[0]) {
 		gmu_core_playlist_add_file(ti.file_name);
 		res = 1;
 	}
@@ -854,20 +1072,20 @@ int gmu_core_medialib_add_id_to_playlist(size_t id)
 	return res;
 }
 
-int gmu_core_medialib_browse_artists(void)
+int gmu_core_medialib_browse_artists(const char *after, int limit)
 {
 	int res = 0;
 #ifdef GMU_MEDIALIB
-	res = medialib_browse(&gm, "artist", NULL);
+	res = medialib_browse(&gm, after, limit, "artist", NULL);
 #endif
 	return res;
 }
 
-int gmu_core_medialib_browse_albums_by_artist(const char *artist)
+int gmu_core_medialib_browse_albums_by_artist(const char *artist, const char *after, int limit)
 {
 	int res = 0;
 #ifdef GMU_MEDIALIB
-	res = medialib_browse(&gm, "album", "artist", artist, NULL);
+	res = medialib_browse(&gm, after, limit, "album", "artist", artist, NULL);
 #endif
 	return res;
 }
@@ -954,12 +1172,15 @@ int main(int argc, char **argv)
 	int          disksync = 0;
 	size_t       i;
 	PB_Status    current_file_player_status = STOPPED;
-	int          auto_shutdown = 0;
+	int          auto_shutdown = 0, upcoming_tracks_changed = 0, playlist_time_changed = 1;
 	time_t       start, end;
 	Verbosity    v = V_INFO;
 	char        *frontend_plugin_by_cmd_arg[MAX_FRONTEND_PLUGIN_BY_CMD_ARG];
 	size_t       frontend_plugin_by_cmd_arg_counter = 0;
 	int          pb_time = -1;
+#ifdef GMU_MEDIALIB
+	int          analysis_progress = -1;
+#endif
 	char        *alt_playlist = NULL;
 
 	for (i = 0; i < MAX_FRONTEND_PLUGIN_BY_CMD_ARG; i++)
@@ -1118,6 +1339,11 @@ int main(int argc, char **argv)
 		prebuffer_size = cfg_get_int_value(config, "Gmu.ReaderCachePrebufferSize");
 		if (prebuffer_size <= 0) prebuffer_size = size / 2;
 		reader_set_cache_size_kb(size, prebuffer_size);
+		if (cfg_get_boolean_value(config, "Gmu.Timeshift")) {
+			int ts_size = cfg_get_int_value(config, "Gmu.TimeshiftCacheSize");
+			if (ts_size > 0)
+				reader_set_timeshift(cfg_get_key_value(config, "Gmu.TimeshiftDirectory"), ts_size);
+		}
 	}
 
 	{
@@ -1134,6 +1360,8 @@ int main(int argc, char **argv)
 		}
 	}
 
+	pcmconv_init();
+
 #if STATIC
 	decloader_load_builtin_decoders();
 #else
@@ -1187,6 +1415,8 @@ int main(int argc, char **argv)
 	}
 #endif
 
+	if (cfg_get_boolean_value(config, "Gmu.CpuFreqScaling"))
+		cpufreq_init(cfg_get_key_value(config, "Gmu.CpuFreqSysfsPath"));
 	file_player_init(&current_track_ti, cfg_get_boolean_value(config, "Gmu.DeviceCloseASAP"));
 	set_default_play_mode(config, &pl);
 
@@ -1194,6 +1424,31 @@ int main(int argc, char **argv)
 
 	gmu_core_config_acquire_lock();
 	file_player_set_lyrics_file_pattern(cfg_get_key_value(config, "Gmu.LyricsFilePattern"));
+	if (cfg_get_boolean_value(config, "Gmu.Prefetch") && cfg_get_int_value(config, "Gmu.PrefetchBudget") > 0)
+		prefetch_init((size_t)cfg_get_int_value(config, "Gmu.PrefetchBudget") * 1024,
+		              cfg_get_key_value(config, "Gmu.LyricsFilePattern"),
+		              cfg_get_key_value(config, "SDL.CoverArtworkFilePattern"));
+	seekindex_init(cfg_get_boolean_value(config, "Gmu.SeekIndex"));
+#ifdef GMU_MEDIALIB
+	if (cfg_get_boolean_value(config, "Gmu.MedialibMemoryIndex") &&
+	    cfg_get_int_value(config, "Gmu.MedialibMemoryIndexMaxKB") > 0)
+		medialib_enable_index(&gm, (size_t)cfg_get_int_value(config, "Gmu.MedialibMemoryIndexMaxKB") * 1024);
+	{
+		int flags = 0;
+
+		if (cfg_get_boolean_value(config, "Gmu.MedialibAnalysis"))
+			flags |= ANALYZER_FEATURES;
+		if (cfg_get_boolean_value(config, "Gmu.MedialibLoudnessScan"))
+			flags |= ANALYZER_LOUDNESS;
+		if (cfg_get_boolean_value(config, "Gmu.MedialibLoudnessTags"))
+			flags |= ANALYZER_LOUDNESS_TAGS;
+		if (flags & (ANALYZER_FEATURES | ANALYZER_LOUDNESS)) {
+			snprintf(temp, 511, "%s/decoders", base_dir);
+			analyzer_start(temp, cfg_get_int_value(config, "Gmu.MedialibAnalysisCpuLimit"),
+			               cfg_get_int_value(config, "Gmu.MedialibAnalysisJobs"), flags);
+		}
+	}
+#endif
 
 	if (cfg_get_boolean_value(config, "Gmu.AutoPlayOnProgramStart")) {
 		wdprintf(V_INFO, "gmu", "AutoPlay enabled.\n");
@@ -1322,10 +1577,25 @@ int main(int argc, char **argv)
 			event_queue_push_with_parameter(&event_queue, GMU_PLAYBACK_TIME_CHANGE, pb_time);
 		}
 
+		cpufreq_update(audio_buffer_get_fill(), audio_buffer_get_size());
+#ifdef GMU_MEDIALIB
+		analyzer_update(audio_buffer_get_fill(), audio_buffer_get_size(), player_status == PLAYING);
+		if (analysis_progress != analyzer_get_progress()) {
+			analysis_progress = analyzer_get_progress();
+			event_queue_push_with_parameter(&event_queue, GMU_MEDIALIB_ANALYSIS_PROGRESS, analysis_progress);
+		}
+#endif
+
 		while (event_queue_is_event_waiting(&event_queue)) {
 			int      event_param = event_queue_get_parameter(&event_queue);
 			GmuEvent event = event_queue_pop(&event_queue);
 
+			if (event == GMU_TRACK_CHANGE || event == GMU_QUEUE_CHANGE ||
+			    event == GMU_PLAYLIST_CHANGE || event == GMU_PLAYMODE_CHANGE)
+				upcoming_tracks_changed = 1;
+			if (event == GMU_PLAYLIST_CHANGE || event == GMU_MEDIALIB_REFRESH_DONE)
+				playlist_time_changed = 1;
+
 			/*wdprintf(V_DEBUG, "gmu", "Got event %d with param %d\n", event, event_param);*/
 			/*wdprintf(V_DEBUG, "gmu", "Pushing event to frontends:\n");*/
 			fe = feloader_frontend_list_get_next_frontend(1);
@@ -1338,6 +1608,12 @@ int main(int argc, char **argv)
 			}
 			/*wdprintf(V_DEBUG, "gmu", "Done.\n");*/
 		}
+		if (upcoming_tracks_changed) {
+			prefetch_upcoming_tracks();
+			upcoming_tracks_changed = 0;
+		}
+		/* Spread over several iterations for large playlists */
+		if (playlist_time_changed) playlist_time_changed = update_playlist_total_time();
 	}
 
 	wdprintf(
@@ -1366,7 +1642,13 @@ int main(int argc, char **argv)
 	feloader_free();
 	wdprintf(V_INFO, "gmu", "Unloading frontends done.\n");
 
+#ifdef GMU_MEDIALIB
+	analyzer_stop();
+#endif
+	prefetch_shutdown();
+	seekindex_shutdown();
 	file_player_shutdown();
+	cpufreq_close();
 	audio_device_close();
 	audio_buffer_free();
 
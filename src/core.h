@@ -43,6 +43,9 @@ int              gmu_core_play_pause(void);
 int              gmu_core_pause(void);
 int              gmu_core_next(void);
 int              gmu_core_previous(void);
+int              gmu_core_seek(long position_ms);
+int              gmu_core_seek_relative(long offset_ms);
+void             gmu_core_set_power_save_mode(int enable);
 int              gmu_core_stop(void);
 int              gmu_core_play_pl_item(int item);
 int              gmu_core_play_file(const char *filename);
@@ -101,14 +104,26 @@ Entry           *gmu_core_playlist_get_next(Entry *entry);
 Entry           *gmu_core_playlist_get_prev(Entry *entry);
 int              gmu_core_playlist_get_played(Entry *entry);
 int              gmu_core_playlist_entry_get_queue_pos(Entry *entry);
+/* Returns the length of playlist item 'item' in seconds, or -1 if unknown;
+ * The playlist lock must NOT be held by the caller */
+int              gmu_core_playlist_get_entry_length(int item);
+/* Returns the total length of the playlist's entries in seconds, as far as
+ * known; 'unknown_entries' (may be NULL) is set to the number of entries
+ * with an unknown length */
+int              gmu_core_playlist_get_total_time(int *unknown_entries);
 /* Media library wrapper functions: */
 void             gmu_core_medialib_start_refresh(void);
-int              gmu_core_medialib_search_find(GmuMedialibDataType type, const char *str);
-TrackInfo        gmu_core_medialib_search_fetch_next_result(void);
+int              gmu_core_medialib_search_find(GmuMedialibDataType type, const char *str, int after_id, int limit);
+TrackSummary     gmu_core_medialib_search_fetch_next_result(void);
 void             gmu_core_medialib_search_finish(void);
+/* Results are fetched with gmu_core_medialib_search_fetch_next_result() */
+int              gmu_core_medialib_similar_tracks(int id, int limit);
+/* Returns the memory used by the medialib's in-memory index in bytes and
+ * stores its limit in 'max_bytes' (0 if the index is disabled) */
+size_t           gmu_core_medialib_get_index_memory_usage(size_t *max_bytes);
 int              gmu_core_medialib_add_id_to_playlist(size_t id);
-int              gmu_core_medialib_browse_artists(void);
-int              gmu_core_medialib_browse_albums_by_artist(const char *artist);
+int              gmu_core_medialib_browse_artists(const char *after, int limit);
+int              gmu_core_medialib_browse_albums_by_artist(const char *artist, const char *after, int limit);
 const char      *gmu_core_medialib_browse_fetch_next_result(void);
 void             gmu_core_medialib_browse_finish(void);
 void             gmu_core_medialib_path_add(const char *path);
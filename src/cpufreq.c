@@ -0,0 +1,265 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: cpufreq.c  Created: 210703
+ *
+ * Description: Buffer-aware CPU frequency scaling
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "cpufreq.h"
+#include "debug.h"
+#include FILE_HW_H
+
+#define CPUFREQ_MAX_STEPS          32
+/* Minimum time between two frequency changes */
+#define CPUFREQ_UPDATE_INTERVAL_MS 500
+/* Share of CPU time (in percent) the decoder should need at most */
+#define CPUFREQ_TARGET_LOAD        50
+#define CPUFREQ_TARGET_LOAD_UI     25
+/* Switch to the maximum frequency when the buffer runs lower than this */
+#define CPUFREQ_BOOST_BUFFER_MS    250
+
+typedef enum CpuFreqMethod { CPUFREQ_NONE, CPUFREQ_SYSFS, CPUFREQ_HW_HOOK } CpuFreqMethod;
+
+static pthread_mutex_t    mutex = PTHREAD_MUTEX_INITIALIZER;
+static CpuFreqMethod      method = CPUFREQ_NONE;
+static char               path[256];
+static char               prev_governor[32];
+static unsigned long      steps[CPUFREQ_MAX_STEPS]; /* in kHz, ascending */
+static int                num_steps, cur_step;
+static int                ui_active = 1;
+static unsigned long long audio_usec, cpu_usec; /* Decoder statistics since the last update */
+static int                bytes_per_sec;
+static struct timespec    last_update;
+
+static int read_sysfs(const char *name, char *buf, size_t size)
+{
+	char  file[320];
+	FILE *f;
+	int   res = 0;
+
+	snprintf(file, 319, "%s/%s", path, name);
+	if ((f = fopen(file, "r"))) {
+		if (fgets(buf, size, f)) {
+			size_t len = strlen(buf);
+			while (len > 0 && (buf[len-1] == '\n' || buf[len-1] == ' ')) buf[--len] = '\0';
+			res = 1;
+		}
+		fclose(f);
+	}
+	return res;
+}
+
+static int write_sysfs(const char *name, const char *value)
+{
+	char  file[320];
+	FILE *f;
+	int   res = 0;
+
+	snprintf(file, 319, "%s/%s", path, name);
+	if ((f = fopen(file, "w"))) {
+		res = fputs(value, f) >= 0;
+		if (fclose(f) != 0) res = 0;
+	}
+	return res;
+}
+
+static int compare_ulong(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long *)a, y = *(const unsigned long *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Reads the available frequencies. If the driver does not provide a list,
+ * a few steps between the minimum and maximum frequency are used. */
+static int sysfs_read_steps(void)
+{
+	char buf[512];
+
+	num_steps = 0;
+	if (read_sysfs("scaling_available_frequencies", buf, sizeof(buf))) {
+		char *p = buf, *end;
+		unsigned long freq;
+		while (num_steps < CPUFREQ_MAX_STEPS && (freq = strtoul(p, &end, 10)) > 0 && end != p) {
+			steps[num_steps++] = freq;
+			p = end;
+		}
+		qsort(steps, num_steps, sizeof(unsigned long), compare_ulong);
+	} else {
+		char          buf_max[32];
+		unsigned long min, max;
+		if (read_sysfs("cpuinfo_min_freq", buf, sizeof(buf)) &&
+		    read_sysfs("cpuinfo_max_freq", buf_max, sizeof(buf_max))) {
+			min = strtoul(buf, NULL, 10);
+			max = strtoul(buf_max, NULL, 10);
+			if (min > 0 && max >= min) {
+				int i;
+				for (i = 0; i < 5; i++) steps[num_steps++] = min + (max - min) * i / 4;
+			}
+		}
+	}
+	return num_steps > 0;
+}
+
+static int sysfs_init(void)
+{
+	char governor[32];
+	int  res = 0;
+
+	prev_governor[0] = '\0';
+	if (sysfs_read_steps() && read_sysfs("scaling_governor", governor, sizeof(governor))) {
+		if (strcmp(governor, "userspace") != 0) {
+			strncpy(prev_governor, governor, sizeof(prev_governor) - 1);
+			prev_governor[sizeof(prev_governor) - 1] = '\0';
+			write_sysfs("scaling_governor", "userspace");
+			if (!read_sysfs("scaling_governor", governor, sizeof(governor)))
+				governor[0] = '\0';
+		}
+		if (strcmp(governor, "userspace") == 0)
+			res = 1;
+		else
+			wdprintf(V_WARNING, "cpufreq", "Unable to activate the userspace governor.\n");
+	}
+	return res;
+}
+
+static void set_step(int step)
+{
+	char value[32];
+
+	if (step == cur_step) return;
+	switch (method) {
+		case CPUFREQ_SYSFS:
+			snprintf(value, 31, "%lu", steps[step]);
+			if (!write_sysfs("scaling_setspeed", value))
+				wdprintf(V_WARNING, "cpufreq", "Unable to set CPU frequency to %s kHz.\n", value);
+			break;
+		case CPUFREQ_HW_HOOK:
+#ifdef HW_CPU_CLOCK_STEPS_MHZ
+			hw_set_cpu_clock(steps[step] / 1000);
+#endif
+			break;
+		case CPUFREQ_NONE:
+			break;
+	}
+	wdprintf(V_DEBUG, "cpufreq", "CPU frequency: %lu kHz\n", steps[step]);
+	cur_step = step;
+}
+
+int cpufreq_init(const char *sysfs_path)
+{
+	int res = 0;
+
+	pthread_mutex_lock(&mutex);
+	strncpy(path, sysfs_path ? sysfs_path : CPUFREQ_DEFAULT_SYSFS_PATH, sizeof(path) - 1);
+	path[sizeof(path) - 1] = '\0';
+	method = CPUFREQ_NONE;
+	if (sysfs_init()) {
+		method = CPUFREQ_SYSFS;
+	} else {
+#ifdef HW_CPU_CLOCK_STEPS_MHZ
+		static const unsigned long hw_steps[] = HW_CPU_CLOCK_STEPS_MHZ;
+#ifdef hw_cpu_clock_available
+		if (hw_cpu_clock_available())
+#endif
+		{
+			for (num_steps = 0; num_steps < (int)(sizeof(hw_steps) / sizeof(hw_steps[0])); num_steps++)
+				steps[num_steps] = hw_steps[num_steps] * 1000;
+			method = CPUFREQ_HW_HOOK;
+		}
+#endif
+	}
+	if (method != CPUFREQ_NONE) {
+		wdprintf(V_INFO, "cpufreq", "CPU frequency scaling enabled with %d steps (%lu - %lu kHz).\n",
+		         num_steps, steps[0], steps[num_steps-1]);
+		/* Start at full speed, the first updates will lower it as needed */
+		cur_step = -1;
+		set_step(num_steps - 1);
+		audio_usec = cpu_usec = 0;
+		clock_gettime(CLOCK_MONOTONIC, &last_update);
+		res = 1;
+	} else {
+		wdprintf(V_INFO, "cpufreq", "CPU frequency scaling not available.\n");
+	}
+	pthread_mutex_unlock(&mutex);
+	return res;
+}
+
+void cpufreq_close(void)
+{
+	pthread_mutex_lock(&mutex);
+	if (method == CPUFREQ_SYSFS && prev_governor[0] != '\0')
+		write_sysfs("scaling_governor", prev_governor);
+	else if (method == CPUFREQ_HW_HOOK)
+		set_step(num_steps - 1);
+	method = CPUFREQ_NONE;
+	pthread_mutex_unlock(&mutex);
+}
+
+void cpufreq_report_decode(size_t bytes, int bytes_per_second, unsigned long cpu_time_usec)
+{
+	pthread_mutex_lock(&mutex);
+	if (method != CPUFREQ_NONE && bytes_per_second > 0) {
+		audio_usec += (unsigned long long)bytes * 1000000 / bytes_per_second;
+		cpu_usec += cpu_time_usec;
+		bytes_per_sec = bytes_per_second;
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void cpufreq_set_ui_active(int active)
+{
+	pthread_mutex_lock(&mutex);
+	ui_active = active;
+	pthread_mutex_unlock(&mutex);
+}
+
+void cpufreq_update(size_t buffer_fill, size_t buffer_size)
+{
+	struct timespec now;
+	long            elapsed_ms;
+
+	pthread_mutex_lock(&mutex);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed_ms = (now.tv_sec - last_update.tv_sec) * 1000 + (now.tv_nsec - last_update.tv_nsec) / 1000000;
+	if (method != CPUFREQ_NONE && elapsed_ms >= CPUFREQ_UPDATE_INTERVAL_MS) {
+		int step = cur_step;
+		int min_step = ui_active ? num_steps / 2 : 0;
+
+		if (audio_usec > 0 && buffer_size > 0 &&
+		    buffer_fill < (unsigned long long)bytes_per_sec * CPUFREQ_BOOST_BUFFER_MS / 1000) {
+			/* The decoder is running but cannot keep the buffer filled */
+			step = num_steps - 1;
+		} else if (audio_usec > 0) {
+			/* Percentage of CPU time needed for decoding in real time. Assuming
+			 * it scales inversely with the clock frequency, choose the lowest
+			 * frequency that keeps the load below the target. */
+			unsigned long long load = cpu_usec * 100 / audio_usec;
+			unsigned long long target = ui_active ? CPUFREQ_TARGET_LOAD_UI : CPUFREQ_TARGET_LOAD;
+
+			for (step = 0; step < num_steps - 1; step++)
+				if (load * steps[cur_step] <= target * steps[step]) break;
+			/* Go up immediately, but only go down one step at a time */
+			if (step < cur_step - 1) step = cur_step - 1;
+		} else if (step > 0) { /* Nothing decoded; paused, stopped or buffer full */
+			step--;
+		}
+		if (step < min_step) step = min_step;
+		set_step(step);
+		audio_usec = cpu_usec = 0;
+		last_update = now;
+	}
+	pthread_mutex_unlock(&mutex);
+}
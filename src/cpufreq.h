@@ -0,0 +1,38 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: cpufreq.h  Created: 210703
+ *
+ * Description: Buffer-aware CPU frequency scaling
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#ifndef _CPUFREQ_H
+#define _CPUFREQ_H
+#include <stddef.h>
+
+#define CPUFREQ_DEFAULT_SYSFS_PATH "/sys/devices/system/cpu/cpu0/cpufreq"
+
+/* Takes control of the CPU frequency through the cpufreq sysfs interface
+ * found in 'sysfs_path' (using the userspace governor), or through the
+ * platform's CPU clock hook if there is no usable sysfs interface.
+ * Returns 1 on success, 0 if the CPU frequency cannot be controlled. */
+int  cpufreq_init(const char *sysfs_path);
+/* Restores the previous governor (or the maximum clock with the platform hook) */
+void cpufreq_close(void);
+/* To be called by the decoder thread after decoding 'bytes' bytes of audio
+ * data (playing at 'bytes_per_second'), which took 'cpu_time_usec' microseconds
+ * of CPU time. */
+void cpufreq_report_decode(size_t bytes, int bytes_per_second, unsigned long cpu_time_usec);
+/* Sets whether the user interface is in use (e.g. the display is on) */
+void cpufreq_set_ui_active(int active);
+/* Adjusts the CPU frequency based on the decoder load and the audio buffer
+ * fill level. Can be called frequently, it is rate limited internally. */
+void cpufreq_update(size_t buffer_fill, size_t buffer_size);
+#endif
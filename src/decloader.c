@@ -31,9 +31,146 @@ static union {
 	GmuDecoder * (*fptr) (void);
 } dlsymunion;
 
-static char         *dir_extensions[] = { ".so", NULL };
-static DecoderChain *dc_root;
-static char          extensions[1024];
+/* Number of hash table buckets for the extension and mime type lookup (power of two) */
+#define DECODER_HASH_SIZE    128
+#define DECODER_HASH_KEY_LEN 64
+
+typedef struct _DecoderHashEntry DecoderHashEntry;
+
+struct _DecoderHashEntry {
+	DecoderHashEntry *next;
+	GmuDecoder       *gd;
+	char              key[DECODER_HASH_KEY_LEN];
+};
+
+typedef struct _DecoderMagic {
+	const GmuMagicPattern *mp;
+	GmuDecoder            *gd;
+	int                    index; /* Keeps the load order for equal priorities */
+} DecoderMagic;
+
+static char             *dir_extensions[] = { ".so", NULL };
+static DecoderChain     *dc_root;
+static char              extensions[1024];
+static DecoderHashEntry *extension_table[DECODER_HASH_SIZE];
+static DecoderHashEntry *mime_type_table[DECODER_HASH_SIZE];
+static DecoderMagic     *magic_table;
+static int               magic_table_size;
+
+/* Copies the key from 'src' to 'target' in lower case, without leading dots
+ * and surrounding whitespace. 'len' is the key's length in 'src'. Returns 0
+ * for empty or too long keys, 1 otherwise. */
+static int hash_key_normalize(char *target, const char *src, size_t len)
+{
+	size_t i;
+
+	while (len > 0 && (*src == '.' || *src == ' ')) { src++; len--; }
+	while (len > 0 && src[len-1] == ' ') len--;
+	if (len == 0 || len >= DECODER_HASH_KEY_LEN) return 0;
+	for (i = 0; i < len; i++)
+		target[i] = (src[i] >= 'A' && src[i] <= 'Z') ? src[i] + ('a' - 'A') : src[i];
+	target[len] = '\0';
+	return 1;
+}
+
+/* FNV-1a */
+static unsigned int hash_key(const char *key)
+{
+	unsigned int h = 2166136261U;
+
+	for (; *key; key++) {
+		h ^= (unsigned char)*key;
+		h *= 16777619U;
+	}
+	return h & (DECODER_HASH_SIZE - 1);
+}
+
+static GmuDecoder *hash_table_get(DecoderHashEntry **table, const char *key)
+{
+	DecoderHashEntry *e = table[hash_key(key)];
+
+	while (e && strcmp(e->key, key) != 0) e = e->next;
+	return e ? e->gd : NULL;
+}
+
+/* Adds all keys of the semicolon-separated 'list'. When several decoders
+ * claim the same key, the one that has been loaded first is used. */
+static void hash_table_add_list(DecoderHashEntry **table, const char *list, GmuDecoder *gd)
+{
+	while (list && *list) {
+		const char       *end = strchr(list, ';');
+		size_t            len = end ? (size_t)(end - list) : strlen(list);
+		DecoderHashEntry *e;
+		char              key[DECODER_HASH_KEY_LEN];
+
+		if (hash_key_normalize(key, list, len) && !hash_table_get(table, key) &&
+		    (e = malloc(sizeof(DecoderHashEntry)))) {
+			unsigned int h = hash_key(key);
+			memcpy(e->key, key, sizeof(key));
+			e->gd = gd;
+			e->next = table[h];
+			table[h] = e;
+		}
+		list = end ? end + 1 : NULL;
+	}
+}
+
+static void hash_table_free(DecoderHashEntry **table)
+{
+	int i;
+
+	for (i = 0; i < DECODER_HASH_SIZE; i++) {
+		while (table[i]) {
+			DecoderHashEntry *e = table[i];
+			table[i] = e->next;
+			free(e);
+		}
+	}
+}
+
+static int magic_compare(const void *a, const void *b)
+{
+	const DecoderMagic *x = a, *y = b;
+	int                 res = y->mp->priority - x->mp->priority;
+	return res ? res : x->index - y->index;
+}
+
+static void magic_table_add(GmuDecoder *gd)
+{
+	const GmuMagicPattern *mp = (*gd->get_magic_patterns)();
+	int                    n;
+
+	for (n = 0; mp && mp[n].pattern; n++);
+	if (n > 0) {
+		DecoderMagic *tmp = realloc(magic_table, (magic_table_size + n) * sizeof(DecoderMagic));
+		if (tmp) {
+			int i;
+			magic_table = tmp;
+			for (i = 0; i < n; i++, magic_table_size++) {
+				magic_table[magic_table_size].mp = mp + i;
+				magic_table[magic_table_size].gd = gd;
+				magic_table[magic_table_size].index = magic_table_size;
+			}
+			qsort(magic_table, magic_table_size, sizeof(DecoderMagic), magic_compare);
+		}
+	}
+}
+
+/* Makes the decoder available for the lookup functions */
+static void decoder_register(GmuDecoder *gd)
+{
+	wdprintf(V_INFO, "decloader", "%s: Name: %s\n", gd->identifier, (*gd->get_name)());
+	if (gd->get_file_extensions) {
+		int len = strlen(extensions);
+		wdprintf(V_INFO, "decloader", "%s: File extensions: %s\n", gd->identifier, (*gd->get_file_extensions)());
+		snprintf(extensions+len, 1023-len, "%s;", (*gd->get_file_extensions)());
+		hash_table_add_list(extension_table, (*gd->get_file_extensions)(), gd);
+	}
+	if (gd->get_mime_types)
+		hash_table_add_list(mime_type_table, (*gd->get_mime_types)(), gd);
+	if (gd->get_magic_patterns)
+		magic_table_add(gd);
+}
 
 static DecoderChain *dc_init_element(void)
 {
@@ -67,6 +204,12 @@ static void dc_free(DecoderChain *dc)
 void decloader_free(void)
 {
 	dc_free(dc_root);
+	dc_root = NULL;
+	hash_table_free(extension_table);
+	hash_table_free(mime_type_table);
+	free(magic_table);
+	magic_table = NULL;
+	magic_table_size = 0;
 }
 
 /*
@@ -139,12 +282,7 @@ int decloader_load_all(const char *directory)
 					snprintf(fpath, 255, "%s/%s", dir_get_path(dir), dir_get_filename(dir, i));
 					if ((gd = decloader_load_decoder(fpath))) {
 						wdprintf(V_INFO, "decloader", "Loading %s was successful.\n", dir_get_filename(dir, i));
-						wdprintf(V_INFO, "decloader", "%s: Name: %s\n", gd->identifier, (*gd->get_name)());
-						if (gd->get_file_extensions) {
-							int len = strlen(extensions);
-							wdprintf(V_INFO, "decloader", "%s: File extensions: %s\n", gd->identifier, (*gd->get_file_extensions)());
-							snprintf(extensions+len, 1023-len, "%s;", (*gd->get_file_extensions)());
-						}
+						decoder_register(gd);
 						dc->gd = gd;
 						dc->next = dc_init_element();
 						dc = dc->next;
@@ -162,76 +300,82 @@ int decloader_load_all(const char *directory)
 
 GmuDecoder *decloader_get_decoder_for_extension(const char *file_extension)
 {
-	DecoderChain *dc = dc_root;
-	GmuDecoder   *gd = NULL;
-
-	if (file_extension) {
-		while (dc && dc->next) {
-			char ext[512], ext2[512] = "";
-			if (dc->gd->get_file_extensions) {
-				strtoupper(ext, (*dc->gd->get_file_extensions)(), 511);
-				strtoupper(ext2, file_extension, 511);
-				if (strstr(ext, ext2) != NULL) {
-					wdprintf(V_INFO, "decloader", "Matching decoder for %s: %s\n",
-						     file_extension, dc->gd->identifier);
-					break;
-				}
-			}
-			dc = dc->next;
-		}
-		if (dc) gd = dc->gd;
-	}
-	if (!dc || dc->gd == NULL)
+	GmuDecoder *gd = NULL;
+	char        key[DECODER_HASH_KEY_LEN];
+
+	if (file_extension && hash_key_normalize(key, file_extension, strlen(file_extension)))
+		gd = hash_table_get(extension_table, key);
+	if (gd)
+		wdprintf(V_DEBUG, "decloader", "Matching decoder for %s: %s\n", file_extension, gd->identifier);
+	else
 		wdprintf(V_INFO, "decloader", "No matching decoder found for %s.\n", file_extension);
 	return gd;
 }
 
 GmuDecoder *decloader_get_decoder_for_mime_type(const char *mime_type)
 {
-	DecoderChain *dc = dc_root;
-	GmuDecoder   *gd = NULL;
-
-	if (mime_type) {
-		while (dc->next) {
-			if (dc->gd->get_mime_types) {
-				const char *mt = (*dc->gd->get_mime_types)();
-				if (strstr(mt, mime_type) != NULL) {
-					wdprintf(V_INFO, "decloader", "Matching decoder for %s: %s\n",
-						     mime_type, dc->gd->identifier);
-					break;
-				}
-			}
-			dc = dc->next;
-		}
-		gd = dc->gd;
-	}
-	if (dc->gd == NULL) wdprintf(V_INFO, "decloader", "No matching decoder found for %s.\n", mime_type);
+	GmuDecoder *gd = NULL;
+	char        key[DECODER_HASH_KEY_LEN];
+
+	/* Parameters such as "; charset=..." are not part of the type */
+	if (mime_type && hash_key_normalize(key, mime_type, strcspn(mime_type, ";")))
+		gd = hash_table_get(mime_type_table, key);
+	if (gd)
+		wdprintf(V_INFO, "decloader", "Matching decoder for %s: %s\n", mime_type, gd->identifier);
+	else
+		wdprintf(V_INFO, "decloader", "No matching decoder found for %s.\n", mime_type);
 	return gd;
 }
 
-
 GmuDecoder *decloader_get_decoder_for_data_chunk(const char *data, int size)
 {
-	DecoderChain *dc = dc_root;
-	GmuDecoder   *gd = NULL;
+	GmuDecoder *gd = NULL;
 
 	if (data && size > 0) {
-		while (dc->next) {
-			if (dc->gd->data_check_magic_bytes) {
-				if ((*dc->gd->data_check_magic_bytes)(data, size)) { /* match found */
-					wdprintf(V_INFO, "decloader", "Matching decoder found: %s\n",
-					         dc->gd->identifier);
-					break;
-				}
-			} else {
-				wdprintf(V_INFO, "decloader", "%s does not support magic bytes check.\n",
-				         dc->gd->identifier);
-			}
-			dc = dc->next;
+		DecoderChain *dc;
+		int           i;
+
+		for (i = 0; i < magic_table_size && !gd; i++) {
+			const GmuMagicPattern *mp = magic_table[i].mp;
+			GmuDecoder            *cand = magic_table[i].gd;
+			if (mp->offset + mp->length <= (size_t)size &&
+			    memcmp(data + mp->offset, mp->pattern, mp->length) == 0 &&
+			    (!cand->data_check_magic_bytes || (*cand->data_check_magic_bytes)(data, size)))
+				gd = cand;
+		}
+		/* Decoders without magic patterns have to check the data themselves */
+		for (dc = dc_root; !gd && dc && dc->gd; dc = dc->next) {
+			if (!dc->gd->get_magic_patterns && dc->gd->data_check_magic_bytes &&
+			    (*dc->gd->data_check_magic_bytes)(data, size))
+				gd = dc->gd;
 		}
-		gd = dc->gd;
 	}
-	if (dc->gd == NULL) wdprintf(V_INFO, "decloader", "No matching decoder found.\n");
+	if (gd)
+		wdprintf(V_INFO, "decloader", "Matching decoder found: %s\n", gd->identifier);
+	else
+		wdprintf(V_INFO, "decloader", "No matching decoder found.\n");
+	return gd;
+}
+
+GmuDecoder *decloader_get_decoder_for_file(const char *file, Reader **r)
+{
+	const char *ext = get_file_extension(file);
+	GmuDecoder *gd = NULL;
+
+	*r = NULL;
+	if (ext) gd = decloader_get_decoder_for_extension(ext);
+	if (!gd) {
+		*r = reader_open(file);
+		if (*r && reader_read_bytes(*r, 4096))
+			gd = decloader_get_decoder_for_data_chunk(reader_get_buffer(*r), reader_get_number_of_bytes_in_buffer(*r));
+	}
+	if (gd && gd->set_reader_handle && !*r) {
+		*r = reader_open(file);
+		if (*r) reader_read_bytes(*r, 4096);
+	} else if ((!gd || !gd->set_reader_handle) && *r) {
+		reader_close(*r);
+		*r = NULL;
+	}
 	return gd;
 }
 
@@ -267,12 +411,7 @@ int decloader_load_builtin_decoders(void)
 		wdprintf(V_INFO, "decloader", "Loading internal decoder %d...\n", i);
 		dc->gd = (*decload_funcs[i])();
 		wdprintf(V_INFO, "decloader", "Loading decoder %d was successful.\n", i);
-		wdprintf(V_INFO, "decloader", "%s: Name: %s\n", dc->gd->identifier, (*dc->gd->get_name)());
-		if (dc->gd->get_file_extensions) {
-			int len = strlen(extensions);
-			wdprintf(V_INFO, "decloader", "%s: File extensions: %s\n", dc->gd->identifier, (*dc->gd->get_file_extensions)());
-			snprintf(extensions+len, 1023-len, "%s;", (*dc->gd->get_file_extensions)());
-		}
+		decoder_register(dc->gd);
 		dc->next = dc_init_element();
 		dc = dc->next;
 		res = 1;
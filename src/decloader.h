@@ -29,6 +29,10 @@ int         decloader_load_all(const char *directory);
 GmuDecoder *decloader_get_decoder_for_extension(const char *file_extension);
 GmuDecoder *decloader_get_decoder_for_mime_type(const char *mime_type);
 GmuDecoder *decloader_get_decoder_for_data_chunk(const char *data, int size);
+/* Finds the decoder for a file the same way the file player does (by file
+ * extension first, then by content). If the decoder uses a Reader, it is
+ * opened and returned in 'r', otherwise 'r' is set to NULL. */
+GmuDecoder *decloader_get_decoder_for_file(const char *file, Reader **r);
 char       *decloader_get_all_extensions(void);
 GmuDecoder *decloader_decoder_list_get_next_decoder(int getfirst);
 void        decloader_free(void);
@@ -23,19 +23,22 @@
 #include "../charset.h"
 #include "FLAC/stream_decoder.h"
 #include "../debug.h"
+#include "../pcmconv.h"
 #define BUF_SIZE 65536
 
 static FLAC__StreamDecoder *fsd;
 static long                 total_samples, seek_to_sample;
 static int                  sample_rate, channels, track_length, bitrate, file_size;
-static unsigned int         size = 1; /* size of decoded data */
-static char                 buf[BUF_SIZE];
+static char                 buf[BUF_SIZE]; /* holds the part of a frame that did not fit into the target */
+static size_t               buf_pos, buf_size;
+static char                *out_target;
+static size_t               out_max, out_size;
 static TrackInfo            ti, ti_metaonly;
 static Reader              *r;
 
 static const char *get_name(void)
 {
-	return "FLAC decoder v0.6";
+	return "FLAC decoder v0.7";
 }
 
 static FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder, 
@@ -43,39 +46,28 @@ static FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *
                                                      const FLAC__int32 *const   buffer[],
                                                      void                      *client_data)
 {
-	unsigned int length = frame->header.blocksize * frame->header.channels
-	                                              * frame->header.bits_per_sample / 8;
-	unsigned int sample, channel, pos = 0, byte_count = 0;
-	FLAC__int16 *packed16 = (FLAC__int16 *)alloca(length);
-	FLAC__int8  *packed   = (FLAC__int8 *)packed16;
-
-	for (sample = 0; sample < frame->header.blocksize; sample++) {
-		for (channel = 0; channel < frame->header.channels; channel++) {
-			switch (frame->header.bits_per_sample) {
-				case 8:
-					packed[pos] = (FLAC__int8)buffer[channel][sample];
-					byte_count++;
-					break;
-				case 16:
-					packed16[pos] = (FLAC__int16)buffer[channel][sample];
-					byte_count+=2;
-					break;
-				case 24:
-					packed16[pos] = (FLAC__int16)(buffer[channel][sample] / 256);
-					byte_count+=2;
-					break;
-			}
-			pos++;
-		}
-	}
-
-	if (byte_count <= BUF_SIZE) {
-		memcpy(buf, (char *)packed, byte_count);
-		size = byte_count;
+	size_t length = frame->header.blocksize * frame->header.channels * 2;
+	int    shift  = frame->header.bits_per_sample - 16;
+
+	if (!out_target) { /* not called from decode_data(), nothing to do */
+	} else if (length <= out_max - out_size) {
+		/* Convert directly into the caller's buffer */
+		pcmconv_s32_planar_to_s16(out_target + out_size, buffer, frame->header.channels,
+		                          frame->header.blocksize, shift);
+		out_size += length;
+	} else if (length <= BUF_SIZE) {
+		/* Frame does not fit, keep the remainder for the next decode_data() call */
+		size_t fits = out_max - out_size;
+		pcmconv_s32_planar_to_s16(buf, buffer, frame->header.channels,
+		                          frame->header.blocksize, shift);
+		memcpy(out_target + out_size, buf, fits);
+		out_size += fits;
+		buf_pos  = fits;
+		buf_size = length;
 	} else {
-		wdprintf(V_DEBUG, "flac", "Sample size > buffer size: %d bytes\n", byte_count);
+		wdprintf(V_DEBUG, "flac", "Sample size > buffer size: %lu bytes\n", (unsigned long)length);
 	}
-	return 0;
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
 
 static FLAC__StreamDecoderReadStatus read_callback(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
@@ -87,10 +79,14 @@ static FLAC__StreamDecoderReadStatus read_callback(const FLAC__StreamDecoder *de
 	 * in the buffer already, otherwise we initiate a read operation with
 	 * the desired size.
 	 */
-	size_t bs = reader_get_number_of_bytes_in_buffer(r);
+	size_t      bs = reader_get_number_of_bytes_in_buffer(r);
+	const char *data = NULL;
 
 	if (bs <= 0) {
-		if (reader_read_bytes(r, *bytes)) {
+		/* Copy directly from the file mapping if possible */
+		if ((data = reader_peek(r, *bytes, &bs))) {
+			reader_seek_whence(r, bs, SEEK_CUR);
+		} else if (reader_read_bytes(r, *bytes)) {
 			bs = reader_get_number_of_bytes_in_buffer(r);
 		} else {
 			bs = 0;
@@ -101,9 +97,9 @@ static FLAC__StreamDecoderReadStatus read_callback(const FLAC__StreamDecoder *de
 	}
 
 	if (bs != 0 && !reader_is_eof(r)) {
-		memcpy(buffer, reader_get_buffer(r), *bytes);
+		memcpy(buffer, data ? data : reader_get_buffer(r), *bytes);
 		/* Clear the buffer, so we know that we have consumed the data: */
-		reader_clear_buffer(r);
+		if (!data) reader_clear_buffer(r);
 		res = FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
 	} else {
 		res = FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
@@ -206,8 +202,9 @@ static int open_file(const char *filename)
 	int result = 1;
 
 	total_samples = 0;
-	seek_to_sample = 0;
+	seek_to_sample = -1;
 	sample_rate = 0;
+	buf_pos = buf_size = 0;
 	fsd = FLAC__stream_decoder_new();
 	FLAC__stream_decoder_set_metadata_respond(fsd, FLAC__METADATA_TYPE_VORBIS_COMMENT);
 
@@ -252,30 +249,41 @@ static int close_file(void)
 
 static int decode_data(char *target, size_t max_size)
 {
-	if (seek_to_sample) {
-		if (seek_to_sample < 0) seek_to_sample = 0;
+	out_target = target;
+	out_max    = max_size;
+	out_size   = 0;
+	if (seek_to_sample >= 0) {
+		buf_pos = buf_size = 0;
+		/* Writes the frame containing the target sample */
 		FLAC__stream_decoder_seek_absolute(fsd, seek_to_sample);
-		seek_to_sample = 0;
+		seek_to_sample = -1;
+	} else if (buf_pos < buf_size) {
+		out_size = buf_size - buf_pos < max_size ? buf_size - buf_pos : max_size;
+		memcpy(target, buf + buf_pos, out_size);
+		buf_pos += out_size;
 	}
-	if (FLAC__stream_decoder_process_single(fsd) == false)
-		size = 0;
-	if (FLAC__stream_decoder_get_state(fsd) >= FLAC__STREAM_DECODER_END_OF_STREAM)
-		size = 0;
-	if (size <= max_size) {
-		memcpy(target, buf, size);
-		/*total_samples++;
-		size += ret;*/
-	} else {
-		wdprintf(V_ERROR, "flac", "FATAL: Target buffer too small: %d < %d\n", max_size, size);
-		size = max_size;
+	/* Metadata blocks do not produce any samples, so keep going until we got a frame */
+	while (out_size == 0) {
+		if (FLAC__stream_decoder_process_single(fsd) == false)
+			break;
+		if (FLAC__stream_decoder_get_state(fsd) >= FLAC__STREAM_DECODER_END_OF_STREAM)
+			break;
 	}
-	return size;
+	out_target = NULL;
+	return out_size;
+}
+
+static long seek_sample(long sample)
+{
+	if (sample < 0) sample = 0;
+	if (total_samples > 0 && sample >= total_samples) sample = total_samples - 1;
+	seek_to_sample = sample;
+	return sample;
 }
 
 static int seek(int seconds)
 {
-	seek_to_sample = seconds * sample_rate;
-	return 1;
+	return seek_sample((long)seconds * sample_rate) >= 0;
 }
 
 static int get_decoder_buffer_size(void)
@@ -413,6 +421,16 @@ static GmuCharset meta_data_get_charset(void)
 	return M_CHARSET_UTF_8;
 }
 
+static const GmuMagicPattern magic_patterns[] = {
+	{ 0, "fLaC", 4, 0 },
+	{ 0, NULL, 0, 0 }
+};
+
+static const GmuMagicPattern *get_magic_patterns(void)
+{
+	return magic_patterns;
+}
+
 static void set_reader_handle(Reader *reader)
 {
 	r = reader;
@@ -444,7 +462,10 @@ static GmuDecoder gd = {
 	meta_data_get_charset,
 	NULL,
 	set_reader_handle,
-	NULL
+	NULL,
+	seek_sample,
+	NULL,
+	get_magic_patterns
 };
 
 GmuDecoder *GMU_REGISTER_DECODER(void)
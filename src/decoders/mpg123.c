@@ -25,15 +25,35 @@
 #include "../wejconfig.h"
 #include "../debug.h"
 #include "../charset.h"
+#include "../consts.h"
+#include "../seekindex.h"
 
 static mpg123_handle *player;
 static int            init = 0;
-static long           seek_to_sample_offset;
 static int            sample_rate, channels = 0, bitrate = 0;
 static TrackInfo      ti, ti_metaonly;
 static Reader        *r;
 static int            metaint = -1, metacount = 0;
-static int            seek_request = 0;
+static SeekIndex     *seek_index;
+static char           file_name[PATH_LEN_MAX];
+
+/* Hands the cached seek index over to mpg123, which then finds the frame
+ * offsets for seek requests without having to scan the stream */
+static void set_seek_index(void)
+{
+	if (!seek_index) seek_index = seekindex_load(file_name);
+	if (seek_index && seek_index->type == SEEKINDEX_MPEG && seek_index->samplerate == sample_rate) {
+		off_t *offsets = malloc(seek_index->count * sizeof(off_t));
+		if (offsets) {
+			size_t i;
+			for (i = 0; i < seek_index->count; i++)
+				offsets[i] = (off_t)seek_index->points[i].offset;
+			if (mpg123_set_index(player, offsets, seek_index->frames_per_point, seek_index->count) == MPG123_OK)
+				wdprintf(V_DEBUG, "mpg123", "Using seek index with %lu entries.\n", (unsigned long)seek_index->count);
+			free(offsets);
+		}
+	}
+}
 
 static const char *get_name(void)
 {
@@ -87,19 +107,6 @@ static int decode_data(char *target, size_t max_size)
 			metacount = metaint;
 		}
 
-		if (seek_request && reader_is_seekable(r) && seek_to_sample_offset >= 0) {
-			off_t offset;
-			wdprintf(V_DEBUG, "mpg123", "Seeking requested to sample %d.\n", seek_to_sample_offset);
-			if (mpg123_feedseek(player, seek_to_sample_offset, SEEK_SET, &offset) >= 0) {
-				wdprintf(V_DEBUG, "mpg123", "Seeking stream to file offset at %d bytes.\n", offset);
-				reader_seek(r, offset);
-			} else {
-				wdprintf(V_WARNING, "mpg123", "Seek error.\n");
-			}
-			seek_to_sample_offset = 0;
-			seek_request = 0;
-		}
-
 		readsize = 4096;
 		if (metacount > 0) {
 			if (metacount < readsize) readsize = metacount;
@@ -152,9 +159,6 @@ static int mpg123_play_file(const char *mpeg_file)
 	int                     result = 1;
 	struct mpg123_frameinfo mi;
 
-	seek_to_sample_offset = 0;
-	seek_request = 0;
-
 	if (!init) {
 		wdprintf(V_DEBUG, "mpg123", "Initializing.\n");
 		if (mpg123_init() != MPG123_OK)
@@ -170,9 +174,14 @@ static int mpg123_play_file(const char *mpeg_file)
 
 		wdprintf(V_INFO, "mpg123", "Opening %s...\n", mpeg_file);
 		trackinfo_clear(&ti);
-		id3_read_tag(mpeg_file, &ti, "MP3");
+		id3_read_tag(mpeg_file, &ti, "MP3", ID3_READ_ALL);
 		trackinfo_set_updated(&ti);
 		/*strncpy(ti->file_name, mpeg_file, SIZE_FILE_NAME-1);*/
+		strncpy(file_name, mpeg_file, PATH_LEN_MAX-1);
+		file_name[PATH_LEN_MAX-1] = '\0';
+		seekindex_free(seek_index);
+		seek_index = seekindex_load(file_name);
+		if (!seek_index) seekindex_request(file_name);
 
 		if (r) { /* Always use stream reader */
 			wdprintf(V_INFO, "mpg123", "Opening stream...\n");
@@ -237,6 +246,7 @@ static int mpg123_play_file(const char *mpeg_file)
 			mpg123_info(player, &mi);
 			sample_rate = mi.rate;
 			bitrate = 1000 * (mi.abr_rate ? mi.abr_rate : mi.bitrate);
+			if (seek_index) set_seek_index();
 			/*ti->samplerate = mi.rate;
 			ti->channels   = mi.mode == MPG123_M_MONO ? 1 : 2;
 			ti->bitrate    = 1000 * (mi.abr_rate ? mi.abr_rate : mi.bitrate);
@@ -260,15 +270,30 @@ static int mpg123_play_file(const char *mpeg_file)
 	return result;
 }
 
-static int mpg123_seek_to(int offset_seconds)
+static long seek_sample(long sample)
 {
-	int res = 0;
-	if (offset_seconds >= 0) {
-		seek_to_sample_offset = offset_seconds * sample_rate;
-		seek_request = 1;
-		res = 1;
+	off_t res = -1, offset;
+
+	if (sample >= 0 && reader_is_seekable(r)) {
+		/* The index might have been built in the meantime */
+		if (!seek_index && file_name[0] != '\0') set_seek_index();
+		wdprintf(V_DEBUG, "mpg123", "Seeking requested to sample %ld.\n", sample);
+		/* Returns the sample offset mpg123 will actually continue at */
+		res = mpg123_feedseek(player, sample, SEEK_SET, &offset);
+		if (res >= 0) {
+			wdprintf(V_DEBUG, "mpg123", "Seeking stream to file offset at %ld bytes.\n", (long)offset);
+			reader_seek(r, offset);
+		} else {
+			wdprintf(V_WARNING, "mpg123", "Seek error.\n");
+			res = -1;
+		}
 	}
-	return res;
+	return (long)res;
+}
+
+static int mpg123_seek_to(int offset_seconds)
+{
+	return offset_seconds >= 0 && seek_sample((long)offset_seconds * sample_rate) >= 0;
 }
 
 static int close_file(void)
@@ -278,6 +303,9 @@ static int close_file(void)
 	mpg123_delete(player);
 	mpg123_exit();
 	init = 0;
+	seekindex_free(seek_index);
+	seek_index = NULL;
+	file_name[0] = '\0';
 	return 0;
 }
 
@@ -298,6 +326,9 @@ static int get_current_bitrate(void)
 
 static int get_length(void)
 {
+	/* The scanned number of samples is exact, even for VBR files without a Xing header */
+	if (seek_index && seek_index->samplerate == sample_rate)
+		return seek_index->total_samples / sample_rate;
 	return mpg123_length(player) / sample_rate;
 }
 
@@ -381,7 +412,7 @@ static const char *get_mime_types(void)
 
 static int meta_data_load(const char *filename)
 {
-	return id3_read_tag(filename, &ti_metaonly, "MP3");
+	return id3_read_tag(filename, &ti_metaonly, "MP3", 0);
 }
 
 static int meta_data_close(void)
@@ -412,6 +443,17 @@ static int data_check_magic_bytes(const char *data, size_t size)
 	return id3 || sync;
 }
 
+static const GmuMagicPattern magic_patterns[] = {
+	{ 0, "ID3", 3, 0 },
+	{ 0, "\377", 1, -10 }, /* MPEG frame sync, confirmed by data_check_magic_bytes() */
+	{ 0, NULL, 0, 0 }
+};
+
+static const GmuMagicPattern *get_magic_patterns(void)
+{
+	return magic_patterns;
+}
+
 static void set_reader_handle(Reader *reader)
 {
 	r = reader;
@@ -443,7 +485,10 @@ static GmuDecoder gd = {
 	meta_data_get_charset,
 	data_check_magic_bytes,
 	set_reader_handle,
-	NULL
+	NULL,
+	seek_sample,
+	NULL,
+	get_magic_patterns
 };
 
 GmuDecoder *GMU_REGISTER_DECODER(void)
@@ -22,6 +22,7 @@
 #include "../util.h"
 #include "mpcdec/mpcdec.h"
 #include "../debug.h"
+#include "../pcmconv.h"
 
 typedef struct reader_data_t {
     FILE      *file;
@@ -73,17 +74,6 @@ static mpc_bool_t canseek_impl(void *data)
 
 #define WFX_SIZE (2+2+4+4+2+2)
 
-#ifdef MPC_FIXED_POINT
-static int shift_signed(MPC_SAMPLE_FORMAT val, int shift)
-{
-    if (shift > 0)
-        val <<= shift;
-    else if (shift < 0)
-        val >>= -shift;
-    return (int)val;
-}
-#endif
-
 static const char *get_name(void)
 {
 	return "Musepack decoder v0.9";
@@ -168,7 +158,6 @@ static int decode_data(char *target, size_t max_size)
 	unsigned          total_samples = 0;
 	mpc_bool_t        successful = FALSE;
 	MPC_SAMPLE_FORMAT sample_buffer[MPC_DECODER_BUFFER_LENGTH];
-	mpc_int16_t       pcmbuf[MPC_DECODER_BUFFER_LENGTH];
 	unsigned          status;
 
 	memset(sample_buffer, 0, sizeof(MPC_SAMPLE_FORMAT) * MPC_DECODER_BUFFER_LENGTH);
@@ -181,34 +170,17 @@ static int decode_data(char *target, size_t max_size)
 		successful = TRUE;
 		size = 0;
 	} else { /* status > 0 */
-		unsigned n;
-		int m_bps = 16; /* ? */
-		int clip_min = -1 << (m_bps - 1),
-			clip_max = (1 << (m_bps - 1)) - 1;
-#ifndef MPC_FIXED_POINT
-		int float_scale = 1 << (m_bps - 1);
-#endif
-		for (n = 0; n < MPC_DECODER_BUFFER_LENGTH; n++) {
-			int val;
+		size = status * channels * sizeof(mpc_int16_t);
+		if (max_size >= (size_t)size) {
 #ifdef MPC_FIXED_POINT
-			val = shift_signed(sample_buffer[n], m_bps - MPC_FIXED_POINT_SCALE_SHIFT);
+			pcmconv_s32_to_s16(target, sample_buffer, status * channels, MPC_FIXED_POINT_SCALE_SHIFT - 16);
 #else
-			val = (int)(sample_buffer[n] * float_scale);
+			pcmconv_float_to_s16(target, sample_buffer, status * channels);
 #endif
-			if (val < clip_min)
-				val = clip_min;
-			else if (val > clip_max)
-				val = clip_max;
-			pcmbuf[n] = val;
-		}
-
-		if (max_size > MPC_DECODER_BUFFER_LENGTH) {
-			memcpy(target, pcmbuf, MPC_DECODER_BUFFER_LENGTH);
 		} else {
-			wdprintf(V_ERROR, "musepack", "Target buffer too small: %d < %d\n", max_size, MPC_DECODER_BUFFER_LENGTH);
+			wdprintf(V_ERROR, "musepack", "Target buffer too small: %lu < %d\n", (unsigned long)max_size, size);
 			size = 0;
 		}
-
 		total_samples += status;
 		/*if (seek_to_sample_offset) {*/
 			/* do seeking */
@@ -230,6 +202,12 @@ static int seek(int second)
 	return 1;
 }
 
+static long seek_sample(long sample)
+{
+	if (sample < 0) sample = 0;
+	return mpc_decoder_seek_sample(&decoder, sample) ? sample : -1;
+}
+
 static int get_decoder_buffer_size(void)
 {
 	return MPC_DECODER_BUFFER_LENGTH;
@@ -366,7 +344,8 @@ static GmuDecoder gd = {
 	meta_data_get_charset,
 	NULL,
 	NULL,
-	NULL
+	NULL,
+	seek_sample
 };
 
 GmuDecoder *GMU_REGISTER_DECODER(void)
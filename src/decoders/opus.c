@@ -22,14 +22,45 @@
 #include "../util.h"
 #include "../reader.h"
 #include "../debug.h"
+#include "../consts.h"
+#include "../seekindex.h"
 
 static int          init = 0;
-static long         seek_to_sample_offset;
 static int          sample_rate, channels = 0, bitrate = 0;
 static TrackInfo    ti, ti_metaonly;
 static Reader      *r;
 static OggOpusFile *oof;
-static int          seek_request = 0;
+static SeekIndex   *seek_index;
+static char         file_name[PATH_LEN_MAX];
+
+/* Opus needs 80 ms of decoder pre-roll to converge after a seek */
+#define OPUS_PRE_ROLL 3840
+
+/* Jumps to the page listed in the seek index at least OPUS_PRE_ROLL samples
+ * before 'sample' and decodes up to the exact position. Returns 0 if there
+ * is no usable index, in which case op_pcm_seek() should be used. */
+static int seek_sample_indexed(long sample)
+{
+	SeekPoint   p;
+	ogg_int64_t pos;
+	opus_int16  buf[2048];
+
+	if (!seek_index && file_name[0] != '\0') seek_index = seekindex_load(file_name);
+	if (!seek_index || seek_index->type != SEEKINDEX_OGG || channels <= 0 ||
+	    !seekindex_lookup(seek_index, sample - OPUS_PRE_ROLL, &p) || op_raw_seek(oof, p.offset) != 0)
+		return 0;
+	while ((pos = op_pcm_tell(oof)) >= 0 && pos < sample) {
+		int n = (int)(sample - pos) * (channels > 1 ? 2 : 1);
+		int samples;
+		if (n > 2048) n = 2048;
+		if (channels > 1)
+			samples = op_read_stereo(oof, buf, n);
+		else
+			samples = op_read(oof, buf, n, NULL);
+		if (samples <= 0) return 0;
+	}
+	return pos == sample;
+}
 
 static const char *get_name(void)
 {
@@ -42,8 +73,8 @@ static int read_func(void *_stream, unsigned char *_ptr, int _nbytes)
 	int     res = -1;
 	Reader *r = (Reader *)_stream;
 	if (reader_read_bytes(r, _nbytes)) {
-		memcpy(_ptr, reader_get_buffer(r), _nbytes);
-		res = _nbytes;
+		res = reader_get_number_of_bytes_in_buffer(r);
+		memcpy(_ptr, reader_get_buffer(r), res);
 	}
 	return res;
 }
@@ -147,14 +178,6 @@ static int decode_data(char *target, size_t max_size)
 		if (read_tags(oof, li, tim)) trackinfo_set_updated(&ti);
 	}
 
-	if (seek_request && reader_is_seekable(r) && seek_to_sample_offset >= 0) {
-		wdprintf(V_DEBUG, "opus", "Seeking requested to sample %d.\n", seek_to_sample_offset);
-		if (op_pcm_seek(oof, seek_to_sample_offset) != 0)
-			wdprintf(V_WARNING, "opus", "Seeking failed.\n");
-		seek_to_sample_offset = 0;
-		seek_request = 0;
-	}
-
 	if (channels > 1)
 		samples = op_read_stereo(oof, (opus_int16 *)target, max_size / 2);
 	else if (channels == 1)
@@ -194,6 +217,11 @@ static int opus_play_file(const char *opus_file)
 			channels = op_channel_count(oof, -1);
 			bitrate  = op_bitrate(oof, -1);
 			sample_rate = 48000;
+			strncpy(file_name, opus_file, PATH_LEN_MAX-1);
+			file_name[PATH_LEN_MAX-1] = '\0';
+			seekindex_free(seek_index);
+			seek_index = seekindex_load(file_name);
+			if (!seek_index) seekindex_request(file_name);
 		}
 	} else {
 		wdprintf(V_WARNING, "opus", "Reader was unable to open stream/file.\n");
@@ -202,22 +230,33 @@ static int opus_play_file(const char *opus_file)
 	return result;
 }
 
-static int opus_seek_to(int offset_seconds)
+static long seek_sample(long sample)
 {
-	int res = 0;
-	if (offset_seconds >= 0) {
-		seek_to_sample_offset = offset_seconds * sample_rate;
-		seek_request = 1;
-		res = 1;
+	long res = -1;
+
+	if (sample >= 0 && reader_is_seekable(r)) {
+		wdprintf(V_DEBUG, "opus", "Seeking requested to sample %ld.\n", sample);
+		if (seek_sample_indexed(sample) || op_pcm_seek(oof, sample) == 0)
+			res = (long)op_pcm_tell(oof);
+		else
+			wdprintf(V_WARNING, "opus", "Seeking failed.\n");
 	}
 	return res;
 }
 
+static int opus_seek_to(int offset_seconds)
+{
+	return offset_seconds >= 0 && seek_sample((long)offset_seconds * sample_rate) >= 0;
+}
+
 static int close_file(void)
 {
 	wdprintf(V_DEBUG, "opus", "Closing file.\n");
 	op_free(oof);
 	init = 0;
+	seekindex_free(seek_index);
+	seek_index = NULL;
+	file_name[0] = '\0';
 	return 0;
 }
 
@@ -376,6 +415,16 @@ static int data_check_magic_bytes(const char *data, size_t size)
 	return res;
 }
 
+static const GmuMagicPattern magic_patterns[] = {
+	{ 28, "OpusHead", 8, 10 }, /* Identification header in the first Ogg page */
+	{ 0, NULL, 0, 0 }
+};
+
+static const GmuMagicPattern *get_magic_patterns(void)
+{
+	return magic_patterns;
+}
+
 static void set_reader_handle(Reader *reader)
 {
 	r = reader;
@@ -407,7 +456,10 @@ static GmuDecoder gd = {
 	meta_data_get_charset,
 	data_check_magic_bytes,
 	set_reader_handle,
-	NULL
+	NULL,
+	seek_sample,
+	NULL,
+	get_magic_patterns
 };
 
 GmuDecoder *GMU_REGISTER_DECODER(void)
@@ -54,7 +54,7 @@ static spx_int32_t      current_bitrate, bitrate;
 
 static const char *get_name(void)
 {
-	return "Speex decoder v0.1";
+	return "Speex decoder v0.2";
 }
 
 static void *header_process(ogg_packet *op, spx_int32_t enh_enabled, spx_int32_t *frame_size,
@@ -236,8 +236,8 @@ static int close_file(void)
 
 static int decode_data(char *target, size_t max_size)
 {
-	int size = 1;
-	int i, j;
+	int size = 1, pos = 0;
+	int j;
 
 	if (!eos) {
 		int osp = ogg_stream_packetout(&os, &op);
@@ -267,9 +267,13 @@ static int decode_data(char *target, size_t max_size)
 				/* Copy Ogg packet to Speex bitstream */
 				speex_bits_read_from(&bits, (char*)op.packet, op.bytes);
 				for (j = 0; j != nframes; j++) {
-					int ret;
+					int    ret;
+					int    frame_bytes = frame_size * channels * (int)sizeof(short);
+					/* Decode straight into the target buffer if the frame fits */
+					short *out = (pos + frame_bytes <= (int)max_size) ? (short *)(void *)(target + pos) : output;
+
 					/* Decode frame */
-					ret = speex_decode_int(st, &bits, output);
+					ret = speex_decode_int(st, &bits, out);
 
 					if (ret == -1) {
 						break;
@@ -283,7 +287,7 @@ static int decode_data(char *target, size_t max_size)
 						break;
 					}
 					if (channels == 2)
-						speex_decode_stereo_int(output, frame_size, &stereo);
+						speex_decode_stereo_int(out, frame_size, &stereo);
 
 					speex_decoder_ctl(st, SPEEX_GET_BITRATE, &current_bitrate);
 
@@ -305,10 +309,18 @@ static int decode_data(char *target, size_t max_size)
 						}
 
 						if (new_frame_size > 0) {
-							char *audio = (char *)output;
-							for (i = 0; i < frame_size * channels * 2 && i < max_size; i++)
-								target[i] = audio[i];
-							size = i;
+							if (out == output) {
+								/* Target is full, the rest of this frame gets lost */
+								int len = (int)max_size - pos;
+								if (len > frame_bytes) len = frame_bytes;
+								if (len > 0) {
+									memcpy(target + pos, output, len);
+									pos += len;
+								}
+							} else {
+								pos += frame_bytes;
+							}
+							size = pos > 0 ? pos : 1;
 							audio_size += sizeof(short) * new_frame_size * channels;
 						}
 					}
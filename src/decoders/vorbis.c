@@ -22,10 +22,14 @@
 #include "tremor/ivorbiscodec.h"
 #include "tremor/ivorbisfile.h"
 #include "../debug.h"
+#include "../consts.h"
+#include "../seekindex.h"
 
 static OggVorbis_File  vf, vf_metaonly;
 static vorbis_info    *vi;
 static Reader         *r;
+static SeekIndex      *seek_index;
+static char            file_name[PATH_LEN_MAX];
 
 static const char *get_name(void)
 {
@@ -40,10 +44,14 @@ static size_t read_callback(void *buffer, size_t size, size_t nmemb, void *datas
 	 * in the buffer already, otherwise we initiate a read operation with
 	 * the desired size.
 	 */
-	size_t bs = reader_get_number_of_bytes_in_buffer(r);
+	size_t      bs = reader_get_number_of_bytes_in_buffer(r);
+	const char *data = NULL;
 
 	if (bs <= 0) {
-		if (reader_read_bytes(r, size * nmemb)) {
+		/* Copy directly from the file mapping if possible */
+		if ((data = reader_peek(r, size * nmemb, &bs))) {
+			reader_seek_whence(r, bs, SEEK_CUR);
+		} else if (reader_read_bytes(r, size * nmemb)) {
 			bs = reader_get_number_of_bytes_in_buffer(r);
 		} else {
 			bs = 0;
@@ -51,9 +59,9 @@ static size_t read_callback(void *buffer, size_t size, size_t nmemb, void *datas
 	}
 
 	if (bs != 0 && !reader_is_eof(r)) {
-		memcpy(buffer, reader_get_buffer(r), bs);
+		memcpy(buffer, data ? data : reader_get_buffer(r), bs);
 		/* Clear the buffer, so we know that we have consumed the data: */
-		reader_clear_buffer(r);
+		if (!data) reader_clear_buffer(r);
 	} else {
 		bs = 0;
 		wdprintf(V_DEBUG, "vorbis", "read_callback(): End of stream!\n");
@@ -103,6 +111,11 @@ static int open_file(const char *filename)
 	} else {
 		vi  = ov_info(&vf, -1);
 		res = 1;
+		strncpy(file_name, filename, PATH_LEN_MAX-1);
+		file_name[PATH_LEN_MAX-1] = '\0';
+		seekindex_free(seek_index);
+		seek_index = seekindex_load(file_name);
+		if (!seek_index) seekindex_request(file_name);
 	}
 	return res;
 }
@@ -110,6 +123,9 @@ static int open_file(const char *filename)
 static int close_file(void)
 {
 	ov_clear(&vf);
+	seekindex_free(seek_index);
+	seek_index = NULL;
+	file_name[0] = '\0';
 	return 0;
 }
 
@@ -131,16 +147,49 @@ static int decode_data(char *target, size_t max_size)
 	return size;
 }
 
+/* Jumps to the page listed in the seek index right before 'sample' and
+ * decodes up to the exact position. Returns 0 if there is no usable index,
+ * in which case the caller should fall back to the bisection search. */
+static int seek_sample_indexed(long sample)
+{
+	SeekPoint   p;
+	ogg_int64_t pos;
+	char        buf[4096];
+	int         section;
+
+	if (!seek_index && file_name[0] != '\0') seek_index = seekindex_load(file_name);
+	if (!seek_index || seek_index->type != SEEKINDEX_OGG || seek_index->samplerate != vi->rate ||
+	    !seekindex_lookup(seek_index, sample, &p) || ov_raw_seek(&vf, p.offset) != 0)
+		return 0;
+	while ((pos = ov_pcm_tell(&vf)) < sample) {
+		long bytes = (long)(sample - pos) * vi->channels * 2;
+		if (bytes > (long)sizeof(buf)) bytes = sizeof(buf);
+		if (ov_read(&vf, buf, bytes, &section) <= 0) return 0;
+	}
+	return pos == sample;
+}
+
 static int seek(int seconds)
 {
 	int  unsuccessful = 1;
 	long pos = seconds * 1000;
 
 	if (pos <= 0) pos = 0;
+	if (seek_sample_indexed((long)seconds * vi->rate)) return 1;
 	unsuccessful = ov_time_seek_page(&vf, pos);
 	return !unsuccessful;
 }
 
+static long seek_sample(long sample)
+{
+	long res = -1;
+	if (sample > 0 && seek_sample_indexed(sample))
+		res = sample;
+	else if (ov_pcm_seek(&vf, sample > 0 ? sample : 0) == 0)
+		res = (long)ov_pcm_tell(&vf);
+	return res;
+}
+
 static int get_decoder_buffer_size(void)
 {
 	return 4096;
@@ -251,6 +300,16 @@ static GmuCharset meta_data_get_charset(void)
 	return M_CHARSET_UTF_8;
 }
 
+static const GmuMagicPattern magic_patterns[] = {
+	{ 28, "\001vorbis", 7, 10 }, /* Identification header in the first Ogg page */
+	{ 0, NULL, 0, 0 }
+};
+
+static const GmuMagicPattern *get_magic_patterns(void)
+{
+	return magic_patterns;
+}
+
 static void set_reader_handle(Reader *reader)
 {
 	r = reader;
@@ -282,7 +341,10 @@ static GmuDecoder gd = {
 	meta_data_get_charset,
 	NULL,
 	set_reader_handle,
-	NULL
+	NULL,
+	seek_sample,
+	NULL,
+	get_magic_patterns
 };
 
 GmuDecoder *GMU_REGISTER_DECODER(void)
@@ -0,0 +1,648 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: wav.c  Created: 210731
+ *
+ * Description: Uncompressed PCM decoder (WAV, AIFF/AIFC and raw PCM)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include "../gmudecoder.h"
+#include "../trackinfo.h"
+#include "../util.h"
+#include "../reader.h"
+#include "../debug.h"
+#include "../pcmconv.h"
+
+/* Output data per decode call (in bytes of 16 bit samples) */
+#define WAV_BUF_SIZE            32768
+/* Source data per decode call; large enough for 64 bit float samples */
+#define WAV_RAW_BUF_SIZE        (WAV_BUF_SIZE * 4)
+/* Larger metadata chunks are skipped */
+#define WAV_MAX_META_CHUNK_SIZE 65536
+#define WAV_META_SIZE           256
+
+#define WAVE_FORMAT_PCM        0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+typedef enum WavContainer { WAV_NONE, WAV_RIFF, WAV_AIFF, WAV_RAW } WavContainer;
+
+typedef struct WavFile {
+	Reader      *r;
+	size_t       buf_pos;    /* Bytes already consumed from the Reader's buffer */
+	long         offset;     /* Position in the file while parsing the header */
+	WavContainer container;
+	int          channels, samplerate;
+	int          bytes_per_sample, frame_size;
+	int          is_float, is_big_endian, is_unsigned;
+	long         data_start, data_size, pos; /* in bytes */
+	char         title[WAV_META_SIZE], artist[WAV_META_SIZE], album[WAV_META_SIZE];
+	char         comment[WAV_META_SIZE], date[WAV_META_SIZE], tracknr[WAV_META_SIZE];
+} WavFile;
+
+static WavFile       wf, wf_metaonly;
+static int16_t       out_buf[WAV_BUF_SIZE / 2];
+static unsigned char raw_buf[WAV_RAW_BUF_SIZE];
+static float         float_buf[WAV_BUF_SIZE / 2];
+
+/* The WAVE_FORMAT_EXTENSIBLE sub format GUIDs only differ in the first two bytes */
+static const unsigned char ksdataformat_guid_tail[14] = {
+	0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+};
+
+static const char *get_name(void)
+{
+	return "PCM decoder v1.0";
+}
+
+static int host_is_big_endian(void)
+{
+	const uint16_t x = 1;
+	return *(const unsigned char *)&x == 0;
+}
+
+static uint32_t get_u16(const unsigned char *p, int big_endian)
+{
+	return big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+static uint32_t get_u32(const unsigned char *p, int big_endian)
+{
+	return big_endian ? ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+	                  : ((uint32_t)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+/* Converts an 80 bit IEEE 754 extended precision number (as used for the
+ * AIFF sample rate) to an integer */
+static long extended_to_long(const unsigned char *p)
+{
+	int      exponent = ((p[0] & 0x7F) << 8) | p[1];
+	uint64_t mantissa = ((uint64_t)get_u32(p + 2, 1) << 32) | get_u32(p + 6, 1);
+	int      shift = 16383 + 63 - exponent;
+	long     res = 0;
+
+	if (p[0] & 0x80 || shift > 63) /* negative or less than one */
+		res = 0;
+	else if (shift >= 0)
+		res = (long)(mantissa >> shift);
+	return res;
+}
+
+/* Reads 'size' bytes, taking the data left in the Reader's buffer first.
+ * Returns the number of bytes read. */
+static size_t read_data(WavFile *w, void *target, size_t size)
+{
+	size_t n = 0;
+
+	while (n < size) {
+		size_t bs = reader_get_number_of_bytes_in_buffer(w->r);
+		size_t chunk;
+		if (w->buf_pos >= bs) {
+			reader_clear_buffer(w->r);
+			w->buf_pos = 0;
+			if (!reader_read_bytes(w->r, size - n)) break;
+			bs = reader_get_number_of_bytes_in_buffer(w->r);
+		}
+		chunk = bs - w->buf_pos < size - n ? bs - w->buf_pos : size - n;
+		memcpy((char *)target + n, reader_get_buffer(w->r) + w->buf_pos, chunk);
+		w->buf_pos += chunk;
+		n += chunk;
+	}
+	w->offset += n;
+	return n;
+}
+
+/* Skips 'size' bytes. Returns 1 on success, 0 otherwise. */
+static int skip_data(WavFile *w, long size)
+{
+	size_t bs = reader_get_number_of_bytes_in_buffer(w->r);
+	long   left = size;
+	int    res = 1;
+
+	if (w->buf_pos + size <= bs) {
+		w->buf_pos += size;
+		left = 0;
+	} else {
+		left -= bs - w->buf_pos;
+		reader_clear_buffer(w->r);
+		w->buf_pos = 0;
+	}
+	if (left > 0 && reader_is_seekable(w->r)) {
+		long file_size = reader_get_file_size(w->r);
+		res = (file_size <= 0 || w->offset + size <= file_size) &&
+		      reader_seek_whence(w->r, left, SEEK_CUR);
+	} else {
+		while (res && left > 0) {
+			res = reader_read_bytes(w->r, left < 4096 ? left : 4096);
+			left -= reader_get_number_of_bytes_in_buffer(w->r);
+			reader_clear_buffer(w->r);
+		}
+	}
+	if (res) w->offset += size;
+	return res;
+}
+
+static void set_meta(char *target, const char *data, size_t size)
+{
+	if (size > WAV_META_SIZE - 1) size = WAV_META_SIZE - 1;
+	memcpy(target, data, size);
+	target[size] = '\0';
+}
+
+/* Parses the sub chunks of a RIFF LIST/INFO chunk */
+static void parse_info_chunk(WavFile *w, const unsigned char *data, size_t size)
+{
+	size_t i = 4;
+
+	if (size < 4 || memcmp(data, "INFO", 4) != 0) return;
+	while (i + 8 <= size) {
+		const unsigned char *id = data + i;
+		size_t               len = get_u32(data + i + 4, w->is_big_endian);
+		const char          *value = (const char *)data + i + 8;
+
+		if (len > size - i - 8) break;
+		if (memcmp(id, "INAM", 4) == 0)
+			set_meta(w->title, value, len);
+		else if (memcmp(id, "IART", 4) == 0)
+			set_meta(w->artist, value, len);
+		else if (memcmp(id, "IPRD", 4) == 0)
+			set_meta(w->album, value, len);
+		else if (memcmp(id, "ICMT", 4) == 0)
+			set_meta(w->comment, value, len);
+		else if (memcmp(id, "ICRD", 4) == 0)
+			set_meta(w->date, value, len);
+		else if (memcmp(id, "ITRK", 4) == 0 || memcmp(id, "IPRT", 4) == 0)
+			set_meta(w->tracknr, value, len);
+		i += 8 + len + (len & 1);
+	}
+}
+
+static int parse_wav_format(WavFile *w, const unsigned char *fmt, size_t size)
+{
+	int format, block_align, res = 0;
+
+	if (size >= 16) {
+		format         = get_u16(fmt, w->is_big_endian);
+		w->channels    = get_u16(fmt + 2, w->is_big_endian);
+		w->samplerate  = get_u32(fmt + 4, w->is_big_endian);
+		block_align    = get_u16(fmt + 12, w->is_big_endian);
+		if (format == WAVE_FORMAT_EXTENSIBLE && size >= 40 &&
+		    memcmp(fmt + 26, ksdataformat_guid_tail, sizeof(ksdataformat_guid_tail)) == 0)
+			format = get_u16(fmt + 24, w->is_big_endian);
+		if (w->channels > 0) w->bytes_per_sample = block_align / w->channels;
+		w->is_float    = format == WAVE_FORMAT_IEEE_FLOAT;
+		w->is_unsigned = w->bytes_per_sample == 1;
+		if (format == WAVE_FORMAT_PCM || format == WAVE_FORMAT_IEEE_FLOAT)
+			res = 1;
+		else
+			wdprintf(V_WARNING, "wav", "Unsupported format: 0x%04x\n", format);
+	}
+	return res;
+}
+
+static int parse_aiff_format(WavFile *w, const unsigned char *comm, size_t size, int is_aifc)
+{
+	int res = 0;
+
+	if (size >= 18) {
+		w->channels         = get_u16(comm, 1);
+		w->bytes_per_sample = (get_u16(comm + 6, 1) + 7) / 8;
+		w->samplerate       = extended_to_long(comm + 8);
+		w->is_big_endian    = 1;
+		w->is_float         = 0;
+		w->is_unsigned      = 0;
+		res = 1;
+		if (is_aifc && size >= 22) {
+			if (memcmp(comm + 18, "sowt", 4) == 0) {
+				w->is_big_endian = 0;
+			} else if (memcmp(comm + 18, "fl32", 4) == 0 || memcmp(comm + 18, "FL32", 4) == 0) {
+				w->is_float = 1;
+				w->bytes_per_sample = 4;
+			} else if (memcmp(comm + 18, "fl64", 4) == 0 || memcmp(comm + 18, "FL64", 4) == 0) {
+				w->is_float = 1;
+				w->bytes_per_sample = 8;
+			} else if (memcmp(comm + 18, "NONE", 4) != 0 && memcmp(comm + 18, "twos", 4) != 0) {
+				wdprintf(V_WARNING, "wav", "Unsupported AIFC compression: %.4s\n", comm + 18);
+				res = 0;
+			}
+		}
+	}
+	return res;
+}
+
+/* Parses the file header up to the start of the audio data. With 'scan_all'
+ * set, the remaining chunks are checked for metadata as well, which needs a
+ * seekable stream. Returns 1 on success, 0 otherwise. */
+static int parse_header(WavFile *w, int scan_all)
+{
+	unsigned char hdr[12], fmt[64];
+	int           have_format = 0, have_data = 0, is_aifc = 0, be;
+	long          file_size = reader_get_file_size(w->r);
+
+	if (read_data(w, hdr, 12) != 12) return 0;
+	if ((memcmp(hdr, "RIFF", 4) == 0 || memcmp(hdr, "RIFX", 4) == 0) && memcmp(hdr + 8, "WAVE", 4) == 0) {
+		w->container = WAV_RIFF;
+		w->is_big_endian = hdr[3] == 'X';
+	} else if (memcmp(hdr, "FORM", 4) == 0 && (memcmp(hdr + 8, "AIFF", 4) == 0 || memcmp(hdr + 8, "AIFC", 4) == 0)) {
+		w->container = WAV_AIFF;
+		w->is_big_endian = 1;
+		is_aifc = hdr[11] == 'C';
+	} else {
+		wdprintf(V_WARNING, "wav", "Unknown file format.\n");
+		return 0;
+	}
+	be = w->is_big_endian; /* Byte order of the chunk headers, the samples may differ */
+
+	while (read_data(w, hdr, 8) == 8) {
+		long size = get_u32(hdr + 4, be);
+		long pad = size & 1;
+		int  ok = 1;
+
+		if (size < 0 && memcmp(hdr, "data", 4) != 0) break;
+		if (memcmp(hdr, "fmt ", 4) == 0 || memcmp(hdr, "COMM", 4) == 0) {
+			size_t n = size < (long)sizeof(fmt) ? (size_t)size : sizeof(fmt);
+			ok = read_data(w, fmt, n) == n && skip_data(w, size - n + pad);
+			if (ok && w->container == WAV_RIFF)
+				have_format = parse_wav_format(w, fmt, n);
+			else if (ok)
+				have_format = parse_aiff_format(w, fmt, n, is_aifc);
+			if (!have_format) break;
+		} else if (memcmp(hdr, "data", 4) == 0 || memcmp(hdr, "SSND", 4) == 0) {
+			if (hdr[0] == 'S') { /* Skip the offset/block size fields and the given offset */
+				unsigned char ssnd[8];
+				ok = read_data(w, ssnd, 8) == 8 && skip_data(w, get_u32(ssnd, 1));
+				size -= 8 + (ok ? get_u32(ssnd, 1) : 0);
+			}
+			w->data_start = w->offset;
+			w->data_size  = size;
+			/* Streamed files often come with a bogus data size */
+			if (file_size > 0 && (size <= 0 || w->data_start + size > file_size))
+				w->data_size = file_size - w->data_start;
+			else if (file_size <= 0 && (size <= 0 || (uint32_t)size == 0xFFFFFFFF))
+				w->data_size = LONG_MAX;
+			have_data = ok;
+			if (!scan_all || !ok || !skip_data(w, w->data_size + pad)) break;
+		} else if ((memcmp(hdr, "LIST", 4) == 0 || memcmp(hdr, "NAME", 4) == 0 ||
+		            memcmp(hdr, "AUTH", 4) == 0 || memcmp(hdr, "ANNO", 4) == 0) &&
+		           size <= WAV_MAX_META_CHUNK_SIZE) {
+			unsigned char *data = malloc(size + 1);
+			ok = data && read_data(w, data, size) == (size_t)size && skip_data(w, pad);
+			if (ok) {
+				if (hdr[0] == 'L')
+					parse_info_chunk(w, data, size);
+				else if (hdr[0] == 'N')
+					set_meta(w->title, (char *)data, size);
+				else if (hdr[1] == 'U')
+					set_meta(w->artist, (char *)data, size);
+				else
+					set_meta(w->comment, (char *)data, size);
+			}
+			free(data);
+		} else {
+			ok = skip_data(w, size + pad);
+		}
+		if (!ok || (have_data && !scan_all)) break;
+	}
+	if (have_format && (w->channels < 1 || w->channels > 8 || w->samplerate <= 0 ||
+	                    w->bytes_per_sample < 1 || w->bytes_per_sample > 4 + 4 * w->is_float ||
+	                    (w->is_float && w->bytes_per_sample != 4 && w->bytes_per_sample != 8))) {
+		wdprintf(V_WARNING, "wav", "Unsupported sample format: %d channels, %d bytes per sample%s, %d Hz\n",
+		         w->channels, w->bytes_per_sample, w->is_float ? " (float)" : "", w->samplerate);
+		have_format = 0;
+	}
+	w->frame_size = w->channels * w->bytes_per_sample;
+	return have_format && have_data;
+}
+
+static int open_file(const char *filename)
+{
+	const char *ext = get_file_extension(filename);
+	Reader     *r = wf.r;
+	int         res = 0;
+
+	memset(&wf, 0, sizeof(WavFile));
+	wf.r = r;
+	if (!r) {
+		wdprintf(V_WARNING, "wav", "Unable to open stream: %s\n", filename);
+		return 0;
+	}
+	/* Gmu might have read some bytes already to determine the file type */
+	if (reader_is_seekable(r)) reader_seek(r, 0);
+
+	if (ext && (strcasecmp(ext, "raw") == 0 || strcasecmp(ext, "pcm") == 0)) {
+		/* No header, assume CD audio: 44.1 kHz, 16 bit, stereo, little endian */
+		long file_size = reader_get_file_size(r);
+		wf.container        = WAV_RAW;
+		wf.channels         = 2;
+		wf.samplerate       = 44100;
+		wf.bytes_per_sample = 2;
+		wf.frame_size       = 4;
+		wf.data_size        = file_size > 0 ? file_size : LONG_MAX;
+		res = 1;
+	} else {
+		res = parse_header(&wf, reader_is_seekable(r));
+		if (res && reader_is_seekable(r) && !reader_seek(r, wf.data_start)) res = 0;
+		if (reader_is_seekable(r)) wf.buf_pos = 0;
+	}
+	if (res)
+		wdprintf(V_DEBUG, "wav", "%d channel(s), %d Hz, %d bit%s, %s endian, %ld bytes of audio data\n",
+		         wf.channels, wf.samplerate, wf.bytes_per_sample * 8, wf.is_float ? " float" : "",
+		         wf.is_big_endian ? "big" : "little", wf.data_size);
+	return res;
+}
+
+static int close_file(void)
+{
+	Reader *r = wf.r;
+	memset(&wf, 0, sizeof(WavFile));
+	wf.r = r;
+	return 0;
+}
+
+/* Converts 'samples' samples to native 16 bit samples */
+static void convert_samples(int16_t *target, const unsigned char *src, size_t samples)
+{
+	int    bps = wf.bytes_per_sample, be = wf.is_big_endian;
+	size_t i;
+
+	if (wf.is_float) {
+		for (i = 0; i < samples; i++, src += bps) {
+			if (bps == 4) {
+				uint32_t v = get_u32(src, be);
+				memcpy(float_buf + i, &v, 4);
+			} else {
+				uint64_t v = be ? ((uint64_t)get_u32(src, 1) << 32) | get_u32(src + 4, 1)
+				                : ((uint64_t)get_u32(src + 4, 0) << 32) | get_u32(src, 0);
+				double   d;
+				memcpy(&d, &v, 8);
+				float_buf[i] = (float)d;
+			}
+		}
+		pcmconv_float_to_s16(target, float_buf, samples);
+	} else if (bps == 1) {
+		pcmconv_8bit_to_s16(target, src, samples, wf.is_unsigned);
+	} else {
+		/* Keep the two most significant bytes */
+		int msb = be ? 0 : bps - 1, next = be ? 1 : bps - 2;
+		for (i = 0; i < samples; i++, src += bps)
+			target[i] = (int16_t)((src[msb] << 8) | src[next]);
+	}
+}
+
+/* Decodes up to 'max_size' bytes. If the samples can be used as is, they
+ * are not copied to 'target', instead '*data' is set to point to them in the
+ * file mapping or the Reader's buffer. Otherwise they are converted to
+ * 'target' and '*data' is set to 'target'. */
+static int decode(char *target, size_t max_size, const char **data)
+{
+	const unsigned char *src = NULL;
+	size_t               size, n = 0, frames;
+	long                 left = wf.data_size - wf.pos;
+	int                  passthrough;
+
+	if (max_size > WAV_BUF_SIZE) max_size = WAV_BUF_SIZE;
+	passthrough = wf.bytes_per_sample == 2 && !wf.is_float && wf.is_big_endian == host_is_big_endian();
+	frames = max_size / (wf.channels * 2);
+	if (frames > WAV_RAW_BUF_SIZE / wf.frame_size) frames = WAV_RAW_BUF_SIZE / wf.frame_size;
+	if ((long)frames > left / wf.frame_size) frames = left / wf.frame_size;
+	size = frames * wf.frame_size;
+	if (size == 0) return 0;
+
+	if (wf.buf_pos < reader_get_number_of_bytes_in_buffer(wf.r)) {
+		/* There is some data left in the Reader's buffer from parsing the header */
+		n = read_data(&wf, raw_buf, size);
+		src = raw_buf;
+	} else if ((src = (const unsigned char *)reader_peek(wf.r, size, &n))) {
+		reader_seek_whence(wf.r, n, SEEK_CUR);
+	} else if (reader_read_bytes(wf.r, size)) {
+		src = (const unsigned char *)reader_get_buffer(wf.r);
+		n = reader_get_number_of_bytes_in_buffer(wf.r);
+		wf.buf_pos = n;
+	}
+	frames = n / wf.frame_size; /* An incomplete frame can only occur at the end */
+	wf.pos += n;
+	if (frames > 0 && passthrough) {
+		*data = (const char *)src;
+	} else if (frames > 0) {
+		convert_samples((int16_t *)target, src, frames * wf.channels);
+		*data = target;
+	}
+	return frames * wf.channels * 2;
+}
+
+static int decode_data(char *target, size_t max_size)
+{
+	const char *data = target;
+	int         size = decode(target, max_size, &data);
+
+	if (size > 0 && data != target) memcpy(target, data, size);
+	return size;
+}
+
+static int decode_data_direct(const char **data, size_t max_size)
+{
+	if (max_size > sizeof(out_buf)) max_size = sizeof(out_buf);
+	return decode((char *)out_buf, max_size, data);
+}
+
+static long seek_sample(long sample)
+{
+	long frames = wf.data_size / wf.frame_size;
+
+	if (!reader_is_seekable(wf.r)) return -1;
+	if (sample < 0) sample = 0;
+	if (sample > frames) sample = frames;
+	if (!reader_seek(wf.r, wf.data_start + sample * wf.frame_size)) return -1;
+	wf.buf_pos = 0;
+	wf.pos = sample * wf.frame_size;
+	return sample;
+}
+
+static int seek(int seconds)
+{
+	return seek_sample((long)seconds * wf.samplerate) >= 0;
+}
+
+static int get_decoder_buffer_size(void)
+{
+	return WAV_BUF_SIZE;
+}
+
+static const char *get_file_extensions(void)
+{
+	return ".wav;.wave;.aif;.aiff;.aifc;.pcm;.raw";
+}
+
+static const char *get_mime_types(void)
+{
+	return "audio/wav;audio/x-wav;audio/wave;audio/vnd.wave;audio/aiff;audio/x-aiff";
+}
+
+static int get_current_bitrate(void)
+{
+	return wf.samplerate * wf.frame_size * 8;
+}
+
+static int get_length(void)
+{
+	return wf.samplerate > 0 && wf.data_size < LONG_MAX ? wf.data_size / wf.frame_size / wf.samplerate : 0;
+}
+
+static int get_samplerate(void)
+{
+	return wf.samplerate;
+}
+
+static int get_channels(void)
+{
+	return wf.channels;
+}
+
+static int get_bitrate(void)
+{
+	return wf.samplerate * wf.frame_size * 8;
+}
+
+static const char *get_meta_data(GmuMetaDataType gmdt, int for_current_file)
+{
+	WavFile    *w = for_current_file ? &wf : &wf_metaonly;
+	const char *result = NULL;
+
+	switch (gmdt) {
+		case GMU_META_ARTIST:
+			result = w->artist;
+			break;
+		case GMU_META_TITLE:
+			result = w->title;
+			break;
+		case GMU_META_ALBUM:
+			result = w->album;
+			break;
+		case GMU_META_TRACKNR:
+			result = w->tracknr;
+			break;
+		case GMU_META_DATE:
+			result = w->date;
+			break;
+		case GMU_META_COMMENT:
+			result = w->comment;
+			break;
+		default:
+			break;
+	}
+	return result && result[0] ? result : NULL;
+}
+
+static const char *get_file_type(void)
+{
+	const char *res = "PCM";
+
+	switch (wf.container) {
+		case WAV_RIFF:
+			res = "WAV";
+			break;
+		case WAV_AIFF:
+			res = "AIFF";
+			break;
+		default:
+			break;
+	}
+	return res;
+}
+
+static int meta_data_load(const char *filename)
+{
+	int res = 0;
+
+	memset(&wf_metaonly, 0, sizeof(WavFile));
+	if ((wf_metaonly.r = reader_open(filename))) {
+		res = parse_header(&wf_metaonly, reader_is_seekable(wf_metaonly.r));
+		reader_close(wf_metaonly.r);
+		wf_metaonly.r = NULL;
+	}
+	return res;
+}
+
+static int meta_data_close(void)
+{
+	return 1;
+}
+
+static GmuCharset meta_data_get_charset(void)
+{
+	return M_CHARSET_AUTODETECT;
+}
+
+static int data_check_magic_bytes(const char *data, size_t size)
+{
+	return size >= 12 &&
+	       (((memcmp(data, "RIFF", 4) == 0 || memcmp(data, "RIFX", 4) == 0) && memcmp(data + 8, "WAVE", 4) == 0) ||
+	        (memcmp(data, "FORM", 4) == 0 && (memcmp(data + 8, "AIFF", 4) == 0 || memcmp(data + 8, "AIFC", 4) == 0)));
+}
+
+static const GmuMagicPattern magic_patterns[] = {
+	{ 0, "RIFF", 4, 0 },
+	{ 0, "RIFX", 4, 0 },
+	{ 0, "FORM", 4, 0 },
+	{ 0, NULL, 0, 0 }
+};
+
+static const GmuMagicPattern *get_magic_patterns(void)
+{
+	return magic_patterns;
+}
+
+static void set_reader_handle(Reader *reader)
+{
+	wf.r = reader;
+}
+
+static GmuDecoder gd = {
+	"wav_decoder",
+	NULL,
+	NULL,
+	get_name,
+	NULL,
+	get_file_extensions,
+	get_mime_types,
+	open_file,
+	close_file,
+	decode_data,
+	seek,
+	get_current_bitrate,
+	get_meta_data,
+	NULL,
+	get_samplerate,
+	get_channels,
+	get_length,
+	get_bitrate,
+	get_file_type,
+	get_decoder_buffer_size,
+	meta_data_load,
+	meta_data_close,
+	meta_data_get_charset,
+	data_check_magic_bytes,
+	set_reader_handle,
+	NULL,
+	seek_sample,
+	decode_data_direct,
+	get_magic_patterns
+};
+
+GmuDecoder *GMU_REGISTER_DECODER(void)
+{
+	return &gd;
+}
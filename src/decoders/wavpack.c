@@ -21,51 +21,18 @@
 #include "../trackinfo.h"
 #include "../util.h"
 #include "../debug.h"
+#include "../pcmconv.h"
 
-static int32_t         temp_buffer[256];
+#define TEMP_BUFFER_SAMPLES 4096
+
+static int32_t         temp_buffer[TEMP_BUFFER_SAMPLES];
 static WavpackContext *wpc;
 static long            total_unpacked_samples;
 static int             get_channels(void);
-typedef unsigned char  uchar;
-
-static uchar *format_samples(int bps, uchar *dst, int32_t *src, uint32_t samcnt)
-{
-    int32_t temp;
-
-    switch (bps) {
-        case 1:
-            while (samcnt--)
-                *dst++ = *src++ + 128;
-            break;
-        case 2:
-            while (samcnt--) {
-                *dst++ = (uchar)(temp = *src++);
-                *dst++ = (uchar)(temp >> 8);
-            }
-            break;
-        case 3:
-            while (samcnt--) {
-                *dst++ = (uchar)(temp = *src++);
-                *dst++ = (uchar)(temp >> 8);
-                *dst++ = (uchar)(temp >> 16);
-            }
-            break;
-        case 4:
-            while (samcnt--) {
-                *dst++ = (uchar)(temp = *src++);
-                *dst++ = (uchar)(temp >> 8);
-                *dst++ = (uchar)(temp >> 16);
-                *dst++ = (uchar)(temp >> 24);
-            }
-            break;
-    }
-
-    return dst;
-}
 
 static const char *get_name(void)
 {
-	return "WavPack decoder v0.3";
+	return "WavPack decoder v0.4";
 }
 
 static int open_file(const char *filename)
@@ -88,20 +55,25 @@ static int close_file(void)
 
 static int decode_data(char *target, size_t max_size)
 {
-	int      bps, channels;
+	int      channels, frames;
 	uint32_t samples_unpacked = 0;
 
 	channels = get_channels();
-	bps = WavpackGetBytesPerSample(wpc);
-	if (max_size >= 1024) {
-		samples_unpacked = WavpackUnpackSamples(wpc, temp_buffer, 256 / channels);
+	/* WavPack delivers 32 bit samples, which get converted to 16 bit
+	 * directly into the target buffer */
+	frames = max_size / (channels * 2);
+	if (frames > TEMP_BUFFER_SAMPLES / channels)
+		frames = TEMP_BUFFER_SAMPLES / channels;
+	if (frames > 0) {
+		samples_unpacked = WavpackUnpackSamples(wpc, temp_buffer, frames);
 		total_unpacked_samples += samples_unpacked;
 		if (samples_unpacked)
-            format_samples(bps, (uchar *)target, temp_buffer, samples_unpacked * channels);
+			pcmconv_s32_to_s16(target, temp_buffer, samples_unpacked * channels,
+			                   WavpackGetBytesPerSample(wpc) * 8 - 16);
 	} else {
-		wdprintf(V_ERROR, "wavpack", "Target buffer too small: %d < 1024\n", max_size);
+		wdprintf(V_ERROR, "wavpack", "Target buffer too small: %lu bytes\n", (unsigned long)max_size);
 	}
-	return samples_unpacked * (WavpackGetBitsPerSample(wpc) / 4);
+	return samples_unpacked * channels * 2;
 }
 
 static int seek(int seconds)
@@ -0,0 +1,107 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: filecache.c  Created: 211019
+ *
+ * Description: Size limit for on-disk caches (seek indexes, thumbnails)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utime.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "filecache.h"
+#include "consts.h"
+#include "debug.h"
+
+/* Cache files are marked as used at most this often */
+#define FILECACHE_TOUCH_SECS (24 * 60 * 60)
+
+typedef struct CacheEntry
+{
+	char      name[64];
+	time_t    last_used;
+	long long size;
+} CacheEntry;
+
+static int compare_cache_entries(const void *a, const void *b)
+{
+	const CacheEntry *ea = a, *eb = b;
+	return ea->last_used < eb->last_used ? -1 : (ea->last_used > eb->last_used ? 1 : 0);
+}
+
+int filecache_has_extension(const char *name, const char *extension)
+{
+	size_t len = strlen(name), ext_len = strlen(extension);
+	return len > ext_len && strcmp(name + len - ext_len, extension) == 0;
+}
+
+long long filecache_prune(const char *dir_name, long long max_size,
+                          int (*is_valid)(const char *file, const char *name),
+                          int (*abort_cb)(void))
+{
+	DIR           *dir = dir_name ? opendir(dir_name) : NULL;
+	struct dirent *de;
+	CacheEntry    *entries = NULL;
+	size_t         count = 0, allocated = 0, i;
+	long long      total = 0;
+	int            removed = 0;
+
+	while (dir && (de = readdir(dir)) && !(abort_cb && abort_cb())) {
+		char        file[PATH_LEN_MAX];
+		struct stat st;
+		size_t      len = strlen(de->d_name);
+
+		if (de->d_name[0] == '.' || len >= sizeof(entries->name)) continue;
+		snprintf(file, sizeof(file), "%s/%s", dir_name, de->d_name);
+		if (stat(file, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+		if (is_valid && !is_valid(file, de->d_name)) {
+			if (remove(file) == 0) removed++;
+			continue;
+		}
+		if (count == allocated) {
+			CacheEntry *tmp = realloc(entries, (allocated + 256) * sizeof(CacheEntry));
+			if (!tmp) break;
+			entries = tmp;
+			allocated += 256;
+		}
+		memcpy(entries[count].name, de->d_name, len + 1);
+		entries[count].last_used = st.st_mtime;
+		entries[count].size = (long long)st.st_size;
+		total += entries[count].size;
+		count++;
+	}
+	if (dir) closedir(dir);
+	if (total > max_size) {
+		qsort(entries, count, sizeof(CacheEntry), compare_cache_entries);
+		for (i = 0; i < count && total > max_size / 4 * 3; i++) {
+			char file[PATH_LEN_MAX];
+			snprintf(file, sizeof(file), "%s/%s", dir_name, entries[i].name);
+			if (remove(file) == 0) {
+				total -= entries[i].size;
+				removed++;
+			}
+		}
+	}
+	if (removed > 0) wdprintf(V_DEBUG, "filecache", "Removed %d files from %s.\n", removed, dir_name);
+	free(entries);
+	return total;
+}
+
+void filecache_touch(const char *file)
+{
+	struct stat st;
+
+	if (stat(file, &st) == 0 && time(NULL) - st.st_mtime > FILECACHE_TOUCH_SECS)
+		utime(file, NULL);
+}
@@ -0,0 +1,37 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: filecache.h  Created: 211019
+ *
+ * Description: Size limit for on-disk caches (seek indexes, thumbnails)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#ifndef _FILECACHE_H
+#define _FILECACHE_H
+
+/* Default size limit of a cache directory in bytes */
+#define FILECACHE_MAX_SIZE (8 * 1024 * 1024)
+
+/* Removes the files of the cache directory 'dir_name' that are not valid
+ * anymore, and the least recently used ones if the cache is larger than
+ * 'max_size' bytes, until it is down to three quarters of that size.
+ * 'is_valid' (may be NULL) decides which files are kept; it gets the full
+ * path and the name of each file. The cleanup is stopped early when
+ * 'abort_cb' (may be NULL) returns a non-zero value. Returns the size of
+ * the remaining cache files in bytes. */
+long long filecache_prune(const char *dir_name, long long max_size,
+                          int (*is_valid)(const char *file, const char *name),
+                          int (*abort_cb)(void));
+/* Marks the cache file 'file' as recently used; To save writes, this is
+ * only done if it has not been marked within the last day */
+void      filecache_touch(const char *file);
+/* Returns 1 if 'name' ends with 'extension' (e.g. ".idx") */
+int       filecache_has_extension(const char *name, const char *extension);
+#endif
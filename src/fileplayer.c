@@ -17,7 +17,6 @@
 #include <string.h>
 #include <stdlib.h>
 #include <pthread.h>
-#include <unistd.h>
 #include "fileplayer.h"
 #include "audio.h"
 #include "trackinfo.h"
@@ -33,11 +32,47 @@
 #include "eventqueue.h"
 #include "gmuerror.h"
 #include "pthread_helper.h"
+#include "cpufreq.h"
 
 #define BUF_SIZE 65536
+/* Waiting for a network stream's buffer to fill up is given up after this
+ * time (in ms) without any progress */
+#define STREAM_STALL_TIMEOUT_MS 10000
+/* Amount of data that should be available in a network stream's cache for
+ * the decoder to run without blocking */
+#define STREAM_READ_RESERVE     8192
+
+typedef enum FilePlayerCommandType {
+	FP_CMD_NEXT_FILE, FP_CMD_STOP, FP_CMD_SEEK, FP_CMD_PAUSE, FP_CMD_PLAY, FP_CMD_QUIT
+} FilePlayerCommandType;
+
+typedef struct _FilePlayerCommand FilePlayerCommand;
+
+struct _FilePlayerCommand
+{
+	FilePlayerCommand    *next;
+	FilePlayerCommandType type;
+	char                 *filename; /* FP_CMD_NEXT_FILE only */
+	long                  param;    /* FP_CMD_SEEK: Target position in seconds */
+};
+
+/**
+ * Command queue for the decoder thread. Commands are pushed by the
+ * file_player_*() functions and processed by the decoder thread, which
+ * sleeps on cmd_cond while it has nothing to do.
+ */
+static FilePlayerCommand *cmd_first, *cmd_last;
+static pthread_mutex_t    cmd_mutex;
+static pthread_cond_t     cmd_cond;
+
+/**
+ * State owned by the decoder thread. It is only ever modified by the
+ * thread itself while processing commands, so no locking is needed.
+ */
+static char              *next_file;
+static long               seek_ms = -1;
 
 static char            lyrics_file_pattern[256];
-static long            seek_second;
 
 static int             file_player_shut_down = 0;
 static pthread_mutex_t shut_down_mutex;
@@ -62,13 +97,8 @@ static pthread_mutex_t   item_status_mutex;
  */
 static PB_Status_Request user_pb_request = PBRQ_NONE;
 
-static char             *file = NULL;
-static pthread_mutex_t   file_mutex;
-
 static TrackInfo        *ti;
 
-static pthread_mutex_t   mutex;
-
 static int               dev_close_asap; /* When true, the device isn't kept open, but closed ASAP */
 
 static void set_item_status(PB_Status status)
@@ -144,6 +174,95 @@ PB_Status file_player_get_item_status(void)
 static void *decode_audio_thread(void *udata);
 static pthread_t thread;
 
+static int push_command(FilePlayerCommandType type, const char *filename, long param)
+{
+	FilePlayerCommand *cmd = malloc(sizeof(FilePlayerCommand));
+	int                res = 0;
+
+	if (cmd) {
+		cmd->next     = NULL;
+		cmd->type     = type;
+		cmd->param    = param;
+		cmd->filename = filename ? strdup(filename) : NULL;
+		pthread_mutex_lock(&cmd_mutex);
+		if (cmd_last)
+			cmd_last->next = cmd;
+		else
+			cmd_first = cmd;
+		cmd_last = cmd;
+		pthread_cond_signal(&cmd_cond);
+		pthread_mutex_unlock(&cmd_mutex);
+		res = 1;
+	} else {
+		wdprintf(V_ERROR, "fileplayer", "ERROR: malloc() failed!\n");
+	}
+	return res;
+}
+
+static void free_commands(FilePlayerCommand *cmd)
+{
+	while (cmd) {
+		FilePlayerCommand *next = cmd->next;
+		if (cmd->filename) free(cmd->filename);
+		free(cmd);
+		cmd = next;
+	}
+}
+
+/**
+ * Waits up to 'timeout_ms' milliseconds for new commands (forever when
+ * negative, not at all when 0) and applies all queued commands to the
+ * decoder thread's state. To be called by the decoder thread only.
+ * Returns the number of commands processed.
+ */
+static int process_commands(int timeout_ms)
+{
+	FilePlayerCommand *cmd, *first;
+	int                n = 0;
+
+	pthread_mutex_lock(&cmd_mutex);
+	if (!cmd_first && timeout_ms < 0) {
+		pthread_cond_wait(&cmd_cond, &cmd_mutex);
+	} else if (!cmd_first && timeout_ms > 0) {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_sec  += timeout_ms / 1000;
+		ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&cmd_cond, &cmd_mutex, &ts);
+	}
+	first = cmd_first;
+	cmd_first = cmd_last = NULL;
+	pthread_mutex_unlock(&cmd_mutex);
+
+	for (cmd = first; cmd; cmd = cmd->next, n++) {
+		switch (cmd->type) {
+			case FP_CMD_NEXT_FILE:
+				if (next_file) free(next_file);
+				next_file = cmd->filename;
+				cmd->filename = NULL;
+				wdprintf(V_DEBUG, "fileplayer", "Next file: %s\n", next_file);
+				break;
+			case FP_CMD_STOP:
+				if (next_file) free(next_file);
+				next_file = NULL;
+				break;
+			case FP_CMD_SEEK:
+				seek_ms = cmd->param;
+				break;
+			case FP_CMD_PAUSE: /* Pause state is handled by the audio module, */
+			case FP_CMD_PLAY:  /* we only need to wake up the thread */
+			case FP_CMD_QUIT:
+				break;
+		}
+	}
+	free_commands(first);
+	return n;
+}
+
 void file_player_shutdown(void)
 {
 	wdprintf(V_DEBUG, "fileplayer", "Initiating shutdown.\n");
@@ -151,53 +270,33 @@ void file_player_shutdown(void)
 	pthread_mutex_lock(&shut_down_mutex);
 	file_player_shut_down = 1;
 	pthread_mutex_unlock(&shut_down_mutex);
-	file_player_set_filename(NULL);
-	file_player_start_playback(); /* Release waiting lock in thread */
+	push_command(FP_CMD_QUIT, NULL, 0);
 	pthread_join(thread, NULL);
-	if (file) free(file);
+	free_commands(cmd_first);
+	cmd_first = cmd_last = NULL;
+	if (next_file) free(next_file);
+	next_file = NULL;
 	pthread_mutex_destroy(&item_status_mutex);
 	pthread_mutex_destroy(&shut_down_mutex);
-	pthread_mutex_destroy(&file_mutex);
-	pthread_mutex_destroy(&mutex);
+	pthread_mutex_destroy(&cmd_mutex);
+	pthread_cond_destroy(&cmd_cond);
 	wdprintf(V_DEBUG, "fileplayer", "Shutdown complete.\n");
 }
 
-static int locked = 0;
-
-void file_player_set_filename(char *filename)
-{
-	if (!locked) pthread_mutex_lock(&mutex);
-	locked = 1;
-	pthread_mutex_lock(&file_mutex);
-	if (filename) {
-		int len = strlen(filename);
-		if (len > 0) {
-			file = realloc(file, len+1);
-			if (file) {
-				memcpy(file, filename, len+1);
-				wdprintf(V_DEBUG, "fileplayer", "Filename set: %s\n", file);
-			}
-		}
-	}
-	pthread_mutex_unlock(&file_mutex);
-}
-
-void file_player_start_playback(void)
-{
-	pthread_mutex_unlock(&mutex);
-	locked = 0;
-}
-
 int file_player_init(TrackInfo *ti_ref, int device_close_asap)
 {
-	pthread_mutex_init(&mutex, NULL);
-	pthread_mutex_init(&file_mutex, NULL);
+	pthread_condattr_t attr;
+
+	pthread_mutex_init(&cmd_mutex, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&cmd_cond, &attr);
+	pthread_condattr_destroy(&attr);
 	pthread_mutex_init(&shut_down_mutex, NULL);
 	pthread_mutex_init(&item_status_mutex, NULL);
-	file_player_set_filename(NULL);
 	ti = ti_ref;
-	pthread_create_with_stack_size(&thread, DEFAULT_THREAD_STACK_SIZE, decode_audio_thread, NULL);
 	dev_close_asap = device_close_asap;
+	pthread_create_with_stack_size(&thread, DEFAULT_THREAD_STACK_SIZE, decode_audio_thread, NULL);
 	return 0;
 }
 
@@ -205,9 +304,78 @@ void file_player_stop_playback(void)
 {
 	set_item_status(STOPPED);
 	wdprintf(V_INFO, "fileplayer", "Stop playback!\n");
-	file_player_set_filename(NULL);
+	push_command(FP_CMD_STOP, NULL, 0);
+}
+
+/**
+ * Returns the time (in ms) it takes the audio device to play 'bytes'
+ * bytes of audio data, or -1 when playback is paused and the decoder
+ * thread should wait for a command instead.
+ */
+static int wait_time_for_bytes(size_t bytes, int bytes_per_second)
+{
+	int res = 50;
+
+	if (audio_get_pause())
+		res = -1;
+	else if (audio_get_status() == SDL_AUDIO_PLAYING && bytes_per_second > 0)
+		res = (int)((long long)bytes * 1000 / bytes_per_second) + 1;
+	return res;
+}
+
+/**
+ * Waits until the reader has buffered enough data to (re)start playback of
+ * a network stream. If the stream stalls, playback continues with whatever
+ * data is available. Returns 1 if playback can continue, 0 otherwise.
+ */
+static int wait_for_stream_buffer(Reader *r)
+{
+	int stall_ms = 0, prev_buf_fill = -1;
+
+	while (!reader_is_ready(r) && !reader_is_eof(r) && get_item_status() == PLAYING &&
+	       stall_ms < STREAM_STALL_TIMEOUT_MS) {
+		int buf_fill = reader_get_cache_fill(r);
+		if (prev_buf_fill != buf_fill) {
+			prev_buf_fill = buf_fill;
+			stall_ms = 0;
+		} else {
+			stall_ms += 200;
+		}
+		process_commands(200);
+	}
+	if (stall_ms >= STREAM_STALL_TIMEOUT_MS)
+		wdprintf(V_WARNING, "fileplayer", "Network stream stalled.\n");
+	return get_item_status() == PLAYING && reader_get_cache_fill(r) > 0;
 }
 
+/* Waits for the reader to refill its jitter buffer */
+static int rebuffer_stream(Reader *r)
+{
+	reader_rebuffer(r);
+	return wait_for_stream_buffer(r);
+}
+
+/**
+ * Handles a buffer underrun while playing a network stream: Instead of
+ * playing silence, the audio output is paused until the reader has
+ * refilled its jitter buffer. Output is resumed by the decoder loop once
+ * the audio buffer has been filled again.
+ */
+static void recover_from_underrun(Reader *r, int count)
+{
+	struct timespec t_start, t_end;
+	long            duration_ms;
+
+	wdprintf(V_INFO, "fileplayer", "Buffer underrun #%d. Rebuffering...\n", count);
+	event_queue_push_with_parameter(gmu_core_get_event_queue(), GMU_BUFFER_UNDERRUN, count);
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	audio_force_pause(1);
+	rebuffer_stream(r);
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	duration_ms = (t_end.tv_sec - t_start.tv_sec) * 1000 + (t_end.tv_nsec - t_start.tv_nsec) / 1000000;
+	wdprintf(V_INFO, "fileplayer", "Rebuffering done after %ld ms.\n", duration_ms);
+	event_queue_push_with_parameter(gmu_core_get_event_queue(), GMU_BUFFER_UNDERRUN_RECOVERED, (int)duration_ms);
+}
 
 /* Return 1 when new meta data differs from previous data, 0 otherwise */
 static int update_metadata(GmuDecoder *gd, TrackInfo *ti, GmuCharset charset)
@@ -278,36 +446,21 @@ static void *decode_audio_thread(void *udata)
 	GmuCharset  charset = M_CHARSET_AUTODETECT;
 
 	wdprintf(V_INFO, "fileplayer", "File player thread initialized.\n");
-	seek_second = -1;
 	while (!file_player_check_shutdown()) {
 		char *filename = NULL;
-		int   len = 0, set_playing = 0;
+		int   bytes_per_second = 0, underruns = 0;
 
-		pthread_mutex_lock(&mutex);  /* Wait for playback to be started */
-		pthread_mutex_unlock(&mutex);
+		/* Sleep until there is something to play */
+		while (!next_file && !file_player_check_shutdown())
+			process_commands(-1);
+		filename  = next_file;
+		next_file = NULL;
 		wdprintf(V_DEBUG, "fileplayer", "decode_audio_thread(): Playback has been requested...\n");
 
-		pthread_mutex_lock(&file_mutex);
-		if (file) len = strlen(file);
-		if (len > 0) {
-			filename = malloc(len+1);
-			if (filename) {
-				strncpy(filename, file, len);
-				filename[len] = '\0';
-				set_playing = 1; /* Since the global file pointer points to a filename, we want play that file */
-				wdprintf(V_DEBUG, "fileplayer", "Preparing playback of: %s\n", filename);
-			} else {
-				wdprintf(V_ERROR, "fileplayer", "ERROR: malloc() failed!\n");
-			}
-			free(file); file = NULL; /* Clear the global file pointer/memory */
-		} else {
-			wdprintf(V_WARNING, "fileplayer", "WARNING: Zero length filename detected!\n");
-		}
-		pthread_mutex_unlock(&file_mutex);
-		if (set_playing)
+		if (filename) {
+			wdprintf(V_DEBUG, "fileplayer", "Preparing playback of: %s\n", filename);
 			set_item_status(PLAYING);
-		else
-			wdprintf(V_WARNING, "fileplayer", "Uh, no proper filename set. Not starting playback!\n");
+		}
 		r = NULL;
 		if (!file_player_check_shutdown() && filename && get_item_status() == PLAYING) {
 			const char *tmp = get_file_extension(filename);
@@ -362,12 +515,15 @@ static void *decode_audio_thread(void *udata)
 							ti->channels   = (*gd->get_channels)();
 						if (*gd->get_bitrate)
 							ti->bitrate    = (*gd->get_bitrate)();
+						if (r && ti->bitrate > 0)
+							reader_set_bitrate(r, ti->bitrate);
 						if (*gd->get_length)
 							ti->length     = (*gd->get_length)();
 						if (*gd->get_file_type)
 							strncpy_charset_conv(ti->file_type, (*gd->get_file_type)(),
 												 SIZE_FILE_TYPE-1, 0, charset);
 						channels = ti->channels;
+						bytes_per_second = ti->samplerate * ti->channels * 2;
 						trackinfo_release_lock(ti);
 					}
 
@@ -404,22 +560,11 @@ static void *decode_audio_thread(void *udata)
 						if (get_pb_request() == PBRQ_PLAY) audio_set_pause(0);
 
 						if (r && !reader_is_ready(r)) {
-							int check_count = 20, prev_buf_fill = 0;
-							/* Wait for the reader to pre-buffer the requested amount of data (if necessary) */
+							/* Wait for the reader to pre-buffer the required amount of data (if necessary) */
 							wdprintf(V_DEBUG, "fileplayer", "Prebuffering...\n");
 							event_queue_push(gmu_core_get_event_queue(), GMU_BUFFERING);
-							while (r && !reader_is_ready(r) && !reader_is_eof(r) && get_item_status() == PLAYING && check_count > 0) {
-								int buf_fill = reader_get_cache_fill(r);
-								if (prev_buf_fill != buf_fill) {
-									prev_buf_fill = buf_fill;
-									check_count = 20;
-								} else {
-									check_count--;
-								}
-								SDL_Delay(200);
-							}
-							if (check_count <= 0) {
-								set_item_status(FINISHED);
+							if (!wait_for_stream_buffer(r)) {
+								if (get_item_status() == PLAYING) set_item_status(FINISHED);
 								wdprintf(V_DEBUG, "fileplayer", "Prebuffering failed.\n");
 								event_queue_push(gmu_core_get_event_queue(), GMU_BUFFERING_FAILED);
 							} else {
@@ -433,23 +578,70 @@ static void *decode_audio_thread(void *udata)
 							|| (item_status != STOPPED && audio_buffer_get_fill() > 0) )
 							&& !file_player_check_shutdown()
 						) {
-							int size = 0, br = 0;
+							int             size = 0, br = 0;
+							const char     *out = pcmout;
+							struct timespec cpu_start, cpu_end;
 
-							if (seek_second >= 0) {
+							process_commands(0);
+							if (seek_ms >= 0) {
 								if (get_item_status() == PLAYING && (!gd->set_reader_handle || reader_is_seekable(r))) {
-									if (*gd->seek && (*gd->seek)(seek_second))
-										audio_set_sample_counter(seek_second * ti->samplerate);
+									long landed = -1;
+									if (gd->seek_sample) {
+										landed = (*gd->seek_sample)((long)((long long)seek_ms * ti->samplerate / 1000));
+									} else if (*gd->seek && (*gd->seek)(seek_ms / 1000)) {
+										landed = seek_ms / 1000 * ti->samplerate;
+									}
+									/* Drop the stale data and report the landed position to the clock */
+									if (landed >= 0) audio_buffer_flush(landed);
+								} else if (get_item_status() == PLAYING && r && reader_has_timeshift(r) && bytes_per_second > 0) {
+									/* Live stream: Move within the timeshift cache, assuming a constant bitrate */
+									long bitrate = ti->recent_bitrate > 0 ? ti->recent_bitrate : ti->bitrate;
+									if (bitrate > 0) {
+										long now_ms = audio_get_playtime_ms() +
+										              (long)((long long)audio_buffer_get_fill() * 1000 / bytes_per_second);
+										long offset = (long)((long long)(seek_ms - now_ms) * bitrate / 8000);
+										offset = reader_timeshift_move(r, offset);
+										if (offset != 0)
+											audio_buffer_flush((long)((now_ms + (long long)offset * 8000 / bitrate) *
+											                          ti->samplerate / 1000));
+									}
 								}
-								seek_second = -1;
+								seek_ms = -1;
+							}
+							if (r && get_item_status() == PLAYING && reader_is_network_stream(r) &&
+							    reader_get_cache_fill(r) < STREAM_READ_RESERVE && !reader_is_eof(r)) {
+								/* Wait for the network instead of blocking in the decoder while there
+								 * is enough audio data left, otherwise pause until the stream recovers */
+								if (audio_get_pause())
+									process_commands(-1);
+								else if (audio_get_status() == SDL_AUDIO_PLAYING &&
+								         audio_buffer_get_fill() > (size_t)bytes_per_second / 4)
+									process_commands(50);
+								else if (audio_get_status() == SDL_AUDIO_PLAYING)
+									recover_from_underrun(r, ++underruns);
+								else if (!rebuffer_stream(r)) /* Output not started yet */
+									break;
+								continue;
 							}
 							if (audio_fade_out_in_progress()) {
 								if (audio_fade_out_step(15)) set_item_status(STOPPED);
 							}
+							clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
 							while (ret > 0 && size < BUF_SIZE / 2 && item_status != STOPPED) {
+								if (gd->decode_data_direct) { /* Use the decoder's data without copying it to pcmout */
+									ret = (*gd->decode_data_direct)(&out, BUF_SIZE / 2);
+									if (ret > 0) size = ret;
+									break;
+								}
 								ret = (*gd->decode_data)(pcmout+size, BUF_SIZE-size);
 								if (ret > 0) size += ret;
 							}
-							if (ret <= 0) SDL_Delay(50);
+							if (size > 0 && clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end) == 0)
+								cpufreq_report_decode(size, bytes_per_second,
+								                      (cpu_end.tv_sec - cpu_start.tv_sec) * 1000000 +
+								                      (cpu_end.tv_nsec - cpu_start.tv_nsec) / 1000);
+							if (ret == 0 && audio_buffer_get_fill() > 0) /* EOF, wait for the buffer to drain */
+								process_commands(wait_time_for_bytes(audio_buffer_get_fill(), bytes_per_second));
 							if (gd->get_current_bitrate) br = (*gd->get_current_bitrate)();
 							if (br > 0) {
 								if (trackinfo_acquire_lock(ti)) {
@@ -465,9 +657,19 @@ static void *decode_audio_thread(void *udata)
 								break;
 							} else {
 								int ret = 0;
-								while (!ret && get_item_status() == PLAYING) {
-									ret = audio_fill_buffer(pcmout, size);
-									if (!ret) SDL_Delay(10);
+								/* A pending seek request makes the decoded data obsolete */
+								while (!ret && get_item_status() == PLAYING && seek_ms < 0) {
+									ret = audio_fill_buffer(out, size);
+									if (!ret) { /* Sleep until there is enough room in the buffer */
+										size_t fill = audio_buffer_get_fill();
+										size_t free_space = audio_buffer_get_size() - fill;
+										size_t refill_level = audio_buffer_get_refill_level();
+										size_t wait_bytes = size > free_space ? size - free_space : 0;
+										/* With deep buffering, sleep until the buffer has drained to the refill level */
+										if (fill > refill_level && fill - refill_level > wait_bytes)
+											wait_bytes = fill - refill_level;
+										process_commands(wait_time_for_bytes(wait_bytes, bytes_per_second));
+									}
 									if (get_item_status() == PLAYING && get_pb_request() == PBRQ_PLAY && audio_get_pause()) {
 										wdprintf(V_DEBUG, "fileplayer", "Unpause audio due to user request...\n");
 										audio_set_pause(0);
@@ -475,7 +677,7 @@ static void *decode_audio_thread(void *udata)
 								}
 								if (audio_get_status() != SDL_AUDIO_PLAYING &&
 									!audio_get_pause() &&
-									audio_buffer_get_fill() > audio_buffer_get_size() / 2 &&
+									audio_buffer_get_fill() > AUDIO_BUFFER_SIZE / 2 &&
 									get_pb_request() == PBRQ_PLAY) {
 									wdprintf(V_DEBUG, "fileplayer", "Unpausing audio...\n");
 									audio_force_pause(0);
@@ -495,7 +697,7 @@ static void *decode_audio_thread(void *udata)
 						}
 						wdprintf(V_INFO, "fileplayer", "Playback stopped: %d\n", item_status);
 						wdprintf(V_DEBUG, "fileplayer", "Buffer: %d\n", audio_buffer_get_fill());
-						seek_second = -1;
+						seek_ms = -1;
 					} else {
 						wdprintf(V_WARNING, "fileplayer", "Broken audio stream.\n");
 					}
@@ -529,10 +731,8 @@ static void *decode_audio_thread(void *udata)
 		if (gd && gd->set_reader_handle) {
 			(*gd->set_reader_handle)(NULL);
 		}
-		pthread_mutex_lock(&file_mutex);
-		if (dev_close_asap && !file) audio_device_close();
-		pthread_mutex_unlock(&file_mutex);
-		usleep(100000);
+		process_commands(0);
+		if (dev_close_asap && !next_file) audio_device_close();
 	}
 	wdprintf(V_DEBUG, "fileplayer", "Decoder thread finished.\n");
 	return NULL;
@@ -552,20 +752,31 @@ int file_player_play_file(char *filename, int skip_current, int fade_out_on_skip
 	}
 
 	wdprintf(V_INFO, "fileplayer", "Trying to play %s... (skip current: %d)\n", filename, skip_current);
-	file_player_set_filename(filename);
-	file_player_start_playback();
+	if (filename && filename[0] != '\0')
+		push_command(FP_CMD_NEXT_FILE, filename, 0);
+	else
+		wdprintf(V_WARNING, "fileplayer", "WARNING: Zero length filename detected!\n");
 	return 0;
 }
 
 /**
  * Initiates a seek request in the current stream to the relative
- * offset 'offset'. If the specified offset lies before the beginning
- * of the stream, the file player will try to seek to the beginning.
+ * offset 'offset' (in seconds). If the specified offset lies before the
+ * beginning of the stream, the file player will try to seek to the beginning.
  */
 int file_player_seek(long offset)
 {
-	seek_second = audio_get_playtime() / 1000 + offset;
-	if (seek_second < 0) seek_second = 0;
+	return file_player_seek_to_ms(audio_get_playtime_ms() + offset * 1000);
+}
+
+/**
+ * Initiates a seek request in the current stream to the absolute
+ * position 'ms' (in milliseconds). Already buffered data is discarded
+ * as soon as the decoder has reached the new position.
+ */
+int file_player_seek_to_ms(long ms)
+{
+	push_command(FP_CMD_SEEK, NULL, ms < 0 ? 0 : ms);
 	return 0;
 }
 
@@ -589,12 +800,15 @@ int file_player_request_playback_state_change(PB_Status_Request request)
 	switch (request) {
 		case PBRQ_PAUSE:
 			audio_set_pause(1);
+			push_command(FP_CMD_PAUSE, NULL, 0);
 			break;
 		case PBRQ_STOP:
 			file_player_stop_playback();
 			audio_set_pause(1);
 			break;
 		case PBRQ_PLAY:
+			push_command(FP_CMD_PLAY, NULL, 0);
+			break;
 		default:
 			break;
 	}
@@ -26,10 +26,9 @@ void      file_player_stop_playback(void);
 int       file_player_play_file(char *file, int skip_current, int fade_out_on_skip);
 int       file_player_read_tags(char *file, char *file_type, TrackInfo *ti);
 int       file_player_seek(long offset);
+int       file_player_seek_to_ms(long ms);
 int       file_player_is_thread_running(void);
 void      file_player_shutdown(void);
-void      file_player_set_filename(char *filename);
-void      file_player_start_playback(void);
 int       file_player_init(TrackInfo *ti_ref, int device_close_asap);
 TrackInfo *file_player_get_trackinfo_ref(void);
 int       file_player_request_playback_state_change(PB_Status_Request request);
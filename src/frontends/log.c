@@ -72,7 +72,7 @@ static int init(void)
 		wdprintf(V_INFO, "logbot", "Logging has been disabled.\n");
 	}
 	gmu_core_config_release_lock();
-	trackinfo_clear(&previous);
+	trackinfo_init(&previous, 0);
 	return logging_enabled;
 }
 
@@ -105,7 +105,9 @@ static void update_trackinfo(TrackInfo *ti)
 		trackinfo_copy(&previous, ti);
 		trackinfo_release_lock(ti);
 	} else {
-		trackinfo_clear(&previous);
+		/* Image and lyrics data are shared with the copied object, so
+		 * they must not be freed here */
+		trackinfo_init(&previous, 0);
 	}
 }
 
@@ -135,7 +137,8 @@ static int event_callback(GmuEvent event, int param)
 				    (pt >= minimum_playtime_seconds ||
 				     minimum_playtime_seconds > gmu_core_get_length_current_track())) {
 					save_previous_trackinfo();
-					trackinfo_clear(&previous);
+					/* Shares image and lyrics with the current track info */
+					trackinfo_init(&previous, 0);
 				}
 				break;
 			default:
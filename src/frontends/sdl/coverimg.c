@@ -15,13 +15,19 @@
  */
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_thread.h>
 #include <SDL2/SDL_image.h>
 #ifndef SDLFE_WITHOUT_SDL_GFX
 #include <SDL2/SDL2_rotozoom.h>
 #endif
+#ifdef SDLFE_WITH_LIBJPEG
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
 #include "coverimg.h"
+#include "thumbcache.h"
 #include "../../png.h"
 #include "../../jpeg.h"
 #include "../../bmp.h"
@@ -29,23 +35,206 @@
 #include "../../core.h"
 #include "debug.h"
 
+/* Image files larger than this are not even considered */
+#define COVER_FILE_SIZE_MAX (32 * 1024 * 1024)
+
+#ifndef SDLFE_WITHOUT_SDL_GFX
+static MimeType get_mime_type_from_data(const char *data, int size)
+{
+	const unsigned char *d = (const unsigned char *)data;
+	MimeType             res = COVER_MIME_UNKNOWN;
+
+	if (size >= 8 && memcmp(d, "\x89PNG", 4) == 0)
+		res = COVER_MIME_PNG;
+	else if (size >= 3 && d[0] == 0xFF && d[1] == 0xD8 && d[2] == 0xFF)
+		res = COVER_MIME_JPEG;
+	else if (size >= 2 && d[0] == 'B' && d[1] == 'M')
+		res = COVER_MIME_BMP;
+	return res;
+}
+
+static char *read_file_alloc(const char *filename, int *size)
+{
+	char *data = NULL;
+	FILE *f = fopen(filename, "rb");
+
+	*size = 0;
+	if (f) {
+		long len = -1;
+		if (fseek(f, 0, SEEK_END) == 0) len = ftell(f);
+		if (len > 0 && len <= COVER_FILE_SIZE_MAX && fseek(f, 0, SEEK_SET) == 0 && (data = malloc(len))) {
+			if (fread(data, 1, len, f) == (size_t)len) {
+				*size = (int)len;
+			} else {
+				free(data);
+				data = NULL;
+			}
+		}
+		fclose(f);
+	}
+	return data;
+}
+
+/* Returns the factor by which an image of the given size needs to be
+ * scaled to fit the target size */
+static float get_scale_factor(CoverImage *ci, int width, int height)
+{
+	float ratio_image  = (float)width / height;
+	float ratio_screen = (float)ci->target_width / ci->target_height;
+
+	if (ci->target_height <= 0 || ratio_image > ratio_screen)
+		return (float)ci->target_width / width;
+	return (float)ci->target_height / height;
+}
+
+#ifdef SDLFE_WITH_LIBJPEG
+typedef struct JpegErrorManager {
+	struct jpeg_error_mgr pub;
+	jmp_buf               setjmp_buffer;
+} JpegErrorManager;
+
+static void jpeg_error_exit(j_common_ptr cinfo)
+{
+	JpegErrorManager *err = (JpegErrorManager *)cinfo->err;
+	longjmp(err->setjmp_buffer, 1);
+}
+
+/*
+ * Decodes a JPEG image, letting libjpeg scale it down by 1/2, 1/4 or 1/8
+ * while decoding, as far as the target size permits. This is much faster
+ * than decoding the full image and requires a fraction of the memory, so
+ * images exceeding max_pixels can still be loaded, as long as the scaled
+ * image does not exceed that limit.
+ */
+static SDL_Surface *load_jpeg_scaled(CoverImage *ci, const char *data, int size, unsigned int max_pixels)
+{
+	struct jpeg_decompress_struct cinfo;
+	JpegErrorManager              jerr;
+	SDL_Surface *volatile         s = NULL;
+	int                           denom;
+	float                         scale;
+
+	cinfo.err = jpeg_std_error(&jerr.pub);
+	jerr.pub.error_exit = jpeg_error_exit;
+	if (setjmp(jerr.setjmp_buffer)) {
+		wdprintf(V_DEBUG, "coverimg", "libjpeg failed to decode the image.\n");
+		jpeg_destroy_decompress(&cinfo);
+		if (s) SDL_FreeSurface(s);
+		return NULL;
+	}
+	jpeg_create_decompress(&cinfo);
+	jpeg_mem_src(&cinfo, (unsigned char *)data, size);
+	jpeg_read_header(&cinfo, TRUE);
+	scale = get_scale_factor(ci, cinfo.image_width, cinfo.image_height);
+	/* Use the largest denominator, that still yields an image
+	 * at least as large as the target size... */
+	for (denom = 8; denom > 1 && scale * denom > 1.0f; denom /= 2);
+	/* ...unless the image would be too large */
+	while (denom < 8 && (unsigned long)(cinfo.image_width / denom) * (cinfo.image_height / denom) >= max_pixels)
+		denom *= 2;
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = denom;
+	cinfo.out_color_space = JCS_RGB;
+	jpeg_calc_output_dimensions(&cinfo);
+	if ((unsigned long)cinfo.output_width * cinfo.output_height >= max_pixels) {
+		wdprintf(V_WARNING, "coverimg", "Cover image too large.\n");
+		jpeg_destroy_decompress(&cinfo);
+		return NULL;
+	}
+	wdprintf(V_DEBUG, "coverimg", "Decoding %dx%d JPEG image at 1/%d scale.\n",
+	         cinfo.image_width, cinfo.image_height, denom);
+	jpeg_start_decompress(&cinfo);
+	s = SDL_CreateRGBSurfaceWithFormat(0, cinfo.output_width, cinfo.output_height, 24, SDL_PIXELFORMAT_RGB24);
+	if (s && cinfo.output_components == 3) {
+		while (cinfo.output_scanline < cinfo.output_height) {
+			JSAMPROW row = (JSAMPROW)((char *)s->pixels + cinfo.output_scanline * s->pitch);
+			jpeg_read_scanlines(&cinfo, &row, 1);
+		}
+		jpeg_finish_decompress(&cinfo);
+	} else if (s) {
+		SDL_FreeSurface(s);
+		s = NULL;
+	}
+	jpeg_destroy_decompress(&cinfo);
+	return s;
+}
+#endif
+
+/* Decodes the image and scales it to the target size. Returns an RGB24
+ * surface or NULL if the image could not be loaded. */
+static SDL_Surface *load_image_scaled(CoverImage *ci, const char *data, int size, MimeType mime_type,
+                                      unsigned int max_pixels)
+{
+	SDL_Surface *cover_fullsize = NULL, *res = NULL;
+
+#ifdef SDLFE_WITH_LIBJPEG
+	if (mime_type == COVER_MIME_JPEG)
+		cover_fullsize = load_jpeg_scaled(ci, data, size, max_pixels);
+#endif
+	if (!cover_fullsize) {
+		ImageSize    is;
+		unsigned int width = 0, height = 0;
+
+		/* check if cover image dimensions are small enough: */
+		switch (mime_type) {
+			case COVER_MIME_JPEG:
+				jpeg_get_dimensions_from_memory(&is, (char *)data, size, &width, &height);
+				break;
+			case COVER_MIME_PNG:
+				png_get_dimensions_from_memory(&is, (char *)data, size, &width, &height);
+				break;
+			case COVER_MIME_BMP:
+				bmp_get_dimensions_from_memory(&is, (char *)data, size, &width, &height);
+				break;
+			default:
+				break;
+		}
+		wdprintf(V_DEBUG, "coverimg", "image dimensions: %d x %d\n", width, height);
+		if (width * height < max_pixels && width > 0 && height > 0)
+			cover_fullsize = IMG_Load_RW(SDL_RWFromConstMem(data, size), 1);
+		else
+			wdprintf(V_WARNING, "coverimg", "Cover image too large or bad image data.\n");
+		if (!cover_fullsize)
+			wdprintf(V_WARNING, "coverimg", "Failed. Probably bad image data.\n");
+	}
+
+	if (cover_fullsize) {
+		SDL_Surface *tmp;
+		float        r = get_scale_factor(ci, cover_fullsize->w, cover_fullsize->h);
+
+		tmp = zoomSurface(cover_fullsize, r, r, 1);
+		/*printf("coverimg: orig. size = %dx%d\t new size = %dx%d\n",
+				cover_fullsize->w, cover_fullsize->h, tmp->w, tmp->h);*/
+		SDL_FreeSurface(cover_fullsize);
+		if (tmp) {
+			res = SDL_ConvertSurfaceFormat(tmp, SDL_PIXELFORMAT_RGB24, 0);
+			SDL_FreeSurface(tmp);
+		}
+	}
+	return res;
+}
+#endif
+
 static int cover_image_thread(void *udata)
 {
 #ifndef SDLFE_WITHOUT_SDL_GFX
 	CoverImage  *ci = (CoverImage *)udata;
-	ImageSize    is;
-	unsigned int width = 0, height = 0;
 
 	wdprintf(V_DEBUG, "coverimg", "Loader thread.\n");
 	ci->thread_running = 1;
 	while (ci->thread_running) {
 		if (ci->loading) {
-			SDL_Surface *cover_fullsize = NULL;
+			SDL_Surface *cover = NULL;
 			unsigned int max_cover_image_pixels = 0;
+			int          use_cache;
 			ConfigFile  *config = gmu_core_get_config();
+			char        *data = NULL;
+			int          size = 0;
+			MimeType     mime_type = COVER_MIME_UNKNOWN;
 
 			gmu_core_config_acquire_lock();
 			max_cover_image_pixels = cfg_get_int_value(config, "SDL.MaxCoverImageKPixels") * 1000;
+			use_cache = cfg_get_boolean_value(config, "SDL.CoverThumbnailCache");
 			gmu_core_config_release_lock();
 
 			while (SDL_mutexP(ci->mutex1) == -1) SDL_Delay(50);
@@ -58,82 +247,42 @@ static int cover_image_thread(void *udata)
 				char fn[256];
 
 				strncpy(fn, ci->filename, 255);
+				fn[255] = '\0';
 				ci->filename[0] = '\0';
 				SDL_mutexV(ci->mutex2);
-				/* check if cover image dimensions are small enough: */
-				if (!png_get_dimensions_from_file(&is, fn, &width, &height))
-					if (!jpeg_get_dimensions_from_file(&is, fn, &width, &height))
-						bmp_get_dimensions_from_file(&is, fn, &width, &height);
-				wdprintf(V_DEBUG, "coverimg", "image size = %d x %d\n", width, height);
-				if (width * height < max_cover_image_pixels && width > 0 && height > 0) {
-					cover_fullsize = IMG_Load(fn);
-					wdprintf(V_DEBUG, "coverimg", "Cover image \"%s\" loaded. Now resizing...\n", fn);
-				} else {
-					wdprintf(V_WARNING, "coverimg", "Cover image too large or bad image data.\n");
-				}
+				data = read_file_alloc(fn, &size);
+				if (data) mime_type = get_mime_type_from_data(data, size);
 			} else if (ci->image_data != NULL) {
-				/* Try to load image from memory... */
-				switch (ci->mime_type) {
-					case COVER_MIME_JPEG:
-						jpeg_get_dimensions_from_memory(&is, ci->image_data, ci->image_data_size, &width, &height);
-						break;
-					case COVER_MIME_PNG:
-						png_get_dimensions_from_memory(&is, ci->image_data, ci->image_data_size, &width, &height);
-						break;
-					case COVER_MIME_BMP:
-						bmp_get_dimensions_from_memory(&is, ci->image_data, ci->image_data_size, &width, &height);
-						break;
-					default:
-						break;
-				}
-				wdprintf(V_DEBUG, "coverimg", "image dimensions: %d x %d\n", width, height);
-				if (width * height < max_cover_image_pixels && width > 0 && height > 0)
-					cover_fullsize = IMG_Load_RW(SDL_RWFromConstMem(ci->image_data, ci->image_data_size), 1);
-				else
-					wdprintf(V_WARNING, "coverimg", "Cover image too large or bad image data.\n");
-				if (!cover_fullsize)
-					wdprintf(V_WARNING, "coverimg", "Failed. Probably bad image data in tag.\n");
+				/* Take over the image data; It is freed when done */
+				data = ci->image_data;
+				size = ci->image_data_size;
+				mime_type = ci->mime_type;
+				ci->image_data = NULL;
 				SDL_mutexV(ci->mutex2);
 			} else {
 				SDL_mutexV(ci->mutex2);
 				wdprintf(V_INFO, "coverimg", "No image available to load.\n");
 			}
 
-			if (cover_fullsize) {
-				SDL_Surface *tmp;
-				float        ratio_image  = (float)cover_fullsize->w / cover_fullsize->h;
-				float        ratio_screen = (float)ci->target_width / ci->target_height;
-				float        rx = 1.0, ry = 1.0;
-
-				if (ci->target_height <= 0 || ratio_image > ratio_screen)
-					ry = rx = (float)ci->target_width / cover_fullsize->w;
-				else if (ci->target_height > 0)
-					ry = rx = (float)ci->target_height / cover_fullsize->h;
-				SDL_LockMutex(ci->mutex_image);
-				if (ci->image) {
-					SDL_FreeSurface(ci->image);
-					ci->image = NULL;
+			if (data) {
+				unsigned long long hash = thumbcache_hash(data, size);
+
+				if (use_cache)
+					cover = thumbcache_load(hash, ci->target_width, ci->target_height);
+				if (!cover) {
+					cover = load_image_scaled(ci, data, size, mime_type, max_cover_image_pixels);
+					if (cover && use_cache)
+						thumbcache_save(hash, ci->target_width, ci->target_height, cover);
 				}
-				SDL_UnlockMutex(ci->mutex_image);
-				tmp = zoomSurface(cover_fullsize, rx, ry, 1);
-				/*printf("coverimg: orig. size = %dx%d\t new size = %dx%d\n",
-						cover_fullsize->w, cover_fullsize->h, tmp->w, tmp->h);*/
-				SDL_FreeSurface(cover_fullsize);
-				if (tmp) {
-					SDL_LockMutex(ci->mutex_image);
-					ci->image = SDL_ConvertSurfaceFormat(tmp, SDL_PIXELFORMAT_RGB24, 0);
-					SDL_UnlockMutex(ci->mutex_image);
-					SDL_FreeSurface(tmp);
+				if (cover)
 					wdprintf(V_INFO, "coverimg", "Loaded and resized cover image successfully.\n");
-				}
-			} else {
-				SDL_LockMutex(ci->mutex_image);
-				if (ci->image) {
-					SDL_FreeSurface(ci->image);
-					ci->image = NULL;
-				}
-				SDL_UnlockMutex(ci->mutex_image);
+				free(data);
 			}
+
+			SDL_LockMutex(ci->mutex_image);
+			if (ci->image) SDL_FreeSurface(ci->image);
+			ci->image = cover;
+			SDL_UnlockMutex(ci->mutex_image);
 			if (ci->ready_flag) *ci->ready_flag = 1;
 			ci->loading = 0;
 			SDL_mutexV(ci->mutex1);
@@ -97,7 +97,8 @@ void pl_browser_draw(PlaylistBrowser *pb, SDL_Surface *sdl_target)
 	              63 : skin_textarea_get_characters_per_line(pb->skin));
 	int    selected_entry_drawn = 0;
 	char  *mode;
-	int    pl_length;
+	char   total[16] = "";
+	int    pl_length, pl_time, unknown;
 
 	switch (gmu_core_playlist_get_play_mode()) {
 		default:
@@ -119,8 +120,17 @@ void pl_browser_draw(PlaylistBrowser *pb, SDL_Surface *sdl_target)
 	}
 
 	pl_length = gmu_core_playlist_get_length();
-	snprintf(buf, 63, "Playlist (%d %s, mode: %s)", pl_length,
-	         pl_length != 1 ? "entries" : "entry", mode);
+	/* Marked with '+' as long as the lengths of some entries are unknown */
+	pl_time = gmu_core_playlist_get_total_time(&unknown);
+	if (pl_length > 0 && pl_time > 0) {
+		if (pl_time >= 3600)
+			snprintf(total, 15, ", %d:%02d:%02d%s", pl_time / 3600, pl_time / 60 % 60, pl_time % 60,
+			         unknown > 0 ? "+" : "");
+		else
+			snprintf(total, 15, ", %d:%02d%s", pl_time / 60, pl_time % 60, unknown > 0 ? "+" : "");
+	}
+	snprintf(buf, 63, "Playlist (%d %s%s, mode: %s)", pl_length,
+	         pl_length != 1 ? "entries" : "entry", total, mode);
 	skin_draw_header_text(pb->skin, buf, sdl_target);
 
 	if (pb->first_visible_item == -1 || pb->offset == 0) {
@@ -924,6 +924,7 @@ static void run_player(char *skin_name, char *decoders_str)
 				skin_update_bg(&skin, display, buffer);
 				update_display = 1;
 				hw_display_on();
+				gmu_core_set_power_save_mode(0);
 			}
 
 			backlight_poweroff_timer = seconds_until_backlight_poweroff * FPS;
@@ -956,6 +957,7 @@ static void run_player(char *skin_name, char *decoders_str)
 				case GLOBAL_LOCK:
 					if (!hold_state) {
 						hw_display_off();
+						gmu_core_set_power_save_mode(1);
 						update_display = 0;
 						/* Clear the whole screen: */
 						SDL_FillRect(display, NULL, 0);
@@ -968,6 +970,7 @@ static void run_player(char *skin_name, char *decoders_str)
 						skin_update_bg(&skin, display, buffer);
 						update_display = 1;
 						hw_display_on();
+						gmu_core_set_power_save_mode(0);
 					}
 					hold_state = !hold_state;
 					break;
@@ -977,6 +980,7 @@ static void run_player(char *skin_name, char *decoders_str)
 						skin_update_bg(&skin, display, buffer);
 						update_display = 1;
 						hw_display_on();
+						gmu_core_set_power_save_mode(0);
 						hold_state = 0;
 					}
 					break;
@@ -1214,6 +1218,7 @@ static void run_player(char *skin_name, char *decoders_str)
 			if (backlight_poweroff_timer == 0) {
 				if (!display_inactive) {
 					hw_display_off();
+					gmu_core_set_power_save_mode(1);
 					/* Clear the whole screen: */
 //					SDL_FillRect(display, NULL, 0);
 //					SDL_UpdateRect(display, 0, 0, 0, 0);
@@ -1389,6 +1394,8 @@ static void *start_player(void *arg)
 	cfg_add_key_if_not_present(config, "SDL.TimeDisplay", "elapsed");
 	cfg_add_key_if_not_present(config, "SDL.MaxCoverImageKPixels", "400");
 	cfg_key_add_presets(config, "SDL.MaxCoverImageKPixels", "400", "800", "2000", "4000", "16000", NULL);
+	cfg_add_key_if_not_present(config, "SDL.CoverThumbnailCache", "yes");
+	cfg_key_add_presets(config, "SDL.CoverThumbnailCache", "yes", "no", NULL);
 	gmu_core_config_release_lock();
 
 	if (start) {
@@ -1538,11 +1545,13 @@ static int event_callback(GmuEvent event, int param)
 			break;
 		}
 		case GMU_BUFFERING:
+		case GMU_BUFFER_UNDERRUN:
 			player_display_set_notice_message("BUFFERING...", NOTICE_DELAY);
 			player_display_set_playback_symbol_blinking(1);
 			break;
 		case GMU_BUFFERING_DONE:
 		case GMU_BUFFERING_FAILED:
+		case GMU_BUFFER_UNDERRUN_RECOVERED:
 			player_display_set_playback_symbol_blinking(0);
 			break;
 		case GMU_PLAYMODE_CHANGE: {
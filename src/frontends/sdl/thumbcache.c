@@ -0,0 +1,164 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: thumbcache.c  Created: 210904
+ *
+ * Description: On-disk cache for pre-scaled cover images
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <SDL2/SDL.h>
+#include "thumbcache.h"
+#include "../../util.h"
+#include "../../filecache.h"
+#include "debug.h"
+
+#define THUMBCACHE_MAGIC "GMUTHMB1"
+/* Thumbnails are meant to be small; anything larger is not cached */
+#define THUMBCACHE_MAX_DIMENSION 4096
+/* The least recently used thumbnails are removed once the cache grows
+ * larger than this (see filecache_prune()) */
+#define THUMBCACHE_MAX_SIZE      FILECACHE_MAX_SIZE
+
+/* Thumbnail files consist of this header followed by the RGB24 pixel rows
+ * without padding. The integers are stored in host byte order. */
+typedef struct ThumbFileHeader {
+	char magic[8];
+	int  width, height;
+} ThumbFileHeader;
+
+/* Each cover image loader thread stores its thumbnails */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static long long       cache_size = -1; /* -1: Not known until the first cleanup */
+
+/* 64 bit FNV-1a */
+unsigned long long thumbcache_hash(const void *data, size_t size)
+{
+	unsigned long long   hash = 14695981039346656037ULL;
+	const unsigned char *c = data;
+	size_t               i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= c[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static char *get_cache_file_alloc(unsigned long long hash, int target_width, int target_height, int create_dir)
+{
+	char name[80];
+
+	snprintf(name, sizeof(name), "thumbnails/%016llx-%dx%d.thm", hash, target_width, target_height);
+	if (create_dir) {
+		char *dir = get_data_dir_with_name_alloc("gmu", 1, "thumbnails");
+		if (dir) {
+			mkdir(dir, S_IRWXU);
+			free(dir);
+		}
+	}
+	return get_data_dir_with_name_alloc("gmu", 0, name);
+}
+
+SDL_Surface *thumbcache_load(unsigned long long hash, int target_width, int target_height)
+{
+	SDL_Surface    *s = NULL;
+	char           *cache_file = get_cache_file_alloc(hash, target_width, target_height, 0);
+	ThumbFileHeader hdr;
+	FILE           *f;
+
+	if (cache_file && (f = fopen(cache_file, "rb"))) {
+		if (fread(&hdr, sizeof(hdr), 1, f) == 1 &&
+		    memcmp(hdr.magic, THUMBCACHE_MAGIC, 8) == 0 &&
+		    hdr.width > 0 && hdr.width <= THUMBCACHE_MAX_DIMENSION &&
+		    hdr.height > 0 && hdr.height <= THUMBCACHE_MAX_DIMENSION &&
+		    (s = SDL_CreateRGBSurfaceWithFormat(0, hdr.width, hdr.height, 24, SDL_PIXELFORMAT_RGB24))) {
+			int y;
+			for (y = 0; y < hdr.height; y++) {
+				if (fread((char *)s->pixels + y * s->pitch, 3, hdr.width, f) != (size_t)hdr.width) {
+					SDL_FreeSurface(s);
+					s = NULL;
+					break;
+				}
+			}
+		}
+		fclose(f);
+		if (s) {
+			wdprintf(V_DEBUG, "thumbcache", "Loaded %dx%d thumbnail %016llx\n", hdr.width, hdr.height, hash);
+			/* Mark the thumbnail as recently used for the cache cleanup */
+			filecache_touch(cache_file);
+		}
+	}
+	free(cache_file);
+	return s;
+}
+
+/* Leftovers of interrupted writes are removed */
+static int cache_file_is_valid(const char *cache_file, const char *name)
+{
+	(void)cache_file;
+	return filecache_has_extension(name, ".thm");
+}
+
+/* Keeps track of the cache size and removes the least recently used
+ * thumbnails when the cache gets too large */
+static void update_cache_size(long long added)
+{
+	pthread_mutex_lock(&mutex);
+	if (cache_size >= 0) cache_size += added;
+	if (cache_size < 0 || cache_size > THUMBCACHE_MAX_SIZE) {
+		char *dir = get_data_dir_with_name_alloc("gmu", 0, "thumbnails");
+		cache_size = dir ? filecache_prune(dir, THUMBCACHE_MAX_SIZE, cache_file_is_valid, NULL) : 0;
+		free(dir);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+int thumbcache_save(unsigned long long hash, int target_width, int target_height, SDL_Surface *thumbnail)
+{
+	int             res = 0;
+	char           *cache_file, *tmp_file;
+	ThumbFileHeader hdr;
+	FILE           *f;
+
+	if (!thumbnail || thumbnail->format->format != SDL_PIXELFORMAT_RGB24 ||
+	    thumbnail->w > THUMBCACHE_MAX_DIMENSION || thumbnail->h > THUMBCACHE_MAX_DIMENSION)
+		return 0;
+	if (!(cache_file = get_cache_file_alloc(hash, target_width, target_height, 1))) return 0;
+	if ((tmp_file = malloc(strlen(cache_file) + 5))) {
+		sprintf(tmp_file, "%s.tmp", cache_file);
+		memcpy(hdr.magic, THUMBCACHE_MAGIC, 8);
+		hdr.width  = thumbnail->w;
+		hdr.height = thumbnail->h;
+		if ((f = fopen(tmp_file, "wb"))) {
+			int y;
+			res = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+			SDL_LockSurface(thumbnail);
+			for (y = 0; res && y < thumbnail->h; y++)
+				res = fwrite((char *)thumbnail->pixels + y * thumbnail->pitch, 3, thumbnail->w, f) == (size_t)thumbnail->w;
+			SDL_UnlockSurface(thumbnail);
+			if (fclose(f) != 0) res = 0;
+			/* Replace an old thumbnail atomically, so readers never see a partial file */
+			if (res) res = rename(tmp_file, cache_file) == 0;
+			if (!res) remove(tmp_file);
+		}
+		free(tmp_file);
+	}
+	if (res) {
+		wdprintf(V_DEBUG, "thumbcache", "Stored thumbnail %s\n", cache_file);
+		update_cache_size((long long)sizeof(hdr) + 3LL * thumbnail->w * thumbnail->h);
+	}
+	free(cache_file);
+	return res;
+}
@@ -0,0 +1,30 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: thumbcache.h  Created: 210904
+ *
+ * Description: On-disk cache for pre-scaled cover images
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stddef.h>
+#include <SDL2/SDL.h>
+
+#ifndef _THUMBCACHE_H
+#define _THUMBCACHE_H
+/* Hashes the encoded image data; The hash identifies a cover image
+ * regardless of whether it has been embedded or loaded from a file */
+unsigned long long thumbcache_hash(const void *data, size_t size);
+/* Returns the cached RGB24 thumbnail of the image with the given hash,
+ * that has been scaled for the given target size, or NULL if there is none */
+SDL_Surface       *thumbcache_load(unsigned long long hash, int target_width, int target_height);
+/* Stores an RGB24 surface in the cache; Returns 1 on success, 0 otherwise */
+int                thumbcache_save(unsigned long long hash, int target_width, int target_height,
+                                   SDL_Surface *thumbnail);
+#endif
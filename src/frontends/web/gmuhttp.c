@@ -164,6 +164,48 @@ static int event_callback(GmuEvent event, int param)
 			if (r < MSG_MAX_LEN && r > 0) httpd_send_websocket_broadcast(msg);
 			break;
 		}
+		case GMU_BUFFER_UNDERRUN: {
+			r = snprintf(
+				msg,
+				MSG_MAX_LEN,
+				"{ \"cmd\": \"buffer_underrun\", \"count\" : %d }",
+				param
+			);
+			if (r < MSG_MAX_LEN && r > 0) httpd_send_websocket_broadcast(msg);
+			break;
+		}
+		case GMU_BUFFER_UNDERRUN_RECOVERED: {
+			r = snprintf(
+				msg,
+				MSG_MAX_LEN,
+				"{ \"cmd\": \"buffer_recovered\", \"duration_ms\" : %d }",
+				param
+			);
+			if (r < MSG_MAX_LEN && r > 0) httpd_send_websocket_broadcast(msg);
+			break;
+		}
+		case GMU_PLAYLIST_TIME_CHANGE: {
+			int unknown, total = gmu_core_playlist_get_total_time(&unknown);
+			r = snprintf(
+				msg,
+				MSG_MAX_LEN,
+				"{ \"cmd\": \"playlist_time\", \"time\" : %d, \"unknown\" : %d }",
+				total,
+				unknown
+			);
+			if (r < MSG_MAX_LEN && r > 0) httpd_send_websocket_broadcast(msg);
+			break;
+		}
+		case GMU_MEDIALIB_ANALYSIS_PROGRESS: {
+			r = snprintf(
+				msg,
+				MSG_MAX_LEN,
+				"{ \"cmd\": \"mlib_analysis_progress\", \"percent\" : %d }",
+				param
+			);
+			if (r < MSG_MAX_LEN && r > 0) httpd_send_websocket_broadcast(msg);
+			break;
+		}
 		default:
 			break;
 	}
@@ -830,11 +830,15 @@ void httpd_send_websocket_broadcast(const char *str)
 void gmu_http_playlist_get_info(Connection *c)
 {
 	char msg[MSG_MAX_LEN];
+	int  unknown, total = gmu_core_playlist_get_total_time(&unknown);
 	int  r = snprintf(
 		msg,
 		MSG_MAX_LEN,
-		"{ \"cmd\": \"playlist_info\", \"changed_at_position\" : 0, \"length\" : %zd }",
-		gmu_core_playlist_get_length()
+		"{ \"cmd\": \"playlist_info\", \"changed_at_position\" : 0, \"length\" : %zd, " \
+		"\"time\" : %d, \"unknown\" : %d }",
+		gmu_core_playlist_get_length(),
+		total,
+		unknown
 	);
 	if (r < MSG_MAX_LEN && r > 0) websocket_send_string(c, msg);
 }
@@ -843,19 +847,21 @@ void gmu_http_playlist_get_item(int id, Connection *c)
 {
 	char   msg[MSG_MAX_LEN], *tmp_title = NULL;
 	Entry *item;
-	int    r;
+	int    r, length;
 
 	gmu_core_playlist_acquire_lock();
 	item = gmu_core_playlist_get_entry(id);
 	tmp_title = json_string_escape_alloc(gmu_core_playlist_get_entry_name(item));
 	gmu_core_playlist_release_lock();
+	/* Might query the medialib, so it is done without the playlist lock */
+	length = gmu_core_playlist_get_entry_length(id);
 	r = snprintf(
 		msg,
 		MSG_MAX_LEN,
 		"{ \"cmd\": \"playlist_item\", \"position\" : %d, \"title\": \"%s\", \"length\": %d }",
 		id,
 		tmp_title ? tmp_title : "??",
-		0
+		length
 	);
 	if (tmp_title) free(tmp_title);
 	if (r > 0 && !charset_is_valid_utf8_string(msg)) {
@@ -864,7 +870,7 @@ void gmu_http_playlist_get_item(int id, Connection *c)
 			MSG_MAX_LEN,
 			"{ \"cmd\": \"playlist_item\", \"position\" : %d, \"title\": \"(Invalid UTF-8)\", \"length\": %d }",
 			id,
-			0
+			length
 		);
 	}
 	if (r < MSG_MAX_LEN && r > 0) websocket_send_string(c, msg);
@@ -929,6 +935,7 @@ void gmu_http_playmode_get_info(Connection *c)
 void gmu_http_send_initial_information(Connection *c)
 {
 	char msg[MSG_MAX_LEN];
+	int  unknown, total;
 	int  r = snprintf(
 		msg,
 		MSG_MAX_LEN,
@@ -936,6 +943,15 @@ void gmu_http_send_initial_information(Connection *c)
 		gmu_core_playlist_get_length()
 	);
 	if (r < MSG_MAX_LEN && r > 0) websocket_send_string(c, msg);
+	total = gmu_core_playlist_get_total_time(&unknown);
+	r = snprintf(
+		msg,
+		MSG_MAX_LEN,
+		"{ \"cmd\": \"playlist_time\", \"time\" : %d, \"unknown\" : %d }",
+		total,
+		unknown
+	);
+	if (r < MSG_MAX_LEN && r > 0) websocket_send_string(c, msg);
 	r = snprintf(
 		msg,
 		MSG_MAX_LEN,
@@ -1039,72 +1055,238 @@ static void gmu_http_ping(Connection *c)
 	websocket_send_string(c, "{\"cmd\":\"pong\"}");
 }
 
-static void gmu_http_medialib_search(Connection *c, const char *type, const char *str)
+static void gmu_http_medialib_info(Connection *c)
+{
+	char   str[128];
+	size_t max_bytes, bytes = gmu_core_medialib_get_index_memory_usage(&max_bytes);
+
+	snprintf(str, 128, "{\"cmd\":\"mlib_info\",\"index_kb\":%lu,\"index_max_kb\":%lu}",
+	         (unsigned long)(bytes / 1024), (unsigned long)(max_bytes / 1024));
+	websocket_send_string(c, str);
+}
+
+/*
+ * Medialib results are sent in pages of at most 'limit' rows. Each page
+ * ends with a *_done message containing a continuation cursor if there
+ * might be more results. The client requests the next page by sending
+ * the same command again along with that cursor. The cursor has the form
+ * "<pos>:<last key>", where pos is the position of the next result.
+ * Within a page, rows are sent in frames of MLIB_ROWS_PER_FRAME rows.
+ */
+#define MLIB_PAGE_SIZE_DEFAULT 200
+#define MLIB_PAGE_SIZE_MAX     1000
+#define MLIB_ROWS_PER_FRAME    50
+#define MLIB_FRAME_SIZE        32768
+
+typedef struct MlibFrame {
+	Connection *c;
+	const char *cmd;
+	size_t      pos;   /* Position of the next row */
+	int         rows;  /* Rows in the current frame */
+	size_t      len;
+	char        buf[MLIB_FRAME_SIZE];
+} MlibFrame;
+
+static void mlib_frame_init(MlibFrame *f, Connection *c, const char *cmd, size_t pos)
+{
+	f->c = c;
+	f->cmd = cmd;
+	f->pos = pos;
+	f->rows = 0;
+	f->len = 0;
+}
+
+static void mlib_frame_flush(MlibFrame *f)
+{
+	if (f->rows > 0) {
+		memcpy(f->buf + f->len, "]}", 3);
+		websocket_send_string(f->c, f->buf);
+		f->rows = 0;
+		f->len = 0;
+	}
+}
+
+/* Appends a JSON object to the current frame, sending the frame first
+ * if it is full. Rows too large for a frame are dropped. */
+static void mlib_frame_add_row(MlibFrame *f, const char *row)
+{
+	size_t row_len = strlen(row);
+
+	if (f->rows >= MLIB_ROWS_PER_FRAME || (f->rows > 0 && f->len + row_len + 4 > MLIB_FRAME_SIZE))
+		mlib_frame_flush(f);
+	if (f->rows == 0)
+		f->len = snprintf(f->buf, MLIB_FRAME_SIZE, "{\"cmd\":\"%s\",\"pos\":%zu,\"items\":[", f->cmd, f->pos);
+	if (f->len + row_len + 4 <= MLIB_FRAME_SIZE) {
+		if (f->rows > 0) f->buf[f->len++] = ',';
+		memcpy(f->buf + f->len, row, row_len + 1);
+		f->len += row_len;
+		f->rows++;
+	}
+	f->pos++;
+}
+
+/* Splits a "<pos>:<key>" cursor; Returns the key or NULL if there is none */
+static const char *mlib_cursor_parse(const char *cursor, size_t *pos)
+{
+	const char *key = NULL;
+	char       *end = NULL;
+
+	*pos = 0;
+	if (cursor) {
+		long p = strtol(cursor, &end, 10);
+		if (end && *end == ':' && p >= 0) {
+			*pos = p;
+			key = end + 1;
+		}
+	}
+	return key;
+}
+
+static int mlib_page_size(int limit)
 {
-	TrackInfo ti;
-	size_t    i = 0;
-	char      rstr[1024];
-	int       res = gmu_core_medialib_search_find(GMU_MLIB_ANY, str);
+	if (limit <= 0) limit = MLIB_PAGE_SIZE_DEFAULT;
+	return limit > MLIB_PAGE_SIZE_MAX ? MLIB_PAGE_SIZE_MAX : limit;
+}
 
+/* Appends a track (search result) to the current frame */
+static void mlib_frame_add_track(MlibFrame *f, const TrackSummary *ts)
+{
+	char  rstr[4096];
+	char *artist = json_string_escape_alloc(ts->artist);
+	char *title  = json_string_escape_alloc(ts->title);
+	char *album  = json_string_escape_alloc(ts->album);
+	char *date   = json_string_escape_alloc(ts->date);
+	char *file   = json_string_escape_alloc(ts->file_name);
+	if (snprintf(
+		rstr,
+		sizeof(rstr),
+		"{\"id\":%d,\"artist\":\"%s\",\"title\":\"%s\",\"album\":\"%s\",\"date\":\"%s\",\"file\":\"%s\",\"length\":%d}",
+		ts->id,
+		artist ? artist : "",
+		title ? title : "",
+		album ? album : "",
+		date ? date : "",
+		file ? file : "",
+		ts->length
+	) < (int)sizeof(rstr))
+		mlib_frame_add_row(f, rstr);
+	else
+		f->pos++;
+	free(artist);
+	free(title);
+	free(album);
+	free(date);
+	free(file);
+}
+
+static void gmu_http_medialib_search(Connection *c, const char *type, const char *str,
+                                     const char *cursor, int limit)
+{
+	TrackSummary ts;
+	MlibFrame   *f = malloc(sizeof(MlibFrame));
+	size_t       pos;
+	const char  *after = mlib_cursor_parse(cursor, &pos);
+	int          last_id = after ? atoi(after) : 0;
+	int          i = 0, res;
+
+	if (!f) return;
+	limit = mlib_page_size(limit);
+	res = gmu_core_medialib_search_find(GMU_MLIB_ANY, str, last_id, limit);
 	websocket_send_string(c, "{ \"cmd\": \"mlib_search_start\" }");
 
+	mlib_frame_init(f, c, "mlib_results", pos);
 	if (res) {
-		for (ti = gmu_core_medialib_search_fetch_next_result();
-			 ti.id >= 0;
-			 ti = gmu_core_medialib_search_fetch_next_result(), i++) {
-			char *artist = json_string_escape_alloc(ti.artist);
-			char *title  = json_string_escape_alloc(ti.title);
-			char *album  = json_string_escape_alloc(ti.album);
-			char *date   = json_string_escape_alloc(ti.date);
-			char *file   = json_string_escape_alloc(ti.file_name);
-			snprintf(
-				rstr,
-				1023,
-				"{\"cmd\":\"mlib_result\", \"pos\":%zd,\"id\":%d,\"artist\":\"%s\",\"title\":\"%s\",\"album\":\"%s\",\"date\":\"%s\",\"file\":\"%s\"}",
-				i,
-				ti.id,
-				artist,
-				title,
-				album,
-				date,
-				file
-			);
-			free(artist);
-			free(title);
-			free(album);
-			free(date);
-			free(file);
-			websocket_send_string(c, rstr);
+		for (ts = gmu_core_medialib_search_fetch_next_result();
+			 ts.id >= 0;
+			 ts = gmu_core_medialib_search_fetch_next_result(), i++) {
+			mlib_frame_add_track(f, &ts);
+			last_id = ts.id;
 		}
 	}
 	gmu_core_medialib_search_finish();
+	mlib_frame_flush(f);
+	if (i == limit) {
+		char *str_esc = json_string_escape_alloc(str);
+		snprintf(f->buf, MLIB_FRAME_SIZE, "{\"cmd\":\"mlib_search_done\",\"str\":\"%s\",\"cursor\":\"%zu:%d\"}",
+		         str_esc ? str_esc : "", f->pos, last_id);
+		free(str_esc);
+		websocket_send_string(c, f->buf);
+	} else {
+		websocket_send_string(c, "{ \"cmd\": \"mlib_search_done\" }");
+	}
+	free(f);
+}
+
+/* Sends the tracks most similar to the track 'id' like search results */
+static void gmu_http_medialib_similar(Connection *c, int id, int limit)
+{
+	TrackSummary ts;
+	MlibFrame   *f = malloc(sizeof(MlibFrame));
+
+	if (!f) return;
+	limit = mlib_page_size(limit);
+	websocket_send_string(c, "{ \"cmd\": \"mlib_search_start\" }");
+	mlib_frame_init(f, c, "mlib_results", 0);
+	if (gmu_core_medialib_similar_tracks(id, limit)) {
+		for (ts = gmu_core_medialib_search_fetch_next_result();
+			 ts.id >= 0;
+			 ts = gmu_core_medialib_search_fetch_next_result())
+			mlib_frame_add_track(f, &ts);
+	}
+	gmu_core_medialib_search_finish();
+	mlib_frame_flush(f);
 	websocket_send_string(c, "{ \"cmd\": \"mlib_search_done\" }");
+	free(f);
 }
 
-static void gmu_http_medialib_browse_artists(Connection *c)
+/* Browses artists, or the albums of 'artist' if column is "album" */
+static void gmu_http_medialib_browse(Connection *c, const char *column, const char *artist,
+                                     const char *cursor, int limit)
 {
-	const char  *str = NULL;
-	size_t       i = 0;
-	char         rstr[1024];
-	int          res = gmu_core_medialib_browse_artists();
+	const char *str = NULL;
+	MlibFrame  *f = malloc(sizeof(MlibFrame));
+	char        rstr[1024];
+	char       *last = NULL;
+	size_t      pos;
+	const char *after = mlib_cursor_parse(cursor, &pos);
+	int         i = 0, res;
+
+	if (!f) return;
+	limit = mlib_page_size(limit);
+	if (strcmp(column, "album") == 0)
+		res = gmu_core_medialib_browse_albums_by_artist(artist, after, limit);
+	else
+		res = gmu_core_medialib_browse_artists(after, limit);
 
+	mlib_frame_init(f, c, "mlib_browse_results", pos);
 	if (res) {
 		for (str = gmu_core_medialib_browse_fetch_next_result();
 			 str;
 			 str = gmu_core_medialib_browse_fetch_next_result(), i++) {
-			char *artist = json_string_escape_alloc(str);
-			snprintf(
-				rstr,
-				1023,
-				"{\"cmd\":\"mlib_browse_result\", \"pos\":%zd,\"artist\":\"%s\"}",
-				i,
-				artist
-			);
-			free(artist);
-			websocket_send_string(c, rstr);
+			char *value = json_string_escape_alloc(str);
+			if (snprintf(rstr, sizeof(rstr), "{\"%s\":\"%s\"}", column, value ? value : "") < (int)sizeof(rstr))
+				mlib_frame_add_row(f, rstr);
+			else
+				f->pos++;
+			free(last);
+			last = value;
 		}
 	}
 	gmu_core_medialib_browse_finish();
+	mlib_frame_flush(f);
+	if (i == limit) {
+		char *artist_esc = json_string_escape_alloc(artist);
+		snprintf(f->buf, MLIB_FRAME_SIZE,
+		         "{\"cmd\":\"mlib_browse_done\",\"column\":\"%s\",\"artist\":\"%s\",\"cursor\":\"%zu:%s\"}",
+		         column, artist_esc ? artist_esc : "", f->pos, last ? last : "");
+		free(artist_esc);
+		websocket_send_string(c, f->buf);
+	} else {
+		snprintf(f->buf, MLIB_FRAME_SIZE, "{\"cmd\":\"mlib_browse_done\",\"column\":\"%s\"}", column);
+		websocket_send_string(c, f->buf);
+	}
+	free(last);
+	free(f);
 }
 
 /**
@@ -1157,6 +1339,12 @@ static int gmu_http_handle_websocket_message(const char *message, Connection *c)
 				gmu_core_previous();
 			} else if (strcmp(cmd, "stop") == 0) {
 				gmu_core_stop();
+			} else if (strcmp(cmd, "seek") == 0) {
+				/* 'time' is the absolute position in ms, 'relative' an offset in ms */
+				if (json_get_type_for_key(json, "time") == JSON_NUMBER)
+					gmu_core_seek((long)json_get_number_value_for_key(json, "time"));
+				else if (json_get_type_for_key(json, "relative") == JSON_NUMBER)
+					gmu_core_seek_relative((long)json_get_number_value_for_key(json, "relative"));
 			} else if (strcmp(cmd, "trackinfo") == 0) {
 				gmu_http_get_current_trackinfo(c);
 			} else if (strcmp(cmd, "playlist_get_item") == 0) {
@@ -1211,18 +1399,29 @@ static int gmu_http_handle_websocket_message(const char *message, Connection *c)
 			} else if (strcmp(cmd, "medialib_refresh") == 0) {
 				gmu_core_medialib_start_refresh();
 			} else if (strcmp(cmd, "medialib_search") == 0) {
-				const char *type = json_get_string_value_for_key(json, "type");
-				const char *str  = json_get_string_value_for_key(json, "str");
+				const char *type   = json_get_string_value_for_key(json, "type");
+				const char *str    = json_get_string_value_for_key(json, "str");
+				const char *cursor = json_get_string_value_for_key(json, "cursor");
+				int         limit  = json_get_integer_value_for_key(json, "limit");
 				if (type && str) {
-					gmu_http_medialib_search(c, type, str);
+					gmu_http_medialib_search(c, type, str, cursor, limit);
 				}
+			} else if (strcmp(cmd, "medialib_similar") == 0) {
+				int id    = json_get_integer_value_for_key(json, "id");
+				int limit = json_get_integer_value_for_key(json, "limit");
+				if (id > 0) gmu_http_medialib_similar(c, id, limit);
+			} else if (strcmp(cmd, "medialib_info") == 0) {
+				gmu_http_medialib_info(c);
 			} else if (strcmp(cmd, "medialib_add_id_to_playlist") == 0) {
 				int id = json_get_number_value_for_key(json, "id");
 				if (id > 0) gmu_core_medialib_add_id_to_playlist(id);
 			} else if (strcmp(cmd, "medialib_browse") == 0) {
-				const char *col = json_get_string_value_for_key(json, "column");
-				if (col && strcmp(col, "artist") == 0) {
-					gmu_http_medialib_browse_artists(c);
+				const char *col    = json_get_string_value_for_key(json, "column");
+				const char *artist = json_get_string_value_for_key(json, "artist");
+				const char *cursor = json_get_string_value_for_key(json, "cursor");
+				int         limit  = json_get_integer_value_for_key(json, "limit");
+				if (col && (strcmp(col, "artist") == 0 || (strcmp(col, "album") == 0 && artist))) {
+					gmu_http_medialib_browse(c, col, artist, cursor, limit);
 				}
 			} else if (strcmp(cmd, "medialib_path_add") == 0) {
 				const char *path = json_get_string_value_for_key(json, "path");
@@ -62,6 +62,11 @@ void json_keys_free(JSON_Key *first_key)
 		free(tk->key_name);
 		free(tk->key_value_str);
 		if (tk->key_value_object) json_object_free(tk->key_value_object);
+		while (tk->key_value_array) {
+			JSON_Object *to = tk->key_value_array;
+			tk->key_value_array = to->next;
+			json_object_free(to);
+		}
 		free(tk);
 	}
 }
@@ -216,8 +221,38 @@ JSON_Object *json_parse_alloc(const char *json_data)
 								break;
 							}
 							case '[': { /* Array */
-								wdprintf(V_DEBUG, "json", "Array detected. Ignoring.\n");
-								for (; json_data[i] != ']' && i < len; i++);
+								/* Arrays of objects are supported, anything else is ignored */
+								JSON_Object *last = NULL;
+								for (i++; i < len; i++) {
+									v = find_first_non_whitespace_char(json_data+i);
+									if (v < 0) break;
+									i += v;
+									if (json_data[i] == ']') {
+										break;
+									} else if (json_data[i] == '{') {
+										JSON_Object *obj = json_parse_alloc(json_data+i);
+										if (!obj) break;
+										if (obj->parse_error) {
+											json_object_free(obj);
+											break;
+										}
+										obj->parent = json;
+										i += obj->length - 1;
+										if (!current_key) {
+											json_object_free(obj);
+										} else if (last) {
+											last->next = obj;
+										} else {
+											current_key->type = JSON_ARRAY;
+											current_key->key_value_array = obj;
+										}
+										last = obj;
+									} else if (json_data[i] != ',') {
+										wdprintf(V_DEBUG, "json", "Array with non-object elements detected. Ignoring.\n");
+										for (; json_data[i] != ']' && i < len; i++);
+										break;
+									}
+								}
 								if (json_data[i] != ']') {
 									wdprintf(V_WARNING, "json", "ERROR: Invalid JSON data. No end of array found.\n");
 									json->parse_error = 1;
@@ -347,6 +382,20 @@ double json_get_number_value_for_key(JSON_Object *object, const char *key)
 	return res;
 }
 
+/* Returns the first element of an array of objects; The other elements
+ * can be reached through the 'next' pointer of each element. */
+JSON_Object *json_get_array_for_key(JSON_Object *object, const char *key)
+{
+	JSON_Object *res = NULL;
+	if (object) {
+		JSON_Key *k = json_get_key_object_for_key(object, key);
+		if (k && k->type == JSON_ARRAY) {
+			res = k->key_value_array;
+		}
+	}
+	return res;
+}
+
 int json_get_integer_value_for_key(JSON_Object *object, const char *key)
 {
 	int res = 0;
@@ -62,6 +62,7 @@ JSON_Key     *json_get_key_object_for_key(JSON_Object *object, const char *key);
 char         *json_get_string_value_for_key(JSON_Object *object, const char *key);
 double        json_get_number_value_for_key(JSON_Object *object, const char *key);
 int           json_get_integer_value_for_key(JSON_Object *object, const char *key);
+JSON_Object  *json_get_array_for_key(JSON_Object *object, const char *key);
 char         *json_get_first_key_string(JSON_Object *object);
 JSON_Key_Type json_get_type_for_key(JSON_Object *object, const char *key);
 char         *json_encode_message_alloc(JSON_Key_Type type_1, const char *key, ...);
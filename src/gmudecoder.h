@@ -30,6 +30,19 @@ typedef enum GmuCharset {
 	M_CHARSET_AUTODETECT
 } GmuCharset;
 
+/* Magic byte pattern identifying a file format */
+typedef struct _GmuMagicPattern {
+	/* Position of the pattern in the data */
+	size_t      offset;
+	/* The pattern and its length (it may contain null bytes) */
+	const char *pattern;
+	size_t      length;
+	/* Patterns are checked in order of descending priority, so specific
+	 * patterns (e.g. the codec header in an Ogg stream) should have a
+	 * higher priority than generic ones (e.g. an MPEG frame sync). */
+	int         priority;
+} GmuMagicPattern;
+
 typedef struct _GmuDecoder {
 	/* Short identifier such as "vorbis_decoder" */
 	const char   *identifier;
@@ -108,6 +121,23 @@ typedef struct _GmuDecoder {
 	void         (*set_reader_handle)(Reader *r);
 	/* internal handle, do not use */
 	void         *handle;
+	/* Sample accurate seeking. Seeks to the given sample (per channel) from
+	 * the beginning of the stream. Returns the sample actually seeked to or
+	 * a negative value on failure. Optional, can be NULL, in which case
+	 * seek() is used instead. */
+	long         (*seek_sample)(long sample);
+	/* Zero-copy alternative to decode_data(). Decodes up to max_size bytes of
+	 * audio data and sets *data to point to it, e.g. directly into a memory
+	 * mapped file when no conversion is needed. The data must stay valid until
+	 * the next call of any of the decoder's functions. Return values as with
+	 * decode_data(). Optional, can be NULL. */
+	int          (*decode_data_direct)(const char **data, size_t max_size);
+	/* Returns the magic byte patterns of the supported formats as an array
+	 * terminated by an entry with pattern set to NULL. If one matches, the
+	 * data is checked with data_check_magic_bytes() (if available) to confirm
+	 * the match. Optional, but recommended for streaming audio. Without it,
+	 * data_check_magic_bytes() is called for every unknown stream. */
+	const GmuMagicPattern * (*get_magic_patterns)(void);
 } GmuDecoder;
 
 /* This function must be implemented by the decoder. It must return a valid
@@ -24,8 +24,12 @@ typedef enum GmuEvent {
 	GMU_TRACKINFO_CHANGE, GMU_BUFFER_EMPTY,
 	GMU_FILE_ERROR, GMU_NETWORK_ERROR,
 	GMU_BUFFERING, GMU_BUFFERING_FAILED, GMU_BUFFERING_DONE,
+	GMU_BUFFER_UNDERRUN,           /* Parameter: Number of underruns in the current track */
+	GMU_BUFFER_UNDERRUN_RECOVERED, /* Parameter: Duration of the underrun in ms */
 	GMU_PLAYBACK_TIME_CHANGE, GMU_MEDIALIB_REFRESH_DONE,
 	GMU_MEDIALIB_SEARCH_START, GMU_MEDIALIB_SEARCH_DONE,
+	GMU_MEDIALIB_ANALYSIS_PROGRESS, /* Parameter: Progress of the medialib analysis in percent */
+	GMU_PLAYLIST_TIME_CHANGE,       /* Parameter: Total length of the playlist in seconds */
 	GMU_ERROR, GMU_TICK
 } GmuEvent;
 #endif
@@ -28,6 +28,7 @@
 #define SYS_CLK_FREQ 7372800
 
 static int memfd;
+static void *memmap = MAP_FAILED;
 
 static volatile unsigned long  *memregs32;
 static volatile unsigned short *memregs16;
@@ -61,17 +62,22 @@ unsigned char gp2x_init_phys(void)
 		return 0;
 	}
 
-	memregs32 = (unsigned long*) mmap(0, 0x10000, PROT_READ|PROT_WRITE, 
-	                                  MAP_SHARED, memfd, 0xc0000000);
-
-	if (memregs32 == (unsigned long *)0xFFFFFFFF) return 0;
-	memregs16 = (unsigned short *)memregs32;
+	memmap = mmap(0, 0x10000, PROT_READ|PROT_WRITE, MAP_SHARED, memfd, 0xc0000000);
+	if (memmap == MAP_FAILED) {
+		close(memfd);
+		return 0;
+	}
+	memregs32 = (unsigned long *)memmap;
+	memregs16 = (unsigned short *)memmap;
 	wdprintf(V_DEBUG, "hw_gp2xwiz", "init phys.\n");
 	return 1;
 }
 
 void gp2x_close_phys(void)
 {
+	/* Unmap, since the registers get mapped again for every access */
+	if (memmap != MAP_FAILED) munmap(memmap, 0x10000);
+	memmap = MAP_FAILED;
 	close(memfd);
 	wdprintf(V_DEBUG, "hw_gp2xwiz", "close phys.\n");
 }
@@ -26,6 +26,12 @@
 
 #define SAMPLE_BUFFER_SIZE 4096
 
+/* CPU clock steps and hooks used for CPU frequency scaling (see cpufreq.c).
+ * Only the GP2X (MMSP2) clock registers are supported, not those of the Wiz. */
+#define HW_CPU_CLOCK_STEPS_MHZ { 100, 133, 166, 200 }
+#define hw_cpu_clock_available() (gp2x_get_model() != MODEL_WIZ)
+#define hw_set_cpu_clock(mhz) gp2x_set_cpu_clock(mhz)
+
 typedef enum GP2XModel { MODEL_UNKNOWN, MODEL_F100, MODEL_F200, MODEL_WIZ } GP2XModel;
 
 void          gp2x_set_cpu_clock(unsigned int MHz);
@@ -22,6 +22,8 @@
 #include "debug.h"
 #include "id3.h"
 #define ID3V2_MAX_SIZE 262144
+/* Upper limit for single frames (e.g. cover art) beyond ID3V2_MAX_SIZE */
+#define ID3V2_MAX_FRAME_SIZE 4194304
 
 static int convert_copy_strip(char *target, const char *source, size_t size)
 {
@@ -41,40 +43,39 @@ int id3_read_id3v1(FILE *file, TrackInfo *ti, const char *file_type)
 	int result = 0;
 
 	if (fseek(file, -128, SEEK_END) == 0) {
-		char id[3];
+		char tag[128];
 
 		/* Search for a ID3v1 tag: */
-		if (fread(id, 3, 1, file) && strncmp(id, "TAG", 3) == 0) {
+		if (fread(tag, 128, 1, file) && strncmp(tag, "TAG", 3) == 0) {
 			char title[31], artist[31], album[31], year[5], comment[31];
 			int  tracknr = 0;
 
-			if (fread(title, 30, 1, file)  &&
-			    fread(artist, 30, 1, file) &&
-			    fread(album, 30, 1, file)  &&
-			    fread(year, 4, 1, file)    &&
-			    fread(comment, 30, 1, file)) {
-				title[30] = '\0';
-				artist[30] = '\0';
-				album[30] = '\0';
-				year[4] = '\0';
-				comment[30] = '\0';
-				wdprintf(V_INFO, "id3", "ID3v1.%d detected!\n", (comment[28] == '\0' ? 1 : 0));
-				if (comment[28] == '\0') {
-					snprintf(ti->file_type, SIZE_FILE_TYPE-1, "%s (ID3v1.1)", file_type);
-					tracknr = comment[29];
-				} else {
-					snprintf(ti->file_type, SIZE_FILE_TYPE-1, "%s (ID3v1)", file_type);
-				}
-				if (strlen(title) > 0) {
-					convert_copy_strip(ti->title, title, SIZE_TITLE-1);
-				}
-				convert_copy_strip(ti->artist, artist, SIZE_ARTIST-1);
-				convert_copy_strip(ti->album, album, SIZE_ALBUM-1);
-				convert_copy_strip(ti->comment, comment, SIZE_COMMENT-1);
-				convert_copy_strip(ti->date, year, SIZE_DATE-1);
-				snprintf(ti->tracknr, SIZE_TRACKNR-1, "%d", tracknr);
-				result = 1;
+			memcpy(title,   tag+3,  30);
+			memcpy(artist,  tag+33, 30);
+			memcpy(album,   tag+63, 30);
+			memcpy(year,    tag+93, 4);
+			memcpy(comment, tag+97, 30);
+			title[30] = '\0';
+			artist[30] = '\0';
+			album[30] = '\0';
+			year[4] = '\0';
+			comment[30] = '\0';
+			wdprintf(V_INFO, "id3", "ID3v1.%d detected!\n", (comment[28] == '\0' ? 1 : 0));
+			if (comment[28] == '\0') {
+				snprintf(ti->file_type, SIZE_FILE_TYPE-1, "%s (ID3v1.1)", file_type);
+				tracknr = comment[29];
+			} else {
+				snprintf(ti->file_type, SIZE_FILE_TYPE-1, "%s (ID3v1)", file_type);
+			}
+			if (strlen(title) > 0) {
+				convert_copy_strip(ti->title, title, SIZE_TITLE-1);
 			}
+			convert_copy_strip(ti->artist, artist, SIZE_ARTIST-1);
+			convert_copy_strip(ti->album, album, SIZE_ALBUM-1);
+			convert_copy_strip(ti->comment, comment, SIZE_COMMENT-1);
+			convert_copy_strip(ti->date, year, SIZE_DATE-1);
+			snprintf(ti->tracknr, SIZE_TRACKNR-1, "%d", tracknr);
+			result = 1;
 		}
 	}
 	return result;
@@ -93,9 +94,36 @@ static int calc_size(const unsigned char *four_bytes)
 }
 
 typedef enum {
-	TITLE, ARTIST, ALBUM, COMMENT, DATE, TRACKNR, LYRICS
+	TITLE, ARTIST, ALBUM, COMMENT, DATE, TRACKNR
 } MetaDataItem;
 
+static int convert_text(char *target, size_t target_size, const char *str, size_t str_size, Charset charset)
+{
+	int res = 0;
+	switch (charset) {
+		case ISO_8859_1:
+			res = charset_iso8859_1_to_utf8(target, str, target_size);
+			break;
+		case UTF_8:
+			if (charset_is_valid_utf8_string(str)) {
+				strncpy(target, str, target_size);
+				res = 1;
+			} else {
+				target[0] = '\0';
+			}
+			break;
+		case UTF_16:
+			res = charset_utf16_to_utf8(target, target_size, str, str_size, BE);
+			break;
+		case UTF_16_BOM:
+			res = charset_utf16_to_utf8(target, target_size, str, str_size, BOM);
+			break;
+		default:
+			break;
+	}
+	return res;
+}
+
 static int set_data(
 	TrackInfo   *ti,
 	MetaDataItem mdi,
@@ -115,36 +143,15 @@ static int set_data(
 			case COMMENT: target = ti->comment; target_size = SIZE_COMMENT-1; break;
 			case DATE:    target = ti->date;    target_size = SIZE_DATE-1;    break;
 			case TRACKNR: target = ti->tracknr; target_size = SIZE_TRACKNR-1; break;
-			case LYRICS:  target = ti->lyrics;  target_size = SIZE_LYRICS-1;  break;
-		}
-		switch (charset) {
-			case ISO_8859_1:
-				res = charset_iso8859_1_to_utf8(target, str, target_size);
-				break;
-			case UTF_8:
-				if (charset_is_valid_utf8_string(str)) {
-					strncpy(target, str, target_size);
-					res = 1;
-				} else {
-					target[0] = '\0';
-				}
-				break;
-			case UTF_16:
-				res = charset_utf16_to_utf8(target, target_size, str, str_size, BE);
-				break;
-			case UTF_16_BOM:
-				res = charset_utf16_to_utf8(target, target_size, str, str_size, BOM);
-				break;
-			default:
-				break;
 		}
+		res = convert_text(target, target_size, str, str_size, charset);
 	}
 	return res;
 }
 
-static void set_cover_art(TrackInfo *ti, char *data, size_t data_size, Charset charset)
+static void set_cover_art(TrackInfo *ti, const char *data, size_t data_size, Charset charset)
 {
-	char  *mime_type = data, *descr = NULL;
+	const char *mime_type = data, *descr = NULL;
 	size_t m;
 	int    pic_type;
 	/* skip over mime type: */
@@ -165,14 +172,38 @@ static void set_cover_art(TrackInfo *ti, char *data, size_t data_size, Charset c
 		descr
 	);
 	/*wdprintf(V_DEBUG, "id3", "APIC: size = %d (header: %d)\n", data_size-m, m);*/
-	trackinfo_set_image(ti, data+m, data_size-m, mime_type);
+	if (m < data_size)
+		trackinfo_set_image(ti, data+m, data_size-m, mime_type);
+}
+
+/* ID3v2.2 PIC frames use a three character image format instead of a mime type */
+static void set_cover_art_v22(TrackInfo *ti, const char *data, size_t data_size, Charset charset)
+{
+	const char *mime_type = "image/jpeg";
+	size_t      m = 4; /* skip over image format and picture type byte */
+
+	if (data_size > m) {
+		if (strncmp(data, "PNG", 3) == 0)
+			mime_type = "image/png";
+		else if (strncmp(data, "BMP", 3) == 0)
+			mime_type = "image/bmp";
+		/* skip over description: */
+		if (charset == UTF_16 || charset == UTF_16_BOM)
+			for (; m + 1 < data_size && !(data[m] == '\0' && data[m+1] == '\0'); m += 2);
+		else
+			for (; m < data_size && data[m] != '\0'; m++);
+		m += (charset == UTF_16 || charset == UTF_16_BOM) ? 2 : 1;
+		wdprintf(V_DEBUG, "id3", "PIC: mime type: %s pic type: %d\n", mime_type, data[3]);
+		if (m < data_size)
+			trackinfo_set_image(ti, data+m, data_size-m, mime_type);
+	}
 }
 
 static void set_lyrics(TrackInfo *ti, const char *str, size_t str_size, Charset charset)
 {
-	if (str[0] != '\0') {
-		int i = 0;
-		/* skip lyrics description */
+	if (str_size > 0) {
+		size_t i = 0;
+		/* skip lyrics description (which is usually empty) */
 		if (charset == UTF_16 || charset == UTF_16_BOM)
 			for (i = 0; !(str[i] == '\0' && str[i+1] == '\0') && i < str_size; i++);
 		else
@@ -180,169 +211,262 @@ static void set_lyrics(TrackInfo *ti, const char *str, size_t str_size, Charset
 		if (charset == UTF_16 || charset == UTF_16_BOM) i++;
 		i++;
 		/*wdprintf(V_DEBUG, "id3", "i=%d str_size=%d str=%s\n", i, str_size, str);*/
-		set_data(ti, LYRICS, str+i, str_size-i, charset);
-		ti->has_lyrics = 1;
+		if (i < str_size && str[i] != '\0') {
+			/* Converted in a temporary buffer, the TrackInfo keeps a right-sized copy */
+			char *lyrics = malloc(SIZE_LYRICS);
+			if (lyrics) {
+				lyrics[SIZE_LYRICS-1] = '\0';
+				if (convert_text(lyrics, SIZE_LYRICS-1, str+i, str_size-i, charset))
+					trackinfo_set_lyrics(ti, lyrics);
+				free(lyrics);
+			}
+		}
+	}
+}
+
+/* Removes the unsynchronisation scheme (0xFF 0x00 -> 0xFF) in place,
+ * returns the new data size */
+static size_t decode_unsync(unsigned char *data, size_t size)
+{
+	size_t i, j;
+
+	for (i = 0, j = 0; i < size; i++) {
+		data[j++] = data[i];
+		if (data[i] == 0xFF && i + 1 < size && data[i+1] == 0x00)
+			i++;
 	}
+	return j;
 }
 
-static int fread_unsync(char *frame_data, size_t fsize, FILE *file)
+/*
+ * The tag is read from the file in one bulk read (bounded by ID3V2_MAX_SIZE)
+ * and parsed from memory. Frames outside of that window are only read from
+ * the file when they are actually needed.
+ */
+typedef struct Id3Buffer
 {
-	size_t j;
-
-	for (j = 0; j < fsize; j++) {
-		unsigned char uc = fgetc(file);
-		frame_data[j] = (char)uc;
-		if (uc == 0xFF) {
-			uc = fgetc(file);
-			if (uc != 0) {
-				j++;
-				frame_data[j] = (char)uc;
+	FILE          *file;
+	unsigned char *data;
+	size_t         data_size; /* Allocated size of data */
+	size_t         offset;    /* Tag offset of data[0] */
+	size_t         len;       /* Number of valid bytes in data */
+	size_t         tag_size;  /* Tag size (without the 10 bytes header) */
+	int            unsync;    /* Tag has been decoded as a whole, no further reads possible */
+} Id3Buffer;
+
+static const unsigned char *id3_buffer_get(Id3Buffer *b, size_t pos, size_t size)
+{
+	const unsigned char *res = NULL;
+
+	if (pos >= b->offset && size <= b->len && pos - b->offset <= b->len - size) {
+		res = b->data + (pos - b->offset);
+	} else if (!b->unsync && size <= ID3V2_MAX_FRAME_SIZE && size <= b->tag_size - pos) {
+		size_t read_size = b->data_size;
+
+		if (size > b->data_size) {
+			unsigned char *tmp = realloc(b->data, size);
+			if (tmp) {
+				b->data = tmp;
+				b->data_size = size;
+				read_size = size;
 			}
 		}
+		if (read_size > b->tag_size - pos) read_size = b->tag_size - pos;
+		if (size <= b->data_size && fseek(b->file, 10 + pos, SEEK_SET) == 0) {
+			b->offset = pos;
+			b->len = fread(b->data, 1, read_size, b->file);
+			if (b->len >= size) res = b->data;
+		}
 	}
-	return j;
+	return res;
+}
+
+/* Maps ID3v2.2 frame IDs to their ID3v2.3 counterparts */
+static const char *id3v22_frame_id(const unsigned char *id)
+{
+	static const char *ids[][2] = {
+		{ "TT2", "TIT2" }, { "TP1", "TPE1" }, { "TAL", "TALB" }, { "TRK", "TRCK" },
+		{ "TYE", "TYER" }, { "COM", "COMM" }, { "PIC", "APIC" }, { "ULT", "USLT" },
+		{ NULL, NULL }
+	};
+	int i;
+
+	for (i = 0; ids[i][0]; i++)
+		if (memcmp(id, ids[i][0], 3) == 0) return ids[i][1];
+	return "XXXX";
 }
 
-int id3_read_id3v2(FILE *file, TrackInfo *ti, const char *file_type)
+int id3_read_id3v2(FILE *file, TrackInfo *ti, const char *file_type, int flags)
 {
-	char id[3];
-	int  result = 0;
+	unsigned char header[10];
+	int           result = 0;
 
 	rewind(file);
-	if (fread(id, 3, 1, file) && strncmp(id, "ID3", 3) == 0) {
-		unsigned char ver_major, ver_minor, flags, size[4];
-
-		ver_major = fgetc(file);
-		ver_minor = fgetc(file);
-		flags     = fgetc(file);
-		if (fread(size, 4, 1, file)) {
-			wdprintf(V_INFO, "id3", "ID3v2.%d.%d detected!\n", ver_major, ver_minor);
-			snprintf(ti->file_type, SIZE_FILE_TYPE, "%s (ID3v2.%d.%d)",
-					 file_type, ver_major, ver_minor);
-			if (ver_major > 4 || ver_major < 3) {
-				wdprintf(V_WARNING, "id3", "Unsupported ID3 version.\n");
-			} else if ((flags & (1+2+4+8)) > 0) {
-				wdprintf(V_WARNING, "id3", "Tag error!\n");
-			} else {
-				int           error = 0, global_unsync = 0;
-				size_t        i, real_size = 0;
-				unsigned char frame_size[5];
-
-				if ((flags & 16) > 0) /* bit 4 */
-					wdprintf(V_DEBUG, "id3", "ID3v2: Footer present.\n");
-				if ((flags & 32) > 0) /* bit 5 */
-					wdprintf(V_DEBUG, "id3", "ID3v2: Experimental indicator is set.\n");
-				if ((flags & 64) > 0) /* bit 6 */
-					wdprintf(V_DEBUG, "id3", "ID3v2: Extended header bit is set.\n");
-				if ((flags & 128) > 0) { /* bit 7 */
-					wdprintf(V_DEBUG, "id3", "ID3v2: Unsynchronisation bit is set.\n");
-					global_unsync = 1;
+	if (fread(header, 10, 1, file) && strncmp((char *)header, "ID3", 3) == 0) {
+		unsigned char ver_major = header[3], ver_minor = header[4], tag_flags = header[5];
+
+		wdprintf(V_INFO, "id3", "ID3v2.%d.%d detected!\n", ver_major, ver_minor);
+		snprintf(ti->file_type, SIZE_FILE_TYPE, "%s (ID3v2.%d.%d)",
+				 file_type, ver_major, ver_minor);
+		if (ver_major > 4 || ver_major < 2) {
+			wdprintf(V_WARNING, "id3", "Unsupported ID3 version.\n");
+		} else if ((tag_flags & (1+2+4+8)) > 0 || (header[6] | header[7] | header[8] | header[9]) > 127) {
+			wdprintf(V_WARNING, "id3", "Tag error!\n");
+		} else if (ver_major == 2 && (tag_flags & 64) > 0) {
+			wdprintf(V_WARNING, "id3", "Compressed ID3v2.2 tags are not supported.\n");
+		} else {
+			Id3Buffer b;
+			size_t    header_len = ver_major == 2 ? 6 : 10;
+			size_t    pos = 0;
+
+			if ((tag_flags & 16) > 0) /* bit 4 */
+				wdprintf(V_DEBUG, "id3", "ID3v2: Footer present.\n");
+			if ((tag_flags & 32) > 0) /* bit 5 */
+				wdprintf(V_DEBUG, "id3", "ID3v2: Experimental indicator is set.\n");
+			b.file      = file;
+			b.tag_size  = calc_size_unsync(header + 6);
+			b.offset    = 0;
+			b.unsync    = 0;
+			b.data_size = b.tag_size < ID3V2_MAX_SIZE ? b.tag_size : ID3V2_MAX_SIZE;
+			b.data      = malloc(b.data_size > 0 ? b.data_size : 1);
+			b.len       = b.data ? fread(b.data, 1, b.data_size, file) : 0;
+			wdprintf(V_DEBUG, "id3", "Tag size: %d bytes\n", b.tag_size);
+
+			/* Before ID3v2.4 unsynchronisation applies to the whole tag */
+			if ((tag_flags & 128) > 0 && ver_major < 4) { /* bit 7 */
+				wdprintf(V_DEBUG, "id3", "ID3v2: Unsynchronisation bit is set.\n");
+				b.len      = decode_unsync(b.data, b.len);
+				b.tag_size = b.len;
+				b.unsync   = 1;
+			}
+			if ((tag_flags & 64) > 0 && b.len >= 4) { /* bit 6 */
+				wdprintf(V_DEBUG, "id3", "ID3v2: Extended header bit is set.\n");
+				if (ver_major == 3)
+					pos = 4 + calc_size(b.data);
+				else
+					pos = calc_size_unsync(b.data);
+			}
+
+			while (b.data && pos < b.tag_size && b.tag_size - pos >= header_len) {
+				const unsigned char *h = id3_buffer_get(&b, pos, header_len);
+				const unsigned char *frame;
+				const char          *frame_id;
+				char                 frame_id_v2x[5];
+				size_t               fsize;
+				unsigned char        fflags;
+				int                  frame_unsync = 0, wanted;
+
+				if (!h || h[0] == '\0') break; /* Padding */
+				/* h is only valid until the next id3_buffer_get() call */
+				fflags = ver_major == 2 ? 0 : h[9];
+				if (ver_major == 2) {
+					frame_id = id3v22_frame_id(h);
+					fsize = (h[3] << 16) | (h[4] << 8) | h[5];
+				} else {
+					memcpy(frame_id_v2x, h, 4);
+					frame_id_v2x[4] = '\0';
+					frame_id = frame_id_v2x;
+					/* ID3v2.4 uses synchsafe integers for the frame size */
+					fsize = ver_major == 4 ? calc_size_unsync(h+4) : calc_size(h+4);
+				}
+				pos += header_len;
+				if (fsize > b.tag_size - pos) break;
+
+				wanted = strncmp(frame_id, "TIT2", 4) == 0 || strncmp(frame_id, "TPE1", 4) == 0 ||
+				         strncmp(frame_id, "TALB", 4) == 0 || strncmp(frame_id, "TRCK", 4) == 0 ||
+				         strncmp(frame_id, "TYER", 4) == 0 || strncmp(frame_id, "TDRC", 4) == 0 ||
+				         strncmp(frame_id, "COMM", 4) == 0 ||
+				         ((flags & ID3_READ_COVER)  && strncmp(frame_id, "APIC", 4) == 0) ||
+				         ((flags & ID3_READ_LYRICS) && strncmp(frame_id, "USLT", 4) == 0);
+				if (ver_major == 4) {
+					if (fflags & (8+4)) /* Compressed or encrypted */
+						wanted = 0;
+					frame_unsync = (fflags & 2) ? 1 : 0;
+				} else if (ver_major == 3) {
+					if (fflags & (128+64))
+						wanted = 0;
 				}
-				real_size = calc_size_unsync(size);
-				wdprintf(V_DEBUG, "id3", "Tag size: %d bytes\n", real_size);
-				for (i = 0; i < 4; i++)
-					if (size[i] > 127) {
-						wdprintf(V_WARNING, "id3", "Error in ID3 tag.\n");
-						error = 1;
-						break;
+
+				if (wanted && fsize > 1 && (frame = id3_buffer_get(&b, pos, fsize))) {
+					char    *frame_data = malloc(fsize+2);
+					Charset  charset    = ISO_8859_1;
+					char    *tmp_charset;
+					size_t   data_size  = fsize;
+
+					if (!frame_data) break;
+					memcpy(frame_data, frame, fsize);
+					if (ver_major == 4 && (fflags & 1) && fsize > 4) { /* Data length indicator */
+						data_size -= 4;
+						memmove(frame_data, frame_data+4, data_size);
+					}
+					if (frame_unsync)
+						data_size = decode_unsync((unsigned char *)frame_data, data_size);
+					if (data_size < 2) {
+						free(frame_data);
+						pos += fsize;
+						continue;
 					}
-				if (!error) {
-					size_t byte_counter = 0;
-					char   frame_id[5] = "X", frame_flags[3];
-
-					if (real_size - 10 > ID3V2_MAX_SIZE) frame_id[0] = 0;
-					while (byte_counter < real_size - 10 && frame_id[0] != 0) {
-						size_t fsize;
-						int    frame_unsync = 0;
-
-						if (fread(frame_id,    4, 1, file) &&
-						    fread(frame_size,  4, 1, file) &&
-						    fread(frame_flags, 2, 1, file)) {
-							byte_counter += 10;
-							fsize = calc_size(frame_size);
-							/*wdprintf(V_DEBUG, "id3", "Frame ID: %s - Frame size: %d bytes\n", frame_id, fsize);*/
-
-							if (ver_major == 4)
-								frame_unsync = (frame_flags[1] & 2) ? 1 : 0;
-							/*wdprintf(V_DEBUG, "id3", "bytecounter=%d fsize=%d realsize=%d r-b=%d\n",
-									   byte_counter, fsize, real_size, real_size - byte_counter);*/
-							if (fsize > 0 && fsize <= real_size - byte_counter) {
-								char    *frame_data = malloc(fsize+1);
-								Charset  charset    = ISO_8859_1;
-								char    *tmp_charset;
-
-								if ((global_unsync && ver_major == 3 ) || frame_unsync) {
-									fread_unsync(frame_data, fsize, file);
-									/*wdprintf(V_DEBUG, "id3", "Decoded unsync scheme.\n");*/
-								} else {
-									if (!fread(frame_data, fsize, 1, file)) {
-										wdprintf(V_ERROR, "id3", "ERROR: Incomplete data.\n");
-										break;
-									}
-								}
-								byte_counter += fsize;
-								frame_data[fsize] = '\0';
-								switch(frame_data[0]) {
-									case 0:
-										charset = ISO_8859_1;
-										tmp_charset = "ISO-8859-1";
-										break;
-									case 1:
-										charset = UTF_16_BOM;
-										tmp_charset = "UTF-16 (with BOM)";
-										break;
-									case 2:
-										charset = UTF_16;
-										tmp_charset = "UTF-16 (without BOM)";
-										break;
-									case 3:
-										charset = UTF_8;
-										tmp_charset = "UTF-8";
-										break;
-									default:
-										tmp_charset = "unknown";
-										break;
-								}
-								wdprintf(V_INFO, "id3", "%s charset: %s\n", frame_id, tmp_charset);
-								/*wdprintf(V_DEBUG, "id3", "Frame data: %s\n", frame_data+1);*/
-
-								if (strncmp(frame_id, "TIT2", 4) == 0) {
-									int r = set_data(ti, TITLE, frame_data+1, fsize-1, charset);
-									if (!result) result = r;
-								} else if (strncmp(frame_id, "TPE1", 4) == 0) {
-									int r = set_data(ti, ARTIST, frame_data+1, fsize-1, charset);
-									if (!result) result = r;
-								} else if (strncmp(frame_id, "TALB", 4) == 0) {
-									set_data(ti, ALBUM, frame_data+1, fsize-1, charset);	
-								} else if (strncmp(frame_id, "TRCK", 4) == 0) {
-									set_data(ti, TRACKNR, frame_data+1, fsize-1, charset);
-								} else if (strncmp(frame_id, "TYER", 4) == 0) { /* 2.3.0 */
-									set_data(ti, DATE, frame_data+1, fsize-1, charset);						
-								} else if (strncmp(frame_id, "TDRC", 4) == 0) { /* 2.4.0 */
-									set_data(ti, DATE, frame_data+1, fsize-1, charset);
-								} else if (strncmp(frame_id, "COMM", 4) == 0) {
-									set_data(ti, COMMENT, frame_data+1, fsize-1, charset);
-								} else if (strncmp(frame_id, "APIC", 4) == 0) {
-									set_cover_art(ti, frame_data+1, fsize-1, charset);
-								} else if (strncmp(frame_id, "USLT", 4) == 0) {
-									set_lyrics(ti, frame_data+4, fsize-4, charset);
-								}
-								free(frame_data);
-							} else {
-								break;
-							}
-						} else {
+					/* Terminate the data for both 8 bit and 16 bit character sets */
+					frame_data[data_size] = '\0';
+					frame_data[data_size+1] = '\0';
+					switch(frame_data[0]) {
+						case 0:
+							charset = ISO_8859_1;
+							tmp_charset = "ISO-8859-1";
+							break;
+						case 1:
+							charset = UTF_16_BOM;
+							tmp_charset = "UTF-16 (with BOM)";
+							break;
+						case 2:
+							charset = UTF_16;
+							tmp_charset = "UTF-16 (without BOM)";
 							break;
-						}
+						case 3:
+							charset = UTF_8;
+							tmp_charset = "UTF-8";
+							break;
+						default:
+							tmp_charset = "unknown";
+							break;
+					}
+					wdprintf(V_INFO, "id3", "%s charset: %s\n", frame_id, tmp_charset);
+
+					if (strncmp(frame_id, "TIT2", 4) == 0) {
+						int r = set_data(ti, TITLE, frame_data+1, data_size-1, charset);
+						if (!result) result = r;
+					} else if (strncmp(frame_id, "TPE1", 4) == 0) {
+						int r = set_data(ti, ARTIST, frame_data+1, data_size-1, charset);
+						if (!result) result = r;
+					} else if (strncmp(frame_id, "TALB", 4) == 0) {
+						set_data(ti, ALBUM, frame_data+1, data_size-1, charset);
+					} else if (strncmp(frame_id, "TRCK", 4) == 0) {
+						set_data(ti, TRACKNR, frame_data+1, data_size-1, charset);
+					} else if (strncmp(frame_id, "TYER", 4) == 0) { /* 2.3.0 */
+						set_data(ti, DATE, frame_data+1, data_size-1, charset);
+					} else if (strncmp(frame_id, "TDRC", 4) == 0) { /* 2.4.0 */
+						set_data(ti, DATE, frame_data+1, data_size-1, charset);
+					} else if (strncmp(frame_id, "COMM", 4) == 0) {
+						set_data(ti, COMMENT, frame_data+1, data_size-1, charset);
+					} else if (strncmp(frame_id, "APIC", 4) == 0) {
+						if (ver_major == 2)
+							set_cover_art_v22(ti, frame_data+1, data_size-1, charset);
+						else
+							set_cover_art(ti, frame_data+1, data_size-1, charset);
+					} else if (strncmp(frame_id, "USLT", 4) == 0 && data_size > 4) {
+						set_lyrics(ti, frame_data+4, data_size-4, charset);
 					}
+					free(frame_data);
 				}
+				pos += fsize;
 			}
+			free(b.data);
 		}
 	}
 	return result;
 }
 
-int id3_read_tag(const char *filename, TrackInfo *ti, const char *file_type)
+int id3_read_tag(const char *filename, TrackInfo *ti, const char *file_type, int flags)
 {
 	int   result = 0;
 	FILE *file;
@@ -364,7 +488,7 @@ int id3_read_tag(const char *filename, TrackInfo *ti, const char *file_type)
 			}
 		}
 		strncpy(ti->file_type, "MP3", SIZE_FILE_TYPE-1);
-		if (!(result = id3_read_id3v2(file, ti, file_type)))
+		if (!(result = id3_read_id3v2(file, ti, file_type, flags)))
 			result = id3_read_id3v1(file, ti, file_type);
 		fclose(file);
 	}
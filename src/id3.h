@@ -18,7 +18,13 @@
 #include <stdio.h>
 #include "trackinfo.h"
 
+/* Flags for id3_read_id3v2() and id3_read_tag(), selecting the (potentially
+ * large) frames to be extracted in addition to the basic meta data */
+#define ID3_READ_COVER  1
+#define ID3_READ_LYRICS 2
+#define ID3_READ_ALL    (ID3_READ_COVER | ID3_READ_LYRICS)
+
 int id3_read_id3v1(FILE *file, TrackInfo *ti, const char *file_type);
-int id3_read_id3v2(FILE *file, TrackInfo *ti, const char *file_type);
-int id3_read_tag(const char *filename, TrackInfo *ti, const char *file_type);
+int id3_read_id3v2(FILE *file, TrackInfo *ti, const char *file_type, int flags);
+int id3_read_tag(const char *filename, TrackInfo *ti, const char *file_type, int flags);
 #endif
@@ -0,0 +1,459 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: loudness.c  Created: 210925
+ *
+ * Description: EBU R128 loudness and true peak measurement
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "loudness.h"
+#include "pcmconv.h"
+#include "debug.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define LOUDNESS_HAVE_SSE2 1
+#include <emmintrin.h>
+#define SSE2_FUNC __attribute__((target("sse2")))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LOUDNESS_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* Channels are processed in groups of LANES, one channel per vector lane,
+ * since the biquads are recursive and cannot be vectorized along time */
+#define LANES         4
+#define GROUPS        (LOUDNESS_MAX_CHANNELS / LANES)
+#define CHUNK_FRAMES  1024
+/* Taps per phase of the true peak interpolation filter */
+#define TP_TAPS       12
+#define TP_MAX_PHASES 4
+/* Gating (in LUFS/LU) as specified by EBU R128 */
+#define ABSOLUTE_GATE -70.0
+#define RELATIVE_GATE -10.0
+
+typedef struct Biquad
+{
+	float b0, b1, b2, a1, a2;
+} Biquad;
+
+struct Loudness
+{
+	int     channels, groups, phases;
+	Biquad  stage[2];
+	/* Filter states: [stage][z1/z2][lane] per group */
+	float   state[GROUPS][2 * 2 * LANES];
+	float   weight[GROUPS * LANES];
+	float   tp_coefs[TP_MAX_PHASES * TP_TAPS];
+	/* Samples of each group; The first TP_TAPS-1 frames are the history
+	 * needed by the interpolation filter. */
+	float   buf[GROUPS][(TP_TAPS - 1 + CHUNK_FRAMES) * LANES];
+	float   peak;
+	/* Gating blocks are 400 ms long and overlap by 75%, so they are made of
+	 * the energies of the last four 100 ms sub-blocks */
+	size_t  subblock_len, subblock_pos;
+	double  subblock_sum[GROUPS * LANES];
+	double  subblocks[4];
+	size_t  subblock_count;
+	double *blocks;
+	size_t  blocks_len, blocks_size;
+};
+
+/*
+ * Kernels working on LANES channels at once. Each frame fills exactly one
+ * vector, so unlike the pcmconv kernels, they need no scalar tail.
+ */
+typedef struct LoudnessKernels
+{
+	const char *name;
+	/* Filters 'frames' frames with the two K-weighting biquads, updating the
+	 * filter state, and stores the sum of the squared results per lane */
+	void  (*kweight)(const Biquad *, float *, const float *, size_t, float *);
+	/* Returns the maximum absolute value of the signal interpolated by the
+	 * polyphase filter; x is preceded by TP_TAPS-1 frames of history */
+	float (*true_peak)(const float *, int, const float *, size_t);
+} LoudnessKernels;
+
+static void kweight_c(const Biquad *bq, float *state, const float *x, size_t frames, float *sum)
+{
+	int lane;
+
+	for (lane = 0; lane < LANES; lane++) {
+		float  z1a = state[lane], z2a = state[LANES + lane];
+		float  z1b = state[2 * LANES + lane], z2b = state[3 * LANES + lane];
+		float  acc = 0.0f;
+		size_t n;
+
+		for (n = 0; n < frames; n++) {
+			float v = x[n * LANES + lane];
+			float y = bq[0].b0 * v + z1a;
+			float w;
+			z1a = bq[0].b1 * v - bq[0].a1 * y + z2a;
+			z2a = bq[0].b2 * v - bq[0].a2 * y;
+			w   = bq[1].b0 * y + z1b;
+			z1b = bq[1].b1 * y - bq[1].a1 * w + z2b;
+			z2b = bq[1].b2 * y - bq[1].a2 * w;
+			acc += w * w;
+		}
+		state[lane] = z1a;
+		state[LANES + lane] = z2a;
+		state[2 * LANES + lane] = z1b;
+		state[3 * LANES + lane] = z2b;
+		sum[lane] = acc;
+	}
+}
+
+static float true_peak_c(const float *coefs, int phases, const float *x, size_t frames)
+{
+	float  peak = 0.0f;
+	size_t n;
+
+	for (n = 0; n < frames; n++) {
+		int p, lane, k;
+		for (p = 0; p < phases; p++) {
+			for (lane = 0; lane < LANES; lane++) {
+				float acc = 0.0f;
+				for (k = 0; k < TP_TAPS; k++)
+					acc += coefs[p * TP_TAPS + k] * x[((long)n - k) * LANES + lane];
+				if (fabsf(acc) > peak) peak = fabsf(acc);
+			}
+		}
+	}
+	return peak;
+}
+
+static const LoudnessKernels kernels_scalar = {
+	"scalar",
+	kweight_c,
+	true_peak_c
+};
+
+#ifdef LOUDNESS_HAVE_SSE2
+static SSE2_FUNC void kweight_sse2(const Biquad *bq, float *state, const float *x, size_t frames, float *sum)
+{
+	__m128 b0a = _mm_set1_ps(bq[0].b0), b1a = _mm_set1_ps(bq[0].b1), b2a = _mm_set1_ps(bq[0].b2);
+	__m128 a1a = _mm_set1_ps(bq[0].a1), a2a = _mm_set1_ps(bq[0].a2);
+	__m128 b0b = _mm_set1_ps(bq[1].b0), b1b = _mm_set1_ps(bq[1].b1), b2b = _mm_set1_ps(bq[1].b2);
+	__m128 a1b = _mm_set1_ps(bq[1].a1), a2b = _mm_set1_ps(bq[1].a2);
+	__m128 z1a = _mm_loadu_ps(state), z2a = _mm_loadu_ps(state + LANES);
+	__m128 z1b = _mm_loadu_ps(state + 2 * LANES), z2b = _mm_loadu_ps(state + 3 * LANES);
+	__m128 acc = _mm_setzero_ps();
+	size_t n;
+
+	for (n = 0; n < frames; n++) {
+		__m128 v = _mm_loadu_ps(x + n * LANES);
+		__m128 y = _mm_add_ps(_mm_mul_ps(b0a, v), z1a);
+		__m128 w;
+		z1a = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1a, v), _mm_mul_ps(a1a, y)), z2a);
+		z2a = _mm_sub_ps(_mm_mul_ps(b2a, v), _mm_mul_ps(a2a, y));
+		w   = _mm_add_ps(_mm_mul_ps(b0b, y), z1b);
+		z1b = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1b, y), _mm_mul_ps(a1b, w)), z2b);
+		z2b = _mm_sub_ps(_mm_mul_ps(b2b, y), _mm_mul_ps(a2b, w));
+		acc = _mm_add_ps(acc, _mm_mul_ps(w, w));
+	}
+	_mm_storeu_ps(state, z1a);
+	_mm_storeu_ps(state + LANES, z2a);
+	_mm_storeu_ps(state + 2 * LANES, z1b);
+	_mm_storeu_ps(state + 3 * LANES, z2b);
+	_mm_storeu_ps(sum, acc);
+}
+
+static SSE2_FUNC float true_peak_sse2(const float *coefs, int phases, const float *x, size_t frames)
+{
+	__m128 sign = _mm_set1_ps(-0.0f);
+	__m128 peak = _mm_setzero_ps();
+	size_t n;
+
+	for (n = 0; n < frames; n++) {
+		int p, k;
+		for (p = 0; p < phases; p++) {
+			__m128 acc = _mm_setzero_ps();
+			for (k = 0; k < TP_TAPS; k++)
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(coefs[p * TP_TAPS + k]),
+				                                 _mm_loadu_ps(x + ((long)n - k) * LANES)));
+			peak = _mm_max_ps(peak, _mm_andnot_ps(sign, acc));
+		}
+	}
+	peak = _mm_max_ps(peak, _mm_movehl_ps(peak, peak));
+	peak = _mm_max_ss(peak, _mm_shuffle_ps(peak, peak, 1));
+	return _mm_cvtss_f32(peak);
+}
+
+static const LoudnessKernels kernels_sse2 = {
+	"SSE2",
+	kweight_sse2,
+	true_peak_sse2
+};
+#endif
+
+#ifdef LOUDNESS_HAVE_NEON
+static void kweight_neon(const Biquad *bq, float *state, const float *x, size_t frames, float *sum)
+{
+	float32x4_t z1a = vld1q_f32(state), z2a = vld1q_f32(state + LANES);
+	float32x4_t z1b = vld1q_f32(state + 2 * LANES), z2b = vld1q_f32(state + 3 * LANES);
+	float32x4_t acc = vdupq_n_f32(0.0f);
+	size_t      n;
+
+	for (n = 0; n < frames; n++) {
+		float32x4_t v = vld1q_f32(x + n * LANES);
+		float32x4_t y = vmlaq_n_f32(z1a, v, bq[0].b0);
+		float32x4_t w;
+		z1a = vmlsq_n_f32(vmlaq_n_f32(z2a, v, bq[0].b1), y, bq[0].a1);
+		z2a = vmlsq_n_f32(vmulq_n_f32(v, bq[0].b2), y, bq[0].a2);
+		w   = vmlaq_n_f32(z1b, y, bq[1].b0);
+		z1b = vmlsq_n_f32(vmlaq_n_f32(z2b, y, bq[1].b1), w, bq[1].a1);
+		z2b = vmlsq_n_f32(vmulq_n_f32(y, bq[1].b2), w, bq[1].a2);
+		acc = vmlaq_f32(acc, w, w);
+	}
+	vst1q_f32(state, z1a);
+	vst1q_f32(state + LANES, z2a);
+	vst1q_f32(state + 2 * LANES, z1b);
+	vst1q_f32(state + 3 * LANES, z2b);
+	vst1q_f32(sum, acc);
+}
+
+static float true_peak_neon(const float *coefs, int phases, const float *x, size_t frames)
+{
+	float32x4_t peak = vdupq_n_f32(0.0f);
+	float32x2_t m;
+	size_t      n;
+
+	for (n = 0; n < frames; n++) {
+		int p, k;
+		for (p = 0; p < phases; p++) {
+			float32x4_t acc = vdupq_n_f32(0.0f);
+			for (k = 0; k < TP_TAPS; k++)
+				acc = vmlaq_n_f32(acc, vld1q_f32(x + ((long)n - k) * LANES), coefs[p * TP_TAPS + k]);
+			peak = vmaxq_f32(peak, vabsq_f32(acc));
+		}
+	}
+	m = vpmax_f32(vget_low_f32(peak), vget_high_f32(peak));
+	return vget_lane_f32(vpmax_f32(m, m), 0);
+}
+
+static const LoudnessKernels kernels_neon = {
+	"NEON",
+	kweight_neon,
+	true_peak_neon
+};
+#endif
+
+static const LoudnessKernels *kernels = &kernels_scalar;
+
+void loudness_init(void)
+{
+	kernels = &kernels_scalar;
+#ifdef LOUDNESS_HAVE_NEON
+	if (pcmconv_cpu_supports(PCMCONV_IMPL_NEON)) kernels = &kernels_neon;
+#endif
+#ifdef LOUDNESS_HAVE_SSE2
+	if (pcmconv_cpu_supports(PCMCONV_IMPL_SSE2)) kernels = &kernels_sse2;
+#endif
+	wdprintf(V_DEBUG, "loudness", "Using %s kernels.\n", kernels->name);
+}
+
+const char *loudness_get_implementation_name(void)
+{
+	return kernels->name;
+}
+
+/* K-weighting filter of ITU-R BS.1770, with the coefficients computed for
+ * the given sample rate: A high shelf modelling the head, followed by the
+ * "RLB" high pass */
+static void kweighting_init(Biquad *stage, int samplerate)
+{
+	double f0 = 1681.974450955533, gain = 3.999843853973347, q = 0.7071752369554196;
+	double k = tan(M_PI * f0 / samplerate);
+	double vh = pow(10.0, gain / 20.0), vb = pow(vh, 0.4996667741545416);
+	double a0 = 1.0 + k / q + k * k;
+
+	stage[0].b0 = (float)((vh + vb * k / q + k * k) / a0);
+	stage[0].b1 = (float)(2.0 * (k * k - vh) / a0);
+	stage[0].b2 = (float)((vh - vb * k / q + k * k) / a0);
+	stage[0].a1 = (float)(2.0 * (k * k - 1.0) / a0);
+	stage[0].a2 = (float)((1.0 - k / q + k * k) / a0);
+
+	f0 = 38.13547087602444;
+	q  = 0.5003270373238773;
+	k  = tan(M_PI * f0 / samplerate);
+	a0 = 1.0 + k / q + k * k;
+	stage[1].b0 = 1.0f;
+	stage[1].b1 = -2.0f;
+	stage[1].b2 = 1.0f;
+	stage[1].a1 = (float)(2.0 * (k * k - 1.0) / a0);
+	stage[1].a2 = (float)((1.0 - k / q + k * k) / a0);
+}
+
+/* Windowed sinc interpolation filter, split into one sub-filter per phase.
+ * Each phase is normalized to unity gain at DC. */
+static void true_peak_init(float *coefs, int phases)
+{
+	int    taps = phases * TP_TAPS, p, k;
+	double center = (taps - 1) / 2.0;
+
+	for (p = 0; p < phases; p++) {
+		double sum = 0.0;
+		for (k = 0; k < TP_TAPS; k++) {
+			int    m = k * phases + p;
+			double t = (m - center) / phases;
+			double h = t == 0.0 ? 1.0 : sin(M_PI * t) / (M_PI * t);
+			/* Blackman window */
+			h *= 0.42 - 0.5 * cos(2.0 * M_PI * (m + 0.5) / taps) + 0.08 * cos(4.0 * M_PI * (m + 0.5) / taps);
+			coefs[p * TP_TAPS + k] = (float)h;
+			sum += h;
+		}
+		for (k = 0; k < TP_TAPS; k++)
+			coefs[p * TP_TAPS + k] = (float)(coefs[p * TP_TAPS + k] / sum);
+	}
+}
+
+Loudness *loudness_new(int samplerate, int channels)
+{
+	Loudness *l = NULL;
+
+	if (samplerate > 0 && channels > 0 && channels <= LOUDNESS_MAX_CHANNELS &&
+	    (l = calloc(1, sizeof(Loudness)))) {
+		int c;
+
+		l->channels = channels;
+		l->groups = (channels + LANES - 1) / LANES;
+		kweighting_init(l->stage, samplerate);
+		/* Oversampled to at least 192 kHz for measuring the true peak */
+		l->phases = samplerate < 96000 ? 4 : (samplerate < 192000 ? 2 : 1);
+		true_peak_init(l->tp_coefs, l->phases);
+		for (c = 0; c < channels; c++)
+			l->weight[c] = 1.0f;
+		/* 5.1: The LFE channel is ignored, the surround channels are weighted */
+		if (channels == 6) {
+			l->weight[3] = 0.0f;
+			l->weight[4] = 1.41f;
+			l->weight[5] = 1.41f;
+		}
+		l->subblock_len = (samplerate + 5) / 10;
+	}
+	return l;
+}
+
+void loudness_free(Loudness *l)
+{
+	if (l) free(l->blocks);
+	free(l);
+}
+
+static void add_block(Loudness *l, double energy)
+{
+	if (l->blocks_len == l->blocks_size) {
+		size_t  size = l->blocks_size ? l->blocks_size * 2 : 1024;
+		double *tmp = realloc(l->blocks, size * sizeof(double));
+		if (!tmp) return;
+		l->blocks = tmp;
+		l->blocks_size = size;
+	}
+	l->blocks[l->blocks_len++] = energy;
+}
+
+static void finish_subblock(Loudness *l)
+{
+	double energy = 0.0;
+	int    c;
+
+	for (c = 0; c < l->channels; c++) {
+		energy += l->weight[c] * l->subblock_sum[c];
+		l->subblock_sum[c] = 0.0;
+	}
+	l->subblocks[l->subblock_count % 4] = energy / l->subblock_len;
+	l->subblock_count++;
+	l->subblock_pos = 0;
+	if (l->subblock_count >= 4)
+		add_block(l, (l->subblocks[0] + l->subblocks[1] + l->subblocks[2] + l->subblocks[3]) / 4.0);
+}
+
+/* Processes the frames waiting in the buffers (at most up to the end of the current sub-block) */
+static void process(Loudness *l, size_t frames)
+{
+	int g, i;
+
+	for (g = 0; g < l->groups; g++) {
+		float *x = l->buf[g] + (TP_TAPS - 1) * LANES;
+		float  sum[LANES], peak;
+		int    lane;
+
+		kernels->kweight(l->stage, l->state[g], x, frames, sum);
+		for (lane = 0; lane < LANES && g * LANES + lane < l->channels; lane++)
+			l->subblock_sum[g * LANES + lane] += sum[lane];
+		peak = kernels->true_peak(l->tp_coefs, l->phases, x, frames);
+		if (peak > l->peak) l->peak = peak;
+		/* Keep the history for the interpolation filter */
+		memmove(l->buf[g], l->buf[g] + frames * LANES, (TP_TAPS - 1) * LANES * sizeof(float));
+		/* Avoid slow denormal numbers while the filters decay during silence */
+		for (i = 0; i < 2 * 2 * LANES; i++)
+			if (fabsf(l->state[g][i]) < 1e-20f) l->state[g][i] = 0.0f;
+	}
+	l->subblock_pos += frames;
+	if (l->subblock_pos == l->subblock_len) finish_subblock(l);
+}
+
+void loudness_add_samples(Loudness *l, const int16_t *samples, size_t frames)
+{
+	while (frames > 0) {
+		size_t n = l->subblock_len - l->subblock_pos, i;
+		int    c;
+
+		if (n > CHUNK_FRAMES) n = CHUNK_FRAMES;
+		if (n > frames) n = frames;
+		for (i = 0; i < n; i++) {
+			for (c = 0; c < l->channels; c++)
+				l->buf[c / LANES][(TP_TAPS - 1 + i) * LANES + c % LANES] = *samples++ * (1.0f / 32768.0f);
+		}
+		process(l, n);
+		frames -= n;
+	}
+}
+
+static double energy_to_lufs(double energy)
+{
+	return -0.691 + 10.0 * log10(energy);
+}
+
+int loudness_compute(Loudness *l, double *integrated, double *true_peak)
+{
+	double abs_gate = pow(10.0, (ABSOLUTE_GATE + 0.691) / 10.0), rel_gate;
+	double sum = 0.0;
+	size_t n = 0, i;
+
+	for (i = 0; i < l->blocks_len; i++) {
+		if (l->blocks[i] > abs_gate) {
+			sum += l->blocks[i];
+			n++;
+		}
+	}
+	if (n == 0) return 0;
+	rel_gate = sum / n * pow(10.0, RELATIVE_GATE / 10.0);
+	sum = 0.0;
+	n = 0;
+	for (i = 0; i < l->blocks_len; i++) {
+		if (l->blocks[i] > abs_gate && l->blocks[i] > rel_gate) {
+			sum += l->blocks[i];
+			n++;
+		}
+	}
+	if (n == 0 || l->peak <= 0.0f) return 0;
+	*integrated = energy_to_lufs(sum / n);
+	*true_peak = 20.0 * log10(l->peak);
+	return 1;
+}
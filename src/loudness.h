@@ -0,0 +1,40 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: loudness.h  Created: 210925
+ *
+ * Description: EBU R128 loudness and true peak measurement
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#ifndef _LOUDNESS_H
+#define _LOUDNESS_H
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOUDNESS_MAX_CHANNELS 8
+/* Reference level for ReplayGain 2.0 compatible gain values */
+#define LOUDNESS_REPLAYGAIN_REFERENCE -18.0
+
+typedef struct Loudness Loudness;
+
+/* Selects the fastest kernel set supported by the CPU. Must be called once
+ * before any other function. */
+void        loudness_init(void);
+const char *loudness_get_implementation_name(void);
+/* Returns NULL for unsupported formats (more than LOUDNESS_MAX_CHANNELS channels) */
+Loudness   *loudness_new(int samplerate, int channels);
+void        loudness_free(Loudness *l);
+/* Measures interleaved signed 16 bit samples */
+void        loudness_add_samples(Loudness *l, const int16_t *samples, size_t frames);
+/* Computes the integrated loudness (ITU-R BS.1770-4 with gating as specified
+ * by EBU R128) in LUFS and the true peak in dBTP. Returns 1 on success, 0 if
+ * the audio was too short or silent. */
+int         loudness_compute(Loudness *l, double *integrated, double *true_peak);
+#endif
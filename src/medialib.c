@@ -10,6 +10,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <pthread.h>
 #include <sqlite3.h>
 #include "medialib.h"
@@ -17,6 +18,7 @@
 #include "dirparser.h"
 #include "trackinfo.h"
 #include "metadatareader.h"
+#include "audioinfo.h"
 #include "util.h"
 #include "debug.h"
 #include "core.h" /* For DEFAULT_THREAD_STACK_SIZE */
@@ -36,12 +38,45 @@ int medialib_create_db_and_open(GmuMedialib *gm)
 	return res;
 }
 
+/* Brings databases created by older versions up to date */
+static int medialib_upgrade_schema(GmuMedialib *gm)
+{
+	sqlite3_stmt *pp_stmt = NULL;
+	int           version = 0, res = 1;
+
+	if (sqlite3_prepare_v2(gm->db, "PRAGMA user_version", -1, &pp_stmt, NULL) == SQLITE_OK &&
+	    sqlite3_step(pp_stmt) == SQLITE_ROW)
+		version = sqlite3_column_int(pp_stmt, 0);
+	sqlite3_finalize(pp_stmt);
+	for (; res && version >= 0 && medialib_sql_upgrades[version]; version++) {
+		char *q = sqlite3_mprintf("BEGIN; %s PRAGMA user_version = %d; COMMIT;", medialib_sql_upgrades[version], version + 1);
+
+		wdprintf(V_INFO, "medialib", "Upgrading database schema to version %d...\n", version + 1);
+		res = q && sqlite3_exec(gm->db, q, 0, 0, 0) == SQLITE_OK;
+		if (!res) {
+			wdprintf(V_ERROR, "medialib", "ERROR: Schema upgrade failed: %s\n", sqlite3_errmsg(gm->db));
+			sqlite3_exec(gm->db, "ROLLBACK", 0, 0, 0);
+		}
+		sqlite3_free(q);
+	}
+	return res;
+}
+
 int medialib_open(GmuMedialib *gm)
 {
 	int   res = 0;
 	char *gmu_db = get_data_dir_with_name_alloc("gmu", 1, "gmu.db");
 
 	gm->refresh_in_progress = 0;
+	gm->index = NULL;
+	gm->index_enabled = 0;
+	gm->index_thread_started = 0;
+	gm->index_writes = 0;
+	gm->search_from_index = 0;
+	gm->browse_from_index = 0;
+	memset(&gm->search_result, 0, sizeof(MedialibIndexResult));
+	memset(&gm->browse_result, 0, sizeof(MedialibIndexResult));
+	pthread_mutex_init(&gm->index_mutex, NULL);
 	wdprintf(V_INFO, "medialib", "Opening medialib...\n");
 	if (gmu_db && sqlite3_open_v2(gmu_db, &(gm->db), SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX, NULL) != SQLITE_OK) {
 		wdprintf(V_ERROR, "medialib", "ERROR: Can't open database: %s\n", sqlite3_errmsg(gm->db));
@@ -53,15 +88,168 @@ int medialib_open(GmuMedialib *gm)
 		res = 1;
 		wdprintf(V_INFO, "medialib", "OK!\n");
 	}
+	if (res && gm->db) {
+		/* The background analyzer writes to the same database, so wait for
+		 * its short transactions instead of failing right away. With WAL,
+		 * reading does not have to wait for it at all. */
+		sqlite3_busy_timeout(gm->db, 5000);
+		if (sqlite3_exec(gm->db, "PRAGMA journal_mode=WAL", NULL, NULL, NULL) != SQLITE_OK)
+			wdprintf(V_DEBUG, "medialib", "WAL journal mode not available.\n");
+	}
+	if (res) res = medialib_upgrade_schema(gm);
 	free(gmu_db);
 	return res;
 }
 
 void medialib_close(GmuMedialib *gm)
 {
+	pthread_mutex_lock(&gm->index_mutex);
+	gm->index_enabled = 0; /* Makes a running index load stop early */
+	pthread_mutex_unlock(&gm->index_mutex);
+	if (gm->index_thread_started) pthread_join(gm->index_thread, NULL);
+	medialibindex_free(gm->index);
+	gm->index = NULL;
+	medialibindex_result_free(&gm->search_result);
+	medialibindex_result_free(&gm->browse_result);
+	pthread_mutex_destroy(&gm->index_mutex);
 	if (gm->db) sqlite3_close(gm->db);
 }
 
+/* Reads the whole track table into a new index; Returns NULL if that
+ * fails, e.g. because the index would exceed its memory limit */
+static MedialibIndex *medialib_index_build(GmuMedialib *gm)
+{
+	sqlite3_stmt  *pp_stmt = NULL;
+	MedialibIndex *mi = medialibindex_new(gm->index_max_bytes);
+	const char    *q = "SELECT id, file, artist, title, album, date, length, rating_explicit, file_missing " \
+	                   "FROM track ORDER BY id";
+	int            sqres = SQLITE_ERROR;
+
+	if (mi && sqlite3_prepare_v2(gm->db, q, -1, &pp_stmt, NULL) == SQLITE_OK) {
+		while (gm->index_enabled && (sqres = sqlite3_step(pp_stmt)) == SQLITE_ROW) {
+			TrackSummary ts;
+
+			ts.id        = sqlite3_column_int(pp_stmt, 0);
+			ts.file_name = (const char *)sqlite3_column_text(pp_stmt, 1);
+			ts.artist    = (const char *)sqlite3_column_text(pp_stmt, 2);
+			ts.title     = (const char *)sqlite3_column_text(pp_stmt, 3);
+			ts.album     = (const char *)sqlite3_column_text(pp_stmt, 4);
+			ts.date      = (const char *)sqlite3_column_text(pp_stmt, 5);
+			ts.length    = sqlite3_column_int(pp_stmt, 6);
+			ts.rating    = sqlite3_column_type(pp_stmt, 7) == SQLITE_NULL ?
+			               MEDIALIBINDEX_NO_RATING : sqlite3_column_int(pp_stmt, 7);
+			if (!medialibindex_add_track(mi, &ts, sqlite3_column_int(pp_stmt, 8))) {
+				wdprintf(V_WARNING, "medialib", "Memory index exceeds its limit of %lu KiB. Using the database instead.\n",
+				         (unsigned long)(gm->index_max_bytes / 1024));
+				gm->index_enabled = 0;
+				break;
+			}
+		}
+	}
+	sqlite3_finalize(pp_stmt);
+	if (mi && sqres != SQLITE_DONE) {
+		medialibindex_free(mi);
+		mi = NULL;
+	}
+	return mi;
+}
+
+static void medialib_index_load(GmuMedialib *gm)
+{
+	int tries;
+
+	for (tries = 0; tries < 3 && gm->index_enabled && !gm->index; tries++) {
+		unsigned long  writes;
+		size_t         tracks = 0, mem = 0;
+		MedialibIndex *mi;
+
+		pthread_mutex_lock(&gm->index_mutex);
+		writes = gm->index_writes;
+		pthread_mutex_unlock(&gm->index_mutex);
+		if (!(mi = medialib_index_build(gm))) break;
+		pthread_mutex_lock(&gm->index_mutex);
+		/* Changes made while loading might be missing from the new index,
+		 * so it is only used if there haven't been any */
+		if (gm->index_writes == writes && gm->index_enabled && !gm->index) {
+			gm->index = mi;
+			tracks = medialibindex_get_track_count(mi);
+			mem = medialibindex_get_memory_usage(mi);
+			mi = NULL;
+		}
+		pthread_mutex_unlock(&gm->index_mutex);
+		if (mi) {
+			medialibindex_free(mi);
+		} else {
+			wdprintf(V_INFO, "medialib", "Memory index loaded: %lu tracks, %lu KiB.\n",
+			         (unsigned long)tracks, (unsigned long)(mem / 1024));
+		}
+	}
+}
+
+static void *thread_index_load(void *udata)
+{
+	medialib_index_load((GmuMedialib *)udata);
+	return NULL;
+}
+
+int medialib_enable_index(GmuMedialib *gm, size_t max_bytes)
+{
+	int res = 0;
+
+	if (gm->db && !gm->index_enabled) {
+		gm->index_max_bytes = max_bytes;
+		gm->index_enabled = 1;
+		/* A running refresh loads the index once it is done */
+		if (!gm->refresh_in_progress) {
+			res = pthread_create_with_stack_size(&gm->index_thread, DEFAULT_THREAD_STACK_SIZE, thread_index_load, gm) == 0;
+			gm->index_thread_started = res;
+		} else {
+			res = 1;
+		}
+	}
+	return res;
+}
+
+size_t medialib_get_index_memory_usage(GmuMedialib *gm)
+{
+	size_t res = 0;
+
+	pthread_mutex_lock(&gm->index_mutex);
+	if (gm->index) res = medialibindex_get_memory_usage(gm->index);
+	pthread_mutex_unlock(&gm->index_mutex);
+	return res;
+}
+
+/* Every database change is passed on to the index between these two calls.
+ * If the index can't be updated, it is dropped, so it never differs from
+ * the database. */
+static void index_update_begin(GmuMedialib *gm)
+{
+	pthread_mutex_lock(&gm->index_mutex);
+	gm->index_writes++;
+}
+
+static void index_update_end(GmuMedialib *gm, int ok)
+{
+	if (!ok && gm->index) {
+		wdprintf(V_WARNING, "medialib", "Memory index exceeds its limit. Using the database instead.\n");
+		medialibindex_free(gm->index);
+		gm->index = NULL;
+	}
+	pthread_mutex_unlock(&gm->index_mutex);
+}
+
+/* Binds length, sample rate, channels and bitrate to four consecutive
+ * parameters starting at index 'first' */
+static int bind_audio_properties(sqlite3_stmt *pp_stmt, int first, TrackInfo *ti)
+{
+	int res = sqlite3_bind_int(pp_stmt, first, (int)ti->length);
+	if (res == SQLITE_OK) res = sqlite3_bind_int(pp_stmt, first + 1, ti->samplerate);
+	if (res == SQLITE_OK) res = sqlite3_bind_int(pp_stmt, first + 2, ti->channels);
+	if (res == SQLITE_OK) res = sqlite3_bind_int(pp_stmt, first + 3, (int)ti->bitrate);
+	return res;
+}
+
 /*
  * Adds a single file (file = filename with full path) to the medialib
  * Returns 1 on success, 0 otherwise
@@ -98,8 +286,12 @@ int medialib_add_file(GmuMedialib *gm, const char *file)
 	trackinfo_init(&ti, 0);
 	if (new_file && metadatareader_read(file, filetype, &ti)) {
 		/* Add file with metadata to media library... */
-		int         a, b, c, d, e;
-		const char *q = "INSERT INTO track (file, artist, title, album, comment, file_missing) VALUES (?1, ?2, ?3, ?4, ?5, 0)";
+		int         a, b, c, d, e, f;
+		const char *q = "INSERT INTO track (file, artist, title, album, comment, file_missing, " \
+		                "length, samplerate, channels, bitrate) VALUES (?1, ?2, ?3, ?4, ?5, 0, ?6, ?7, ?8, ?9)";
+
+		/* A length of 0 marks files whose length could not be determined */
+		audioinfo_read(file, filetype, &ti);
 
 		sqres = sqlite3_prepare_v2(gm->db, q, -1, &pp_stmt, NULL);
 		if (sqres == SQLITE_OK) {
@@ -108,11 +300,26 @@ int medialib_add_file(GmuMedialib *gm, const char *file)
 			c = sqlite3_bind_text(pp_stmt, 3, ti.title,   -1, SQLITE_STATIC);
 			d = sqlite3_bind_text(pp_stmt, 4, ti.album,   -1, SQLITE_STATIC);
 			e = sqlite3_bind_text(pp_stmt, 5, ti.comment, -1, SQLITE_STATIC);
-			if (a == SQLITE_OK && b == SQLITE_OK && c == SQLITE_OK && d == SQLITE_OK && e == SQLITE_OK) {
+			f = bind_audio_properties(pp_stmt, 6, &ti);
+			if (a == SQLITE_OK && b == SQLITE_OK && c == SQLITE_OK && d == SQLITE_OK && e == SQLITE_OK && f == SQLITE_OK) {
 				sqres = sqlite3_step(pp_stmt);
 				if (sqres != SQLITE_DONE) {
 					wdprintf(V_ERROR, "medialib", "ERROR while inserting into database: ERROR %d\n", sqres);
 				} else {
+					TrackSummary ts;
+					int          ok = 1;
+
+					ts.id        = (int)sqlite3_last_insert_rowid(gm->db);
+					ts.file_name = file;
+					ts.artist    = ti.artist;
+					ts.title     = ti.title;
+					ts.album     = ti.album;
+					ts.date      = NULL;
+					ts.length    = (int)ti.length;
+					ts.rating    = MEDIALIBINDEX_NO_RATING;
+					index_update_begin(gm);
+					if (gm->index) ok = medialibindex_add_track(gm->index, &ts, 0);
+					index_update_end(gm, ok);
 					res = 1;
 				}
 			} else {
@@ -141,6 +348,8 @@ static void *thread_gml_refresh(void *udata)
 	wdprintf(V_INFO, "medialib", "Refresh thread created.\n");
 	medialib_refresh(tp->gm);
 	wdprintf(V_INFO, "medialib", "Refresh thread finished.\n");
+	/* Loading the index is postponed while the medialib is being refreshed */
+	if (tp->gm->index_enabled && !tp->gm->index) medialib_index_load(tp->gm);
 	tp->gm->refresh_in_progress = 0;
 	if (tp->finished_callback) (tp->finished_callback)();
 	return NULL;
@@ -178,6 +387,11 @@ void medialib_flag_track_as_bad(GmuMedialib *gm, unsigned int id, int bad)
 			int sqres = sqlite3_step(pp_stmt);
 			if (sqres != SQLITE_DONE) {
 				wdprintf(V_ERROR, "medialib", "ERROR while updating database: ERROR %d\n", sqres);
+			} else {
+				int ok = 1;
+				index_update_begin(gm);
+				if (gm->index) ok = medialibindex_set_missing(gm->index, id, bad);
+				index_update_end(gm, ok);
 			}
 		} else {
 			wdprintf(V_ERROR, "medialib", "ERROR while updating database!\n");
@@ -186,6 +400,44 @@ void medialib_flag_track_as_bad(GmuMedialib *gm, unsigned int id, int bad)
 	sqlite3_finalize(pp_stmt);
 }
 
+/* Fills in the length and stream properties of tracks that have been
+ * added before these were collected */
+static void medialib_update_audio_properties(GmuMedialib *gm)
+{
+	sqlite3_stmt *pp_stmt = NULL, *pp_stmt_update = NULL;
+	const char   *q = "UPDATE track SET length = ?1, samplerate = ?2, channels = ?3, bitrate = ?4 WHERE id = ?5";
+
+	sqlite3_exec(gm->db, "BEGIN", 0, 0, 0);
+	if (sqlite3_prepare_v2(gm->db, q, -1, &pp_stmt_update, NULL) == SQLITE_OK &&
+	    sqlite3_prepare_v2(gm->db, "SELECT id, file FROM track WHERE length IS NULL AND file_missing = 0",
+	                       -1, &pp_stmt, NULL) == SQLITE_OK) {
+		while (sqlite3_step(pp_stmt) == SQLITE_ROW) {
+			TrackInfo   ti;
+			int         id = sqlite3_column_int(pp_stmt, 0);
+			const char *file = (const char *)sqlite3_column_text(pp_stmt, 1);
+
+			if (!file) continue;
+			trackinfo_init(&ti, 0);
+			audioinfo_read(file, get_file_extension(file), &ti);
+			sqlite3_reset(pp_stmt_update);
+			if (bind_audio_properties(pp_stmt_update, 1, &ti) == SQLITE_OK &&
+			    sqlite3_bind_int(pp_stmt_update, 5, id) == SQLITE_OK) {
+				if (sqlite3_step(pp_stmt_update) != SQLITE_DONE) {
+					wdprintf(V_ERROR, "medialib", "ERROR while updating database: %s\n", sqlite3_errmsg(gm->db));
+				} else {
+					int ok = 1;
+					index_update_begin(gm);
+					if (gm->index) ok = medialibindex_set_length(gm->index, id, (int)ti.length);
+					index_update_end(gm, ok);
+				}
+			}
+		}
+	}
+	sqlite3_finalize(pp_stmt);
+	sqlite3_finalize(pp_stmt_update);
+	sqlite3_exec(gm->db, "COMMIT", 0, 0, 0);
+}
+
 void medialib_refresh(GmuMedialib *gm)
 {
 	sqlite3_stmt *pp_stmt = NULL;
@@ -201,6 +453,7 @@ void medialib_refresh(GmuMedialib *gm)
 	}
 	sqlite3_finalize(pp_stmt);
 	sqlite3_exec(gm->db, "COMMIT", 0, 0, 0);
+	medialib_update_audio_properties(gm);
 	/*
 	 * Fetch all medialib entries from DB and check if the corresponding
 	 * files exist on disk. If a file doesn't exist, flag the entry as
@@ -289,8 +542,14 @@ void medialib_path_list_finish(GmuMedialib *gm)
 	sqlite3_finalize(gm->pp_stmt_path_list);
 }
 
-/* Search the medialib; Returns true on success; false (0) otherwise */
-int medialib_search_find(GmuMedialib *gm, GmuMedialibDataType type, const char *str)
+/*
+ * Search the medialib; Returns true on success; false (0) otherwise.
+ * Results are ordered by track ID, so the next page of results can be
+ * requested by passing the ID of the last result of the previous page as
+ * 'after_id' (0 for the first page). At most 'limit' results are returned
+ * per page; limit <= 0 means no limit.
+ */
+int medialib_search_find(GmuMedialib *gm, GmuMedialibDataType type, const char *str, int after_id, int limit)
 {
 	const char *q;
 	int         sqres = -1, len;
@@ -299,19 +558,44 @@ int medialib_search_find(GmuMedialib *gm, GmuMedialibDataType type, const char *
 	switch (type) {
 		case GMU_MLIB_ANY:
 		default:
-			q = "SELECT * FROM track WHERE file_missing = 0 AND (title LIKE ?1 OR artist LIKE ?1 OR album LIKE ?1) LIMIT 200";
+			q = "SELECT id, file, artist, title, album, date, length, rating_explicit FROM track WHERE id > ?2 AND file_missing = 0 AND (title LIKE ?1 OR artist LIKE ?1 OR album LIKE ?1) ORDER BY id LIMIT ?3";
 			break;
 		case GMU_MLIB_ARTIST:
-			q = "SELECT * FROM track WHERE file_missing = 0 AND artist LIKE ?1 LIMIT 200";
+			q = "SELECT id, file, artist, title, album, date, length, rating_explicit FROM track WHERE id > ?2 AND file_missing = 0 AND artist LIKE ?1 ORDER BY id LIMIT ?3";
 			break;
 		case GMU_MLIB_ALBUM:
-			q = "SELECT * FROM track WHERE file_missing = 0 AND album LIKE ?1 LIMIT 200";
+			q = "SELECT id, file, artist, title, album, date, length, rating_explicit FROM track WHERE id > ?2 AND file_missing = 0 AND album LIKE ?1 ORDER BY id LIMIT ?3";
 			break;
 		case GMU_MLIB_TITLE:
-			q = "SELECT * FROM track WHERE file_missing = 0 AND title LIKE ?1 LIMIT 200";
+			q = "SELECT id, file, artist, title, album, date, length, rating_explicit FROM track WHERE id > ?2 AND file_missing = 0 AND title LIKE ?1 ORDER BY id LIMIT ?3";
 			break;
 	}
 	len = str ? strlen(str) : 0;
+	gm->search_from_index = 0;
+	if (len > 0) {
+		int fields;
+
+		switch (type) {
+			case GMU_MLIB_ANY:
+			default:
+				fields = MEDIALIBINDEX_TITLE | MEDIALIBINDEX_ARTIST | MEDIALIBINDEX_ALBUM;
+				break;
+			case GMU_MLIB_ARTIST:
+				fields = MEDIALIBINDEX_ARTIST;
+				break;
+			case GMU_MLIB_ALBUM:
+				fields = MEDIALIBINDEX_ALBUM;
+				break;
+			case GMU_MLIB_TITLE:
+				fields = MEDIALIBINDEX_TITLE;
+				break;
+		}
+		pthread_mutex_lock(&gm->index_mutex);
+		if (gm->index)
+			gm->search_from_index = medialibindex_search(gm->index, fields, str, after_id, limit, &gm->search_result);
+		pthread_mutex_unlock(&gm->index_mutex);
+		if (gm->search_from_index) return 1;
+	}
 	if (len > 0) {
 		str_tmp = malloc(len+3);
 		if (str_tmp) {
@@ -319,54 +603,155 @@ int medialib_search_find(GmuMedialib *gm, GmuMedialibDataType type, const char *
 			wdprintf(V_DEBUG, "medialib", "search str= %s\n", str_tmp);
 			sqres = sqlite3_prepare_v2(gm->db, q, -1, &(gm->pp_stmt_search), NULL);
 			if (sqres == SQLITE_OK) sqres = sqlite3_bind_text(gm->pp_stmt_search, 1, str_tmp, -1, SQLITE_TRANSIENT);
+			if (sqres == SQLITE_OK) sqres = sqlite3_bind_int(gm->pp_stmt_search, 2, after_id);
+			if (sqres == SQLITE_OK) sqres = sqlite3_bind_int(gm->pp_stmt_search, 3, limit > 0 ? limit : -1);
 			free(str_tmp);
 		}
 	}
 	return (sqres == SQLITE_OK);
 }
 
-TrackInfo medialib_search_fetch_next_result(GmuMedialib *gm)
+static const char *column_text(sqlite3_stmt *pp_stmt, int col)
 {
-	TrackInfo ti;
-	trackinfo_init(&ti, 0);
+	const char *res = (const char *)sqlite3_column_text(pp_stmt, col);
+	return res ? res : "";
+}
 
-	if (sqlite3_step(gm->pp_stmt_search) == SQLITE_ROW) {
-		int         id     =               sqlite3_column_int(gm->pp_stmt_search, 0);
-		const char *file   = (const char *)sqlite3_column_text(gm->pp_stmt_search, 1);
-		const char *artist = (const char *)sqlite3_column_text(gm->pp_stmt_search, 3);
-		const char *title  = (const char *)sqlite3_column_text(gm->pp_stmt_search, 4);
-		const char *album  = (const char *)sqlite3_column_text(gm->pp_stmt_search, 5);
-		trackinfo_set_trackid(&ti, id);
-		trackinfo_set_filename(&ti, file);
-		trackinfo_set_artist(&ti, artist);
-		trackinfo_set_title(&ti, title);
-		trackinfo_set_album(&ti, album);
+/*
+ * Returns the next search result. The strings in the TrackSummary point into
+ * the current result row and are valid until the next call. The id is set to
+ * -1 when there are no more results.
+ */
+TrackSummary medialib_search_fetch_next_result(GmuMedialib *gm)
+{
+	TrackSummary ts;
+
+	memset(&ts, 0, sizeof(TrackSummary));
+	if (gm->search_from_index) {
+		const MedialibIndexRow *row = medialibindex_result_next(&gm->search_result);
+		if (row) {
+			ts.id        = row->id;
+			ts.file_name = gm->search_result.strings + row->file;
+			ts.artist    = gm->search_result.strings + row->artist;
+			ts.title     = gm->search_result.strings + row->title;
+			ts.album     = gm->search_result.strings + row->album;
+			ts.date      = gm->search_result.strings + row->date;
+			ts.length    = row->length;
+			ts.rating    = row->rating;
+		} else {
+			ts.id = -1;
+		}
+	} else if (sqlite3_step(gm->pp_stmt_search) == SQLITE_ROW) {
+		ts.id        = sqlite3_column_int(gm->pp_stmt_search, 0);
+		ts.file_name = column_text(gm->pp_stmt_search, 1);
+		ts.artist    = column_text(gm->pp_stmt_search, 2);
+		ts.title     = column_text(gm->pp_stmt_search, 3);
+		ts.album     = column_text(gm->pp_stmt_search, 4);
+		ts.date      = column_text(gm->pp_stmt_search, 5);
+		ts.length    = sqlite3_column_int(gm->pp_stmt_search, 6);
+		ts.rating    = sqlite3_column_int(gm->pp_stmt_search, 7);
 	} else {
-		trackinfo_set_trackid(&ti, -1);
+		ts.id = -1;
 	}
-	return ti;
+	return ts;
 }
 
 void medialib_search_finish(GmuMedialib *gm)
 {
-	sqlite3_finalize(gm->pp_stmt_search);
+	if (gm->search_from_index)
+		gm->search_from_index = 0;
+	else
+		sqlite3_finalize(gm->pp_stmt_search);
+}
+
+/*
+ * Finds the tracks most similar to the given track, based on the results of
+ * the acoustic analysis (gmu-analyze). The results are fetched with
+ * medialib_search_fetch_next_result() ordered by similarity (most similar
+ * first). At most 'limit' results are returned; limit <= 0 means no limit.
+ */
+int medialib_similar_tracks(GmuMedialib *gm, int id, int limit)
+{
+	const char *q = "SELECT t.id, t.file, t.artist, t.title, t.album, t.date, t.length, t.rating_explicit " \
+	                "FROM similarity s JOIN track t ON t.id = s.track_id_b " \
+	                "WHERE s.track_id_a = ?1 AND t.file_missing = 0 ORDER BY s.similarity DESC LIMIT ?2";
+	int         sqres;
+
+	gm->search_from_index = 0;
+	sqres = sqlite3_prepare_v2(gm->db, q, -1, &(gm->pp_stmt_search), NULL);
+	if (sqres == SQLITE_OK) sqres = sqlite3_bind_int(gm->pp_stmt_search, 1, id);
+	if (sqres == SQLITE_OK) sqres = sqlite3_bind_int(gm->pp_stmt_search, 2, limit > 0 ? limit : -1);
+	return (sqres == SQLITE_OK);
 }
 
 /*
  * Browse the medialib by applying one or more filters.
  * sel_column is the column name to be selected, e.g. "album".
+ * Results are sorted by value. To fetch the next page of results, pass the
+ * last value of the previous page as 'after' (NULL for the first page).
+ * At most 'limit' values are returned per page; limit <= 0 means no limit.
  * Last argument needs to be NULL.
  * For each filter two arguments are required:
  *  - column name (e.g. "artist") and
  *  - filter value (e.g. "Foo")
  * Any number of filters can be applied.
  */
-int medialib_browse(GmuMedialib *gm, const char *sel_column, ...)
+int medialib_browse(GmuMedialib *gm, const char *after, int limit, const char *sel_column, ...)
 {
-	char   *q = NULL, *qtmp = NULL;
-	int     sqres = -1;
-	va_list args;
-	char   *arg;
+	char       *q = NULL, *qtmp = NULL;
+	int         sqres = -1, other_filters = 0;
+	const char *artist = NULL;
+	/* The name columns of the artist and album tables are NOT NULL, so
+	 * the first page starts with names >= '' */
+	const char *after_op = after ? ">" : ">=";
+	const char *after_val = after ? after : "";
+	va_list     args;
+	char       *arg;
+
+	if (limit <= 0) limit = -1;
+	/* Artists and albums (optionally filtered by artist) are listed from
+	 * the normalized tables, whose indexes deliver them in sorted order */
+	va_start(args, sel_column);
+	for (arg = va_arg(args, char *); arg; arg = va_arg(args, char *)) {
+		char *fvalue = va_arg(args, char *);
+		if (fvalue && strcmp(arg, "artist") == 0 && !artist)
+			artist = fvalue;
+		else if (fvalue)
+			other_filters = 1;
+	}
+	va_end(args);
+	gm->browse_from_index = 0;
+	if (!other_filters) {
+		pthread_mutex_lock(&gm->index_mutex);
+		if (gm->index && strcmp(sel_column, "artist") == 0 && !artist)
+			gm->browse_from_index = medialibindex_browse_artists(gm->index, after, limit, &gm->browse_result);
+		else if (gm->index && strcmp(sel_column, "album") == 0 && artist)
+			gm->browse_from_index = medialibindex_browse_albums(gm->index, artist, after, limit, &gm->browse_result);
+		pthread_mutex_unlock(&gm->index_mutex);
+		if (gm->browse_from_index) return 1;
+	}
+	if (!other_filters && strcmp(sel_column, "artist") == 0 && !artist) {
+		q = sqlite3_mprintf(
+			"SELECT name FROM artist WHERE name %s %Q AND EXISTS " \
+			"(SELECT 1 FROM track WHERE artist_id = artist.id AND file_missing = 0) " \
+			"ORDER BY name ASC LIMIT %d", after_op, after_val, limit);
+	} else if (!other_filters && strcmp(sel_column, "album") == 0 && artist) {
+		q = sqlite3_mprintf(
+			"SELECT album.name FROM album JOIN artist ON artist.id = album.artist_id " \
+			"WHERE artist.name = %Q AND album.name %s %Q AND EXISTS " \
+			"(SELECT 1 FROM track WHERE album_id = album.id AND file_missing = 0) " \
+			"ORDER BY album.name ASC LIMIT %d", artist, after_op, after_val, limit);
+	} else if (!other_filters && strcmp(sel_column, "album") == 0) {
+		q = sqlite3_mprintf(
+			"SELECT DISTINCT name FROM album WHERE name %s %Q AND EXISTS " \
+			"(SELECT 1 FROM track WHERE album_id = album.id AND file_missing = 0) " \
+			"ORDER BY name ASC LIMIT %d", after_op, after_val, limit);
+	}
+	if (q) {
+		sqres = sqlite3_prepare_v2(gm->db, q, -1, &(gm->pp_stmt_browse), NULL);
+		sqlite3_free(q);
+		return (sqres == SQLITE_OK);
+	}
 
 	va_start(args, sel_column);
 
@@ -391,7 +776,12 @@ int medialib_browse(GmuMedialib *gm, const char *sel_column, ...)
 		}
 	}
 	if (!q) q = qtmp;
-	qtmp = sqlite3_mprintf("%s ORDER BY %s ASC", q, sel_column);
+	if (after) {
+		qtmp = sqlite3_mprintf("%s AND %s > %Q", q, sel_column, after);
+		sqlite3_free(q);
+		q = qtmp;
+	}
+	qtmp = sqlite3_mprintf("%s ORDER BY %s ASC LIMIT %d", q, sel_column, limit);
 	sqlite3_free(q);
 	q = qtmp;
 
@@ -404,7 +794,10 @@ int medialib_browse(GmuMedialib *gm, const char *sel_column, ...)
 const char *medialib_browse_fetch_next_result(GmuMedialib *gm)
 {
 	const char *res = NULL;
-	if (sqlite3_step(gm->pp_stmt_browse) == SQLITE_ROW) {
+	if (gm->browse_from_index) {
+		const MedialibIndexRow *row = medialibindex_result_next(&gm->browse_result);
+		if (row) res = gm->browse_result.strings + row->artist;
+	} else if (sqlite3_step(gm->pp_stmt_browse) == SQLITE_ROW) {
 		res = (const char *)sqlite3_column_text(gm->pp_stmt_browse, 0);
 	}
 	return res;
@@ -412,35 +805,55 @@ const char *medialib_browse_fetch_next_result(GmuMedialib *gm)
 
 void medialib_browse_finish(GmuMedialib *gm)
 {
-	sqlite3_finalize(gm->pp_stmt_browse);
+	if (gm->browse_from_index)
+		gm->browse_from_index = 0;
+	else
+		sqlite3_finalize(gm->pp_stmt_browse);
 }
 
-TrackInfo medialib_get_data_for_id(GmuMedialib *gm, int id)
+/* Fills 'ti' with the medialib data of the track with the given ID.
+ * Returns 1 on success, 0 if there is no such track. */
+int medialib_get_data_for_id(GmuMedialib *gm, int id, TrackInfo *ti)
 {
 	sqlite3_stmt *pp_stmt;
-	TrackInfo     ti;
-	const char   *q = "SELECT * FROM track WHERE id = ?1 LIMIT 1";
-	int           sqres;
-
-	trackinfo_init(&ti, 0);
+	const char   *q = "SELECT file, artist, title, album, length, samplerate, channels, bitrate " \
+	                  "FROM track WHERE id = ?1 LIMIT 1";
+	int           sqres, res = 0;
 
+	trackinfo_clear(ti);
+	trackinfo_set_trackid(ti, -1);
 	sqres = sqlite3_prepare_v2(gm->db, q, -1, &pp_stmt, NULL);
 	if (sqres == SQLITE_OK) sqres = sqlite3_bind_int(pp_stmt, 1, id);
 	if (sqres == SQLITE_OK && sqlite3_step(pp_stmt) == SQLITE_ROW) {
-		const char *file   = (const char *)sqlite3_column_text(pp_stmt, 1);
-		const char *artist = (const char *)sqlite3_column_text(pp_stmt, 3);
-		const char *title  = (const char *)sqlite3_column_text(pp_stmt, 4);
-		const char *album  = (const char *)sqlite3_column_text(pp_stmt, 5);
-		trackinfo_set_trackid(&ti, id);
-		trackinfo_set_filename(&ti, file);
-		trackinfo_set_artist(&ti, artist);
-		trackinfo_set_title(&ti, title);
-		trackinfo_set_album(&ti, album);
-	} else {
-		trackinfo_set_trackid(&ti, -1);
+		trackinfo_set_trackid(ti, id);
+		trackinfo_set_filename(ti, column_text(pp_stmt, 0));
+		trackinfo_set_artist(ti, column_text(pp_stmt, 1));
+		trackinfo_set_title(ti, column_text(pp_stmt, 2));
+		trackinfo_set_album(ti, column_text(pp_stmt, 3));
+		ti->length     = (size_t)sqlite3_column_int(pp_stmt, 4);
+		ti->samplerate = sqlite3_column_int(pp_stmt, 5);
+		ti->channels   = sqlite3_column_int(pp_stmt, 6);
+		ti->bitrate    = sqlite3_column_int(pp_stmt, 7);
+		res = 1;
 	}
 	sqlite3_finalize(pp_stmt);
-	return ti;
+	return res;
+}
+
+/* Returns the length in seconds of the track stored as 'file', or -1 if
+ * the file is not part of the medialib or has not been scanned yet */
+int medialib_get_length_for_file(GmuMedialib *gm, const char *file)
+{
+	sqlite3_stmt *pp_stmt;
+	const char   *q = "SELECT length FROM track WHERE file = ?1 AND length IS NOT NULL LIMIT 1";
+	int           res = -1;
+
+	if (sqlite3_prepare_v2(gm->db, q, -1, &pp_stmt, NULL) == SQLITE_OK &&
+	    sqlite3_bind_text(pp_stmt, 1, file, -1, SQLITE_STATIC) == SQLITE_OK &&
+	    sqlite3_step(pp_stmt) == SQLITE_ROW)
+		res = sqlite3_column_int(pp_stmt, 0);
+	sqlite3_finalize(pp_stmt);
+	return res;
 }
 
 static int rate_track(GmuMedialib *gm, int id, int relative, int rating)
@@ -463,6 +876,11 @@ static int rate_track(GmuMedialib *gm, int id, int relative, int rating)
 	if (sqres == SQLITE_OK) sqres = sqlite3_step(pp_stmt);
 	if (sqres != SQLITE_DONE) {
 		wdprintf(V_ERROR, "medialib", "ERROR while updating database: ERROR %d\n", sqres);
+	} else {
+		int ok = 1;
+		index_update_begin(gm);
+		if (gm->index) ok = medialibindex_set_rating(gm->index, id, relative ? (rating > 0 ? 1 : -1) : rating, relative);
+		index_update_end(gm, ok);
 	}
 	sqlite3_finalize(pp_stmt);
 	return sqres;
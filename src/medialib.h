@@ -10,7 +10,9 @@
 #ifndef WEJ_MEDIALIB_H
 #define WEJ_MEDIALIB_H
 #ifdef GMU_MEDIALIB
+#include <pthread.h>
 #include <sqlite3.h>
+#include "medialibindex.h"
 #endif
 #include "trackinfo.h"
 
@@ -18,6 +20,15 @@ typedef struct GmuMedialib {
 #ifdef GMU_MEDIALIB
 	sqlite3      *db;
 	sqlite3_stmt *pp_stmt_search, *pp_stmt_browse, *pp_stmt_path_list;
+	/* Optional in-memory copy of the track table (see medialib_enable_index()) */
+	MedialibIndex      *index;
+	pthread_mutex_t     index_mutex;
+	pthread_t           index_thread;
+	int                 index_enabled, index_thread_started;
+	size_t              index_max_bytes;
+	unsigned long       index_writes;
+	MedialibIndexResult search_result, browse_result;
+	int                 search_from_index, browse_from_index;
 #endif
 	int           refresh_in_progress;
 } GmuMedialib;
@@ -29,6 +40,12 @@ typedef enum {
 int  medialib_create_db_and_open(GmuMedialib *gm);
 int  medialib_open(GmuMedialib *gm);
 void medialib_close(GmuMedialib *gm);
+/* Loads the medialib into memory in the background, so browsing and
+ * searching no longer need to query the database. The index may use at
+ * most 'max_bytes' of memory; if it needs more, the database is used. */
+int  medialib_enable_index(GmuMedialib *gm, size_t max_bytes);
+/* Returns the memory used by the in-memory index (0 if there is none) */
+size_t medialib_get_index_memory_usage(GmuMedialib *gm);
 int  medialib_start_refresh(GmuMedialib *gm, void (*finished_callback)(void));
 int  medialib_is_refresh_in_progress(GmuMedialib *gm);
 void medialib_flag_track_as_bad(GmuMedialib *gm, unsigned int id, int bad);
@@ -37,14 +54,22 @@ int  medialib_add_file(GmuMedialib *gm, const char *file);
 void medialib_path_add(GmuMedialib *gm, const char *path);
 void medialib_path_remove(GmuMedialib *gm, const char *path);
 void medialib_path_remove_with_id(GmuMedialib *gm, unsigned int id);
-/* Search the medialib; Returns the number of results */
-int  medialib_search_find(GmuMedialib *gm, GmuMedialibDataType type, const char *str);
-TrackInfo medialib_search_fetch_next_result(GmuMedialib *gm);
+/* Search the medialib; Results are ordered by ID and paginated by passing
+ * the last ID of the previous page as 'after_id' (0 for the first page) */
+int  medialib_search_find(GmuMedialib *gm, GmuMedialibDataType type, const char *str, int after_id, int limit);
+TrackSummary medialib_search_fetch_next_result(GmuMedialib *gm);
 void medialib_search_finish(GmuMedialib *gm);
-int  medialib_browse(GmuMedialib *gm, const char *sel_column, ...);
+/* Tracks similar to the given one, most similar first; The results are
+ * fetched like search results */
+int  medialib_similar_tracks(GmuMedialib *gm, int id, int limit);
+/* Results are sorted and paginated by passing the last value of the
+ * previous page as 'after' (NULL for the first page) */
+int  medialib_browse(GmuMedialib *gm, const char *after, int limit, const char *sel_column, ...);
 const char *medialib_browse_fetch_next_result(GmuMedialib *gm);
 void medialib_browse_finish(GmuMedialib *gm);
-TrackInfo medialib_get_data_for_id(GmuMedialib *gm, int id);
+int  medialib_get_data_for_id(GmuMedialib *gm, int id, TrackInfo *ti);
+/* Returns the length in seconds of the given file, or -1 if unknown */
+int  medialib_get_length_for_file(GmuMedialib *gm, const char *file);
 /* Increase/decrease/set rating for a given track */
 int  medialib_rate_track_up(GmuMedialib *gm, int id);
 int  medialib_rate_track_down(GmuMedialib *gm, int id);
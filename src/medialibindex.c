@@ -0,0 +1,555 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: medialibindex.c  Created: 210911
+ *
+ * Description: Compact in-memory index of the media library for
+ *              browsing and searching without database queries
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "medialibindex.h"
+
+/* An artist or album; Its tracks are found through the track columns */
+typedef struct Group
+{
+	uint32_t  name;         /* Offset in the string pool */
+	uint32_t  n_present;    /* Number of tracks whose files are not missing */
+	/* Artists only: Album groups of the artist, sorted by name */
+	uint32_t  n_albums, size_albums;
+	uint32_t *albums;
+} Group;
+
+struct MedialibIndex
+{
+	size_t         mem_used, mem_max;
+	/* Each distinct string is stored only once. Offset 0 is the empty string. */
+	char          *pool;
+	size_t         pool_len, pool_size;
+	uint32_t      *slots;   /* Hash table of string offsets + 1, 0 = free */
+	size_t         n_slots, n_strings;
+	/* Track columns, sorted by track ID */
+	size_t         n_tracks, size_tracks;
+	int           *id, *length, *rating;
+	uint32_t      *file, *title, *date;
+	uint32_t      *artist, *album;  /* Group indexes */
+	unsigned char *missing;
+	/* Artist and album groups; Their indexes never change. */
+	Group         *artists, *albums;
+	size_t         n_artists, size_artists, n_albums, size_albums;
+	uint32_t      *artist_order;    /* Artist groups sorted by name */
+	size_t         size_artist_order;
+};
+
+/* Resizes a memory block, keeping track of the total memory used by the index */
+static int mem_resize(MedialibIndex *mi, void *ptr, size_t old_size, size_t new_size)
+{
+	void **p = (void **)ptr;
+	void  *tmp;
+
+	if (mi->mem_used - old_size + new_size > mi->mem_max) return 0;
+	if (!(tmp = realloc(*p, new_size))) return 0;
+	*p = tmp;
+	mi->mem_used = mi->mem_used - old_size + new_size;
+	return 1;
+}
+
+/* Makes room for at least one more element in an array of 'size' elements */
+static int mem_grow(MedialibIndex *mi, void *ptr, size_t elem_size, size_t count, size_t *size)
+{
+	if (count < *size) return 1;
+	if (!mem_resize(mi, ptr, *size * elem_size, (*size ? *size * 2 : 4) * elem_size)) return 0;
+	*size = *size ? *size * 2 : 4;
+	return 1;
+}
+
+MedialibIndex *medialibindex_new(size_t max_bytes)
+{
+	MedialibIndex *mi = calloc(1, sizeof(MedialibIndex));
+	if (mi) {
+		mi->mem_max = max_bytes;
+		mi->mem_used = sizeof(MedialibIndex);
+		if (mem_resize(mi, &mi->pool, 0, 4096)) {
+			mi->pool_size = 4096;
+			mi->pool[0] = '\0';
+			mi->pool_len = 1;
+		} else {
+			free(mi);
+			mi = NULL;
+		}
+	}
+	return mi;
+}
+
+void medialibindex_free(MedialibIndex *mi)
+{
+	size_t i;
+
+	if (!mi) return;
+	for (i = 0; i < mi->n_artists; i++)
+		free(mi->artists[i].albums);
+	free(mi->artists);
+	free(mi->albums);
+	free(mi->artist_order);
+	free(mi->id);
+	free(mi->length);
+	free(mi->rating);
+	free(mi->file);
+	free(mi->title);
+	free(mi->date);
+	free(mi->artist);
+	free(mi->album);
+	free(mi->missing);
+	free(mi->slots);
+	free(mi->pool);
+	free(mi);
+}
+
+static size_t hash_string(const char *str)
+{
+	size_t               hash = 2166136261U;
+	const unsigned char *c;
+
+	for (c = (const unsigned char *)str; *c; c++) {
+		hash ^= *c;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static int rehash(MedialibIndex *mi, size_t n_slots)
+{
+	uint32_t *slots = NULL;
+	size_t    i;
+
+	if (!mem_resize(mi, &slots, 0, n_slots * sizeof(uint32_t))) return 0;
+	memset(slots, 0, n_slots * sizeof(uint32_t));
+	for (i = 0; i < mi->n_slots; i++) {
+		if (mi->slots[i]) {
+			size_t s = hash_string(mi->pool + mi->slots[i] - 1) & (n_slots - 1);
+			while (slots[s]) s = (s + 1) & (n_slots - 1);
+			slots[s] = mi->slots[i];
+		}
+	}
+	free(mi->slots);
+	mi->mem_used -= mi->n_slots * sizeof(uint32_t);
+	mi->slots = slots;
+	mi->n_slots = n_slots;
+	return 1;
+}
+
+/* Returns the pool offset of 'str', adding it to the pool if necessary.
+ * Returns 0 (the empty string) for NULL; *ok is cleared on failure. */
+static uint32_t intern(MedialibIndex *mi, const char *str, int *ok)
+{
+	size_t s, len;
+
+	if (!str || !str[0] || !*ok) return 0;
+	if (mi->n_strings * 2 >= mi->n_slots && !rehash(mi, mi->n_slots ? mi->n_slots * 2 : 1024)) {
+		*ok = 0;
+		return 0;
+	}
+	for (s = hash_string(str) & (mi->n_slots - 1); mi->slots[s]; s = (s + 1) & (mi->n_slots - 1))
+		if (strcmp(mi->pool + mi->slots[s] - 1, str) == 0) return mi->slots[s] - 1;
+
+	len = strlen(str) + 1;
+	if (mi->pool_len + len > mi->pool_size) {
+		size_t size = mi->pool_size * 2;
+		while (mi->pool_len + len > size) size *= 2;
+		if (size > UINT32_MAX || !mem_resize(mi, &mi->pool, mi->pool_size, size)) {
+			*ok = 0;
+			return 0;
+		}
+		mi->pool_size = size;
+	}
+	memcpy(mi->pool + mi->pool_len, str, len);
+	mi->slots[s] = (uint32_t)mi->pool_len + 1;
+	mi->n_strings++;
+	mi->pool_len += len;
+	return mi->slots[s] - 1;
+}
+
+/* Binary search in an array of group indexes sorted by name; Returns the
+ * position of the first group whose name is >= 'name' (or > 'name' if
+ * 'after' is true). Sets *found if that group's name equals 'name'. */
+static size_t find_group(MedialibIndex *mi, const Group *groups, const uint32_t *order, size_t n,
+                         const char *name, int after, int *found)
+{
+	size_t lo = 0, hi = n;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int    cmp = strcmp(mi->pool + groups[order[mid]].name, name);
+		if (cmp < 0 || (after && cmp == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (found) *found = lo < n && strcmp(mi->pool + groups[order[lo]].name, name) == 0;
+	return lo;
+}
+
+/* Inserts 'value' at position 'pos' of an array of n uint32_t values */
+static int insert_u32(MedialibIndex *mi, uint32_t **array, size_t *n, size_t *size, size_t pos, uint32_t value)
+{
+	if (!mem_grow(mi, array, sizeof(uint32_t), *n, size)) return 0;
+	memmove(*array + pos + 1, *array + pos, (*n - pos) * sizeof(uint32_t));
+	(*array)[pos] = value;
+	(*n)++;
+	return 1;
+}
+
+static int add_group(MedialibIndex *mi, Group **groups, size_t *n, size_t *size, uint32_t name, uint32_t *index)
+{
+	if (!mem_grow(mi, groups, sizeof(Group), *n, size)) return 0;
+	memset(*groups + *n, 0, sizeof(Group));
+	(*groups)[*n].name = name;
+	*index = (uint32_t)(*n)++;
+	return 1;
+}
+
+/* Returns the index of the artist group for 'name', creating it if necessary */
+static int get_artist(MedialibIndex *mi, const char *name, uint32_t *index)
+{
+	int      found, ok = 1;
+	size_t   pos = find_group(mi, mi->artists, mi->artist_order, mi->n_artists, name ? name : "", 0, &found);
+	size_t   n = mi->n_artists;
+	uint32_t str;
+
+	if (found) {
+		*index = mi->artist_order[pos];
+		return 1;
+	}
+	str = intern(mi, name, &ok);
+	if (!ok || !add_group(mi, &mi->artists, &mi->n_artists, &mi->size_artists, str, index)) return 0;
+	return insert_u32(mi, &mi->artist_order, &n, &mi->size_artist_order, pos, *index);
+}
+
+/* Returns the index of the album group for 'name' of the given artist,
+ * creating it if necessary */
+static int get_album(MedialibIndex *mi, uint32_t artist, const char *name, uint32_t *index)
+{
+	int      found, ok = 1;
+	Group   *a = &mi->artists[artist];
+	size_t   pos = find_group(mi, mi->albums, a->albums, a->n_albums, name ? name : "", 0, &found);
+	size_t   n, size;
+	uint32_t str;
+
+	if (found) {
+		*index = a->albums[pos];
+		return 1;
+	}
+	str = intern(mi, name, &ok);
+	if (!ok || !add_group(mi, &mi->albums, &mi->n_albums, &mi->size_albums, str, index)) return 0;
+	a = &mi->artists[artist];
+	n = a->n_albums;
+	size = a->size_albums;
+	if (!insert_u32(mi, &a->albums, &n, &size, pos, *index)) return 0;
+	a->n_albums = (uint32_t)n;
+	a->size_albums = (uint32_t)size;
+	return 1;
+}
+
+/* Returns the row of the track with the given ID or the position where
+ * it would have to be inserted; Sets *found accordingly. */
+static size_t find_track(const MedialibIndex *mi, int id, int *found)
+{
+	size_t lo = 0, hi = mi->n_tracks;
+
+	if (hi > 0 && mi->id[hi - 1] < id) {
+		lo = hi; /* Appending is the common case */
+	} else {
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (mi->id[mid] < id)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+	}
+	*found = lo < mi->n_tracks && mi->id[lo] == id;
+	return lo;
+}
+
+static int grow_track_columns(MedialibIndex *mi)
+{
+	size_t old = mi->size_tracks, size = old ? old * 2 : 256;
+	int    res = 1;
+
+	if (mi->n_tracks < old) return 1;
+	res = mem_resize(mi, &mi->id,      old * sizeof(int),      size * sizeof(int)) &&
+	      mem_resize(mi, &mi->length,  old * sizeof(int),      size * sizeof(int)) &&
+	      mem_resize(mi, &mi->rating,  old * sizeof(int),      size * sizeof(int)) &&
+	      mem_resize(mi, &mi->file,    old * sizeof(uint32_t), size * sizeof(uint32_t)) &&
+	      mem_resize(mi, &mi->title,   old * sizeof(uint32_t), size * sizeof(uint32_t)) &&
+	      mem_resize(mi, &mi->date,    old * sizeof(uint32_t), size * sizeof(uint32_t)) &&
+	      mem_resize(mi, &mi->artist,  old * sizeof(uint32_t), size * sizeof(uint32_t)) &&
+	      mem_resize(mi, &mi->album,   old * sizeof(uint32_t), size * sizeof(uint32_t)) &&
+	      mem_resize(mi, &mi->missing, old,                    size);
+	/* On failure some columns may have been enlarged already; The index
+	 * is unusable anyway and the memory is accounted for, so that's fine. */
+	if (res) mi->size_tracks = size;
+	return res;
+}
+
+#define MOVE_COLUMN(col, pos) \
+	memmove(mi->col + (pos) + 1, mi->col + (pos), (mi->n_tracks - (pos)) * sizeof(*mi->col))
+
+int medialibindex_add_track(MedialibIndex *mi, const TrackSummary *ts, int missing)
+{
+	int      found, ok = 1;
+	size_t   pos = find_track(mi, ts->id, &found);
+	uint32_t artist, album, file, title, date;
+
+	if (found) return 1;
+	file  = intern(mi, ts->file_name, &ok);
+	title = intern(mi, ts->title, &ok);
+	date  = intern(mi, ts->date, &ok);
+	if (!ok || !get_artist(mi, ts->artist, &artist) || !get_album(mi, artist, ts->album, &album) ||
+	    !grow_track_columns(mi))
+		return 0;
+	if (!missing) {
+		mi->artists[artist].n_present++;
+		mi->albums[album].n_present++;
+	}
+	if (pos < mi->n_tracks) {
+		MOVE_COLUMN(id, pos);
+		MOVE_COLUMN(length, pos);
+		MOVE_COLUMN(rating, pos);
+		MOVE_COLUMN(file, pos);
+		MOVE_COLUMN(title, pos);
+		MOVE_COLUMN(date, pos);
+		MOVE_COLUMN(artist, pos);
+		MOVE_COLUMN(album, pos);
+		MOVE_COLUMN(missing, pos);
+	}
+	mi->id[pos]      = ts->id;
+	mi->length[pos]  = ts->length;
+	mi->rating[pos]  = ts->rating;
+	mi->file[pos]    = file;
+	mi->title[pos]   = title;
+	mi->date[pos]    = date;
+	mi->artist[pos]  = artist;
+	mi->album[pos]   = album;
+	mi->missing[pos] = missing ? 1 : 0;
+	mi->n_tracks++;
+	return 1;
+}
+
+int medialibindex_set_missing(MedialibIndex *mi, int id, int missing)
+{
+	int    found;
+	size_t pos = find_track(mi, id, &found);
+
+	missing = missing ? 1 : 0;
+	if (found && mi->missing[pos] != missing) {
+		mi->missing[pos] = missing;
+		mi->artists[mi->artist[pos]].n_present += missing ? -1 : 1;
+		mi->albums[mi->album[pos]].n_present += missing ? -1 : 1;
+	}
+	return 1;
+}
+
+int medialibindex_set_rating(MedialibIndex *mi, int id, int rating, int relative)
+{
+	int    found;
+	size_t pos = find_track(mi, id, &found);
+
+	if (found) {
+		if (!relative)
+			mi->rating[pos] = rating;
+		else if (mi->rating[pos] != MEDIALIBINDEX_NO_RATING)
+			mi->rating[pos] += rating;
+	}
+	return 1;
+}
+
+int medialibindex_set_length(MedialibIndex *mi, int id, int length)
+{
+	int    found;
+	size_t pos = find_track(mi, id, &found);
+
+	if (found) mi->length[pos] = length;
+	return 1;
+}
+
+size_t medialibindex_get_memory_usage(const MedialibIndex *mi)
+{
+	return mi->mem_used;
+}
+
+size_t medialibindex_get_track_count(const MedialibIndex *mi)
+{
+	return mi->n_tracks;
+}
+
+/* Copies a string into the result; Returns its offset or (size_t)-1 */
+static size_t result_add_string(MedialibIndexResult *res, const char *str)
+{
+	size_t len = strlen(str) + 1, offset = res->strings_len;
+
+	if (res->strings_len + len > res->strings_size) {
+		size_t size = res->strings_size ? res->strings_size * 2 : 4096;
+		char  *tmp;
+		while (res->strings_len + len > size) size *= 2;
+		if (!(tmp = realloc(res->strings, size))) return (size_t)-1;
+		res->strings = tmp;
+		res->strings_size = size;
+	}
+	memcpy(res->strings + offset, str, len);
+	res->strings_len += len;
+	return offset;
+}
+
+static MedialibIndexRow *result_add_row(MedialibIndexResult *res)
+{
+	MedialibIndexRow *row;
+
+	if (res->count == res->size) {
+		size_t size = res->size ? res->size * 2 : 64;
+		MedialibIndexRow *tmp = realloc(res->rows, size * sizeof(MedialibIndexRow));
+		if (!tmp) return NULL;
+		res->rows = tmp;
+		res->size = size;
+	}
+	row = &res->rows[res->count++];
+	memset(row, 0, sizeof(MedialibIndexRow));
+	return row;
+}
+
+/* Adds the names of those groups that have tracks whose files are not missing */
+static int result_add_groups(MedialibIndex *mi, const Group *groups, const uint32_t *order, size_t n,
+                             const char *after, int limit, MedialibIndexResult *res)
+{
+	size_t i = after ? find_group(mi, groups, order, n, after, 1, NULL) : 0;
+
+	for (; i < n && (limit <= 0 || res->count < (size_t)limit); i++) {
+		const Group      *g = &groups[order[i]];
+		MedialibIndexRow *row;
+		if (g->n_present == 0) continue;
+		if (!(row = result_add_row(res))) return 0;
+		row->artist = result_add_string(res, mi->pool + g->name);
+		if (row->artist == (size_t)-1) return 0;
+	}
+	return 1;
+}
+
+int medialibindex_browse_artists(MedialibIndex *mi, const char *after, int limit, MedialibIndexResult *res)
+{
+	medialibindex_result_clear(res);
+	return result_add_groups(mi, mi->artists, mi->artist_order, mi->n_artists, after, limit, res);
+}
+
+int medialibindex_browse_albums(MedialibIndex *mi, const char *artist, const char *after, int limit,
+                                MedialibIndexResult *res)
+{
+	int    found;
+	size_t pos = find_group(mi, mi->artists, mi->artist_order, mi->n_artists, artist ? artist : "", 0, &found);
+
+	medialibindex_result_clear(res);
+	if (!found) return 1;
+	pos = mi->artist_order[pos];
+	return result_add_groups(mi, mi->albums, mi->artists[pos].albums, mi->artists[pos].n_albums,
+	                         after, limit, res);
+}
+
+static int fold(int c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+}
+
+/* Matches 'str' against an SQL LIKE pattern; Like SQLite's LIKE operator,
+ * it ignores the case of ASCII letters only. */
+static int like_match(const char *str, const char *pattern)
+{
+	const char *s = str, *p = pattern, *star_p = NULL, *star_s = NULL;
+
+	while (*s) {
+		if (*p == '%') {
+			while (*p == '%') p++;
+			if (!*p) return 1;
+			star_p = p;
+			star_s = s;
+		} else if (*p && (*p == '_' || fold((unsigned char)*p) == fold((unsigned char)*s))) {
+			p++;
+			s++;
+		} else if (star_p) {
+			p = star_p;
+			s = ++star_s;
+		} else {
+			return 0;
+		}
+	}
+	while (*p == '%') p++;
+	return *p == '\0';
+}
+
+int medialibindex_search(MedialibIndex *mi, int fields, const char *str, int after_id, int limit,
+                         MedialibIndexResult *res)
+{
+	int    found;
+	size_t i = find_track(mi, after_id, &found);
+	char  *pattern;
+
+	medialibindex_result_clear(res);
+	if (!str || !(pattern = malloc(strlen(str) + 3))) return 0;
+	sprintf(pattern, "%%%s%%", str);
+	if (found) i++;
+	for (; i < mi->n_tracks && (limit <= 0 || res->count < (size_t)limit); i++) {
+		const char       *artist = mi->pool + mi->artists[mi->artist[i]].name;
+		const char       *album = mi->pool + mi->albums[mi->album[i]].name;
+		const char       *title = mi->pool + mi->title[i];
+		MedialibIndexRow *row;
+
+		if (mi->missing[i]) continue;
+		if (!(((fields & MEDIALIBINDEX_TITLE) && like_match(title, pattern)) ||
+		      ((fields & MEDIALIBINDEX_ARTIST) && like_match(artist, pattern)) ||
+		      ((fields & MEDIALIBINDEX_ALBUM) && like_match(album, pattern))))
+			continue;
+		if (!(row = result_add_row(res))) break;
+		row->id     = mi->id[i];
+		row->length = mi->length[i];
+		row->rating = mi->rating[i] == MEDIALIBINDEX_NO_RATING ? 0 : mi->rating[i];
+		row->file   = result_add_string(res, mi->pool + mi->file[i]);
+		row->artist = result_add_string(res, artist);
+		row->title  = result_add_string(res, title);
+		row->album  = result_add_string(res, album);
+		row->date   = result_add_string(res, mi->pool + mi->date[i]);
+		if (row->file == (size_t)-1 || row->artist == (size_t)-1 || row->title == (size_t)-1 ||
+		    row->album == (size_t)-1 || row->date == (size_t)-1) {
+			res->count--;
+			break;
+		}
+	}
+	free(pattern);
+	return 1;
+}
+
+const MedialibIndexRow *medialibindex_result_next(MedialibIndexResult *res)
+{
+	return res->pos < res->count ? &res->rows[res->pos++] : NULL;
+}
+
+void medialibindex_result_clear(MedialibIndexResult *res)
+{
+	res->strings_len = 0;
+	res->count = 0;
+	res->pos = 0;
+}
+
+void medialibindex_result_free(MedialibIndexResult *res)
+{
+	free(res->strings);
+	free(res->rows);
+	memset(res, 0, sizeof(MedialibIndexResult));
+}
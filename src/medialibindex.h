@@ -0,0 +1,82 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: medialibindex.h  Created: 210911
+ *
+ * Description: Compact in-memory index of the media library for
+ *              browsing and searching without database queries
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#ifndef _MEDIALIBINDEX_H
+#define _MEDIALIBINDEX_H
+#include <stddef.h>
+#include <limits.h>
+#include "trackinfo.h"
+
+/* Fields to be searched by medialibindex_search() */
+#define MEDIALIBINDEX_ARTIST 1
+#define MEDIALIBINDEX_TITLE  2
+#define MEDIALIBINDEX_ALBUM  4
+
+/* Rating of tracks that have not been rated; Relative rating changes
+ * leave such tracks unrated, just like the SQL updates do with NULL */
+#define MEDIALIBINDEX_NO_RATING INT_MIN
+
+typedef struct MedialibIndex MedialibIndex;
+
+/* The strings of a result row are offsets into the result's string buffer */
+typedef struct MedialibIndexRow
+{
+	int    id, length, rating;
+	size_t file, artist, title, album, date;
+} MedialibIndexRow;
+
+/* Query results are copied out of the index, so they remain valid when
+ * the index is modified or freed. A result can be reused for several
+ * queries and needs to be freed with medialibindex_result_free(). */
+typedef struct MedialibIndexResult
+{
+	char             *strings;
+	size_t            strings_len, strings_size;
+	MedialibIndexRow *rows;
+	size_t            count, size, pos;
+} MedialibIndexResult;
+
+/* Creates an empty index that may use at most 'max_bytes' of memory */
+MedialibIndex *medialibindex_new(size_t max_bytes);
+void           medialibindex_free(MedialibIndex *mi);
+/* All modifying functions return 0 if the operation would exceed the
+ * memory limit or if memory allocation failed. The index must not be
+ * used for queries anymore in that case. */
+int            medialibindex_add_track(MedialibIndex *mi, const TrackSummary *ts, int missing);
+int            medialibindex_set_missing(MedialibIndex *mi, int id, int missing);
+/* Sets the rating or changes it by 'rating' if 'relative' is true */
+int            medialibindex_set_rating(MedialibIndex *mi, int id, int rating, int relative);
+int            medialibindex_set_length(MedialibIndex *mi, int id, int length);
+size_t         medialibindex_get_memory_usage(const MedialibIndex *mi);
+size_t         medialibindex_get_track_count(const MedialibIndex *mi);
+/* The query functions work like their medialib counterparts: Results are
+ * sorted (by name or track ID) and only those after 'after'/'after_id' are
+ * returned, at most 'limit' of them (no limit if limit <= 0). Only tracks
+ * whose files are not missing are taken into account. The result's string
+ * offsets of browse results are stored in the 'artist' field of each row.
+ * Return 1 on success, 0 otherwise. */
+int            medialibindex_browse_artists(MedialibIndex *mi, const char *after, int limit,
+                                            MedialibIndexResult *res);
+int            medialibindex_browse_albums(MedialibIndex *mi, const char *artist, const char *after,
+                                           int limit, MedialibIndexResult *res);
+/* Case insensitive substring search, with the same wildcards as SQL's LIKE */
+int            medialibindex_search(MedialibIndex *mi, int fields, const char *str, int after_id,
+                                    int limit, MedialibIndexResult *res);
+/* Returns the next row of a result or NULL when there are no more rows */
+const MedialibIndexRow *medialibindex_result_next(MedialibIndexResult *res);
+void           medialibindex_result_clear(MedialibIndexResult *res);
+void           medialibindex_result_free(MedialibIndexResult *res);
+#endif
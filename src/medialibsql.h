@@ -41,3 +41,98 @@ CREATE TABLE path \
 	path varchar(255), \
 	date timestamp \
 );";
+
+/* Schema upgrades; entry n upgrades a database from user_version n to n+1 */
+const char *medialib_sql_upgrades[] = {
+"ALTER TABLE track ADD COLUMN samplerate integer; \
+ALTER TABLE track ADD COLUMN channels integer; \
+ALTER TABLE track ADD COLUMN bitrate integer; \
+CREATE INDEX track_file ON track (file);",
+/* Version 2: Normalized artist and album tables. The IDs are maintained
+ * by triggers, so the track's artist and album columns remain the
+ * authoritative source. */
+"CREATE TABLE artist \
+( \
+	id integer primary key, \
+	name varchar(255) NOT NULL UNIQUE \
+); \
+\
+CREATE TABLE album \
+( \
+	id integer primary key, \
+	artist_id integer NOT NULL REFERENCES artist (id), \
+	name varchar(255) NOT NULL, \
+	UNIQUE (artist_id, name) \
+); \
+\
+ALTER TABLE track ADD COLUMN artist_id integer REFERENCES artist (id); \
+ALTER TABLE track ADD COLUMN album_id integer REFERENCES album (id); \
+\
+INSERT OR IGNORE INTO artist (name) SELECT DISTINCT COALESCE(artist, '') FROM track; \
+INSERT OR IGNORE INTO album (artist_id, name) \
+	SELECT DISTINCT artist.id, COALESCE(track.album, '') FROM track \
+	JOIN artist ON artist.name = COALESCE(track.artist, ''); \
+UPDATE track SET artist_id = (SELECT id FROM artist WHERE name = COALESCE(track.artist, '')); \
+UPDATE track SET album_id = (SELECT id FROM album WHERE artist_id = track.artist_id AND name = COALESCE(track.album, '')); \
+\
+CREATE INDEX album_name ON album (name); \
+CREATE INDEX track_artist ON track (artist_id, file_missing); \
+CREATE INDEX track_album ON track (album_id, file_missing); \
+\
+CREATE TRIGGER track_set_artist_album AFTER INSERT ON track \
+BEGIN \
+	INSERT OR IGNORE INTO artist (name) VALUES (COALESCE(new.artist, '')); \
+	INSERT OR IGNORE INTO album (artist_id, name) \
+		SELECT id, COALESCE(new.album, '') FROM artist WHERE name = COALESCE(new.artist, ''); \
+	UPDATE track SET \
+		artist_id = (SELECT id FROM artist WHERE name = COALESCE(new.artist, '')), \
+		album_id  = (SELECT album.id FROM album JOIN artist ON artist.id = album.artist_id \
+		             WHERE artist.name = COALESCE(new.artist, '') AND album.name = COALESCE(new.album, '')) \
+	WHERE id = new.id; \
+END; \
+\
+CREATE TRIGGER track_update_artist_album AFTER UPDATE OF artist, album ON track \
+BEGIN \
+	INSERT OR IGNORE INTO artist (name) VALUES (COALESCE(new.artist, '')); \
+	INSERT OR IGNORE INTO album (artist_id, name) \
+		SELECT id, COALESCE(new.album, '') FROM artist WHERE name = COALESCE(new.artist, ''); \
+	UPDATE track SET \
+		artist_id = (SELECT id FROM artist WHERE name = COALESCE(new.artist, '')), \
+		album_id  = (SELECT album.id FROM album JOIN artist ON artist.id = album.artist_id \
+		             WHERE artist.name = COALESCE(new.artist, '') AND album.name = COALESCE(new.album, '')) \
+	WHERE id = new.id; \
+END;",
+/* Version 3: Acoustic feature vectors (see audiofeatures.h), written by
+ * gmu-analyze. The features are NULL for tracks that could not be analyzed.
+ * lsh0..lsh3 are the locality sensitive hashes of the features. */
+"CREATE TABLE track_features \
+( \
+	track_id integer primary key, \
+	version integer, \
+	features blob, \
+	lsh0 integer, \
+	lsh1 integer, \
+	lsh2 integer, \
+	lsh3 integer \
+); \
+\
+CREATE INDEX track_features_lsh0 ON track_features (lsh0); \
+CREATE INDEX track_features_lsh1 ON track_features (lsh1); \
+CREATE INDEX track_features_lsh2 ON track_features (lsh2); \
+CREATE INDEX track_features_lsh3 ON track_features (lsh3); \
+CREATE INDEX similarity_a ON similarity (track_id_a, similarity);",
+/* Version 4: EBU R128 loudness (LUFS) and true peak (dBTP), written by
+ * gmu-analyze. mtime is the modification time of the analyzed file, so
+ * the file is analyzed again after it has been changed. The values are
+ * NULL for files that could not be analyzed. */
+"CREATE TABLE track_loudness \
+( \
+	track_id integer primary key, \
+	mtime integer, \
+	loudness real, \
+	true_peak real \
+); \
+\
+CREATE INDEX aditional_trackinfo_track ON aditional_trackinfo (track_id, key);",
+NULL
+};
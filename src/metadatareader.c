@@ -19,6 +19,7 @@
 #include "gmudecoder.h"
 #include "util.h"
 #include "decloader.h"
+#include "tagreader.h"
 #include "metadatareader.h"
 
 int metadatareader_read(const char *file, const char *file_type, TrackInfo *ti)
@@ -27,6 +28,11 @@ int metadatareader_read(const char *file, const char *file_type, TrackInfo *ti)
 	GmuDecoder *gd = decloader_get_decoder_for_extension(file_type);
 	GmuCharset  charset = M_CHARSET_AUTODETECT;
 
+	/* Try the native tag readers first, as some decoders need to be fully
+	 * initialized just to read the tags */
+	if (gd && tagreader_read(file, file_type, ti))
+		return 1;
+
 	if (gd && *gd->meta_data_get_charset)
 		charset = (*gd->meta_data_get_charset)();
 
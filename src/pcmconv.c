@@ -0,0 +1,440 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: pcmconv.c  Created: 210612
+ *
+ * Description: PCM sample format conversion kernels
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "pcmconv.h"
+#include "debug.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define PCMCONV_HAVE_SSE2 1
+#include <emmintrin.h>
+/* Allows building the SSE2 kernels even if the compiler's default target
+ * does not include SSE2 (e.g. i386). They are only used if the CPU has it. */
+#define SSE2_FUNC __attribute__((target("sse2")))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PCMCONV_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef struct PcmConvKernels
+{
+	const char *name;
+	void (*s32_planar_to_s16)(int16_t *, const int32_t *const [], int, size_t, size_t, int);
+	void (*s32_planar_to_s32)(int32_t *, const int32_t *const [], int, size_t, size_t);
+	void (*float_to_s16)(int16_t *, const float *, size_t, size_t);
+	void (*u8_to_s16)(int16_t *, const unsigned char *, size_t, size_t, unsigned char);
+} PcmConvKernels;
+
+/*
+ * Scalar kernels. All kernels take a start offset, so the SIMD versions
+ * can hand over the remaining samples that do not fill a whole vector.
+ */
+static inline int16_t clip16(int32_t v)
+{
+	return v > 32767 ? 32767 : (v < -32768 ? -32768 : v);
+}
+
+static void s32_planar_to_s16_c(int16_t *target, const int32_t *const src[], int channels,
+                                size_t start, size_t frames, int shift)
+{
+	size_t i;
+	int    ch;
+
+	target += start * channels;
+	if (shift >= 0) {
+		for (i = start; i < frames; i++)
+			for (ch = 0; ch < channels; ch++)
+				*target++ = clip16(src[ch][i] >> shift);
+	} else {
+		int32_t mul = 1 << -shift;
+		for (i = start; i < frames; i++)
+			for (ch = 0; ch < channels; ch++)
+				*target++ = clip16(src[ch][i] * mul);
+	}
+}
+
+static void s32_planar_to_s32_c(int32_t *target, const int32_t *const src[], int channels,
+                                size_t start, size_t frames)
+{
+	size_t i;
+	int    ch;
+
+	target += start * channels;
+	for (i = start; i < frames; i++)
+		for (ch = 0; ch < channels; ch++)
+			*target++ = src[ch][i];
+}
+
+static void float_to_s16_c(int16_t *target, const float *src, size_t start, size_t samples)
+{
+	size_t i;
+
+	for (i = start; i < samples; i++) {
+		float v = src[i] * 32768.0f;
+		if (v >= 32767.0f)
+			target[i] = 32767;
+		else if (v <= -32768.0f)
+			target[i] = -32768;
+		else if (v == v)
+			target[i] = (int16_t)(v < 0.0f ? v - 0.5f : v + 0.5f);
+		else /* NaN */
+			target[i] = 0;
+	}
+}
+
+static void u8_to_s16_c(int16_t *target, const unsigned char *src, size_t start, size_t samples,
+                        unsigned char flip)
+{
+	size_t i;
+
+	for (i = start; i < samples; i++)
+		target[i] = (int16_t)((signed char)(src[i] ^ flip) * 256);
+}
+
+static const PcmConvKernels kernels_scalar = {
+	"scalar",
+	s32_planar_to_s16_c,
+	s32_planar_to_s32_c,
+	float_to_s16_c,
+	u8_to_s16_c
+};
+
+#ifdef PCMCONV_HAVE_SSE2
+static SSE2_FUNC void s32_planar_to_s16_sse2(int16_t *target, const int32_t *const src[], int channels,
+                                             size_t start, size_t frames, int shift)
+{
+	size_t  i = start;
+	__m128i cnt = _mm_cvtsi32_si128(shift >= 0 ? shift : -shift);
+
+	if (channels == 2) {
+		for (; i + 4 <= frames; i += 4) {
+			__m128i l = _mm_loadu_si128((const __m128i *)(src[0] + i));
+			__m128i r = _mm_loadu_si128((const __m128i *)(src[1] + i));
+			if (shift >= 0) {
+				l = _mm_sra_epi32(l, cnt);
+				r = _mm_sra_epi32(r, cnt);
+			} else {
+				l = _mm_sll_epi32(l, cnt);
+				r = _mm_sll_epi32(r, cnt);
+			}
+			l = _mm_packs_epi32(l, l);
+			r = _mm_packs_epi32(r, r);
+			_mm_storeu_si128((__m128i *)(target + 2 * i), _mm_unpacklo_epi16(l, r));
+		}
+	} else if (channels == 1) {
+		for (; i + 8 <= frames; i += 8) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(src[0] + i));
+			__m128i b = _mm_loadu_si128((const __m128i *)(src[0] + i + 4));
+			if (shift >= 0) {
+				a = _mm_sra_epi32(a, cnt);
+				b = _mm_sra_epi32(b, cnt);
+			} else {
+				a = _mm_sll_epi32(a, cnt);
+				b = _mm_sll_epi32(b, cnt);
+			}
+			_mm_storeu_si128((__m128i *)(target + i), _mm_packs_epi32(a, b));
+		}
+	}
+	s32_planar_to_s16_c(target, src, channels, i, frames, shift);
+}
+
+static SSE2_FUNC void s32_planar_to_s32_sse2(int32_t *target, const int32_t *const src[], int channels,
+                                             size_t start, size_t frames)
+{
+	size_t i = start;
+
+	if (channels == 2) {
+		for (; i + 4 <= frames; i += 4) {
+			__m128i l = _mm_loadu_si128((const __m128i *)(src[0] + i));
+			__m128i r = _mm_loadu_si128((const __m128i *)(src[1] + i));
+			_mm_storeu_si128((__m128i *)(target + 2 * i),     _mm_unpacklo_epi32(l, r));
+			_mm_storeu_si128((__m128i *)(target + 2 * i + 4), _mm_unpackhi_epi32(l, r));
+		}
+	} else if (channels == 1) {
+		memcpy(target + i, src[0] + i, (frames - i) * sizeof(int32_t));
+		i = frames;
+	}
+	s32_planar_to_s32_c(target, src, channels, i, frames);
+}
+
+static SSE2_FUNC void float_to_s16_sse2(int16_t *target, const float *src, size_t start, size_t samples)
+{
+	size_t i = start;
+	__m128 scale = _mm_set1_ps(32768.0f);
+	__m128 max   = _mm_set1_ps(32767.0f);
+	__m128 min   = _mm_set1_ps(-32768.0f);
+	__m128 sign  = _mm_set1_ps(-0.0f);
+	__m128 half  = _mm_set1_ps(0.5f);
+
+	for (; i + 8 <= samples; i += 8) {
+		__m128  fa = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+		__m128  fb = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+		__m128i a, b;
+		/* NaN becomes 0 like in the scalar version (min/max would turn it into 32767) */
+		fa = _mm_and_ps(fa, _mm_cmpord_ps(fa, fa));
+		fb = _mm_and_ps(fb, _mm_cmpord_ps(fb, fb));
+		/* Clamp first, since out of range floats convert to INT_MIN */
+		fa = _mm_max_ps(_mm_min_ps(fa, max), min);
+		fb = _mm_max_ps(_mm_min_ps(fb, max), min);
+		/* Round half away from zero like the scalar version, then truncate */
+		fa = _mm_add_ps(fa, _mm_or_ps(_mm_and_ps(fa, sign), half));
+		fb = _mm_add_ps(fb, _mm_or_ps(_mm_and_ps(fb, sign), half));
+		a = _mm_cvttps_epi32(fa);
+		b = _mm_cvttps_epi32(fb);
+		_mm_storeu_si128((__m128i *)(target + i), _mm_packs_epi32(a, b));
+	}
+	float_to_s16_c(target, src, i, samples);
+}
+
+static SSE2_FUNC void u8_to_s16_sse2(int16_t *target, const unsigned char *src, size_t start, size_t samples,
+                                     unsigned char flip)
+{
+	size_t  i = start;
+	__m128i f = _mm_set1_epi8((char)flip);
+	__m128i zero = _mm_setzero_si128();
+
+	for (; i + 16 <= samples; i += 16) {
+		__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(src + i)), f);
+		/* Interleaving with zero bytes puts each sample into the high byte */
+		_mm_storeu_si128((__m128i *)(target + i),     _mm_unpacklo_epi8(zero, v));
+		_mm_storeu_si128((__m128i *)(target + i + 8), _mm_unpackhi_epi8(zero, v));
+	}
+	u8_to_s16_c(target, src, i, samples, flip);
+}
+
+static const PcmConvKernels kernels_sse2 = {
+	"SSE2",
+	s32_planar_to_s16_sse2,
+	s32_planar_to_s32_sse2,
+	float_to_s16_sse2,
+	u8_to_s16_sse2
+};
+
+static int cpu_has_sse2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+#endif
+
+#ifdef PCMCONV_HAVE_NEON
+static void s32_planar_to_s16_neon(int16_t *target, const int32_t *const src[], int channels,
+                                   size_t start, size_t frames, int shift)
+{
+	size_t    i = start;
+	int32x4_t sh = vdupq_n_s32(-shift); /* vshlq shifts right for negative counts */
+
+	if (channels == 2) {
+		for (; i + 4 <= frames; i += 4) {
+			int16x4x2_t v;
+			v.val[0] = vqmovn_s32(vshlq_s32(vld1q_s32(src[0] + i), sh));
+			v.val[1] = vqmovn_s32(vshlq_s32(vld1q_s32(src[1] + i), sh));
+			vst2_s16(target + 2 * i, v);
+		}
+	} else if (channels == 1) {
+		for (; i + 8 <= frames; i += 8) {
+			int16x4_t a = vqmovn_s32(vshlq_s32(vld1q_s32(src[0] + i), sh));
+			int16x4_t b = vqmovn_s32(vshlq_s32(vld1q_s32(src[0] + i + 4), sh));
+			vst1q_s16(target + i, vcombine_s16(a, b));
+		}
+	}
+	s32_planar_to_s16_c(target, src, channels, i, frames, shift);
+}
+
+static void s32_planar_to_s32_neon(int32_t *target, const int32_t *const src[], int channels,
+                                   size_t start, size_t frames)
+{
+	size_t i = start;
+
+	if (channels == 2) {
+		for (; i + 4 <= frames; i += 4) {
+			int32x4x2_t v;
+			v.val[0] = vld1q_s32(src[0] + i);
+			v.val[1] = vld1q_s32(src[1] + i);
+			vst2q_s32(target + 2 * i, v);
+		}
+	} else if (channels == 1) {
+		memcpy(target + i, src[0] + i, (frames - i) * sizeof(int32_t));
+		i = frames;
+	}
+	s32_planar_to_s32_c(target, src, channels, i, frames);
+}
+
+static void float_to_s16_neon(int16_t *target, const float *src, size_t start, size_t samples)
+{
+	size_t      i = start;
+	uint32x4_t  sign = vdupq_n_u32(0x80000000);
+	uint32x4_t  half = vreinterpretq_u32_f32(vdupq_n_f32(0.5f));
+
+	for (; i + 8 <= samples; i += 8) {
+		float32x4_t fa = vmulq_n_f32(vld1q_f32(src + i), 32768.0f);
+		float32x4_t fb = vmulq_n_f32(vld1q_f32(src + i + 4), 32768.0f);
+		/* Round half away from zero like the scalar version; the float to
+		 * int conversion truncates and saturates */
+		fa = vaddq_f32(fa, vreinterpretq_f32_u32(vorrq_u32(vandq_u32(vreinterpretq_u32_f32(fa), sign), half)));
+		fb = vaddq_f32(fb, vreinterpretq_f32_u32(vorrq_u32(vandq_u32(vreinterpretq_u32_f32(fb), sign), half)));
+		vst1q_s16(target + i, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(fa)), vqmovn_s32(vcvtq_s32_f32(fb))));
+	}
+	float_to_s16_c(target, src, i, samples);
+}
+
+static void u8_to_s16_neon(int16_t *target, const unsigned char *src, size_t start, size_t samples,
+                           unsigned char flip)
+{
+	size_t     i = start;
+	uint8x16_t f = vdupq_n_u8(flip);
+
+	for (; i + 16 <= samples; i += 16) {
+		int8x16_t v = vreinterpretq_s8_u8(veorq_u8(vld1q_u8(src + i), f));
+		vst1q_s16(target + i,     vshll_n_s8(vget_low_s8(v), 8));
+		vst1q_s16(target + i + 8, vshll_n_s8(vget_high_s8(v), 8));
+	}
+	u8_to_s16_c(target, src, i, samples, flip);
+}
+
+static const PcmConvKernels kernels_neon = {
+	"NEON",
+	s32_planar_to_s16_neon,
+	s32_planar_to_s32_neon,
+	float_to_s16_neon,
+	u8_to_s16_neon
+};
+
+static int cpu_has_neon(void)
+{
+#ifdef __aarch64__
+	return 1;
+#else
+	/* NEON is optional on 32 bit ARM, so ask the kernel */
+	int   res = 0;
+	FILE *f = fopen("/proc/cpuinfo", "r");
+
+	if (f) {
+		char line[1024];
+		while (!res && fgets(line, sizeof(line), f)) {
+			if (strncmp(line, "Features", 8) == 0 && strstr(line, " neon"))
+				res = 1;
+		}
+		fclose(f);
+	}
+	return res;
+#endif
+}
+#endif
+
+static const PcmConvKernels *kernels = &kernels_scalar;
+
+int pcmconv_cpu_supports(PcmConvImpl impl)
+{
+	int res = 0;
+
+	switch (impl) {
+		case PCMCONV_IMPL_AUTO:
+		case PCMCONV_IMPL_SCALAR:
+			res = 1;
+			break;
+		case PCMCONV_IMPL_SSE2:
+#ifdef PCMCONV_HAVE_SSE2
+			res = cpu_has_sse2();
+#endif
+			break;
+		case PCMCONV_IMPL_NEON:
+#ifdef PCMCONV_HAVE_NEON
+			res = cpu_has_neon();
+#endif
+			break;
+	}
+	return res;
+}
+
+int pcmconv_set_implementation(PcmConvImpl impl)
+{
+	int res = 0;
+
+	switch (impl) {
+		case PCMCONV_IMPL_AUTO:
+			kernels = &kernels_scalar;
+#ifdef PCMCONV_HAVE_NEON
+			if (cpu_has_neon()) kernels = &kernels_neon;
+#endif
+#ifdef PCMCONV_HAVE_SSE2
+			if (cpu_has_sse2()) kernels = &kernels_sse2;
+#endif
+			res = 1;
+			break;
+		case PCMCONV_IMPL_SCALAR:
+			kernels = &kernels_scalar;
+			res = 1;
+			break;
+		case PCMCONV_IMPL_SSE2:
+#ifdef PCMCONV_HAVE_SSE2
+			if (cpu_has_sse2()) {
+				kernels = &kernels_sse2;
+				res = 1;
+			}
+#endif
+			break;
+		case PCMCONV_IMPL_NEON:
+#ifdef PCMCONV_HAVE_NEON
+			if (cpu_has_neon()) {
+				kernels = &kernels_neon;
+				res = 1;
+			}
+#endif
+			break;
+	}
+	return res;
+}
+
+void pcmconv_init(void)
+{
+	pcmconv_set_implementation(PCMCONV_IMPL_AUTO);
+	wdprintf(V_DEBUG, "pcmconv", "Using %s sample conversion kernels.\n", kernels->name);
+}
+
+const char *pcmconv_get_implementation_name(void)
+{
+	return kernels->name;
+}
+
+void pcmconv_s32_planar_to_s16(void *target, const int32_t *const src[], int channels, size_t frames, int shift)
+{
+	kernels->s32_planar_to_s16(target, src, channels, 0, frames, shift);
+}
+
+void pcmconv_s32_planar_to_s32(void *target, const int32_t *const src[], int channels, size_t frames)
+{
+	kernels->s32_planar_to_s32(target, src, channels, 0, frames);
+}
+
+void pcmconv_s32_to_s16(void *target, const int32_t *src, size_t samples, int shift)
+{
+	/* Interleaved data is handled as a single plane */
+	const int32_t *const plane[1] = { src };
+	kernels->s32_planar_to_s16(target, plane, 1, 0, samples, shift);
+}
+
+void pcmconv_float_to_s16(void *target, const float *src, size_t samples)
+{
+	kernels->float_to_s16(target, src, 0, samples);
+}
+
+void pcmconv_8bit_to_s16(void *target, const unsigned char *src, size_t samples, int is_unsigned)
+{
+	kernels->u8_to_s16(target, src, 0, samples, is_unsigned ? 0x80 : 0x00);
+}
@@ -0,0 +1,51 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: pcmconv.h  Created: 210612
+ *
+ * Description: PCM sample format conversion kernels
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#ifndef _PCMCONV_H
+#define _PCMCONV_H
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum PcmConvImpl {
+	PCMCONV_IMPL_AUTO, PCMCONV_IMPL_SCALAR, PCMCONV_IMPL_SSE2, PCMCONV_IMPL_NEON
+} PcmConvImpl;
+
+/* Selects the fastest kernel set supported by the CPU. Call once on startup,
+ * before any decoder is used. Without calling it, the scalar kernels are used. */
+void        pcmconv_init(void);
+/* Forces a specific kernel set (mainly for benchmarking). Returns 1 on
+ * success, 0 if the requested implementation is not available. */
+int         pcmconv_set_implementation(PcmConvImpl impl);
+const char *pcmconv_get_implementation_name(void);
+/* Returns 1 if the CPU supports the given kernel set, 0 otherwise. Other
+ * modules with SIMD kernels use this to pick their implementation. */
+int         pcmconv_cpu_supports(PcmConvImpl impl);
+
+/* Converts 'frames' frames of planar 32 bit samples (one array per channel,
+ * as delivered by e.g. libFLAC) to interleaved signed 16 bit samples with
+ * saturation. Each sample is shifted right by 'shift' bits before
+ * saturating (use bits_per_sample - 16); negative values shift left. */
+void pcmconv_s32_planar_to_s16(void *target, const int32_t *const src[], int channels, size_t frames, int shift);
+/* Interleaves planar 32 bit samples without changing the sample format. */
+void pcmconv_s32_planar_to_s32(void *target, const int32_t *const src[], int channels, size_t frames);
+/* Converts interleaved 32 bit samples (e.g. WavPack output) to signed 16 bit. */
+void pcmconv_s32_to_s16(void *target, const int32_t *src, size_t samples, int shift);
+/* Converts float samples in the range [-1.0, 1.0] to signed 16 bit samples
+ * with saturation. */
+void pcmconv_float_to_s16(void *target, const float *src, size_t samples);
+/* Converts 8 bit samples to signed 16 bit samples. If is_unsigned is set,
+ * the source samples are unsigned (as in WAV files), signed otherwise. */
+void pcmconv_8bit_to_s16(void *target, const unsigned char *src, size_t samples, int is_unsigned);
+#endif
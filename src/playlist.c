@@ -44,6 +44,7 @@ void playlist_init(Playlist *pl)
 	pl->play_mode    = PM_CONTINUE;
 	pl->played_items = 0;
 	pl->queue_start  = NULL;
+	pl->random_next  = NULL;
 	srand(time(NULL));
 	pthread_mutex_init(&(pl->mutex), NULL);
 }
@@ -82,6 +83,7 @@ void playlist_clear(Playlist *pl)
 	pl->last    = NULL;
 	pl->played_items = 0;
 	pl->queue_start = NULL;
+	pl->random_next = NULL;
 }
 
 int playlist_add_item(Playlist *pl, const char *file, const char *name)
@@ -107,6 +109,8 @@ int playlist_add_item(Playlist *pl, const char *file, const char *name)
 		}
 		if (entry) {
 			entry->played = 0;
+			entry->length = -1;
+			entry->length_looked_up = 0;
 			entry->next = NULL;
 			if (file[0] != '/' && strncmp(file, "http://", 7) != 0) {
 				char path[PATH_LEN_DIR_MAX];
@@ -257,6 +261,8 @@ int playlist_insert_item_after(Playlist *pl, Entry *entry, const char *file, con
 			new_entry->filename[255] = '\0';
 			playlist_entry_set_name(new_entry, name);
 			new_entry->played = 0;
+			new_entry->length = -1;
+			new_entry->length_looked_up = 0;
 			new_entry->queue_pos = 0;
 			new_entry->next_in_queue = NULL;
 			new_entry->prev = entry;
@@ -337,6 +343,7 @@ int playlist_entry_delete(Playlist *pl, Entry *entry)
 		if (pl->current == entry) { /* We try to remove the currently playing entry */
 			pl->current = entry->prev;
 		}
+		if (pl->random_next == entry) pl->random_next = NULL;
 		if (entry->prev == NULL && entry->next == NULL) { /* remove last remaining entry */
 			pl->first = NULL;
 			pl->last = NULL;
@@ -427,10 +434,25 @@ size_t playlist_get_length(Playlist *pl)
 	return pl->length;
 }
 
+/* Picks a random entry that has not been played yet */
+static Entry *playlist_pick_random(Playlist *pl)
+{
+	Entry *entry = NULL;
+
+	while (pl->length > 0 && pl->played_items < pl->length && (!entry || entry->played)) {
+		size_t i, next_item = rand() / (RAND_MAX / pl->length);
+
+		if (next_item >= pl->length) next_item = pl->length - 1;
+		for (i = 0, entry = pl->first; i < next_item; i++)
+			entry = entry->next;
+	}
+	return entry;
+}
+
 int playlist_next(Playlist *pl)
 {
 	int    result = 0;
-	size_t i, next_item;
+	size_t i;
 	Entry *entry;
 
 	if (pl->queue_start != NULL) { /* Queue not empty? */
@@ -472,16 +494,11 @@ int playlist_next(Playlist *pl)
 				break;
 			case PM_RANDOM:
 			case PM_RANDOM_REPEAT:
-				entry = pl->first;
 				if (pl->length > 0) {
-					next_item = rand() / (RAND_MAX / pl->length);
-
-					for (i = 0; i < next_item; i++)
-						entry = entry->next;
-
-					if (entry->played && pl->played_items < pl->length) {
-						result = playlist_next(pl);
-					} else if (pl->played_items < pl->length) {
+					/* Use the entry picked in advance by playlist_get_upcoming(), if still valid */
+					entry = pl->random_next && !pl->random_next->played ? pl->random_next : playlist_pick_random(pl);
+					pl->random_next = NULL;
+					if (entry) {
 						playlist_set_current(pl, entry);
 						result = 1;
 					}
@@ -497,6 +514,37 @@ int playlist_next(Playlist *pl)
 	return result;
 }
 
+size_t playlist_get_upcoming(Playlist *pl, Entry **entries, size_t max)
+{
+	size_t n = 0;
+	Entry *entry;
+
+	for (entry = pl->queue_start; entry && n < max; entry = entry->next_in_queue)
+		entries[n++] = entry;
+	switch (pl->play_mode) {
+		case PM_CONTINUE:
+		case PM_REPEAT_ALL:
+			entry = pl->current ? pl->current->next : pl->first;
+			while (n < max && entry) {
+				entries[n++] = entry;
+				entry = entry->next;
+				if (!entry && pl->play_mode == PM_REPEAT_ALL) entry = pl->first;
+				if (entry == pl->current) break;
+			}
+			break;
+		case PM_REPEAT_1:
+			if (n < max && pl->current) entries[n++] = pl->current;
+			break;
+		case PM_RANDOM:
+		case PM_RANDOM_REPEAT:
+			if (!pl->random_next || pl->random_next->played)
+				pl->random_next = playlist_pick_random(pl);
+			if (n < max && pl->random_next) entries[n++] = pl->random_next;
+			break;
+	}
+	return n;
+}
+
 int playlist_prev(Playlist *pl)
 {
 	int result = 0;
@@ -566,6 +614,32 @@ size_t playlist_entry_get_queue_pos(Entry *entry)
 	return entry->queue_pos;
 }
 
+int playlist_entry_get_length(Entry *entry)
+{
+	return entry ? entry->length : -1;
+}
+
+void playlist_entry_set_length(Entry *entry, int length)
+{
+	if (entry) {
+		entry->length = length;
+		entry->length_looked_up = 1;
+	}
+}
+
+int playlist_entry_is_length_looked_up(Entry *entry)
+{
+	return entry ? entry->length_looked_up : 0;
+}
+
+void playlist_reset_length_lookups(Playlist *pl)
+{
+	Entry *entry;
+
+	for (entry = pl->first; entry; entry = entry->next)
+		if (entry->length < 0) entry->length_looked_up = 0;
+}
+
 int playlist_entry_enqueue(Playlist *pl, Entry *entry)
 {
 	if (entry) {
@@ -32,6 +32,8 @@ struct _Entry
 	char   filename[PATH_LEN_MAX];
 	char   name[PL_ENTRY_NAME_MAX_LENGTH];
 	short  played;
+	short  length_looked_up; /* The length has been looked up, even if it is still unknown */
+	int    length; /* in seconds; -1 if unknown */
 	size_t queue_pos;
 	Entry *next_in_queue;
 };
@@ -44,6 +46,7 @@ struct _Playlist
 	Entry          *current;
 	Entry          *first, *last;
 	Entry          *queue_start;
+	Entry          *random_next; /* Next entry in random mode, if already picked */
 	pthread_mutex_t mutex;
 };
 
@@ -62,6 +65,10 @@ int      playlist_entry_set_name(Entry *entry, const char *name);
 char    *playlist_get_filename(Playlist *pl, size_t item);
 size_t   playlist_get_length(Playlist *pl);
 int      playlist_next(Playlist *pl);
+/* Stores up to 'max' entries that playlist_next() is going to select next,
+ * in order, in 'entries'. Returns the number of entries stored. In random
+ * mode, only the next entry is known (it is picked in advance). */
+size_t   playlist_get_upcoming(Playlist *pl, Entry **entries, size_t max);
 int      playlist_prev(Playlist *pl);
 int      playlist_set_current(Playlist *pl, Entry *entry);
 Entry   *playlist_get_current(Playlist *pl);
@@ -84,6 +91,11 @@ int      playlist_get_played(Entry *entry);
 int      playlist_add_dir(Playlist *pl, const char *directory, void (*finished_callback)(size_t pl_len));
 int      playlist_get_current_position(Playlist *pl);
 size_t   playlist_entry_get_queue_pos(Entry *entry);
+int      playlist_entry_get_length(Entry *entry);
+void     playlist_entry_set_length(Entry *entry, int length);
+int      playlist_entry_is_length_looked_up(Entry *entry);
+/* Marks all entries with an unknown length as not looked up yet */
+void     playlist_reset_length_lookups(Playlist *pl);
 int      playlist_entry_enqueue(Playlist *pl, Entry *entry);
 int      playlist_is_recursive_directory_add_in_progress(void);
 #endif
@@ -0,0 +1,186 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: prefetch.c  Created: 210724
+ *
+ * Description: Page cache prefetching of upcoming tracks
+ *
+ * Opening the next track on slow storage (SD cards, network file systems)
+ * can take a considerable amount of time. To avoid gaps at track changes,
+ * the beginning of the upcoming tracks (and their lyrics and cover files)
+ * is read into the page cache in advance by a low priority thread.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#define _GNU_SOURCE /* for readahead() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "prefetch.h"
+#include "consts.h"
+#include "util.h"
+#include "debug.h"
+#include "core.h" /* for DEFAULT_THREAD_STACK_SIZE */
+#include "pthread_helper.h"
+
+/* Maximum amount of data prefetched per track, and per lyrics/cover file */
+#define PREFETCH_FILE_SIZE  (4 * 1024 * 1024)
+#define PREFETCH_EXTRA_SIZE (512 * 1024)
+
+static pthread_t       thread;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cond = PTHREAD_COND_INITIALIZER;
+static int             running, quit, request;
+static size_t          budget;
+static char            lyrics_pattern[256], cover_pattern[256];
+static char            pending[PREFETCH_MAX_FILES][PATH_LEN_MAX];
+static size_t          pending_count;
+
+/* Requests up to 'max_size' bytes from the beginning of the file to be
+ * read into the page cache. Returns the number of bytes requested. */
+static size_t prefetch_file(const char *file, size_t max_size)
+{
+	size_t      size = 0;
+	int         fd;
+	struct stat st;
+
+	if (max_size > 0 && (fd = open(file, O_RDONLY)) >= 0) {
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+			size = (size_t)st.st_size < max_size ? (size_t)st.st_size : max_size;
+#ifdef __linux__
+			readahead(fd, 0, size);
+#elif defined(POSIX_FADV_WILLNEED)
+			posix_fadvise(fd, 0, size, POSIX_FADV_WILLNEED);
+#endif
+			wdprintf(V_DEBUG, "prefetch", "Prefetched %lu bytes of %s\n", (unsigned long)size, file);
+		}
+		close(fd);
+	}
+	return size;
+}
+
+/* Prefetches the file matching 'pattern' next to 'file', if any */
+static size_t prefetch_extra_file(const char *file, const char *pattern, size_t max_size)
+{
+	size_t size = 0;
+
+	if (pattern[0] != '\0' && max_size > 0) {
+		char *extra_file = get_file_matching_given_pattern_alloc(file, pattern);
+		if (extra_file) {
+			size = prefetch_file(extra_file, max_size < PREFETCH_EXTRA_SIZE ? max_size : PREFETCH_EXTRA_SIZE);
+			free(extra_file);
+		}
+	}
+	return size;
+}
+
+static int check_new_request(void)
+{
+	int res;
+	pthread_mutex_lock(&mutex);
+	res = request || quit;
+	pthread_mutex_unlock(&mutex);
+	return res;
+}
+
+static void *prefetch_thread(void *arg)
+{
+	char   files[PREFETCH_MAX_FILES][PATH_LEN_MAX];
+	char   prefetched[PREFETCH_MAX_FILES][PATH_LEN_MAX];
+	size_t prefetched_size[PREFETCH_MAX_FILES];
+	size_t prefetched_count = 0;
+
+	pthread_lower_current_thread_priority();
+	while (1) {
+		size_t i, j, count, remaining = budget;
+		size_t new_size[PREFETCH_MAX_FILES];
+
+		pthread_mutex_lock(&mutex);
+		while (!quit && !request)
+			pthread_cond_wait(&cond, &mutex);
+		if (quit) {
+			pthread_mutex_unlock(&mutex);
+			break;
+		}
+		count = pending_count;
+		memcpy(files, pending, sizeof(files));
+		request = 0;
+		pthread_mutex_unlock(&mutex);
+
+		for (i = 0; i < count && !check_new_request(); i++) {
+			new_size[i] = 0;
+			/* Skip streams and files that have been prefetched for the previous request */
+			if (strncasecmp(files[i], "http://", 7) == 0) continue;
+			for (j = 0; j < prefetched_count; j++) {
+				if (strcmp(files[i], prefetched[j]) == 0) {
+					new_size[i] = prefetched_size[j];
+					break;
+				}
+			}
+			if (j == prefetched_count) {
+				size_t max = remaining < PREFETCH_FILE_SIZE ? remaining : PREFETCH_FILE_SIZE;
+				new_size[i] = prefetch_file(files[i], max);
+				new_size[i] += prefetch_extra_file(files[i], lyrics_pattern, remaining - new_size[i]);
+				new_size[i] += prefetch_extra_file(files[i], cover_pattern, remaining - new_size[i]);
+			}
+			remaining = new_size[i] < remaining ? remaining - new_size[i] : 0;
+		}
+		memcpy(prefetched, files, sizeof(prefetched));
+		memcpy(prefetched_size, new_size, sizeof(prefetched_size));
+		prefetched_count = i;
+	}
+	return NULL;
+}
+
+int prefetch_init(size_t byte_budget, const char *lyrics_file_pattern, const char *cover_file_pattern)
+{
+	budget = byte_budget;
+	strncpy(lyrics_pattern, lyrics_file_pattern ? lyrics_file_pattern : "", sizeof(lyrics_pattern) - 1);
+	strncpy(cover_pattern, cover_file_pattern ? cover_file_pattern : "", sizeof(cover_pattern) - 1);
+	quit = 0;
+	request = 0;
+	running = pthread_create_with_stack_size(&thread, DEFAULT_THREAD_STACK_SIZE, prefetch_thread, NULL) == 0;
+	if (running)
+		wdprintf(V_INFO, "prefetch", "Prefetching up to %lu kB of upcoming tracks.\n", (unsigned long)(budget / 1024));
+	return running;
+}
+
+void prefetch_files(const char *const *files, size_t count)
+{
+	size_t i;
+
+	if (!running) return;
+	pthread_mutex_lock(&mutex);
+	if (count > PREFETCH_MAX_FILES) count = PREFETCH_MAX_FILES;
+	for (i = 0; i < count; i++) {
+		strncpy(pending[i], files[i] ? files[i] : "", PATH_LEN_MAX - 1);
+		pending[i][PATH_LEN_MAX - 1] = '\0';
+	}
+	pending_count = count;
+	request = 1;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+void prefetch_shutdown(void)
+{
+	if (running) {
+		pthread_mutex_lock(&mutex);
+		quit = 1;
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&mutex);
+		pthread_join(thread, NULL);
+		running = 0;
+	}
+}
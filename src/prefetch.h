@@ -0,0 +1,30 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: prefetch.h  Created: 210724
+ *
+ * Description: Page cache prefetching of upcoming tracks
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#ifndef _PREFETCH_H
+#define _PREFETCH_H
+#include <stddef.h>
+
+/* Maximum number of upcoming tracks to prefetch */
+#define PREFETCH_MAX_FILES 3
+
+/* Starts the low priority prefetch thread. At most 'byte_budget' bytes are
+ * prefetched for all upcoming tracks together. Lyrics and cover files matching
+ * the given patterns (may be NULL) are prefetched along with the tracks. */
+int  prefetch_init(size_t byte_budget, const char *lyrics_file_pattern, const char *cover_file_pattern);
+/* Replaces the list of upcoming files to be prefetched (in playback order) */
+void prefetch_files(const char *const *files, size_t count);
+void prefetch_shutdown(void);
+#endif
@@ -8,6 +8,12 @@
  * Description: pthread related functions
  */
 #include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #include "pthread_helper.h"
 
 int pthread_create_with_stack_size(
@@ -26,3 +32,15 @@ int pthread_create_with_stack_size(
 	}
 	return res;
 }
+
+void pthread_lower_current_thread_priority(void)
+{
+#ifdef __linux__
+	pid_t tid = syscall(SYS_gettid);
+	setpriority(PRIO_PROCESS, tid, 19);
+#ifdef SYS_ioprio_set
+	/* IOPRIO_WHO_PROCESS, IOPRIO_CLASS_IDLE */
+	syscall(SYS_ioprio_set, 1, tid, 3 << 13);
+#endif
+#endif
+}
@@ -15,4 +15,7 @@ int pthread_create_with_stack_size(
 	pthread_t *thread, const size_t stack_size,
 	void *(*start_routine) (void *), void *arg
 );
+/* Sets the lowest CPU and I/O priority for the calling thread, e.g. for
+ * background work that must not get in the way of playback */
+void pthread_lower_current_thread_priority(void);
 #endif
@@ -25,6 +25,9 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <time.h>
 #include <signal.h>
 #include "util.h" /* for assign_signal_handler() */
 #include "reader.h"
@@ -33,8 +36,26 @@
 #include "core.h" /* for VERSION_NUMBER and DEFAULT_THREAD_STACK_SIZE */
 #include "pthread_helper.h"
 
+/* Amount of data the kernel is asked to prefetch when reading local files */
+#define LOCAL_FILE_READAHEAD_SIZE (256 * 1024)
+#define HTTP_RECV_SIZE            16384
+#define HTTP_HEADER_MAX_SIZE      32768
+#define HTTP_POLL_TIMEOUT_MS      2000
+/* Size of the ranges requested from servers supporting range requests */
+#define HTTP_RANGE_CHUNK_SIZE     (1024 * 1024)
+/* Jitter buffer: Before playback starts, enough data for JITTER_BASE_MS plus
+ * JITTER_STALL_FACTOR times the expected worst case network delay is buffered */
+#define JITTER_BASE_MS            2000
+#define JITTER_STALL_FACTOR       4
+#define JITTER_MIN_SIZE           (32 * 1024)
+/* When seeking, the rest of the current response is read and discarded
+ * instead of opening a new connection if there is no more than this left */
+#define HTTP_DRAIN_MAX_SIZE       (64 * 1024)
+
 static size_t http_cache_size           = 512 * 1024;
 static size_t http_cache_prebuffer_size = 256 * 1024;
+static char   timeshift_dir[256];
+static size_t timeshift_size = 0;
 
 int reader_set_cache_size_kb(size_t size, size_t prebuffer_size)
 {
@@ -49,11 +70,47 @@ int reader_set_cache_size_kb(size_t size, size_t prebuffer_size)
 	return size;
 }
 
-int reader_get_cache_fill(Reader *r)
+void reader_set_timeshift(const char *dir, size_t size_kb)
+{
+	strncpy(timeshift_dir, dir ? dir : "/tmp", sizeof(timeshift_dir) - 1);
+	timeshift_dir[sizeof(timeshift_dir) - 1] = '\0';
+	timeshift_size = size_kb * 1024;
+	if (timeshift_size > 0)
+		wdprintf(V_INFO, "reader", "Timeshift cache: %d kB in %s\n", size_kb, timeshift_dir);
+}
+
+/* Amount of data in the cache waiting to be read. Must be called with r->mutex held. */
+static size_t http_cache_get_fill(Reader *r)
 {
+	if (r->timeshift)
+		return timeshift_get_end(&(r->ts)) - r->stream_pos;
 	return ringbuffer_get_fill(&(r->rb_http));
 }
 
+/* Reads up to 'size' bytes from the cache, returns the number of bytes read.
+ * Must be called with r->mutex held. */
+static size_t http_cache_read(Reader *r, char *target, size_t size)
+{
+	size_t n = http_cache_get_fill(r);
+
+	if (n > size) n = size;
+	if (r->timeshift)
+		n = timeshift_read(&(r->ts), r->stream_pos, target, n);
+	else if (n > 0 && !ringbuffer_read(&(r->rb_http), target, n))
+		n = 0;
+	r->stream_pos += n;
+	return n;
+}
+
+int reader_get_cache_fill(Reader *r)
+{
+	int res;
+	pthread_mutex_lock(&(r->mutex));
+	res = http_cache_get_fill(r);
+	pthread_mutex_unlock(&(r->mutex));
+	return res;
+}
+
 /* get sockaddr, IPv4 or IPv6 */
 static void *get_in_addr(struct sockaddr *sa)
 {
@@ -97,47 +154,600 @@ static int http_url_split_alloc(const char *url, char **hostname, int *port, cha
 	return 0;
 }
 
-static void *http_reader_thread(void *arg)
+/* Connects to 'hostname' on 'port'. Returns the socket or -1 on failure. */
+static int http_connect(const char *hostname, int port)
 {
-	Reader *r = (Reader *)arg;
-	int     numbytes = 1, err = 0;
-	char    buf[4096];
-
-	while (numbytes != -1 && numbytes > 0 && !r->eof) {
-		do {
-			numbytes = recv(r->sockfd, buf, 4096, 0);
-			err = errno;
-			if (numbytes > 0) { /* write to ringbuffer */
-				int write_okay = 0;
-				while (!write_okay && !r->eof) {
-					pthread_mutex_lock(&(r->mutex));
-					write_okay = ringbuffer_write(&(r->rb_http), buf, numbytes);
-					pthread_mutex_unlock(&(r->mutex));
-					usleep(1500);
+	struct addrinfo hints, *servinfo, *p;
+	int    rv, sockfd = -1;
+	char   s[INET6_ADDRSTRLEN];
+	char   port_str[6];
+
+	snprintf(port_str, sizeof(port_str), "%d", port);
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if ((rv = getaddrinfo(hostname, port_str, &hints, &servinfo)) != 0) {
+		wdprintf(V_ERROR, "reader",  "getaddrinfo: %s\n", gai_strerror(rv));
+	} else {
+		int err = 0;
+		int flags = 0;
+		/* loop through all the results and connect to the first we can */
+		for (p = servinfo; p != NULL; p = p->ai_next) {
+			if ((sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
+				wdprintf(V_INFO, "reader", "socket: %s\n", strerror(errno));
+				continue;
+			} else { /* Set socket timeout to 2 seconds */
+				struct timeval tv;
+				tv.tv_sec = 2;
+				tv.tv_usec = 0;
+				if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (char *)&tv,  sizeof tv)) {
+					wdprintf(V_INFO, "reader", "setsockopt: %s\n", strerror(errno));
 				}
-			} else {
-				usleep(300000);
-				if (err == 0) {
-					if (numbytes == 0) r->eof = 1;
+			}
+
+			flags = fcntl(sockfd, F_GETFL, 0);
+			fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+			if (connect(sockfd, p->ai_addr, p->ai_addrlen) == -1) {
+				err = errno;
+				wdprintf(V_INFO, "reader", "connect: %s\n", strerror(err));
+				if (err == EINPROGRESS) {
+					wdprintf(V_DEBUG, "reader", "Connection okay; continuing...\n");
+					break;
 				} else {
-					wdprintf(V_DEBUG, "reader", "Network problem: %s (%d)\n", strerror(err), err);
-					wdprintf(V_DEBUG, "reader", "Retrying...\n");
+					wdprintf(V_DEBUG, "reader", "Connection unusable; closing.\n");
+					close(sockfd);
+					sockfd = -1;
 				}
+				continue;
 			}
-		} while (numbytes <= 0 && !r->eof && ringbuffer_get_fill(&(r->rb_http)) > 4000);
-		wdprintf(V_DEBUG, "reader", "buf fill: %d bytes\r", ringbuffer_get_fill(&(r->rb_http)));
-		if (!r->is_ready && ringbuffer_get_fill(&(r->rb_http)) >= http_cache_prebuffer_size)
+			break;
+		}
+
+		if (err == EINPROGRESS) {
+			fd_set myset;
+			struct timeval tv; 
+
+			wdprintf(V_DEBUG, "reader", "Connection in progress. select()ing...\n");
+			do {
+				int res;
+
+				tv.tv_sec = 5; 
+				tv.tv_usec = 0; 
+				FD_ZERO(&myset); 
+				FD_SET(sockfd, &myset); 
+				res = select(sockfd+1, NULL, &myset, NULL, &tv); 
+				if (res < 0 && errno != EINTR) {
+					wdprintf(V_DEBUG, "reader", "Error while connecting: %d - %s\n", errno, strerror(errno));
+					p = NULL;
+					break;
+				} else if (res > 0) {
+					int valopt = 0;
+					socklen_t lon = sizeof(int);
+					if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, (void*)(&valopt), &lon) < 0) {
+						wdprintf(V_DEBUG, "reader", "Error in getsockopt(): %d - %s\n", errno, strerror(errno));
+						p = NULL;
+						break;
+					}
+					if (valopt) {
+						wdprintf(V_DEBUG, "reader", "Error in delayed connection(): %d - %s\n", valopt, strerror(valopt));
+						p = NULL;
+					}
+					break;
+				} else if (res == 0) {
+					wdprintf(V_DEBUG, "reader", "Timeout in select() - Cancelling!\n");
+					p = NULL;
+					break;
+				}
+			} while (1);
+			flags = fcntl(sockfd, F_GETFL, 0);
+			fcntl(sockfd, F_SETFL, flags & (~O_NONBLOCK));
+		}
+
+		if (p == NULL) {
+			wdprintf(V_ERROR, "reader", "Failed to connect.\n");
+			if (sockfd >= 0) close(sockfd);
+			sockfd = -1;
+		} else {
+			inet_ntop(p->ai_family, get_in_addr((struct sockaddr *)p->ai_addr), s, sizeof s);
+			wdprintf(V_INFO, "reader", "Connected to %s:%d.\n", s, port);
+		}
+		freeaddrinfo(servinfo);
+	}
+	return sockfd;
+}
+
+/*
+ * Sends a HTTP GET request for the stream. If range_start is negative, the
+ * whole stream is requested and the connection is closed by the server
+ * afterwards. Otherwise up to HTTP_RANGE_CHUNK_SIZE bytes starting at
+ * range_start are requested, keeping the connection open for the next range.
+ */
+static int http_send_request(Reader *r, long range_start)
+{
+	char   http_request[1024], host[300], range[64] = "";
+	size_t len;
+
+	if (r->http_port != 80)
+		snprintf(host, sizeof(host), "%s:%d", r->http_host, r->http_port);
+	else
+		snprintf(host, sizeof(host), "%s", r->http_host);
+	if (range_start >= 0) {
+		long range_end = range_start + HTTP_RANGE_CHUNK_SIZE - 1;
+		if (range_end >= r->file_size) range_end = r->file_size - 1;
+		snprintf(range, sizeof(range), "Range: bytes=%ld-%ld\r\n", range_start, range_end);
+	}
+	snprintf(http_request, sizeof(http_request),
+	         "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: %s\r\nUser-Agent: Gmu/%s\r\n%s%s\r\n",
+	         r->http_path, host, range_start >= 0 ? "keep-alive" : "close", VERSION_NUMBER,
+	         range_start >= 0 ? "" : "Icy-MetaData: 1\r\n", range);
+	wdprintf(V_DEBUG, "reader", "Sending request: %s\n", http_request);
+	len = strlen(http_request);
+	return send(r->sockfd, http_request, len, 0) == (ssize_t)len;
+}
+
+/*
+ * Reads the HTTP response header from the socket in bulk into 'buf' (which
+ * needs to hold HTTP_HEADER_MAX_SIZE+1 bytes) and stores the header fields
+ * in 'header'. Any stream data received along with the header is left in
+ * 'buf'; '*body' and '*body_size' are set accordingly. Returns the HTTP
+ * status code, or 0 if no complete header has been received.
+ */
+static int http_read_header(int sockfd, ConfigFile *header, char *buf, char **body, size_t *body_size)
+{
+	char   *end = NULL;
+	size_t  size = 0, end_len = 0;
+	int     status = 0;
+
+	while (!end && size < HTTP_HEADER_MAX_SIZE) {
+		ssize_t n = recv(sockfd, buf + size, HTTP_HEADER_MAX_SIZE - size, 0);
+		if (n > 0) {
+			size += n;
+			buf[size] = '\0';
+			if ((end = strstr(buf, "\r\n\r\n")))
+				end_len = 4;
+			else if ((end = strstr(buf, "\n\n")))
+				end_len = 2;
+		} else if (n == 0 || errno != EINTR) {
+			break;
+		}
+	}
+	if (end) {
+		char *line = strchr(buf, '\n'); /* Skip the status line */
+
+		*end = '\0';
+		if (sscanf(buf, "%*s %d", &status) != 1) status = 0;
+		while (line) {
+			char *next = strchr(++line, '\n'), *value;
+			size_t len;
+
+			if (next) *next = '\0';
+			len = strlen(line);
+			if (len > 0 && line[len-1] == '\r') line[len-1] = '\0';
+			if ((value = strchr(line, ':'))) {
+				*value++ = '\0';
+				while (*value == ' ') value++;
+				wdprintf(V_DEBUG, "reader", "key=[%s] value=[%s]\n", line, value);
+				if (line[0] && value[0]) cfg_add_key(header, line, value);
+			}
+			line = next;
+		}
+		end += end_len;
+		*body = end;
+		*body_size = size - (end - buf);
+	}
+	wdprintf(V_DEBUG, "reader", "HTTP header skipped: %s (%d bytes, status %d)\n", end ? "yes" : "no", size, status);
+	return end ? status : 0;
+}
+
+/* Replaces the connection's socket, closing the old one */
+static void http_set_socket(Reader *r, int sockfd)
+{
+	pthread_mutex_lock(&(r->mutex));
+	if (r->sockfd >= 0) close(r->sockfd);
+	r->sockfd = sockfd;
+	r->http_keep_alive = 0;
+	r->http_remaining = -1;
+	pthread_mutex_unlock(&(r->mutex));
+}
+
+/* Marks the end of the stream, unless a seek has been requested meanwhile */
+static void http_set_eof(Reader *r)
+{
+	pthread_mutex_lock(&(r->mutex));
+	if (r->seek_pos < 0) {
+		r->eof = 1;
+		r->is_ready = 1;
+		pthread_cond_broadcast(&(r->cond));
+	}
+	pthread_mutex_unlock(&(r->mutex));
+}
+
+/*
+ * Finds the position closest to 'target' within the timeshift window, from
+ * which reading can continue. In streams with Shoutcast metadata, the
+ * distance to the next metadata block must not change, since the decoder
+ * keeps track of it. Returns -1 if there is no such position. Must be called
+ * with r->mutex held.
+ */
+static long http_timeshift_find_position(Reader *r, long target)
+{
+	long   start = timeshift_get_start(&(r->ts)), end = timeshift_get_end(&(r->ts));
+	long   res = -1;
+
+	if (target < start) target = start;
+	if (target > end) target = end;
+	if (r->icy_metaint <= 0) {
+		res = target;
+	} else {
+		size_t i, count = timeshift_get_mark_count(&(r->ts));
+		long   next_meta = r->icy_next_meta, dist;
+
+		for (i = 0; i < count; i++) {
+			long m = timeshift_get_mark(&(r->ts), i);
+			if (m >= (long)r->stream_pos) {
+				next_meta = m;
+				break;
+			}
+		}
+		dist = next_meta - (long)r->stream_pos;
+		if (dist <= r->icy_metaint) { /* Not possible while in the middle of a metadata block */
+			for (i = 0; i < count; i++) {
+				long pos = (long)timeshift_get_mark(&(r->ts), i) - dist;
+				if (pos >= start && pos <= end && (res < 0 || labs(pos - target) < labs(res - target)))
+					res = pos;
+			}
+		}
+	}
+	return res;
+}
+
+/* Keeps track of the Shoutcast metadata blocks in the data about to be
+ * written to the timeshift cache. Must be called with r->mutex held. */
+static void http_timeshift_track_metadata(Reader *r, const char *data, size_t size)
+{
+	unsigned long pos = timeshift_get_end(&(r->ts));
+
+	while (r->icy_next_meta < pos + size) {
+		unsigned char len = (unsigned char)data[r->icy_next_meta - pos];
+		timeshift_add_mark(&(r->ts), r->icy_next_meta);
+		r->icy_next_meta += 1 + len * 16 + r->icy_metaint;
+	}
+}
+
+/* Puts 'size' bytes of stream data into the cache, waiting for free space if
+ * necessary. The data is dropped if the reader is being closed or a seek has
+ * been requested meanwhile, in which case 0 is returned. The timeshift cache
+ * never runs full; if the reader falls behind the cached window, its read
+ * position is moved forward. */
+static int http_cache_write(Reader *r, const char *data, size_t size)
+{
+	int res;
+
+	pthread_mutex_lock(&(r->mutex));
+	while (!r->timeshift && !r->stop && r->seek_pos < 0 && ringbuffer_get_free(&(r->rb_http)) < size)
+		pthread_cond_wait(&(r->cond), &(r->mutex));
+	res = !r->stop && r->seek_pos < 0;
+	if (res && r->timeshift) {
+		if (r->icy_metaint > 0) http_timeshift_track_metadata(r, data, size);
+		res = timeshift_write(&(r->ts), data, size);
+		if (r->stream_pos < timeshift_get_start(&(r->ts))) {
+			long pos = http_timeshift_find_position(r, timeshift_get_start(&(r->ts)));
+			wdprintf(V_WARNING, "reader", "Timeshift window exceeded. Skipping %ld bytes.\n",
+			         pos >= 0 ? pos - (long)r->stream_pos : 0);
+			if (pos >= 0)
+				r->stream_pos = pos;
+			else
+				r->stream_pos = timeshift_get_start(&(r->ts));
+		}
+	} else if (res) {
+		ringbuffer_write(&(r->rb_http), data, size);
+	}
+	if (res) {
+		if (!r->is_ready && http_cache_get_fill(r) >= r->jitter_target)
 			r->is_ready = 1;
-		fflush(stdout);
+		pthread_cond_broadcast(&(r->cond));
+	}
+	pthread_mutex_unlock(&(r->mutex));
+	return res;
+}
+
+/* Derives the amount of data to buffer from the stream's byte rate and the
+ * network delay statistics. Must be called with r->mutex held. */
+static void http_update_jitter_target(Reader *r)
+{
+	size_t target = http_cache_prebuffer_size;
+
+	if (r->byte_rate > 0) {
+		long long ms = JITTER_BASE_MS + JITTER_STALL_FACTOR * (r->net_wait_avg_us + 4 * r->net_wait_dev_us) / 1000;
+		target = ms * r->byte_rate / 1000;
+		if (target < JITTER_MIN_SIZE) target = JITTER_MIN_SIZE;
+		if (target > http_cache_prebuffer_size) target = http_cache_prebuffer_size;
+	}
+	r->jitter_target = target;
+}
+
+/* Updates the network delay statistics with the time spent waiting for the
+ * last chunk of data (like the round-trip time estimation in TCP) */
+static void http_update_net_stats(Reader *r, long wait_us)
+{
+	pthread_mutex_lock(&(r->mutex));
+	if (r->net_wait_avg_us < 0) {
+		r->net_wait_avg_us = wait_us;
+		r->net_wait_dev_us = wait_us / 2;
+	} else {
+		r->net_wait_dev_us += (labs(wait_us - r->net_wait_avg_us) - r->net_wait_dev_us) / 4;
+		r->net_wait_avg_us += (wait_us - r->net_wait_avg_us) / 8;
+	}
+	http_update_jitter_target(r);
+	pthread_mutex_unlock(&(r->mutex));
+}
+
+/* Receives up to 'size' bytes of the current response. Returns the number of
+ * bytes received, 0 if the server closed the connection or -1 on error. */
+static ssize_t http_recv(Reader *r, char *buf, size_t size)
+{
+	struct pollfd   pfd;
+	struct timespec t_start, t_end;
+	ssize_t         numbytes = -1;
+	int             res;
+
+	pfd.fd = r->sockfd;
+	pfd.events = POLLIN;
+	if (r->http_remaining > 0 && (unsigned long)r->http_remaining < size)
+		size = r->http_remaining;
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	res = poll(&pfd, 1, HTTP_POLL_TIMEOUT_MS);
+	if (res > 0)
+		numbytes = recv(r->sockfd, buf, size, 0);
+	else if (res == 0)
+		errno = ETIMEDOUT;
+	if (numbytes > 0) {
+		int err = errno;
+		clock_gettime(CLOCK_MONOTONIC, &t_end);
+		http_update_net_stats(r, (t_end.tv_sec - t_start.tv_sec) * 1000000 +
+		                         (t_end.tv_nsec - t_start.tv_nsec) / 1000);
+		errno = err;
+		r->http_next_pos += numbytes;
+		if (r->http_remaining > 0) r->http_remaining -= numbytes;
+	}
+	return numbytes;
+}
+
+/*
+ * Requests up to HTTP_RANGE_CHUNK_SIZE bytes of the stream starting at 'pos'.
+ * The current connection is reused if the server allows it. If there is
+ * data left from the previous response, it is read and discarded if there is
+ * not much left, otherwise a new connection is opened. Returns 1 on success.
+ */
+static int http_request_range(Reader *r, long pos)
+{
+	ConfigFile *header = cfg_init();
+	char       *buf = malloc(HTTP_HEADER_MAX_SIZE + 1);
+	int         status = 0, attempt;
+
+	if (r->sockfd >= 0 && r->http_remaining != 0) {
+		if (r->http_keep_alive && r->http_remaining > 0 && r->http_remaining <= HTTP_DRAIN_MAX_SIZE) {
+			char discard[HTTP_RECV_SIZE];
+			wdprintf(V_DEBUG, "reader", "Discarding %ld bytes.\n", r->http_remaining);
+			while (r->http_remaining > 0 && (http_recv(r, discard, HTTP_RECV_SIZE) > 0 || errno == EINTR));
+		}
+		if (r->http_remaining != 0) http_set_socket(r, -1);
+	}
+	for (attempt = 0; buf && header && attempt < 2 && status != 206; attempt++) {
+		int    reused = r->sockfd >= 0;
+		char  *body = NULL;
+		size_t body_size = 0;
+
+		if (!reused) {
+			wdprintf(V_DEBUG, "reader", "Connecting to %s:%d.\n", r->http_host, r->http_port);
+			http_set_socket(r, http_connect(r->http_host, r->http_port));
+		}
+		if (r->sockfd >= 0 && http_send_request(r, pos))
+			status = http_read_header(r->sockfd, header, buf, &body, &body_size);
+		if (status == 206) {
+			char *len  = cfg_get_key_value_ignore_case(header, "Content-Length");
+			char *conn = cfg_get_key_value_ignore_case(header, "Connection");
+			char *cr   = cfg_get_key_value_ignore_case(header, "Content-Range");
+			long  start = -1;
+
+			if (cr && sscanf(cr, "bytes %ld-", &start) == 1 && start != pos) {
+				wdprintf(V_WARNING, "reader", "Unexpected Content-Range: %s\n", cr);
+				status = 0;
+				http_set_socket(r, -1);
+				break;
+			}
+			r->http_remaining = len ? atol(len) : -1;
+			r->http_keep_alive = len && !(conn && strcasecmp(conn, "close") == 0);
+			r->http_next_pos = pos;
+			if (body_size > 0) {
+				if (r->http_remaining > 0 && (unsigned long)r->http_remaining < body_size)
+					body_size = r->http_remaining;
+				http_cache_write(r, body, body_size);
+				r->http_next_pos += body_size;
+				if (r->http_remaining > 0) r->http_remaining -= body_size;
+			}
+		} else {
+			if (status > 0)
+				wdprintf(V_WARNING, "reader", "Range request failed with HTTP status %d.\n", status);
+			http_set_socket(r, -1);
+			/* A reused connection might have been closed by the server, try again with a new one */
+			if (!reused) break;
+		}
+	}
+	if (buf) free(buf);
+	if (header) cfg_free(header);
+	return status == 206;
+}
+
+static void *http_reader_thread(void *arg)
+{
+	Reader *r = (Reader *)arg;
+	char    buf[HTTP_RECV_SIZE];
+
+	while (1) {
+		long    seek_pos;
+		ssize_t numbytes;
+		int     err, stop;
+
+		pthread_mutex_lock(&(r->mutex));
+		while (!r->stop && r->eof && r->seek_pos < 0) /* Nothing to do until the next seek */
+			pthread_cond_wait(&(r->cond), &(r->mutex));
+		seek_pos = r->seek_pos;
+		r->seek_pos = -1;
+		stop = r->stop;
+		pthread_mutex_unlock(&(r->mutex));
+		if (stop) break;
+
+		if (seek_pos >= 0) {
+			wdprintf(V_DEBUG, "reader", "Seeking to byte %ld.\n", seek_pos);
+			if (seek_pos >= r->file_size || !http_request_range(r, seek_pos))
+				http_set_eof(r);
+			continue;
+		}
+		if (r->http_remaining == 0) { /* Current response complete, request the next range */
+			if (!r->seekable || (long)r->http_next_pos >= r->file_size || !http_request_range(r, r->http_next_pos))
+				http_set_eof(r);
+			continue;
+		}
+		numbytes = http_recv(r, buf, HTTP_RECV_SIZE);
+		err = errno;
+		if (numbytes > 0) { /* write to ringbuffer, wait for free space if necessary */
+			http_cache_write(r, buf, numbytes);
+		} else if (numbytes == 0) { /* Connection closed by the server */
+			/* On seekable streams, try to continue with a new connection */
+			if (!r->seekable || (long)r->http_next_pos >= r->file_size ||
+			    !http_request_range(r, r->http_next_pos))
+				http_set_eof(r);
+		} else if (err != EINTR && err != EAGAIN) {
+			size_t fill;
+			/* Keep waiting for the network as long as there is some data left to play */
+			if (err != ETIMEDOUT) wdprintf(V_DEBUG, "reader", "Network problem: %s (%d)\n", strerror(err), err);
+			pthread_mutex_lock(&(r->mutex));
+			fill = http_cache_get_fill(r);
+			pthread_mutex_unlock(&(r->mutex));
+			if (fill <= 4000) {
+				wdprintf(V_DEBUG, "reader", "Giving up.\n");
+				http_set_eof(r);
+			} else {
+				wdprintf(V_DEBUG, "reader", "Retrying...\n");
+			}
+		}
 	}
 	wdprintf(V_DEBUG, "reader", "thread done.\n");
-	r->eof = 1;
 	return NULL;
 }
 
+/* Waits until at least 'size' bytes are in the cache or the end of the stream
+ * has been reached. Must be called with r->mutex held. */
+static void http_wait_for_data(Reader *r, size_t size)
+{
+	while (!r->eof && http_cache_get_fill(r) < size)
+		pthread_cond_wait(&(r->cond), &(r->mutex));
+}
+
+int reader_is_network_stream(Reader *r)
+{
+	return r->fd < 0;
+}
+
+void reader_set_bitrate(Reader *r, long bitrate)
+{
+	if (r->fd < 0) {
+		pthread_mutex_lock(&(r->mutex));
+		r->byte_rate = bitrate / 8;
+		http_update_jitter_target(r);
+		pthread_mutex_unlock(&(r->mutex));
+		wdprintf(V_DEBUG, "reader", "Jitter buffer target: %lu bytes\n", (unsigned long)r->jitter_target);
+	}
+}
+
+void reader_rebuffer(Reader *r)
+{
+	if (r->fd < 0) {
+		pthread_mutex_lock(&(r->mutex));
+		r->is_ready = r->eof || http_cache_get_fill(r) >= r->jitter_target;
+		pthread_mutex_unlock(&(r->mutex));
+	}
+}
+
 int reader_is_ready(Reader *r)
 {
-	return r->is_ready;
+	int res = 1;
+	if (r->fd < 0) {
+		pthread_mutex_lock(&(r->mutex));
+		res = r->is_ready;
+		pthread_mutex_unlock(&(r->mutex));
+	}
+	return res;
+}
+
+static int local_file_open(Reader *r, const char *filename)
+{
+	struct stat st;
+
+	r->fd = open(filename, O_RDONLY);
+	if (r->fd >= 0) {
+		if (fstat(r->fd, &st) == 0) {
+			r->file_size = st.st_size;
+			wdprintf(V_DEBUG, "reader", "File size = %d bytes.\n", r->file_size);
+			if (S_ISREG(st.st_mode) && st.st_size > 0) {
+				void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, r->fd, 0);
+				if (map != MAP_FAILED) {
+					r->map = map;
+					madvise(map, st.st_size, MADV_SEQUENTIAL);
+				} else {
+					wdprintf(V_DEBUG, "reader", "mmap() failed, using pread() instead.\n");
+				}
+			}
+		}
+#ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise(r->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	}
+	return r->fd >= 0;
+}
+
+static void local_file_readahead(Reader *r)
+{
+	if (r->stream_pos + LOCAL_FILE_READAHEAD_SIZE / 2 >= r->readahead_pos) {
+#ifdef POSIX_FADV_WILLNEED
+		posix_fadvise(r->fd, r->stream_pos, LOCAL_FILE_READAHEAD_SIZE, POSIX_FADV_WILLNEED);
+#endif
+		r->readahead_pos = r->stream_pos + LOCAL_FILE_READAHEAD_SIZE;
+	}
+}
+
+/* Reads up to 'size' bytes at the current position, returns the number of bytes read */
+static size_t local_file_read(Reader *r, char *target, size_t size)
+{
+	size_t n = 0;
+
+	local_file_readahead(r);
+	if (r->map) {
+		if (r->stream_pos < (unsigned long)r->file_size) {
+			n = r->file_size - r->stream_pos;
+			if (n > size) n = size;
+			memcpy(target, r->map + r->stream_pos, n);
+		}
+	} else {
+		while (n < size) {
+			ssize_t res = pread(r->fd, target + n, size - n, r->stream_pos + n);
+			if (res > 0)
+				n += res;
+			else if (res == 0 || errno != EINTR)
+				break;
+		}
+	}
+	r->stream_pos += n;
+	if (n == 0) r->eof = 1;
+	return n;
+}
+
+static void local_file_close(Reader *r)
+{
+	if (r->map) munmap(r->map, r->file_size);
+	close(r->fd);
 }
 
 /* Opens a local file or HTTP URL for reading */
@@ -146,201 +756,100 @@ static Reader *_reader_open(const char *url, int max_redirects)
 	Reader *r = malloc(sizeof(Reader));
 	if (r) {
 		r->eof = 0;
-		r->file = NULL;
-		r->sockfd = 0;
+		r->fd = -1;
+		r->map = NULL;
+		r->readahead_pos = 0;
+		r->timeshift = 0;
+		r->icy_metaint = 0;
+		r->icy_next_meta = 0;
+		r->sockfd = -1;
 		r->seekable = 0;
+		r->http_host = NULL;
+		r->http_path = NULL;
+		r->http_port = 80;
+		r->http_remaining = -1;
+		r->http_next_pos = 0;
+		r->http_keep_alive = 0;
+		r->seek_pos = -1;
+		r->stop = 0;
+		r->rb_http.buffer = NULL;
 		r->buf = NULL;
 		r->buf_size = 0;
 		r->buf_data_size = 0;
 		r->file_size = 0;
 		r->is_ready = 0;
+		r->net_wait_avg_us = -1;
+		r->net_wait_dev_us = 0;
+		r->byte_rate = 0;
+		r->jitter_target = http_cache_prebuffer_size;
+		r->thread_running = 0;
 		r->stream_pos = 0;
 		pthread_mutex_init(&(r->mutex), NULL);
+		pthread_cond_init(&(r->cond), NULL);
 
 		r->streaminfo = cfg_init();
 
 		if (strncasecmp(url, "http://", 7) == 0) { /* Got a HTTP URL */
-			char *hostname = NULL, *path = NULL;
-			int   port = 80;
 			/* open http stream... */
 			/* 1) Split URL into host, port and path */
-			http_url_split_alloc(url, &hostname, &port, &path);
+			http_url_split_alloc(url, &(r->http_host), &(r->http_port), &(r->http_path));
 			/* 2) open connection to host on port */
 			assign_signal_handler(SIGPIPE, SIG_IGN);
-			wdprintf(V_INFO, "reader", "Opening connection to host %s on port %d. Reading from %s.\n", hostname, port, path);
-			if (hostname && path && port > 0) {
-				struct addrinfo hints, *servinfo, *p;
-				int    rv;
-				char   s[INET6_ADDRSTRLEN];
-				char   port_str[6];
-
-				snprintf(port_str, 5, "%d", port);
-				memset(&hints, 0, sizeof hints);
-				hints.ai_family = AF_UNSPEC;
-				hints.ai_socktype = SOCK_STREAM;
-
-				if ((rv = getaddrinfo(hostname, port_str, &hints, &servinfo)) != 0) {
-					wdprintf(V_ERROR, "reader",  "getaddrinfo: %s\n", gai_strerror(rv));
-					free(r);
-					r = NULL;
-				} else {
-					int err = 0;
-					int flags = 0;
-					/* loop through all the results and connect to the first we can */
-					for (p = servinfo; p != NULL; p = p->ai_next) {
-						if ((r->sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
-							wdprintf(V_INFO, "reader", "socket: %s\n", strerror(errno));
-							continue;
-						} else { /* Set socket timeout to 2 seconds */
-							struct timeval tv;
-							tv.tv_sec = 2;
-							tv.tv_usec = 0;
-							if (setsockopt(r->sockfd, SOL_SOCKET, SO_RCVTIMEO, (char *)&tv,  sizeof tv)) {
-								wdprintf(V_INFO, "reader", "setsockopt: %s\n", strerror(errno));
-							}
-						}
+			wdprintf(V_INFO, "reader", "Opening connection to host %s on port %d. Reading from %s.\n",
+			         r->http_host, r->http_port, r->http_path);
+			if (r->http_host && r->http_path && r->http_port > 0)
+				r->sockfd = http_connect(r->http_host, r->http_port);
+			if (r->sockfd < 0) {
+				reader_close(r);
+				r = NULL;
+			} else if (!ringbuffer_init(&(r->rb_http), http_cache_size)) {
+				wdprintf(V_ERROR, "reader", "Out of memory.\n");
+				reader_close(r);
+				r = NULL;
+			} else {
+				char  *buf = malloc(HTTP_HEADER_MAX_SIZE + 1), *body = NULL;
+				size_t body_size = 0;
 
-						flags = fcntl(r->sockfd, F_GETFL, 0);
-						fcntl(r->sockfd, F_SETFL, flags | O_NONBLOCK);
-						if (connect(r->sockfd, p->ai_addr, p->ai_addrlen) == -1) {
-							err = errno;
-							wdprintf(V_INFO, "reader", "connect: %s\n", strerror(err));
-							if (err == EINPROGRESS) {
-								wdprintf(V_DEBUG, "reader", "Connection okay; continuing...\n");
-								break;
-							} else {
-								wdprintf(V_DEBUG, "reader", "Connection unusable; closing.\n");
-								close(r->sockfd);
-							}
-							continue;
-						}
-						break;
+				/* Send HTTP GET request and parse the response header, then start the reader thread... */
+				if (buf && http_send_request(r, -1) &&
+				    http_read_header(r->sockfd, r->streaminfo, buf, &body, &body_size)) {
+					/* Try to figure out stream length */
+					char *val = cfg_get_key_value_ignore_case(r->streaminfo, "Content-Length");
+					if (val) {
+						r->file_size = atol(val);
+						r->http_remaining = r->file_size;
+						wdprintf(V_DEBUG, "reader", "Stream size = %d bytes.\n", r->file_size);
 					}
-
-					if (err == EINPROGRESS) {
-						fd_set myset;
-						struct timeval tv; 
-
-						wdprintf(V_DEBUG, "reader", "Connection in progress. select()ing...\n");
-						do {
-							int res;
-
-							tv.tv_sec = 5; 
-							tv.tv_usec = 0; 
-							FD_ZERO(&myset); 
-							FD_SET(r->sockfd, &myset); 
-							res = select((r->sockfd)+1, NULL, &myset, NULL, &tv); 
-							if (res < 0 && errno != EINTR) {
-								wdprintf(V_DEBUG, "reader", "Error while connecting: %d - %s\n", errno, strerror(errno));
-								break;
-							} else if (res > 0) {
-								int valopt = 0;
-								socklen_t lon = sizeof(int);
-								if (getsockopt(r->sockfd, SOL_SOCKET, SO_ERROR, (void*)(&valopt), &lon) < 0) {
-									wdprintf(V_DEBUG, "reader", "Error in getsockopt(): %d - %s\n", errno, strerror(errno));
-									p = NULL;
-									break;
-								}
-								if (valopt) {
-									wdprintf(V_DEBUG, "reader", "Error in delayed connection(): %d - %s\n", valopt, strerror(valopt));
-									p = NULL;
-								}
-								break;
-							} else {
-								wdprintf(V_DEBUG, "reader", "Timeout in select() - Cancelling!\n");
-								p = NULL;
-								break;
-							}
-						} while (1);
-						flags = fcntl(r->sockfd, F_GETFL, 0);
-						fcntl(r->sockfd, F_SETFL, flags & (~O_NONBLOCK));
+					/* Streams with a known size can be seeked in, if the server supports range requests */
+					val = cfg_get_key_value_ignore_case(r->streaminfo, "Accept-Ranges");
+					if (val && strcasecmp(val, "bytes") == 0 && r->file_size > 0 &&
+					    !cfg_get_key_value_ignore_case(r->streaminfo, "icy-metaint")) {
+						wdprintf(V_INFO, "reader", "Server supports range requests. Stream is seekable.\n");
+						r->seekable = 1;
 					}
-
-					if (p == NULL) {
-						wdprintf(V_ERROR, "reader", "Failed to connect.\n");
-						free(r);
-						r = NULL;
-					} else {
-						inet_ntop(p->ai_family, get_in_addr((struct sockaddr *)p->ai_addr), s, sizeof s);
-						wdprintf(V_INFO, "reader", "Connected to %s:%d.\n", s, port);
-						/* Send HTTP GET request */
-						{
-							char http_request[512];
-							snprintf(http_request, 511,
-							         "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\nUser-Agent: Gmu/%s\r\nIcy-MetaData: 1\r\n\r\n",
-							         path, hostname, VERSION_NUMBER);
-							wdprintf(V_DEBUG, "reader", "Sending request: %s\n", http_request);
-							send(r->sockfd, http_request, strlen(http_request), 0);
-						}
-
-						/* Start reader thread... */
-						if (ringbuffer_init(&(r->rb_http), http_cache_size)) {
-							pthread_create_with_stack_size(&(r->thread), DEFAULT_THREAD_STACK_SIZE, http_reader_thread, r);
+					if (r->http_remaining > 0 && (unsigned long)r->http_remaining < body_size)
+						body_size = r->http_remaining;
+					/* Live streams can be cached on disk to allow pausing and going back */
+					if (!r->seekable && r->file_size <= 0 && timeshift_size > 0) {
+						if (timeshift_init(&(r->ts), timeshift_dir, timeshift_size)) {
+							val = cfg_get_key_value_ignore_case(r->streaminfo, "icy-metaint");
+							r->icy_metaint = val ? atol(val) : 0;
+							r->icy_next_meta = r->icy_metaint;
+							r->timeshift = 1;
 						} else {
-							wdprintf(V_ERROR, "reader", "Out of memory.\n");
-						}
-
-						/* Skip http response header */
-						{
-							int    header_end_found = 0;
-							size_t cnt = 0, i = 0;
-							char   ch, key[256], value[512];
-
-							key[0] = '\0'; value[0] = '\0';
-							/* Search for http header end sequence "\r\n\r\n" (or "\n\n"); I assume http headers to be no longer than 32 kB. */
-							while (!header_end_found && !reader_is_eof(r) && cnt < 32768) {
-								/* extract key */
-								ch = 0;
-								while (ch != '\r' && ch != '\n' && ch != ':' && !reader_is_eof(r)) {
-									ch = reader_read_byte(r);
-									if (i < 255 && ch != ':' && ch != '=' && ch != '\r' && ch != '\n') key[i++] = ch;
-									cnt++;
-								}
-								key[i] = '\0';
-								wdprintf(V_DEBUG, "reader", "key=[%s]\n", key);
-
-								/* extract value */
-								i = 0;
-								while ((ch = reader_read_byte(r)) == ' ' && !reader_is_eof(r)) cnt++; /* skip spaces after ":" */
-								if (ch != '\r' && ch != '\n') value[i++] = ch;
-								while (ch != '\r' && ch != '\n' && !reader_is_eof(r)) {
-									ch = reader_read_byte(r);
-									if (i < 511 && ch != '\r' && ch != '\n') value[i++] = ch;
-									cnt++;
-								}
-								value[i] = '\0';
-								wdprintf(V_DEBUG, "reader", "value=[%s]\n", value);
-								if (key[0] && value[0])
-									cfg_add_key(r->streaminfo, key, value);
-
-								i = 0;
-								if (ch == '\n' || (ch = reader_read_byte(r)) == '\n') {
-									ch = reader_read_byte(r);
-									if ((ch == '\r' && (ch = reader_read_byte(r)) == '\n') || ch == '\n')
-										header_end_found = 1;
-									else
-										key[i++] = ch;
-									cnt+=3;
-								} else {
-									key[i++] = ch;
-								}
-							}
-							wdprintf(V_DEBUG, "reader", "HTTP header skipped: %s (%d bytes)\n", header_end_found ? "yes" : "no", cnt);
-							/* Try to figure out stream length */
-							if (header_end_found) {
-								char *val = cfg_get_key_value_ignore_case(r->streaminfo, "Content-Length");
-								if (val) {
-									r->file_size = atol(val);
-									wdprintf(V_DEBUG, "reader", "Stream size = %d bytes.\n", r->file_size);
-								}
-							}
+							wdprintf(V_WARNING, "reader", "Unable to set up the timeshift cache.\n");
 						}
 					}
-					freeaddrinfo(servinfo);
+					http_cache_write(r, body, body_size);
+					r->http_next_pos = body_size;
+					if (r->http_remaining > 0) r->http_remaining -= body_size;
 				}
+				if (buf) free(buf);
+				if (pthread_create_with_stack_size(&(r->thread), DEFAULT_THREAD_STACK_SIZE, http_reader_thread, r) == 0)
+					r->thread_running = 1;
+				else
+					r->eof = 1;
 			}
-			if (hostname) free(hostname);
-			if (path)     free(path);
 			/* Check for 302 redirect (Location) */
 			if (r) {
 				char *v = cfg_get_key_value_ignore_case(r->streaminfo, "Location");
@@ -365,14 +874,8 @@ static Reader *_reader_open(const char *url, int max_redirects)
 			}
 		} else { /* Treat everything else as a local file (for now) */
 			wdprintf(V_INFO, "reader", "Opening file %s.\n", url);
-			r->file = fopen(url, "r");
-			if (r->file) {
-				struct stat st;
+			if (local_file_open(r, url)) {
 				r->seekable = 1;
-				if (stat(url, &st) == 0) {
-					r->file_size = st.st_size;
-					wdprintf(V_DEBUG, "reader", "File size = %d bytes.\n", r->file_size);
-				}
 				r->is_ready = 1;
 			} else {
 				wdprintf(V_ERROR, "reader", "Unable to open file '%s'.\n", url);
@@ -392,17 +895,28 @@ Reader *reader_open(const char *url)
 int reader_close(Reader *r)
 {
 	if (r) {
-		if (r->file) { /* local file */
-			fclose(r->file);
-		} else if (r->sockfd > 0) { /* http stream */
-			/* close http stream */
-			close(r->sockfd);
+		if (r->fd >= 0) { /* local file */
+			local_file_close(r);
+		} else { /* http stream */
+			pthread_mutex_lock(&(r->mutex));
+			r->stop = 1;
 			r->eof = 1;
-			wdprintf(V_DEBUG, "reader", "Waiting for reader thread to finish.\n");
-			pthread_join(r->thread, NULL);
-			wdprintf(V_DEBUG, "reader", "Reader thread joined.\n");
+			pthread_cond_broadcast(&(r->cond));
+			if (r->sockfd >= 0) shutdown(r->sockfd, SHUT_RDWR); /* Wakes up the reader thread */
+			pthread_mutex_unlock(&(r->mutex));
+			if (r->thread_running) {
+				wdprintf(V_DEBUG, "reader", "Waiting for reader thread to finish.\n");
+				pthread_join(r->thread, NULL);
+				wdprintf(V_DEBUG, "reader", "Reader thread joined.\n");
+			}
+			/* close http stream */
+			if (r->sockfd >= 0) close(r->sockfd);
 			ringbuffer_free(&(r->rb_http));
+			if (r->timeshift) timeshift_free(&(r->ts));
+			if (r->http_host) free(r->http_host);
+			if (r->http_path) free(r->http_path);
 		}
+		pthread_cond_destroy(&(r->cond));
 		pthread_mutex_destroy(&(r->mutex));
 		if (r->buf) free(r->buf);
 		cfg_free(r->streaminfo);
@@ -414,27 +928,30 @@ int reader_close(Reader *r)
 
 int reader_is_eof(Reader *r)
 {
-	return r->file ? r->eof : ringbuffer_get_fill(&(r->rb_http)) > 0 ? 0 : r->eof;
+	int res = r->eof;
+	if (r->fd < 0) {
+		pthread_mutex_lock(&(r->mutex));
+		res = http_cache_get_fill(r) > 0 ? 0 : r->eof;
+		pthread_mutex_unlock(&(r->mutex));
+	}
+	return res;
 }
 
 char reader_read_byte(Reader *r)
 {
 	int ch = 0;
-	if (r->file) {
-		ch = fgetc(r->file);
-		if (ch == EOF) r->eof = 1;
+	if (r->fd >= 0) {
+		char buf[1];
+		if (local_file_read(r, buf, 1) == 1) ch = buf[0];
 	} else {
-		int read_okay = 0;
-		while (!read_okay && !reader_is_eof(r)) {
-			char buf[1];
-			pthread_mutex_lock(&(r->mutex));
-			read_okay = ringbuffer_read(&(r->rb_http), buf, 1);
-			pthread_mutex_unlock(&(r->mutex));
-			if (!read_okay && r->eof) break;
-			if (!read_okay) usleep(150);
+		char buf[1];
+		pthread_mutex_lock(&(r->mutex));
+		http_wait_for_data(r, 1);
+		if (http_cache_read(r, buf, 1) == 1) {
 			ch = buf[0];
+			pthread_cond_broadcast(&(r->cond));
 		}
-		if (read_okay) r->stream_pos++;
+		pthread_mutex_unlock(&(r->mutex));
 	}
 	return (char)ch;
 }
@@ -451,39 +968,23 @@ int reader_read_bytes(Reader *r, size_t size)
 	if (size > 0) {
 		if (size > r->buf_size) r->buf = realloc(r->buf, size+1);
 		if (r->buf) r->buf_size = size;
-		if (r->file) {
-			if (r->buf) {
-				long pos = ftell(r->file);
-				memset(r->buf, 0, r->buf_size);
-				if (fread(r->buf, size, 1, r->file) < 1) {
-					do { /* Not the most elegant solution.. ;) */
-						size--;
-						if (fseek(r->file, pos, SEEK_SET) != 0)
-							wdprintf(V_ERROR, "reader", "Unable to seek to pos %d:(\n", pos);
-					} while (fread(r->buf, size, 1, r->file) < 1 && size > 0);
-					r->eof = feof(r->file);
-					if (size > 0)
-						read_okay = 1;
-					else
-						r->eof = 1;
-					r->buf_data_size = size;
-				} else {
-					r->buf[size] = '\0';
-					read_okay = 1;
-					r->buf_data_size = size;
-					r->stream_pos += size;
-				}
-			}
-		} else {
-			while (!read_okay) {
-				pthread_mutex_lock(&(r->mutex));
-				read_okay = ringbuffer_read(&(r->rb_http), r->buf, size);
-				pthread_mutex_unlock(&(r->mutex));
-				if (read_okay) r->buf_data_size = size; else r->buf_data_size = 0;
-				if (!read_okay && r->eof) break;
-				r->buf[size] = '\0';
-				if (!read_okay) usleep(150);
+		if (r->fd >= 0) {
+			if (r->buf) { /* Returns whatever is left on a short read near the end of the file */
+				size_t n = local_file_read(r, r->buf, size);
+				r->buf[n] = '\0';
+				r->buf_data_size = n;
+				read_okay = n > 0;
 			}
+		} else if (r->buf) { /* At the end of the stream, whatever is left is returned */
+			size_t n;
+			pthread_mutex_lock(&(r->mutex));
+			http_wait_for_data(r, size);
+			n = http_cache_read(r, r->buf, size);
+			read_okay = n > 0;
+			r->buf_data_size = n;
+			r->buf[n] = '\0';
+			pthread_cond_broadcast(&(r->cond));
+			pthread_mutex_unlock(&(r->mutex));
 		}
 	}
 	return read_okay;
@@ -494,6 +995,46 @@ char *reader_get_buffer(Reader *r)
 	return r->buf;
 }
 
+const char *reader_peek(Reader *r, size_t size, size_t *available)
+{
+	const char *res = NULL;
+
+	if (r->map) {
+		*available = 0;
+		if (r->stream_pos < (unsigned long)r->file_size) {
+			*available = r->file_size - r->stream_pos;
+			if (*available > size) *available = size;
+		}
+		local_file_readahead(r);
+		res = r->map + r->stream_pos;
+	}
+	return res;
+}
+
+int reader_has_timeshift(Reader *r)
+{
+	return r->timeshift;
+}
+
+long reader_timeshift_move(Reader *r, long byte_offset)
+{
+	long res = 0;
+
+	if (r->timeshift) {
+		long pos;
+		pthread_mutex_lock(&(r->mutex));
+		pos = http_timeshift_find_position(r, (long)r->stream_pos + byte_offset);
+		if (pos >= 0) {
+			res = pos - (long)r->stream_pos;
+			r->stream_pos = pos;
+			r->buf_data_size = 0;
+		}
+		pthread_mutex_unlock(&(r->mutex));
+		wdprintf(V_DEBUG, "reader", "Timeshift: Moved by %ld bytes (requested: %ld).\n", res, byte_offset);
+	}
+	return res;
+}
+
 long reader_get_file_size(Reader *r)
 {
 	return r->file_size;
@@ -508,10 +1049,13 @@ unsigned long reader_get_stream_position(Reader *r)
 int reader_reset_stream(Reader *r)
 {
 	int res = 0;
-	if (r->file) { /* Only possible for local files */
-		rewind(r->file);
+	if (r->fd >= 0) {
 		r->stream_pos = 0;
+		r->readahead_pos = 0;
+		r->eof = 0;
 		res = 1;
+	} else if (r->seekable) {
+		res = reader_seek(r, 0);
 	}
 	return res;
 }
@@ -523,18 +1067,32 @@ int reader_is_seekable(Reader *r)
 
 int reader_seek_whence(Reader *r, long byte_offset, int whence)
 {
-	int res = 0;
-	if (r->file) {
-		if (fseek(r->file, byte_offset, whence) == 0) {
-			r->buf_data_size = 0;
-			r->stream_pos = ftell(r->file);
-			res = 1;
-		} else {
-			wdprintf(V_INFO, "reader", "Seeking failed. :(\n");
-		}
-	} else {
-		/* Seeking not possible in HTTP streams */
-		res = 0;
+	int  res = 0;
+	long pos = byte_offset;
+
+	if (whence == SEEK_CUR)
+		pos += r->stream_pos;
+	else if (whence == SEEK_END)
+		pos += r->file_size;
+	if (pos < 0 || (whence != SEEK_SET && whence != SEEK_CUR && whence != SEEK_END)) {
+		wdprintf(V_INFO, "reader", "Seeking failed. :(\n");
+	} else if (r->fd >= 0) {
+		r->buf_data_size = 0;
+		r->stream_pos = pos;
+		r->readahead_pos = 0;
+		r->eof = 0;
+		res = 1;
+	} else if (r->seekable) {
+		/* Let the reader thread fetch the data from the new position */
+		pthread_mutex_lock(&(r->mutex));
+		ringbuffer_clear(&(r->rb_http));
+		r->buf_data_size = 0;
+		r->stream_pos = pos;
+		r->seek_pos = pos;
+		r->eof = 0;
+		pthread_cond_broadcast(&(r->cond));
+		pthread_mutex_unlock(&(r->mutex));
+		res = 1;
 	}
 	return res;
 }
@@ -20,18 +20,28 @@
 #include <pthread.h>
 #include "ringbuffer.h"
 #include "wejconfig.h"
+#include "timeshift.h"
 
 #define HTTP_CACHE_SIZE_MIN_KB 256
 #define HTTP_CACHE_SIZE_MAX_KB 4096
 
 typedef struct
 {
-	FILE           *file;
+	int             fd;   /* Local file */
+	char           *map;  /* Memory mapping of the local file, if available */
+	unsigned long   readahead_pos;
 	int             eof;
 	int             seekable;
 	long            file_size;
 
 	int             sockfd;
+	char           *http_host, *http_path; /* Needed for reconnecting */
+	int             http_port;
+	long            http_remaining;  /* Bytes left in the current response, -1 if unknown */
+	unsigned long   http_next_pos;   /* Stream position of the next byte received */
+	int             http_keep_alive; /* Connection can be reused for the next request */
+	long            seek_pos;        /* Position requested by a seek, -1 if none */
+	int             stop;            /* Tells the reader thread to quit */
 
 	char           *buf; /* Dynamic read buffer */
 	size_t          buf_size;
@@ -40,30 +50,65 @@ typedef struct
 	ConfigFile     *streaminfo;
 
 	RingBuffer      rb_http;
+	Timeshift       ts;            /* Used instead of rb_http for live streams, if enabled */
+	int             timeshift;
+	long            icy_metaint;   /* Shoutcast metadata interval, 0 if none */
+	unsigned long   icy_next_meta; /* Stream position of the next metadata block */
 	pthread_mutex_t mutex;
+	pthread_cond_t  cond; /* Signals new data, free space and end of stream */
 	pthread_t       thread;
+	int             thread_running;
 
 	unsigned long   stream_pos;
 
 	int             is_ready;
+	/* Jitter buffer: The amount of data to be buffered (jitter_target) is
+	 * derived from the stream's byte rate and the network delay statistics */
+	long            net_wait_avg_us, net_wait_dev_us;
+	long            byte_rate;
+	size_t          jitter_target;
 } Reader;
 
 /* Opens a local file or HTTP URL for reading */
 int     reader_set_cache_size_kb(size_t size, size_t prebuffer_size);
 int     reader_get_cache_fill(Reader *r);
+/* Enables the timeshift cache for live streams in directory 'dir' holding
+ * at least 'size_kb' kB, or disables it if 'size_kb' is 0 */
+void    reader_set_timeshift(const char *dir, size_t size_kb);
 Reader *reader_open(const char *url);
 int     reader_close(Reader *r);
+/* Returns 1 if enough data has been buffered to start playback */
 int     reader_is_ready(Reader *r);
+int     reader_is_network_stream(Reader *r);
+/* Sets the stream's bitrate (in bits per second), which is used to size the
+ * jitter buffer */
+void    reader_set_bitrate(Reader *r, long bitrate);
+/* Clears the ready state of a network stream until the jitter buffer has
+ * been refilled (e.g. after a buffer underrun) */
+void    reader_rebuffer(Reader *r);
 int     reader_is_eof(Reader *r);
 char    reader_read_byte(Reader *r);
 int     reader_read_bytes(Reader *r, size_t size);
 char   *reader_get_buffer(Reader *r);
+/* Zero-copy access to the next 'size' bytes of a memory mapped local file
+ * without consuming them. Returns NULL if not available (e.g. for HTTP
+ * streams), otherwise '*available' is set to the number of accessible bytes,
+ * which is less than 'size' near the end of the file. Data in the read
+ * buffer (see reader_read_bytes()) is not included. */
+const char *reader_peek(Reader *r, size_t size, size_t *available);
 size_t  reader_get_number_of_bytes_in_buffer(Reader *r);
 /* Resets the stream to the beginning (if possible), returns 1 on success, 0 otherwise */
 int     reader_reset_stream(Reader *r);
 int     reader_is_seekable(Reader *r);
 int     reader_seek_whence(Reader *r, long byte_offset, int whence);
 int     reader_seek(Reader *r, long byte_offset);
+/* Returns 1 if the stream is a live stream buffered in the timeshift cache */
+int     reader_has_timeshift(Reader *r);
+/* Moves the read position of a timeshifted stream by about 'byte_offset'
+ * bytes within the cached window. The position is chosen such that the
+ * stream structure stays intact (Shoutcast metadata blocks), so the actual
+ * offset is returned, which is 0 if the position cannot be changed. */
+long    reader_timeshift_move(Reader *r, long byte_offset);
 long    reader_get_file_size(Reader *r);
 unsigned long reader_get_stream_position(Reader *r);
 /* Sets number of bytes in buffer to 0 */
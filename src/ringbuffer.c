@@ -106,6 +106,43 @@ size_t ringbuffer_get_size(RingBuffer *rb)
 	return rb->size;
 }
 
+/* Moves the buffered data into 'buffer', which has to be 'size' bytes large.
+ * On success the ring buffer's previous buffer is returned through 'buffer',
+ * so the caller can free it outside of any lock. */
+int ringbuffer_swap_buffer(RingBuffer *rb, char **buffer, size_t size)
+{
+	int result = 0;
+
+	if (*buffer && size >= rb->buffer_fill) {
+		char  *old = rb->buffer;
+		size_t fill = rb->buffer_fill;
+		ringbuffer_read(rb, *buffer, fill);
+		rb->buffer      = *buffer;
+		rb->size        = size;
+		rb->read_ptr    = 0;
+		rb->write_ptr   = fill < size ? fill : 0;
+		rb->buffer_fill = fill;
+		rb->unread_ptr  = -1;
+		*buffer = old;
+		result = 1;
+	}
+	return result;
+}
+
+/* Changes the size of the ring buffer while keeping its contents. Fails if
+ * the new size is too small for the data currently in the buffer. */
+int ringbuffer_resize(RingBuffer *rb, size_t size)
+{
+	int   result = 0;
+	char *buffer;
+
+	if (size >= rb->buffer_fill && (buffer = (char *)malloc(size))) {
+		result = ringbuffer_swap_buffer(rb, &buffer, size);
+		free(buffer);
+	}
+	return result;
+}
+
 /* Remembers current ringbuffer read position for possible unrolling with unread. */
 void ringbuffer_set_unread_pos(RingBuffer *rb)
 {
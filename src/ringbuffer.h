@@ -34,6 +34,8 @@ size_t ringbuffer_get_fill(RingBuffer *rb);
 size_t ringbuffer_get_free(RingBuffer *rb);
 void   ringbuffer_clear(RingBuffer *rb);
 size_t ringbuffer_get_size(RingBuffer *rb);
+int    ringbuffer_resize(RingBuffer *rb, size_t size);
+int    ringbuffer_swap_buffer(RingBuffer *rb, char **buffer, size_t size);
 void   ringbuffer_set_unread_pos(RingBuffer *rb);
 int    ringbuffer_unread(RingBuffer *rb);
 #endif
@@ -0,0 +1,550 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: seekindex.c  Created: 210821
+ *
+ * Description: Persistent seek index cache for MPEG audio and Ogg files
+ *
+ * Seeking in VBR MP3 files (without a usable Xing TOC) and in Ogg files
+ * requires the decoder to scan or bisect the file, which is slow on
+ * flash storage. A low priority thread scans files once sequentially
+ * and stores a table of (sample, file offset) pairs in the user's data
+ * directory, keyed by path, modification time and size. With such an
+ * index, a seek becomes a table lookup followed by a short read. The
+ * scan also yields the exact number of samples of VBR files.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "seekindex.h"
+#include "consts.h"
+#include "util.h"
+#include "debug.h"
+#include "core.h" /* for DEFAULT_THREAD_STACK_SIZE */
+#include "pthread_helper.h"
+#include "audioinfo.h"
+#include "filecache.h"
+
+#define SCAN_BUFFER_SIZE   65536
+/* Maximum amount of garbage skipped before the first valid MPEG frame */
+#define MPEG_MAX_SYNC_SKIP 65536
+#define SEEKINDEX_MAGIC    "GMUSEEK1"
+/* The least recently used indexes are removed once the cache grows larger
+ * than this (see filecache_prune()) */
+#define CACHE_MAX_SIZE     FILECACHE_MAX_SIZE
+
+typedef struct ScanBuffer
+{
+	FILE          *file;
+	unsigned char  data[SCAN_BUFFER_SIZE];
+	long long      start;
+	size_t         len;
+	int          (*abort_cb)(void);
+	int            aborted;
+} ScanBuffer;
+
+typedef struct SeekIndexFileHeader
+{
+	char      magic[8];
+	long long mtime, file_size, total_samples, count;
+	int       type, samplerate, frames_per_point, path_len;
+} SeekIndexFileHeader;
+
+static pthread_t       thread;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cond = PTHREAD_COND_INITIALIZER;
+static int             running, quit, request, cache_enabled;
+static char            pending[PATH_LEN_MAX];
+static long long       cache_size; /* Only used by the seek index thread */
+
+/* Returns a pointer to 'size' bytes at file offset 'pos', or NULL if
+ * there is not enough data. Sequential access only reads each byte once. */
+static const unsigned char *scan_get(ScanBuffer *sb, long long pos, size_t size)
+{
+	if (sb->aborted || size > SCAN_BUFFER_SIZE) return NULL;
+	if (pos < sb->start || pos + (long long)size > sb->start + (long long)sb->len) {
+		size_t keep = 0;
+
+		if (pos >= sb->start && pos < sb->start + (long long)sb->len) {
+			keep = (size_t)(sb->start + (long long)sb->len - pos);
+			memmove(sb->data, sb->data + (pos - sb->start), keep);
+		} else if (fseeko(sb->file, (off_t)pos, SEEK_SET) != 0) {
+			return NULL;
+		}
+		if (sb->abort_cb && sb->abort_cb()) {
+			sb->aborted = 1;
+			return NULL;
+		}
+		sb->start = pos;
+		sb->len = keep + fread(sb->data + keep, 1, SCAN_BUFFER_SIZE - keep, sb->file);
+		if (size > sb->len) return NULL;
+	}
+	return sb->data + (pos - sb->start);
+}
+
+static int add_point(SeekIndex *si, size_t *allocated, long long sample, long long offset)
+{
+	if (si->count == *allocated) {
+		size_t     new_size = *allocated ? *allocated * 2 : 256;
+		SeekPoint *tmp = realloc(si->points, new_size * sizeof(SeekPoint));
+		if (!tmp) return 0;
+		si->points = tmp;
+		*allocated = new_size;
+	}
+	si->points[si->count].sample = sample;
+	si->points[si->count].offset = offset;
+	si->count++;
+	return 1;
+}
+
+static int mpeg_same_stream(const MpegFrameHeader *a, const MpegFrameHeader *b)
+{
+	return a->version == b->version && a->layer == b->layer && a->samplerate == b->samplerate;
+}
+
+/* Checks for a Xing/Info or VBRI header frame, which contains no audio */
+static int mpeg_is_info_frame(ScanBuffer *sb, long long pos, const MpegFrameHeader *f)
+{
+	const unsigned char *d;
+	int                  xing_offset = audioinfo_get_mpeg_xing_offset(f);
+
+	if (f->layer != 3 || !(d = scan_get(sb, pos, 4 + 32 + 4))) return 0;
+	return memcmp(d + xing_offset, "Xing", 4) == 0 ||
+	       memcmp(d + xing_offset, "Info", 4) == 0 ||
+	       memcmp(d + 4 + 32, "VBRI", 4) == 0;
+}
+
+static SeekIndex *scan_mpeg(ScanBuffer *sb, long long pos)
+{
+	SeekIndex           *si = calloc(1, sizeof(SeekIndex));
+	const unsigned char *h;
+	MpegFrameHeader      ref, f;
+	int                  have_ref = 0, synced = 0;
+	long long            frames = 0, skipped = 0;
+	size_t               allocated = 0;
+
+	if (!si) return NULL;
+	memset(&ref, 0, sizeof(ref));
+	si->type = SEEKINDEX_MPEG;
+	while ((h = scan_get(sb, pos, 4))) {
+		if (!audioinfo_parse_mpeg_header(h, &f) || (have_ref && !mpeg_same_stream(&f, &ref))) {
+			/* Junk or a tag between frames; search for the next frame */
+			synced = 0;
+			pos++;
+			if (!have_ref && ++skipped > MPEG_MAX_SYNC_SKIP) break;
+			continue;
+		}
+		if (!synced) {
+			/* Accept a frame header only if it is followed by another one */
+			MpegFrameHeader nf;
+			if (!(h = scan_get(sb, pos + f.size, 4)) || !audioinfo_parse_mpeg_header(h, &nf) || !mpeg_same_stream(&f, &nf)) {
+				pos++;
+				if (!have_ref && ++skipped > MPEG_MAX_SYNC_SKIP) break;
+				continue;
+			}
+			synced = 1;
+			if (!have_ref) {
+				ref = f;
+				have_ref = 1;
+				si->samplerate = f.samplerate;
+				si->frames_per_point = SEEKINDEX_INTERVAL_MS * f.samplerate / 1000 / f.samples;
+				if (si->frames_per_point < 1) si->frames_per_point = 1;
+				if (mpeg_is_info_frame(sb, pos, &f)) {
+					pos += f.size;
+					continue;
+				}
+			}
+		}
+		if (frames % si->frames_per_point == 0 && !add_point(si, &allocated, frames * ref.samples, pos))
+			break;
+		frames++;
+		pos += f.size;
+	}
+	si->total_samples = frames * (have_ref ? ref.samples : 0);
+	if (sb->aborted || frames == 0) {
+		seekindex_free(si);
+		si = NULL;
+	}
+	return si;
+}
+
+static long long read_le(const unsigned char *d, int bytes)
+{
+	long long res = 0;
+	while (bytes-- > 0) res = (res << 8) | d[bytes];
+	return res;
+}
+
+static SeekIndex *scan_ogg(ScanBuffer *sb)
+{
+	SeekIndex           *si = calloc(1, sizeof(SeekIndex));
+	const unsigned char *h;
+	long long            pos = 0, granule, prev_granule = 0, next_point, pre_skip = 0, serial = -1;
+	long long            interval = 0;
+	size_t               allocated = 0;
+	int                  eos = 0, ok = 1;
+
+	if (!si) return NULL;
+	si->type = SEEKINDEX_OGG;
+	next_point = 0;
+	while (ok && (h = scan_get(sb, pos, 27))) {
+		long long page_serial, page_size;
+		int       i, segments = h[26], flags = h[5];
+
+		if (memcmp(h, "OggS", 4) != 0) {
+			/* Keep what has been indexed before trailing garbage */
+			if (serial < 0) ok = 0;
+			break;
+		}
+		if (!(h = scan_get(sb, pos, 27 + segments))) break;
+		page_size = 27 + segments;
+		for (i = 0; i < segments; i++) page_size += h[27 + i];
+		page_serial = read_le(h + 14, 4);
+		granule = read_le(h + 6, 8);
+		if (serial < 0) {
+			const unsigned char *b = scan_get(sb, pos + 27 + segments, 19);
+
+			/* Identify the codec by the first packet of the first stream */
+			if (!(flags & 2) || !b) {
+				ok = 0;
+			} else if (memcmp(b, "\001vorbis", 7) == 0) {
+				si->samplerate = (int)read_le(b + 12, 4);
+			} else if (memcmp(b, "OpusHead", 8) == 0) {
+				si->samplerate = 48000;
+				pre_skip = read_le(b + 10, 2);
+			} else {
+				ok = 0;
+			}
+			if (si->samplerate <= 0) ok = 0;
+			interval = (long long)si->samplerate * SEEKINDEX_INTERVAL_MS / 1000;
+			next_point = interval;
+			serial = page_serial;
+		} else if (page_serial != serial) {
+			/* Chained or multiplexed streams are not supported */
+			if (flags & 2) ok = 0;
+		} else if (!eos && granule != -1) {
+			/* Decoding can resume at this page with the samples that follow
+			 * the last packet completed on the previous page */
+			if (prev_granule > 0 && prev_granule >= next_point) {
+				long long sample = prev_granule - pre_skip;
+				if (!add_point(si, &allocated, sample > 0 ? sample : 0, pos)) break;
+				next_point = prev_granule + interval;
+			}
+			prev_granule = granule;
+			if (flags & 4) eos = 1;
+		}
+		pos += page_size;
+	}
+	si->total_samples = prev_granule > pre_skip ? prev_granule - pre_skip : 0;
+	if (!ok || sb->aborted || si->total_samples == 0) {
+		seekindex_free(si);
+		si = NULL;
+	}
+	return si;
+}
+
+static SeekIndex *build_index(const char *file, int (*abort_cb)(void))
+{
+	SeekIndex           *si = NULL;
+	ScanBuffer          *sb = malloc(sizeof(ScanBuffer));
+	const unsigned char *h;
+
+	if (!sb) return NULL;
+	sb->start = 0;
+	sb->len = 0;
+	sb->abort_cb = abort_cb;
+	sb->aborted = 0;
+	if ((sb->file = fopen(file, "rb"))) {
+		if ((h = scan_get(sb, 0, 10))) {
+			if (memcmp(h, "OggS", 4) == 0) {
+				si = scan_ogg(sb);
+			} else {
+				long long pos = 0;
+				/* Skip an ID3v2 tag (and its footer) */
+				if (memcmp(h, "ID3", 3) == 0) {
+					pos = 10 + ((h[6] & 0x7F) << 21 | (h[7] & 0x7F) << 14 | (h[8] & 0x7F) << 7 | (h[9] & 0x7F));
+					if (h[5] & 0x10) pos += 10;
+				}
+				si = scan_mpeg(sb, pos);
+			}
+		}
+		fclose(sb->file);
+	}
+	free(sb);
+	return si;
+}
+
+/* The cache file name is derived from the path of the indexed file
+ * using the 64 bit FNV-1a hash function */
+static char *get_cache_file_alloc(const char *file, int create_dir)
+{
+	unsigned long long   hash = 14695981039346656037ULL;
+	const unsigned char *c;
+	char                 name[64];
+
+	for (c = (const unsigned char *)file; *c; c++) {
+		hash ^= *c;
+		hash *= 1099511628211ULL;
+	}
+	snprintf(name, sizeof(name), "seekindex/%016llx.idx", hash);
+	if (create_dir) {
+		char *dir = get_data_dir_with_name_alloc("gmu", 1, "seekindex");
+		if (dir) {
+			mkdir(dir, S_IRWXU);
+			free(dir);
+		}
+	}
+	return get_data_dir_with_name_alloc("gmu", 0, name);
+}
+
+static int save_index(const char *file, const SeekIndex *si)
+{
+	int                 res = 0;
+	struct stat         st;
+	char               *cache_file, *tmp_file;
+	SeekIndexFileHeader hdr;
+	FILE               *f;
+
+	if (stat(file, &st) != 0) return 0;
+	if (!(cache_file = get_cache_file_alloc(file, 1))) return 0;
+	if ((tmp_file = malloc(strlen(cache_file) + 5))) {
+		sprintf(tmp_file, "%s.tmp", cache_file);
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, SEEKINDEX_MAGIC, 8);
+		hdr.mtime            = (long long)st.st_mtime;
+		hdr.file_size        = (long long)st.st_size;
+		hdr.total_samples    = si->total_samples;
+		hdr.count            = (long long)si->count;
+		hdr.type             = si->type;
+		hdr.samplerate       = si->samplerate;
+		hdr.frames_per_point = si->frames_per_point;
+		hdr.path_len         = (int)strlen(file);
+		if ((f = fopen(tmp_file, "wb"))) {
+			res = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+			      fwrite(file, 1, hdr.path_len, f) == (size_t)hdr.path_len &&
+			      fwrite(si->points, sizeof(SeekPoint), si->count, f) == si->count;
+			if (fclose(f) != 0) res = 0;
+			/* Replace the old index atomically, so readers never see a partial file */
+			if (res) res = rename(tmp_file, cache_file) == 0;
+			if (res) cache_size += (long long)(sizeof(hdr) + hdr.path_len + si->count * sizeof(SeekPoint));
+			if (!res) remove(tmp_file);
+		}
+		free(tmp_file);
+	}
+	free(cache_file);
+	return res;
+}
+
+SeekIndex *seekindex_load(const char *file)
+{
+	SeekIndex          *si = NULL;
+	struct stat         st;
+	char               *cache_file, path[PATH_LEN_MAX];
+	SeekIndexFileHeader hdr;
+	FILE               *f;
+
+	if (!cache_enabled || !file || stat(file, &st) != 0) return NULL;
+	if (!(cache_file = get_cache_file_alloc(file, 0))) return NULL;
+	if ((f = fopen(cache_file, "rb"))) {
+		if (fread(&hdr, sizeof(hdr), 1, f) == 1 &&
+		    memcmp(hdr.magic, SEEKINDEX_MAGIC, 8) == 0 &&
+		    hdr.mtime == (long long)st.st_mtime &&
+		    hdr.file_size == (long long)st.st_size &&
+		    hdr.path_len == (int)strlen(file) && hdr.path_len < PATH_LEN_MAX &&
+		    hdr.count > 0 && hdr.count < (long long)(st.st_size / 4) &&
+		    fread(path, 1, hdr.path_len, f) == (size_t)hdr.path_len &&
+		    memcmp(path, file, hdr.path_len) == 0 &&
+		    (si = calloc(1, sizeof(SeekIndex)))) {
+			si->type             = hdr.type == SEEKINDEX_OGG ? SEEKINDEX_OGG : SEEKINDEX_MPEG;
+			si->samplerate       = hdr.samplerate;
+			si->frames_per_point = hdr.frames_per_point;
+			si->total_samples    = hdr.total_samples;
+			si->count            = (size_t)hdr.count;
+			if (!(si->points = malloc(si->count * sizeof(SeekPoint))) ||
+			    fread(si->points, sizeof(SeekPoint), si->count, f) != si->count ||
+			    si->samplerate <= 0 || si->frames_per_point <= 0) {
+				seekindex_free(si);
+				si = NULL;
+			}
+		}
+		fclose(f);
+		/* Mark the index as recently used for the cache cleanup */
+		if (si) filecache_touch(cache_file);
+	}
+	if (si) wdprintf(V_DEBUG, "seekindex", "Loaded index with %lu points for %s\n", (unsigned long)si->count, file);
+	free(cache_file);
+	return si;
+}
+
+SeekIndex *seekindex_build(const char *file)
+{
+	return build_index(file, NULL);
+}
+
+int seekindex_lookup(const SeekIndex *si, long long sample, SeekPoint *point)
+{
+	size_t lo = 0, hi;
+
+	if (!si || si->count == 0 || sample < si->points[0].sample) return 0;
+	hi = si->count;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (si->points[mid].sample <= sample)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	*point = si->points[lo];
+	return 1;
+}
+
+void seekindex_free(SeekIndex *si)
+{
+	if (si) {
+		free(si->points);
+		free(si);
+	}
+}
+
+/* Returns 1 if the index file 'cache_file' belongs to a file that has been
+ * removed or modified since the index has been built */
+static int cache_file_is_stale(const char *cache_file)
+{
+	int                 res = 1;
+	SeekIndexFileHeader hdr;
+	char                path[PATH_LEN_MAX];
+	struct stat         st;
+	FILE               *f;
+
+	if ((f = fopen(cache_file, "rb"))) {
+		if (fread(&hdr, sizeof(hdr), 1, f) == 1 &&
+		    memcmp(hdr.magic, SEEKINDEX_MAGIC, 8) == 0 &&
+		    hdr.path_len > 0 && hdr.path_len < PATH_LEN_MAX &&
+		    fread(path, 1, hdr.path_len, f) == (size_t)hdr.path_len) {
+			path[hdr.path_len] = '\0';
+			res = stat(path, &st) != 0 ||
+			      hdr.mtime != (long long)st.st_mtime ||
+			      hdr.file_size != (long long)st.st_size;
+		}
+		fclose(f);
+	}
+	return res;
+}
+
+static int check_quit(void)
+{
+	int res;
+	pthread_mutex_lock(&mutex);
+	res = quit;
+	pthread_mutex_unlock(&mutex);
+	return res;
+}
+
+/* Leftovers of interrupted writes and indexes of modified files are removed */
+static int cache_file_is_valid(const char *cache_file, const char *name)
+{
+	return filecache_has_extension(name, ".idx") && !cache_file_is_stale(cache_file);
+}
+
+/* Removes the indexes of files that are gone or have been modified, and the
+ * least recently used indexes if the cache is larger than CACHE_MAX_SIZE */
+static void prune_cache(void)
+{
+	char *dir_name = get_data_dir_with_name_alloc("gmu", 0, "seekindex");
+
+	cache_size = dir_name ? filecache_prune(dir_name, CACHE_MAX_SIZE, cache_file_is_valid, check_quit) : 0;
+	free(dir_name);
+}
+
+static int check_new_request(void)
+{
+	int res;
+	pthread_mutex_lock(&mutex);
+	res = request || quit;
+	pthread_mutex_unlock(&mutex);
+	return res;
+}
+
+static void *seekindex_thread(void *arg)
+{
+	char file[PATH_LEN_MAX];
+
+	pthread_lower_current_thread_priority();
+	prune_cache();
+	while (1) {
+		SeekIndex *si;
+
+		pthread_mutex_lock(&mutex);
+		while (!quit && !request)
+			pthread_cond_wait(&cond, &mutex);
+		if (quit) {
+			pthread_mutex_unlock(&mutex);
+			break;
+		}
+		memcpy(file, pending, sizeof(file));
+		request = 0;
+		pthread_mutex_unlock(&mutex);
+
+		if (!(si = seekindex_load(file))) {
+			/* The scan is abandoned when another file is requested */
+			if ((si = build_index(file, check_new_request))) {
+				if (save_index(file, si)) {
+					wdprintf(V_DEBUG, "seekindex", "Stored index with %lu points for %s\n",
+					         (unsigned long)si->count, file);
+					if (cache_size > CACHE_MAX_SIZE) prune_cache();
+				} else
+					wdprintf(V_WARNING, "seekindex", "Unable to store index for %s\n", file);
+			}
+		}
+		seekindex_free(si);
+	}
+	return NULL;
+}
+
+int seekindex_init(int use_cache)
+{
+	cache_enabled = use_cache;
+	quit = 0;
+	request = 0;
+	running = 0;
+	if (cache_enabled) {
+		running = pthread_create_with_stack_size(&thread, DEFAULT_THREAD_STACK_SIZE, seekindex_thread, NULL) == 0;
+		if (running) wdprintf(V_INFO, "seekindex", "Seek index cache enabled.\n");
+	}
+	return running;
+}
+
+void seekindex_request(const char *file)
+{
+	if (!running || !file || strncasecmp(file, "http://", 7) == 0) return;
+	pthread_mutex_lock(&mutex);
+	strncpy(pending, file, PATH_LEN_MAX - 1);
+	pending[PATH_LEN_MAX - 1] = '\0';
+	request = 1;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+void seekindex_shutdown(void)
+{
+	if (running) {
+		pthread_mutex_lock(&mutex);
+		quit = 1;
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&mutex);
+		pthread_join(thread, NULL);
+		running = 0;
+	}
+	cache_enabled = 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: seekindex.h  Created: 210821
+ *
+ * Description: Persistent seek index cache for MPEG audio and Ogg files
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#ifndef _SEEKINDEX_H
+#define _SEEKINDEX_H
+#include <stddef.h>
+
+/* Approximate distance between two seek points */
+#define SEEKINDEX_INTERVAL_MS 1000
+
+typedef enum { SEEKINDEX_MPEG, SEEKINDEX_OGG } SeekIndexType;
+
+typedef struct SeekPoint
+{
+	long long sample; /* First sample that can be decoded when starting at 'offset' */
+	long long offset; /* File offset of an MPEG frame or an Ogg page */
+} SeekPoint;
+
+typedef struct SeekIndex
+{
+	SeekIndexType type;
+	int           samplerate;
+	/* MPEG: The seek points are exactly 'frames_per_point' frames apart,
+	 * starting with the first audio frame (not counting a Xing/Info frame) */
+	int           frames_per_point;
+	long long     total_samples;
+	size_t        count;
+	SeekPoint    *points;
+} SeekIndex;
+
+/* Starts the low priority thread building seek indexes in the background.
+ * If 'use_cache' is true, the indexes are stored in the user's data directory.
+ * The thread removes indexes of deleted or modified files on startup, and the
+ * least recently used indexes whenever the cache grows larger than 8 MB. */
+int        seekindex_init(int use_cache);
+void       seekindex_shutdown(void);
+/* Requests a seek index to be built for 'file' in the background, unless
+ * there is a cached index already. Ignored for streams. */
+void       seekindex_request(const char *file);
+/* Loads the cached seek index for 'file'. Returns NULL if there is none yet,
+ * or if the file has been modified since the index has been built. */
+SeekIndex *seekindex_load(const char *file);
+/* Scans 'file' and builds its seek index right away; Returns NULL if the
+ * file is neither an MPEG audio nor an Ogg Vorbis/Opus file */
+SeekIndex *seekindex_build(const char *file);
+/* Finds the last seek point at or before 'sample'. Returns 1 on success. */
+int        seekindex_lookup(const SeekIndex *si, long long sample, SeekPoint *point);
+void       seekindex_free(SeekIndex *si);
+#endif
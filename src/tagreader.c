@@ -0,0 +1,529 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: tagreader.c  Created: 210814
+ *
+ * Description: Lightweight native tag readers (Vorbis comments,
+ *              FLAC metadata blocks, APEv2 and MP4 atoms)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "trackinfo.h"
+#include "charset.h"
+#include "debug.h"
+#include "id3.h"
+#include "tagreader.h"
+
+/* The header region read in one go, which holds the tags of most files */
+#define TAGREADER_HEAD_SIZE 65536
+/* Upper limit for a second read, when the tags do not fit into the header region */
+#define TAGREADER_MAX_SIZE  262144
+
+typedef enum { TAG_TYPE_NONE, TAG_TYPE_OGG, TAG_TYPE_FLAC, TAG_TYPE_APE, TAG_TYPE_MP4 } TagType;
+
+typedef enum { OGG_CODEC_UNKNOWN, OGG_CODEC_VORBIS, OGG_CODEC_OPUS, OGG_CODEC_SPEEX, OGG_CODEC_FLAC } OggCodec;
+
+static const struct {
+	const char *extension;
+	TagType     type;
+} tag_types[] = {
+	{ "ogg",  TAG_TYPE_OGG },
+	{ "oga",  TAG_TYPE_OGG },
+	{ "opus", TAG_TYPE_OGG },
+	{ "spx",  TAG_TYPE_OGG },
+	{ "flac", TAG_TYPE_FLAC },
+	{ "mpc",  TAG_TYPE_APE },
+	{ "mp+",  TAG_TYPE_APE },
+	{ "wv",   TAG_TYPE_APE },
+	{ "ape",  TAG_TYPE_APE },
+	{ "m4a",  TAG_TYPE_MP4 },
+	{ "m4b",  TAG_TYPE_MP4 },
+	{ "mp4",  TAG_TYPE_MP4 },
+	{ NULL,   TAG_TYPE_NONE }
+};
+
+static TagType get_tag_type(const char *file_type)
+{
+	TagType type = TAG_TYPE_NONE;
+
+	if (file_type) {
+		int i;
+
+		if (file_type[0] == '.') file_type++;
+		for (i = 0; tag_types[i].extension; i++) {
+			if (strcasecmp(file_type, tag_types[i].extension) == 0) {
+				type = tag_types[i].type;
+				break;
+			}
+		}
+	}
+	return type;
+}
+
+static unsigned long get_le32(const unsigned char *b)
+{
+	return (unsigned long)b[0] | ((unsigned long)b[1] << 8) |
+	       ((unsigned long)b[2] << 16) | ((unsigned long)b[3] << 24);
+}
+
+static unsigned long get_be32(const unsigned char *b)
+{
+	return (unsigned long)b[3] | ((unsigned long)b[2] << 8) |
+	       ((unsigned long)b[1] << 16) | ((unsigned long)b[0] << 24);
+}
+
+static size_t read_at(FILE *file, long offset, unsigned char *buf, size_t size)
+{
+	size_t res = 0;
+	if (offset >= 0 && fseek(file, offset, SEEK_SET) == 0)
+		res = fread(buf, 1, size, file);
+	return res;
+}
+
+static long get_file_size(FILE *file)
+{
+	long size = -1;
+	if (fseek(file, 0, SEEK_END) == 0)
+		size = ftell(file);
+	return size;
+}
+
+/* Copies a (not null-terminated) tag value, truncating it on a UTF-8
+ * character boundary. Values that are not valid UTF-8 are treated as
+ * ISO-8859-1. The first occurrence of a field wins. */
+static void set_field(char *target, size_t size, const char *value, size_t len)
+{
+	char tmp[256];
+
+	if (target[0] != '\0' || size > sizeof(tmp)) return;
+	if (len > size-1) {
+		len = size-1;
+		while (len > 0 && ((unsigned char)value[len] & 0xC0) == 0x80) len--;
+	}
+	memcpy(tmp, value, len);
+	tmp[len] = '\0';
+	if (charset_is_valid_utf8_string(tmp))
+		memcpy(target, tmp, len+1);
+	else
+		charset_iso8859_1_to_utf8(target, tmp, size-1);
+}
+
+static int key_is(const char *key, size_t key_len, const char *name)
+{
+	return key_len == strlen(name) && strncasecmp(key, name, key_len) == 0;
+}
+
+/* Stores a key/value pair; Vorbis comments and APEv2 items share most field names */
+static void set_tag_item(TrackInfo *ti, const char *key, size_t key_len, const char *value, size_t len)
+{
+	if (key_is(key, key_len, "TITLE"))
+		set_field(ti->title, SIZE_TITLE, value, len);
+	else if (key_is(key, key_len, "ARTIST"))
+		set_field(ti->artist, SIZE_ARTIST, value, len);
+	else if (key_is(key, key_len, "ALBUM"))
+		set_field(ti->album, SIZE_ALBUM, value, len);
+	else if (key_is(key, key_len, "TRACKNUMBER") || key_is(key, key_len, "TRACK"))
+		set_field(ti->tracknr, SIZE_TRACKNR, value, len);
+	else if (key_is(key, key_len, "DATE") || key_is(key, key_len, "YEAR"))
+		set_field(ti->date, SIZE_DATE, value, len);
+	else if (key_is(key, key_len, "COMMENT") || key_is(key, key_len, "DESCRIPTION"))
+		set_field(ti->comment, SIZE_COMMENT, value, len);
+}
+
+/* Parses a Vorbis comment block (without framing bit). A truncated
+ * block is parsed up to the last complete comment. */
+static int parse_vorbis_comment(const unsigned char *buf, size_t len, TrackInfo *ti)
+{
+	unsigned long vendor_len, count, i;
+	size_t        pos;
+
+	if (len < 8) return 0;
+	vendor_len = get_le32(buf);
+	if (vendor_len > len - 8) return 0;
+	pos = 4 + vendor_len;
+	count = get_le32(buf + pos);
+	pos += 4;
+	for (i = 0; i < count && len - pos >= 4; i++) {
+		unsigned long comment_len = get_le32(buf + pos);
+		const char   *comment = (const char *)buf + pos + 4;
+		const char   *sep;
+
+		pos += 4;
+		if (comment_len > len - pos) break;
+		sep = memchr(comment, '=', comment_len);
+		if (sep)
+			set_tag_item(ti, comment, sep - comment, sep + 1, comment_len - (sep - comment) - 1);
+		pos += comment_len;
+	}
+	return 1;
+}
+
+/*
+ * Assembles packet number 'index' of the first logical stream found in
+ * the Ogg pages in 'buf'. Returns the packet's length (0 if not found) and
+ * sets 'complete' to 1 if the whole packet was found in 'buf'.
+ */
+static size_t ogg_get_packet(const unsigned char *buf, size_t len, int index,
+                             unsigned char *packet, size_t packet_size, int *complete)
+{
+	size_t        pos = 0, packet_len = 0;
+	unsigned long serial = 0;
+	int           n = 0, first_page = 1;
+
+	*complete = 0;
+	while (len - pos >= 27 && memcmp(buf + pos, "OggS", 4) == 0) {
+		int    segments = buf[pos+26], i;
+		size_t data = pos + 27 + segments;
+		int    other_stream;
+
+		if (data > len) break;
+		if (first_page) serial = get_le32(buf + pos + 14);
+		other_stream = !first_page && get_le32(buf + pos + 14) != serial;
+		first_page = 0;
+		for (i = 0; i < segments; i++) {
+			size_t seg_len = buf[pos+27+i];
+
+			if (!other_stream) {
+				if (n == index && data < len) {
+					size_t avail = seg_len < len - data ? seg_len : len - data;
+					if (avail > packet_size - packet_len) avail = packet_size - packet_len;
+					memcpy(packet + packet_len, buf + data, avail);
+					packet_len += avail;
+				}
+				if (seg_len < 255) {
+					if (n == index) {
+						*complete = data + seg_len <= len;
+						return packet_len;
+					}
+					n++;
+				}
+			}
+			data += seg_len;
+		}
+		if (data >= len) break;
+		pos = data;
+	}
+	return packet_len;
+}
+
+static int tagreader_read_ogg(FILE *file, unsigned char *buf, size_t len, TrackInfo *ti)
+{
+	unsigned char *packet = malloc(TAGREADER_MAX_SIZE);
+	int            result = 0;
+
+	if (packet) {
+		OggCodec codec = OGG_CODEC_UNKNOWN;
+		size_t   packet_len;
+		int      complete, index;
+
+		packet_len = ogg_get_packet(buf, len, 0, packet, TAGREADER_MAX_SIZE, &complete);
+		if (packet_len >= 7 && memcmp(packet, "\001vorbis", 7) == 0)
+			codec = OGG_CODEC_VORBIS;
+		else if (packet_len >= 8 && memcmp(packet, "OpusHead", 8) == 0)
+			codec = OGG_CODEC_OPUS;
+		else if (packet_len >= 8 && memcmp(packet, "Speex   ", 8) == 0)
+			codec = OGG_CODEC_SPEEX;
+		else if (packet_len >= 5 && memcmp(packet, "\177FLAC", 5) == 0)
+			codec = OGG_CODEC_FLAC;
+
+		/* Vorbis, Opus and Speex store the comments in the second packet,
+		 * Ogg FLAC has one metadata block per header packet. */
+		for (index = 1; codec != OGG_CODEC_UNKNOWN && index < 16; index++) {
+			packet_len = ogg_get_packet(buf, len, index, packet, TAGREADER_MAX_SIZE, &complete);
+			if (!complete && len == TAGREADER_HEAD_SIZE) {
+				/* The comment packet (probably containing cover art) is larger than the header region */
+				len = read_at(file, 0, buf, TAGREADER_MAX_SIZE);
+				packet_len = ogg_get_packet(buf, len, index, packet, TAGREADER_MAX_SIZE, &complete);
+			}
+			if (packet_len == 0) break;
+			switch (codec) {
+				case OGG_CODEC_VORBIS:
+					if (packet_len >= 7 && memcmp(packet, "\003vorbis", 7) == 0)
+						result = parse_vorbis_comment(packet + 7, packet_len - 7, ti);
+					break;
+				case OGG_CODEC_OPUS:
+					if (packet_len >= 8 && memcmp(packet, "OpusTags", 8) == 0)
+						result = parse_vorbis_comment(packet + 8, packet_len - 8, ti);
+					break;
+				case OGG_CODEC_SPEEX:
+					result = parse_vorbis_comment(packet, packet_len, ti);
+					break;
+				case OGG_CODEC_FLAC:
+					if ((packet[0] & 0x7F) == 4 && packet_len >= 4)
+						result = parse_vorbis_comment(packet + 4, packet_len - 4, ti);
+					else if (!(packet[0] & 0x80))
+						continue;
+					break;
+				default:
+					break;
+			}
+			break;
+		}
+		/* A valid stream without any comments is fine, too */
+		if (codec != OGG_CODEC_UNKNOWN) result = 1;
+		free(packet);
+	}
+	return result;
+}
+
+static int tagreader_read_flac(FILE *file, unsigned char *buf, size_t len, TrackInfo *ti)
+{
+	long   base = 0; /* File offset of buf[0] */
+	size_t pos = 4;
+	int    last = 0;
+
+	/* Skip a (non-standard) ID3v2 tag in front of the FLAC stream */
+	if (len >= 10 && memcmp(buf, "ID3", 3) == 0) {
+		base = ((buf[6] & 0x7F) << 21) | ((buf[7] & 0x7F) << 14) | ((buf[8] & 0x7F) << 7) | (buf[9] & 0x7F);
+		base += (buf[5] & 0x10) ? 20 : 10;
+		len = read_at(file, base, buf, TAGREADER_HEAD_SIZE);
+	}
+	if (len < 4 || memcmp(buf, "fLaC", 4) != 0) return 0;
+
+	while (!last && len - pos >= 4) {
+		int    type = buf[pos] & 0x7F;
+		size_t size = ((size_t)buf[pos+1] << 16) | ((size_t)buf[pos+2] << 8) | buf[pos+3];
+
+		last = buf[pos] & 0x80;
+		pos += 4;
+		if (type == 4) { /* VORBIS_COMMENT */
+			if (size > len - pos) {
+				len = read_at(file, base + (long)pos, buf, size < TAGREADER_MAX_SIZE ? size : TAGREADER_MAX_SIZE);
+				pos = 0;
+				size = len;
+			}
+			parse_vorbis_comment(buf + pos, size, ti);
+			break;
+		}
+		if (size > len - pos) {
+			/* Skip a block that exceeds the header region (e.g. a large PICTURE) */
+			base += (long)(pos + size);
+			len = read_at(file, base, buf, TAGREADER_HEAD_SIZE);
+			pos = 0;
+		} else {
+			pos += size;
+		}
+	}
+	return 1;
+}
+
+static int tagreader_read_ape(FILE *file, unsigned char *buf, TrackInfo *ti, const char *file_type)
+{
+	long   file_size = get_file_size(file);
+	long   tail_offset;
+	size_t len, footer = 0;
+	int    found = 0, result = 0;
+
+	if (file_size < 32) return 0;
+	/* The APEv2 footer is located at the end of the file, optionally followed by an ID3v1 tag */
+	tail_offset = file_size < 160 ? 0 : file_size - 160;
+	len = read_at(file, tail_offset, buf, 160);
+	if (len >= 32 && memcmp(buf + len - 32, "APETAGEX", 8) == 0) {
+		footer = len - 32;
+		found = 1;
+	} else if (len == 160 && memcmp(buf + 32, "TAG", 3) == 0 && memcmp(buf, "APETAGEX", 8) == 0) {
+		footer = 0;
+		found = 1;
+	}
+	if (found) {
+		unsigned long tag_size = get_le32(buf + footer + 12); /* Items and footer */
+		unsigned long count    = get_le32(buf + footer + 16);
+		long          items_offset = tail_offset + (long)footer - (long)(tag_size - 32);
+
+		if (tag_size >= 32 && items_offset >= 0) {
+			size_t pos = 0, items_size = tag_size - 32;
+			unsigned long i;
+
+			if (items_size > TAGREADER_MAX_SIZE) items_size = TAGREADER_MAX_SIZE;
+			len = read_at(file, items_offset, buf, items_size);
+			for (i = 0; i < count && len - pos >= 8; i++) {
+				unsigned long value_size = get_le32(buf + pos);
+				unsigned long flags      = get_le32(buf + pos + 4);
+				const char   *key = (const char *)buf + pos + 8;
+				const char   *key_end;
+
+				pos += 8;
+				key_end = memchr(key, '\0', len - pos);
+				if (!key_end) break;
+				pos += key_end - key + 1;
+				if (value_size > len - pos) break;
+				if (((flags >> 1) & 3) == 0) /* UTF-8 text item */
+					set_tag_item(ti, key, key_end - key, (const char *)buf + pos, value_size);
+				pos += value_size;
+			}
+			result = 1;
+		}
+	} else {
+		result = id3_read_id3v1(file, ti, file_type);
+	}
+	return result;
+}
+
+/*
+ * Searches the atoms between file offsets 'offset' and 'end' for an atom of
+ * type 'type'. Atom headers found in 'buf' (the first 'len' bytes of the
+ * file) are taken from there, others are read from the file.
+ */
+static int mp4_locate_atom(FILE *file, const unsigned char *buf, size_t len, long offset, long end,
+                           const char *type, long *payload_offset, long *payload_size)
+{
+	unsigned char header[16];
+
+	while (end - offset >= 8) {
+		const unsigned char *h = header;
+		unsigned long long   size;
+		size_t               avail = 16;
+		int                  header_len = 8;
+
+		if ((size_t)offset + 16 <= len)
+			h = buf + offset;
+		else if ((avail = read_at(file, offset, header, 16)) < 8)
+			break;
+		size = get_be32(h);
+		if (size == 1) {
+			if (avail < 16) break;
+			size = ((unsigned long long)get_be32(h + 8) << 32) | get_be32(h + 12);
+			header_len = 16;
+		} else if (size == 0) {
+			size = end - offset;
+		}
+		if (size < (unsigned long long)header_len || size > (unsigned long long)(end - offset)) break;
+		if (memcmp(h + 4, type, 4) == 0) {
+			*payload_offset = offset + header_len;
+			*payload_size   = (long)size - header_len;
+			return 1;
+		}
+		offset += (long)size;
+	}
+	return 0;
+}
+
+/* Finds a child atom in a memory buffer; the returned size is clamped to the buffer */
+static const unsigned char *mp4_find_atom(const unsigned char *buf, size_t len, const char *type, size_t *size)
+{
+	size_t pos = 0;
+
+	while (len - pos >= 8) {
+		size_t atom_size = get_be32(buf + pos);
+
+		if (atom_size == 0) atom_size = len - pos;
+		if (atom_size < 8) break;
+		if (memcmp(buf + pos + 4, type, 4) == 0) {
+			*size = atom_size - 8 < len - pos - 8 ? atom_size - 8 : len - pos - 8;
+			return buf + pos + 8;
+		}
+		if (atom_size > len - pos) break;
+		pos += atom_size;
+	}
+	return NULL;
+}
+
+static void mp4_parse_ilst(const unsigned char *ilst, size_t len, TrackInfo *ti)
+{
+	size_t pos = 0;
+
+	while (len - pos >= 8) {
+		size_t               item_size = get_be32(ilst + pos), data_size;
+		const unsigned char *data;
+
+		if (item_size < 8 || item_size > len - pos) break;
+		data = mp4_find_atom(ilst + pos + 8, item_size - 8, "data", &data_size);
+		if (data && data_size >= 8) {
+			const unsigned char *type  = ilst + pos + 4;
+			const char          *value = (const char *)data + 8; /* Skip type and locale */
+			size_t               value_len = data_size - 8;
+
+			if (memcmp(type, "\251nam", 4) == 0)
+				set_field(ti->title, SIZE_TITLE, value, value_len);
+			else if (memcmp(type, "\251ART", 4) == 0)
+				set_field(ti->artist, SIZE_ARTIST, value, value_len);
+			else if (memcmp(type, "\251alb", 4) == 0)
+				set_field(ti->album, SIZE_ALBUM, value, value_len);
+			else if (memcmp(type, "\251day", 4) == 0)
+				set_field(ti->date, SIZE_DATE, value, value_len);
+			else if (memcmp(type, "\251cmt", 4) == 0)
+				set_field(ti->comment, SIZE_COMMENT, value, value_len);
+			else if (memcmp(type, "trkn", 4) == 0 && value_len >= 4 && ti->tracknr[0] == '\0')
+				snprintf(ti->tracknr, SIZE_TRACKNR-1, "%d", (data[10] << 8) | data[11]);
+		}
+		pos += item_size;
+	}
+}
+
+static int tagreader_read_mp4(FILE *file, unsigned char *buf, size_t len, TrackInfo *ti)
+{
+	long file_size = get_file_size(file);
+	long moov_offset, moov_size, udta_offset, udta_size;
+	int  result = 0;
+
+	if (len < 8 || memcmp(buf + 4, "ftyp", 4) != 0 || file_size <= 0) return 0;
+	/* The moov atom is either in the header region or behind the mdat atom */
+	if (mp4_locate_atom(file, buf, len, 0, file_size, "moov", &moov_offset, &moov_size)) {
+		result = 1;
+		if (mp4_locate_atom(file, buf, len, moov_offset, moov_offset + moov_size, "udta", &udta_offset, &udta_size)) {
+			const unsigned char *udta = buf, *meta, *ilst;
+			size_t               size = udta_size, meta_size;
+
+			if ((size_t)(udta_offset + udta_size) <= len)
+				udta = buf + udta_offset;
+			else
+				size = read_at(file, udta_offset, buf, udta_size < TAGREADER_MAX_SIZE ? udta_size : TAGREADER_MAX_SIZE);
+			meta = mp4_find_atom(udta, size, "meta", &meta_size);
+			if (meta && meta_size > 4) { /* meta is a full atom with version and flags */
+				ilst = mp4_find_atom(meta + 4, meta_size - 4, "ilst", &size);
+				if (ilst) mp4_parse_ilst(ilst, size, ti);
+			}
+		}
+	}
+	return result;
+}
+
+int tagreader_read(const char *file, const char *file_type, TrackInfo *ti)
+{
+	TagType type = get_tag_type(file_type);
+	int     result = 0;
+
+	if (type != TAG_TYPE_NONE) {
+		FILE          *f = fopen(file, "rb");
+		unsigned char *buf = f ? malloc(TAGREADER_MAX_SIZE) : NULL;
+
+		if (buf) {
+			size_t len = type != TAG_TYPE_APE ? read_at(f, 0, buf, TAGREADER_HEAD_SIZE) : 0;
+
+			trackinfo_clear(ti);
+			switch (type) {
+				case TAG_TYPE_OGG:
+					result = tagreader_read_ogg(f, buf, len, ti);
+					break;
+				case TAG_TYPE_FLAC:
+					result = tagreader_read_flac(f, buf, len, ti);
+					break;
+				case TAG_TYPE_APE:
+					result = tagreader_read_ape(f, buf, ti, file_type);
+					break;
+				case TAG_TYPE_MP4:
+					result = tagreader_read_mp4(f, buf, len, ti);
+					break;
+				default:
+					break;
+			}
+			if (result)
+				trackinfo_set_updated(ti);
+			else
+				wdprintf(V_DEBUG, "tagreader", "No usable tags found in %s.\n", file);
+		}
+		free(buf);
+		if (f) fclose(f);
+	}
+	return result;
+}
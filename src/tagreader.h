@@ -0,0 +1,26 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: tagreader.h  Created: 210814
+ *
+ * Description: Lightweight native tag readers (Vorbis comments,
+ *              FLAC metadata blocks, APEv2 and MP4 atoms)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#ifndef _TAGREADER_H
+#define _TAGREADER_H
+#include "trackinfo.h"
+
+/* Reads the tags of 'file' into 'ti' by parsing only the header (or footer)
+ * region of the file, without initializing a decoder. Returns 1 on success,
+ * 0 if the file type is unknown or the file could not be parsed, in which
+ * case the caller should fall back to the decoder's meta data reader. */
+int tagreader_read(const char *file, const char *file_type, TrackInfo *ti);
+#endif
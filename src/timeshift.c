@@ -0,0 +1,153 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: timeshift.c  Created: 210718
+ *
+ * Description: Disk-backed segment cache for live streams
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "timeshift.h"
+#include "debug.h"
+
+int timeshift_init(Timeshift *ts, const char *dir, size_t window_size)
+{
+	int i, res = 1;
+
+	/* One segment more than needed for the window, as it is being written to */
+	ts->num_segments = (window_size + TIMESHIFT_SEGMENT_SIZE - 1) / TIMESHIFT_SEGMENT_SIZE + 1;
+	ts->end = 0;
+	ts->fds = malloc(ts->num_segments * sizeof(int));
+	/* Enough marks to cover all segments, unless they are less than 1 kB apart */
+	ts->marks_size = ts->num_segments * (TIMESHIFT_SEGMENT_SIZE / 1024);
+	ts->marks_first = 0;
+	ts->marks_count = 0;
+	ts->marks = malloc(ts->marks_size * sizeof(unsigned long));
+	if (!ts->fds || !ts->marks) {
+		res = 0;
+		ts->num_segments = 0;
+	}
+	for (i = 0; i < ts->num_segments; i++) {
+		char filename[256];
+
+		snprintf(filename, sizeof(filename), "%s/gmu-timeshift-XXXXXX", dir);
+		ts->fds[i] = res ? mkstemp(filename) : -1;
+		if (ts->fds[i] >= 0) {
+			unlink(filename);
+		} else if (res) {
+			wdprintf(V_ERROR, "timeshift", "Unable to create segment file in %s: %s\n", dir, strerror(errno));
+			res = 0;
+		}
+	}
+	if (res)
+		wdprintf(V_INFO, "timeshift", "Timeshift cache: %d segments of %d kB in %s\n",
+		         ts->num_segments, TIMESHIFT_SEGMENT_SIZE / 1024, dir);
+	else
+		timeshift_free(ts);
+	return res;
+}
+
+void timeshift_free(Timeshift *ts)
+{
+	int i;
+
+	for (i = 0; i < ts->num_segments; i++)
+		if (ts->fds[i] >= 0) close(ts->fds[i]);
+	if (ts->fds) free(ts->fds);
+	if (ts->marks) free(ts->marks);
+	ts->fds = NULL;
+	ts->marks = NULL;
+	ts->num_segments = 0;
+}
+
+int timeshift_write(Timeshift *ts, const char *data, size_t size)
+{
+	int res = 1;
+
+	while (res && size > 0) {
+		unsigned long seg = ts->end / TIMESHIFT_SEGMENT_SIZE;
+		size_t        offset = ts->end % TIMESHIFT_SEGMENT_SIZE;
+		size_t        len = TIMESHIFT_SEGMENT_SIZE - offset;
+		ssize_t       n;
+
+		if (len > size) len = size;
+		n = pwrite(ts->fds[seg % ts->num_segments], data, len, offset);
+		if (n > 0) {
+			ts->end += n;
+			data += n;
+			size -= n;
+		} else if (n < 0 && errno != EINTR) {
+			wdprintf(V_ERROR, "timeshift", "Write error: %s\n", strerror(errno));
+			res = 0;
+		}
+	}
+	return res;
+}
+
+unsigned long timeshift_get_start(Timeshift *ts)
+{
+	unsigned long seg = ts->end / TIMESHIFT_SEGMENT_SIZE;
+	/* The current segment and the ones before it, as long as they have not been recycled */
+	return seg >= (unsigned long)ts->num_segments - 1 ?
+	       (seg - (ts->num_segments - 1)) * TIMESHIFT_SEGMENT_SIZE : 0;
+}
+
+unsigned long timeshift_get_end(Timeshift *ts)
+{
+	return ts->end;
+}
+
+size_t timeshift_read(Timeshift *ts, unsigned long pos, char *target, size_t size)
+{
+	size_t res = 0;
+
+	if (pos < timeshift_get_start(ts)) return 0;
+	if (pos + size > ts->end) size = pos < ts->end ? ts->end - pos : 0;
+	while (res < size) {
+		unsigned long seg = (pos + res) / TIMESHIFT_SEGMENT_SIZE;
+		size_t        offset = (pos + res) % TIMESHIFT_SEGMENT_SIZE;
+		size_t        len = TIMESHIFT_SEGMENT_SIZE - offset;
+		ssize_t       n;
+
+		if (len > size - res) len = size - res;
+		n = pread(ts->fds[seg % ts->num_segments], target + res, len, offset);
+		if (n > 0) {
+			res += n;
+		} else if (n == 0 || errno != EINTR) {
+			wdprintf(V_ERROR, "timeshift", "Read error: %s\n", n == 0 ? "Unexpected end of file" : strerror(errno));
+			break;
+		}
+	}
+	return res;
+}
+
+void timeshift_add_mark(Timeshift *ts, unsigned long pos)
+{
+	if (ts->marks_count == ts->marks_size) {
+		ts->marks_first = (ts->marks_first + 1) % ts->marks_size;
+		ts->marks_count--;
+	}
+	ts->marks[(ts->marks_first + ts->marks_count) % ts->marks_size] = pos;
+	ts->marks_count++;
+}
+
+size_t timeshift_get_mark_count(Timeshift *ts)
+{
+	return ts->marks_count;
+}
+
+unsigned long timeshift_get_mark(Timeshift *ts, size_t n)
+{
+	return ts->marks[(ts->marks_first + n) % ts->marks_size];
+}
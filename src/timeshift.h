@@ -0,0 +1,52 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: timeshift.h  Created: 210718
+ *
+ * Description: Disk-backed segment cache for live streams
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#ifndef _TIMESHIFT_H
+#define _TIMESHIFT_H
+#include <stddef.h>
+
+#define TIMESHIFT_SEGMENT_SIZE (1024 * 1024)
+
+/*
+ * The cache consists of a fixed number of segment files. Data is always
+ * appended; once all segments are in use, the oldest segment is recycled.
+ * Positions are absolute stream positions. Besides the data, a list of
+ * marks (stream positions of interest, e.g. metadata blocks) is kept.
+ */
+typedef struct {
+	int           *fds;
+	int            num_segments;
+	unsigned long  end; /* Stream position of the next byte to be written */
+	unsigned long *marks;
+	size_t         marks_size, marks_first, marks_count;
+} Timeshift;
+
+/* Creates the segment files in 'dir'. The cache holds at least 'window_size'
+ * bytes. The files are removed right away, so nothing is left behind, even if
+ * Gmu is not shut down properly. Returns 1 on success, 0 otherwise. */
+int           timeshift_init(Timeshift *ts, const char *dir, size_t window_size);
+void          timeshift_free(Timeshift *ts);
+/* Appends data, recycling the oldest segment(s) if necessary */
+int           timeshift_write(Timeshift *ts, const char *data, size_t size);
+/* Reads up to 'size' bytes from stream position 'pos', returns the number of bytes read */
+size_t        timeshift_read(Timeshift *ts, unsigned long pos, char *target, size_t size);
+/* Stream position of the oldest byte available */
+unsigned long timeshift_get_start(Timeshift *ts);
+unsigned long timeshift_get_end(Timeshift *ts);
+/* Marks are kept in ascending order; when the list is full, the oldest mark is dropped */
+void          timeshift_add_mark(Timeshift *ts, unsigned long pos);
+size_t        timeshift_get_mark_count(Timeshift *ts);
+unsigned long timeshift_get_mark(Timeshift *ts, size_t n);
+#endif
@@ -0,0 +1,681 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: gmuanalyze.c  Created: 210918
+ *
+ * Description: Background analysis of the medialib's tracks
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sqlite3.h>
+#include "../core.h" /* for VERSION_NUMBER */
+#include "../gmudecoder.h"
+#include "../decloader.h"
+#include "../reader.h"
+#include "../pcmconv.h"
+#include "../audiofeatures.h"
+#include "../loudness.h"
+#include "../util.h"
+#include "../debug.h"
+
+#define ANALYZE_BUF_SIZE     65536
+/* Only the beginning of each track is used for the acoustic features */
+#define ANALYZE_MAX_SECONDS  120.0
+/* Number of similar tracks stored per track */
+#define ANALYZE_NEIGHBOURS   20
+/* Upper limit for the number of neighbour candidates compared per track */
+#define ANALYZE_MAX_CANDIDATES 5000
+/* Database schema version with the track_features and track_loudness tables */
+#define ANALYZE_SCHEMA_VERSION 4
+#define ANALYZE_MAX_JOBS     16
+
+/* Analysis stages */
+#define STAGE_FEATURES 1
+#define STAGE_LOUDNESS 2
+
+typedef struct WorkItem {
+	int    id;
+	int    stages; /* Stages still to be done for the track */
+	time_t mtime;  /* Of the file, or the one of the stored loudness until the file is checked */
+	int    has_loudness;
+	char  *file;
+} WorkItem;
+
+typedef struct Neighbour {
+	int   id;
+	float distance;
+} Neighbour;
+
+typedef struct Results {
+	int       stages_ok;
+	float     vector[AUDIOFEATURES_DIM];
+	double    bpm;
+	double    loudness, true_peak;
+	/* Looked up before the results are stored */
+	int       hashes[AUDIOFEATURES_LSH_TABLES];
+	Neighbour neighbours[ANALYZE_NEIGHBOURS];
+	int       neighbour_count;
+} Results;
+
+static volatile sig_atomic_t stop;
+static int                   cpu_limit = 100;
+static int                   write_tags, print_progress;
+
+static void sig_handler(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+/* Gmu pauses the analysis with SIGTSTP instead of SIGSTOP, since that can be
+ * blocked while the database is accessed (see db_access_begin()) */
+static void sig_handler_tstp(int sig)
+{
+	(void)sig;
+	raise(SIGSTOP);
+}
+
+/* A process paused in the middle of a transaction would keep the database
+ * locked for Gmu, so pausing is deferred until db_access_end() */
+static void db_access_begin(void)
+{
+	sigset_t set;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGTSTP);
+	sigprocmask(SIG_BLOCK, &set, NULL);
+}
+
+static void db_access_end(void)
+{
+	sigset_t set;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGTSTP);
+	sigprocmask(SIG_UNBLOCK, &set, NULL);
+}
+
+static double get_time(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* Runs the analysis with the lowest CPU and I/O priority available, so it
+ * only uses resources nobody else needs */
+static void lower_priority(void)
+{
+#ifdef SCHED_IDLE
+	struct sched_param sp;
+
+	memset(&sp, 0, sizeof(sp));
+	if (sched_setscheduler(0, SCHED_IDLE, &sp) != 0)
+#endif
+		if (setpriority(PRIO_PROCESS, 0, 19) != 0)
+			wdprintf(V_WARNING, "gmuanalyze", "Unable to lower the CPU priority.\n");
+#ifdef SYS_ioprio_set
+	/* IOPRIO_WHO_PROCESS, IOPRIO_CLASS_IDLE */
+	if (syscall(SYS_ioprio_set, 1, 0, 3 << 13) != 0)
+		wdprintf(V_DEBUG, "gmuanalyze", "Unable to lower the I/O priority.\n");
+#endif
+}
+
+/* Sleeps as long as needed to keep the CPU usage since 'wall_start' and
+ * 'cpu_start' below the CPU limit */
+static void throttle(double wall_start, double cpu_start)
+{
+	if (cpu_limit < 100) {
+		double cpu = get_time(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+		double wall = get_time(CLOCK_MONOTONIC) - wall_start;
+		double wait = cpu * 100.0 / cpu_limit - wall;
+		if (wait > 0.001) {
+			struct timespec ts;
+			ts.tv_sec  = (time_t)wait;
+			ts.tv_nsec = (long)((wait - ts.tv_sec) * 1000000000.0);
+			nanosleep(&ts, NULL);
+		}
+	}
+}
+
+/* Decodes the file for the requested stages (the features only need the
+ * beginning of it). Returns 1 when done (r->stages_ok tells which stages
+ * were successful) and -1 if interrupted. */
+static int analyze_file(const char *file, int stages, Results *r)
+{
+	static char    buf[ANALYZE_BUF_SIZE];
+	Reader        *reader;
+	GmuDecoder    *gd;
+	AudioFeatures *af = NULL;
+	Loudness      *l = NULL;
+	double         wall_start = get_time(CLOCK_MONOTONIC);
+	double         cpu_start = get_time(CLOCK_PROCESS_CPUTIME_ID);
+	int            res = 1, ret = 1;
+
+	r->stages_ok = 0;
+	if (!(gd = decloader_get_decoder_for_file(file, &reader))) {
+		wdprintf(V_INFO, "gmuanalyze", "No decoder for %s\n", file);
+		return 1;
+	}
+	if (gd->set_reader_handle) (*gd->set_reader_handle)(reader);
+	if ((!gd->set_reader_handle || reader) && (*gd->open_file)(file)) {
+		int samplerate = gd->get_samplerate ? (*gd->get_samplerate)() : 44100;
+		int channels   = gd->get_channels ? (*gd->get_channels)() : 2;
+
+		if (stages & STAGE_FEATURES) af = audiofeatures_new(samplerate, channels);
+		if (stages & STAGE_LOUDNESS) l = loudness_new(samplerate, channels);
+		while ((l || (af && audiofeatures_get_seconds(af) < ANALYZE_MAX_SECONDS)) && ret > 0 && !stop) {
+			const char *data = buf;
+			if (gd->decode_data_direct)
+				ret = (*gd->decode_data_direct)(&data, ANALYZE_BUF_SIZE);
+			else
+				ret = (*gd->decode_data)(buf, ANALYZE_BUF_SIZE);
+			if (ret > 0) {
+				size_t frames = ret / (2 * channels);
+				if (af && audiofeatures_get_seconds(af) < ANALYZE_MAX_SECONDS)
+					audiofeatures_add_samples(af, (const int16_t *)data, frames);
+				if (l) loudness_add_samples(l, (const int16_t *)data, frames);
+			}
+			throttle(wall_start, cpu_start);
+		}
+		(*gd->close_file)();
+		if (stop) {
+			res = -1;
+		} else {
+			if (af && audiofeatures_compute(af, r->vector, &r->bpm))
+				r->stages_ok |= STAGE_FEATURES;
+			if (l && loudness_compute(l, &r->loudness, &r->true_peak))
+				r->stages_ok |= STAGE_LOUDNESS;
+		}
+		audiofeatures_free(af);
+		loudness_free(l);
+	} else {
+		wdprintf(V_INFO, "gmuanalyze", "Cannot open %s\n", file);
+	}
+	if (reader) reader_close(reader);
+	if (gd->set_reader_handle) (*gd->set_reader_handle)(NULL);
+	return res;
+}
+
+/* Inserts the candidate into the list of the closest neighbours (sorted by distance) */
+static void neighbours_add(Neighbour *n, int *count, int id, float distance)
+{
+	int i;
+
+	if (*count == ANALYZE_NEIGHBOURS && distance >= n[*count - 1].distance) return;
+	if (*count < ANALYZE_NEIGHBOURS) (*count)++;
+	for (i = *count - 1; i > 0 && n[i - 1].distance > distance; i--)
+		n[i] = n[i - 1];
+	n[i].id = id;
+	n[i].distance = distance;
+}
+
+static int exec_int(sqlite3 *db, const char *q, int a, int b, int c)
+{
+	sqlite3_stmt *pp_stmt = NULL;
+	int           res = sqlite3_prepare_v2(db, q, -1, &pp_stmt, NULL) == SQLITE_OK;
+
+	if (res && sqlite3_bind_parameter_count(pp_stmt) >= 1) res = sqlite3_bind_int(pp_stmt, 1, a) == SQLITE_OK;
+	if (res && sqlite3_bind_parameter_count(pp_stmt) >= 2) res = sqlite3_bind_int(pp_stmt, 2, b) == SQLITE_OK;
+	if (res && sqlite3_bind_parameter_count(pp_stmt) >= 3) res = sqlite3_bind_int(pp_stmt, 3, c) == SQLITE_OK;
+	if (res) res = sqlite3_step(pp_stmt) == SQLITE_DONE;
+	sqlite3_finalize(pp_stmt);
+	return res;
+}
+
+/* Finds the closest neighbours of the track. As long as there are few
+ * analyzed tracks, all of them are compared, otherwise only those sharing
+ * at least one of the LSH hashes. Only reads from the database, so it is
+ * done before the write transaction is started. */
+static int find_neighbours(sqlite3 *db, int id, Results *r)
+{
+	sqlite3_stmt *pp_stmt = NULL;
+	int           i, res, exhaustive = 0;
+	const char   *q_lsh = "SELECT track_id, features FROM track_features " \
+	                      "WHERE (lsh0 = ?1 OR lsh1 = ?2 OR lsh2 = ?3 OR lsh3 = ?4) " \
+	                      "AND track_id != ?5 AND version = ?6 AND features IS NOT NULL LIMIT ?7";
+	const char   *q_all = "SELECT track_id, features FROM track_features " \
+	                      "WHERE track_id != ?5 AND version = ?6 AND features IS NOT NULL LIMIT ?7";
+
+	r->neighbour_count = 0;
+	audiofeatures_lsh(r->vector, r->hashes);
+	res = sqlite3_prepare_v2(db, "SELECT COUNT(*) <= ?1 FROM track_features", -1, &pp_stmt, NULL) == SQLITE_OK &&
+	      sqlite3_bind_int(pp_stmt, 1, ANALYZE_MAX_CANDIDATES) == SQLITE_OK &&
+	      sqlite3_step(pp_stmt) == SQLITE_ROW;
+	if (res) exhaustive = sqlite3_column_int(pp_stmt, 0);
+	sqlite3_finalize(pp_stmt);
+	if (res) res = sqlite3_prepare_v2(db, exhaustive ? q_all : q_lsh, -1, &pp_stmt, NULL) == SQLITE_OK;
+	for (i = 0; res && !exhaustive && i < AUDIOFEATURES_LSH_TABLES; i++)
+		res = sqlite3_bind_int(pp_stmt, i + 1, r->hashes[i]) == SQLITE_OK;
+	if (res) res = sqlite3_bind_int(pp_stmt, 5, id) == SQLITE_OK &&
+	               sqlite3_bind_int(pp_stmt, 6, AUDIOFEATURES_VERSION) == SQLITE_OK &&
+	               sqlite3_bind_int(pp_stmt, 7, ANALYZE_MAX_CANDIDATES) == SQLITE_OK;
+	while (res && sqlite3_step(pp_stmt) == SQLITE_ROW) {
+		const void *blob = sqlite3_column_blob(pp_stmt, 1);
+		float       other[AUDIOFEATURES_DIM];
+		/* The blob is not necessarily aligned */
+		if (blob && sqlite3_column_bytes(pp_stmt, 1) == sizeof(other)) {
+			memcpy(other, blob, sizeof(other));
+			neighbours_add(r->neighbours, &r->neighbour_count, sqlite3_column_int(pp_stmt, 0),
+			               audiofeatures_distance(r->vector, other));
+		}
+	}
+	sqlite3_finalize(pp_stmt);
+	return res;
+}
+
+/* Links the track with its neighbours in the similarity table */
+static int store_similarity(sqlite3 *db, int id, const Neighbour *n, int count)
+{
+	int i, res = exec_int(db, "DELETE FROM similarity WHERE track_id_a = ?1", id, 0, 0);
+
+	for (i = 0; res && i < count; i++) {
+		int sim = audiofeatures_similarity(n[i].distance);
+		res = exec_int(db, "INSERT INTO similarity (track_id_a, track_id_b, similarity) VALUES (?1, ?2, ?3)",
+		               id, n[i].id, sim) &&
+		      exec_int(db, "DELETE FROM similarity WHERE track_id_a = ?1 AND track_id_b = ?2", n[i].id, id, 0) &&
+		      exec_int(db, "INSERT INTO similarity (track_id_a, track_id_b, similarity) VALUES (?1, ?2, ?3)",
+		               n[i].id, id, sim) &&
+		      /* The neighbour keeps only its closest ANALYZE_NEIGHBOURS tracks */
+		      exec_int(db, "DELETE FROM similarity WHERE track_id_a = ?1 AND rowid NOT IN " \
+		                   "(SELECT rowid FROM similarity WHERE track_id_a = ?1 ORDER BY similarity DESC LIMIT ?2)",
+		               n[i].id, ANALYZE_NEIGHBOURS, 0);
+	}
+	return res;
+}
+
+static int store_features(sqlite3 *db, int id, const Results *r)
+{
+	sqlite3_stmt *pp_stmt = NULL;
+	int           i, res, ok = r->stages_ok & STAGE_FEATURES;
+	const char   *q = "INSERT OR REPLACE INTO track_features (track_id, version, features, lsh0, lsh1, lsh2, lsh3) " \
+	                  "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7)";
+
+	res = sqlite3_prepare_v2(db, q, -1, &pp_stmt, NULL) == SQLITE_OK &&
+	      sqlite3_bind_int(pp_stmt, 1, id) == SQLITE_OK &&
+	      sqlite3_bind_int(pp_stmt, 2, AUDIOFEATURES_VERSION) == SQLITE_OK;
+	if (res && ok) {
+		res = sqlite3_bind_blob(pp_stmt, 3, r->vector, AUDIOFEATURES_DIM * sizeof(float), SQLITE_STATIC) == SQLITE_OK;
+		for (i = 0; res && i < AUDIOFEATURES_LSH_TABLES; i++)
+			res = sqlite3_bind_int(pp_stmt, 4 + i, r->hashes[i]) == SQLITE_OK;
+	}
+	if (res) res = sqlite3_step(pp_stmt) == SQLITE_DONE;
+	sqlite3_finalize(pp_stmt);
+	if (res && ok) res = exec_int(db, "UPDATE track SET tempo = ?2 WHERE id = ?1", id, (int)(r->bpm + 0.5), 0);
+	if (res && ok) res = store_similarity(db, id, r->neighbours, r->neighbour_count);
+	return res;
+}
+
+static int store_tag(sqlite3 *db, int id, const char *key, const char *value)
+{
+	sqlite3_stmt *pp_stmt = NULL;
+	int           res;
+
+	res = sqlite3_prepare_v2(db, "INSERT INTO aditional_trackinfo (track_id, key, value) VALUES (?1, ?2, ?3)",
+	                         -1, &pp_stmt, NULL) == SQLITE_OK &&
+	      sqlite3_bind_int(pp_stmt, 1, id) == SQLITE_OK &&
+	      sqlite3_bind_text(pp_stmt, 2, key, -1, SQLITE_STATIC) == SQLITE_OK &&
+	      sqlite3_bind_text(pp_stmt, 3, value, -1, SQLITE_TRANSIENT) == SQLITE_OK &&
+	      sqlite3_step(pp_stmt) == SQLITE_DONE;
+	sqlite3_finalize(pp_stmt);
+	return res;
+}
+
+/* Stores the loudness, and optionally ReplayGain 2.0 compatible tags
+ * (relative to LOUDNESS_REPLAYGAIN_REFERENCE) */
+static int store_loudness(sqlite3 *db, const WorkItem *item, const Results *r)
+{
+	sqlite3_stmt *pp_stmt = NULL;
+	int           res, ok = r->stages_ok & STAGE_LOUDNESS;
+	const char   *q = "INSERT OR REPLACE INTO track_loudness (track_id, mtime, loudness, true_peak) " \
+	                  "VALUES (?1, ?2, ?3, ?4)";
+
+	res = sqlite3_prepare_v2(db, q, -1, &pp_stmt, NULL) == SQLITE_OK &&
+	      sqlite3_bind_int(pp_stmt, 1, item->id) == SQLITE_OK &&
+	      sqlite3_bind_int64(pp_stmt, 2, (sqlite3_int64)item->mtime) == SQLITE_OK;
+	if (res && ok)
+		res = sqlite3_bind_double(pp_stmt, 3, r->loudness) == SQLITE_OK &&
+		      sqlite3_bind_double(pp_stmt, 4, r->true_peak) == SQLITE_OK;
+	if (res) res = sqlite3_step(pp_stmt) == SQLITE_DONE;
+	sqlite3_finalize(pp_stmt);
+	if (res && write_tags) {
+		res = exec_int(db, "DELETE FROM aditional_trackinfo WHERE track_id = ?1 AND " \
+		                   "key IN ('REPLAYGAIN_TRACK_GAIN', 'REPLAYGAIN_TRACK_PEAK')", item->id, 0, 0);
+		if (res && ok) {
+			char gain[32], peak[32];
+			snprintf(gain, sizeof(gain), "%.2f dB", LOUDNESS_REPLAYGAIN_REFERENCE - r->loudness);
+			snprintf(peak, sizeof(peak), "%.6f", pow(10.0, r->true_peak / 20.0));
+			res = store_tag(db, item->id, "REPLAYGAIN_TRACK_GAIN", gain) &&
+			      store_tag(db, item->id, "REPLAYGAIN_TRACK_PEAK", peak);
+		}
+	}
+	return res;
+}
+
+/* Stores the results of a track in a single transaction, so an interrupted
+ * analysis can be resumed with the next run. The transaction only contains
+ * the writes, so Gmu has to wait for the database as briefly as possible. */
+static int store_results(sqlite3 *db, const WorkItem *item, Results *r)
+{
+	int res = 1;
+
+	db_access_begin();
+	if ((item->stages & STAGE_FEATURES) && (r->stages_ok & STAGE_FEATURES))
+		res = find_neighbours(db, item->id, r);
+	if (res) res = sqlite3_exec(db, "BEGIN IMMEDIATE", 0, 0, 0) == SQLITE_OK;
+	if (res && (item->stages & STAGE_FEATURES)) res = store_features(db, item->id, r);
+	if (res && (item->stages & STAGE_LOUDNESS)) res = store_loudness(db, item, r);
+	if (res) {
+		res = sqlite3_exec(db, "COMMIT", 0, 0, 0) == SQLITE_OK;
+	} else {
+		wdprintf(V_ERROR, "gmuanalyze", "ERROR while updating database: %s\n", sqlite3_errmsg(db));
+		sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+	}
+	db_access_end();
+	return res;
+}
+
+/* Collects the tracks that might need to be analyzed: Tracks without
+ * features of the current version, and (when measuring the loudness) all
+ * tracks, since their files have to be checked for modifications. The
+ * files are not accessed here, so the database is read as quickly as
+ * possible (see filter_work_list()). */
+static WorkItem *get_work_list(sqlite3 *db, int stages, int *count)
+{
+	sqlite3_stmt *pp_stmt = NULL;
+	WorkItem     *items = NULL;
+	int           size = 0;
+	const char   *q = "SELECT t.id, t.file, f.track_id IS NOT NULL, l.mtime FROM track t " \
+	                  "LEFT JOIN track_features f ON f.track_id = t.id AND f.version = ?1 " \
+	                  "LEFT JOIN track_loudness l ON l.track_id = t.id " \
+	                  "WHERE t.file_missing = 0 ORDER BY t.id";
+
+	*count = 0;
+	db_access_begin();
+	if (sqlite3_prepare_v2(db, q, -1, &pp_stmt, NULL) == SQLITE_OK &&
+	    sqlite3_bind_int(pp_stmt, 1, AUDIOFEATURES_VERSION) == SQLITE_OK) {
+		while (!stop && sqlite3_step(pp_stmt) == SQLITE_ROW) {
+			const char *file = (const char *)sqlite3_column_text(pp_stmt, 1);
+			WorkItem    item;
+
+			if (!file) continue;
+			item.id = sqlite3_column_int(pp_stmt, 0);
+			item.stages = stages & STAGE_LOUDNESS;
+			if ((stages & STAGE_FEATURES) && !sqlite3_column_int(pp_stmt, 2))
+				item.stages |= STAGE_FEATURES;
+			item.has_loudness = sqlite3_column_type(pp_stmt, 3) != SQLITE_NULL;
+			item.mtime = item.has_loudness ? (time_t)sqlite3_column_int64(pp_stmt, 3) : 0;
+			if (!item.stages) continue;
+			if (*count == size) {
+				WorkItem *tmp = realloc(items, (size ? size * 2 : 1024) * sizeof(WorkItem));
+				if (!tmp) break;
+				items = tmp;
+				size = size ? size * 2 : 1024;
+			}
+			if (!(item.file = malloc(strlen(file) + 1))) break;
+			strcpy(item.file, file);
+			items[(*count)++] = item;
+		}
+	}
+	sqlite3_finalize(pp_stmt);
+	db_access_end();
+	return items;
+}
+
+/* Removes the tracks whose files do not exist, and those that do not need
+ * to be analyzed, since their loudness has been measured and the file has
+ * not been modified since. Returns the new number of items. */
+static int filter_work_list(WorkItem *items, int count, int max_tracks)
+{
+	int i, n = 0;
+
+	for (i = 0; i < count; i++) {
+		struct stat st;
+		int         keep = !stop && (max_tracks <= 0 || n < max_tracks) && stat(items[i].file, &st) == 0;
+
+		if (keep) {
+			if (items[i].has_loudness && items[i].mtime == st.st_mtime)
+				items[i].stages &= ~STAGE_LOUDNESS;
+			items[i].mtime = st.st_mtime;
+			keep = items[i].stages != 0;
+		}
+		if (keep)
+			items[n++] = items[i];
+		else
+			free(items[i].file);
+	}
+	return n;
+}
+
+static void free_work_list(WorkItem *items, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		free(items[i].file);
+	free(items);
+}
+
+static sqlite3 *open_db(const char *db_file)
+{
+	sqlite3 *db = NULL;
+
+	if (sqlite3_open_v2(db_file, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX, NULL) != SQLITE_OK) {
+		sqlite3_close(db);
+		return NULL;
+	}
+	/* Gmu and the other workers write to the medialib while the analysis is running */
+	sqlite3_busy_timeout(db, 10000);
+	return db;
+}
+
+/* Analyzes every 'jobs'th track of the work list, starting with 'worker' */
+static void run_worker(const char *db_file, const WorkItem *items, int count, int worker, int jobs)
+{
+	sqlite3 *db = open_db(db_file);
+	int      i, analyzed = 0, failed = 0;
+	double   start = get_time(CLOCK_MONOTONIC);
+
+	if (!db) {
+		fprintf(stderr, "Cannot open the medialib %s.\n", db_file);
+		return;
+	}
+	for (i = worker; i < count && !stop; i += jobs) {
+		const char *file = items[i].file;
+		Results     r;
+
+		memset(&r, 0, sizeof(Results));
+		if (analyze_file(file, items[i].stages, &r) > 0 && store_results(db, &items[i], &r)) {
+			if (r.stages_ok == items[i].stages) {
+				analyzed++;
+				wdprintf(V_DEBUG, "gmuanalyze", "Analyzed %s (%.0f BPM, %.1f LUFS, %.1f dBTP)\n",
+				         file, r.bpm, r.loudness, r.true_peak);
+			} else {
+				failed++;
+			}
+		}
+		if (print_progress && !stop) {
+			/* Short enough to be written atomically by each worker */
+			printf("done %d\n", items[i].id);
+			fflush(stdout);
+		}
+	}
+	wdprintf(V_INFO, "gmuanalyze", "Worker %d: %d tracks analyzed, %d failed in %.1f seconds.\n",
+	         worker, analyzed, failed, get_time(CLOCK_MONOTONIC) - start);
+	sqlite3_close(db);
+}
+
+static int get_schema_version(sqlite3 *db)
+{
+	sqlite3_stmt *pp_stmt = NULL;
+	int           version = 0;
+
+	if (sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &pp_stmt, NULL) == SQLITE_OK &&
+	    sqlite3_step(pp_stmt) == SQLITE_ROW)
+		version = sqlite3_column_int(pp_stmt, 0);
+	sqlite3_finalize(pp_stmt);
+	return version;
+}
+
+static void help(const char *prog)
+{
+	fprintf(stderr, "Gmu medialib analyzer %s\n", VERSION_NUMBER);
+	fprintf(stderr, "Usage: %s [options]\n", prog);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  -d <dir>      Decoder directory (default: ./decoders)\n");
+	fprintf(stderr, "  -f <file>     Medialib database (default: the user's gmu.db)\n");
+	fprintf(stderr, "  -s <stages>   Comma separated list of analysis stages (default: features,loudness)\n");
+	fprintf(stderr, "                features: Acoustic features for finding similar tracks\n");
+	fprintf(stderr, "                loudness: EBU R128 loudness and true peak\n");
+	fprintf(stderr, "  -t            Also store the loudness as ReplayGain tags in the medialib\n");
+	fprintf(stderr, "  -j <jobs>     Number of worker processes (default: 1, 0: one per CPU core)\n");
+	fprintf(stderr, "  -c <percent>  Maximum CPU usage per worker (default: 100)\n");
+	fprintf(stderr, "  -n <count>    Analyze at most this many tracks\n");
+	fprintf(stderr, "  -p            Print the progress (\"total <n>\" and \"done <id>\" lines)\n");
+	fprintf(stderr, "  -v            Print debug messages (to stdout)\n");
+	fprintf(stderr, "Tracks that have been analyzed already are skipped, so an interrupted\n");
+	fprintf(stderr, "analysis continues where it has been stopped. The loudness of a track\n");
+	fprintf(stderr, "is measured again when its file has been modified.\n");
+}
+
+static int parse_stages(const char *str)
+{
+	int stages = 0;
+
+	if (strstr(str, "features")) stages |= STAGE_FEATURES;
+	if (strstr(str, "loudness")) stages |= STAGE_LOUDNESS;
+	return stages;
+}
+
+int main(int argc, char **argv)
+{
+	const char      *decoder_dir = "./decoders", *db_file = NULL;
+	char            *db_file_alloc = NULL;
+	sqlite3         *db;
+	WorkItem        *items;
+	pid_t            workers[ANALYZE_MAX_JOBS];
+	struct sigaction sa;
+	int              i, count, max_tracks = 0, verbose = 0, jobs = 1;
+	int              stages = STAGE_FEATURES | STAGE_LOUDNESS;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		char opt = argv[i][1];
+		if ((opt == 'd' || opt == 'f' || opt == 's' || opt == 'j' || opt == 'c' || opt == 'n') && i + 1 >= argc)
+			opt = 'h';
+		switch (opt) {
+			case 'd': decoder_dir = argv[++i]; break;
+			case 'f': db_file = argv[++i]; break;
+			case 's': stages = parse_stages(argv[++i]); break;
+			case 't': write_tags = 1; break;
+			case 'j': jobs = atoi(argv[++i]); break;
+			case 'c': cpu_limit = atoi(argv[++i]); break;
+			case 'n': max_tracks = atoi(argv[++i]); break;
+			case 'p': print_progress = 1; break;
+			case 'v': verbose = 1; break;
+			default:
+				help(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if (i < argc || cpu_limit < 1 || cpu_limit > 100 || !stages || jobs < 0) {
+		help(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (jobs == 0) jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs < 1) jobs = 1;
+	if (jobs > ANALYZE_MAX_JOBS) jobs = ANALYZE_MAX_JOBS;
+	wdprintf_set_verbosity(verbose ? V_DEBUG : V_WARNING);
+	if (!db_file) db_file = db_file_alloc = get_data_dir_with_name_alloc("gmu", 0, "gmu.db");
+	if (!db_file || !(db = open_db(db_file))) {
+		fprintf(stderr, "Cannot open the medialib %s.\n", db_file ? db_file : "");
+		free(db_file_alloc);
+		return EXIT_FAILURE;
+	}
+	if (get_schema_version(db) < ANALYZE_SCHEMA_VERSION) {
+		fprintf(stderr, "The medialib needs to be upgraded by Gmu first.\n");
+		sqlite3_close(db);
+		free(db_file_alloc);
+		return EXIT_FAILURE;
+	}
+
+	/* Without SA_RESTART, so waiting for the workers is interrupted */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sig_handler;
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sa.sa_handler = sig_handler_tstp;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGTSTP, &sa, NULL);
+	/* Inherited by the workers */
+	lower_priority();
+	items = get_work_list(db, stages, &count);
+	/* SQLite connections must not be shared with forked processes */
+	sqlite3_close(db);
+	count = filter_work_list(items, count, max_tracks);
+	if (jobs > count) jobs = count > 0 ? count : 1;
+	wdprintf(V_INFO, "gmuanalyze", "%d tracks to analyze with %d worker(s).\n", count, jobs);
+	if (print_progress) {
+		printf("total %d\n", count);
+		fflush(stdout);
+	}
+
+	pcmconv_init();
+	audiofeatures_init();
+	loudness_init();
+	reader_set_cache_size_kb(512, 256);
+#if STATIC
+	decloader_load_builtin_decoders();
+#else
+	if (decloader_load_all(decoder_dir) <= 0)
+		fprintf(stderr, "No decoders found in %s.\n", decoder_dir);
+#endif
+
+	if (jobs == 1) {
+		run_worker(db_file, items, count, 0, 1);
+	} else {
+		/* The decoders can only decode one file at a time, so each worker is
+		 * a separate process */
+		for (i = 0; i < jobs; i++) {
+			workers[i] = fork();
+			if (workers[i] == 0) {
+				run_worker(db_file, items, count, i, jobs);
+				_exit(EXIT_SUCCESS);
+			} else if (workers[i] < 0) {
+				run_worker(db_file, items, count, i, jobs);
+			}
+		}
+		for (i = 0; i < jobs; i++) {
+			while (workers[i] > 0 && waitpid(workers[i], NULL, 0) < 0 && errno == EINTR) {
+				int j;
+				/* Pass the termination request on to the workers */
+				for (j = 0; stop && j < jobs; j++)
+					if (workers[j] > 0) kill(workers[j], SIGTERM);
+			}
+		}
+	}
+	free_work_list(items, count);
+	free(db_file_alloc);
+	decloader_free();
+	return EXIT_SUCCESS;
+}
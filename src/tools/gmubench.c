@@ -0,0 +1,372 @@
+/*
+ * Gmu Music Player
+ *
+ * Copyright (c) 2006-2021 Johannes Heimansberg (wej.k.vu)
+ *
+ * File: gmubench.c  Created: 210807
+ *
+ * Description: Decoder throughput benchmark
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2 of
+ * the License. See the file COPYING in the Gmu's main directory
+ * for details.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include "../core.h" /* for VERSION_NUMBER */
+#include "../gmudecoder.h"
+#include "../decloader.h"
+#include "../reader.h"
+#include "../pcmconv.h"
+#include "../util.h"
+#include "../debug.h"
+
+#define BENCH_BUF_SIZE      65536
+#define BENCH_MAX_DECODERS  32
+#define BENCH_MAX_FILES     4096
+/* Data per pcmconv kernel call (in samples) and minimum time per kernel */
+#define BENCH_PCMCONV_SAMPLES 65536
+#define BENCH_PCMCONV_SECONDS 0.25
+
+typedef struct BenchTotals {
+	const char *decoder;
+	int         files, meta_files;
+	double      audio_sec, cpu_sec, wall_sec, meta_sec;
+} BenchTotals;
+
+static BenchTotals totals[BENCH_MAX_DECODERS];
+static int         num_totals;
+static char       *files[BENCH_MAX_FILES];
+static int         num_files;
+static FILE       *out;
+
+static double get_time(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static long get_peak_rss_kb(void)
+{
+	struct rusage ru;
+	return getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : 0;
+}
+
+static void json_print_string(const char *str)
+{
+	fputc('"', out);
+	for (; str && *str; str++) {
+		unsigned char ch = *str;
+		if (ch == '"' || ch == '\\')
+			fprintf(out, "\\%c", ch);
+		else if (ch < 0x20)
+			fprintf(out, "\\u%04x", ch);
+		else
+			fputc(ch, out);
+	}
+	fputc('"', out);
+}
+
+static BenchTotals *get_totals(const char *decoder)
+{
+	BenchTotals *bt = NULL;
+	int          i;
+
+	for (i = 0; i < num_totals && !bt; i++)
+		if (strcmp(totals[i].decoder, decoder) == 0) bt = totals + i;
+	if (!bt && num_totals < BENCH_MAX_DECODERS) {
+		bt = totals + num_totals++;
+		bt->decoder = decoder;
+	}
+	return bt;
+}
+
+static void print_file_error(const char *file, const char *error, int first)
+{
+	fprintf(out, "%s\n    { \"file\": ", first ? "" : ",");
+	json_print_string(file);
+	fprintf(out, ", \"error\": \"%s\" }", error);
+}
+
+/* Decodes the file (up to 'max_seconds' of audio, if > 0) without audio output */
+static void bench_decode(const char *file, double max_seconds, int first)
+{
+	static char  buf[BENCH_BUF_SIZE];
+	Reader      *r;
+	GmuDecoder  *gd;
+	BenchTotals *bt;
+	double       wall_start, cpu_start, wall, cpu, first_sample = -1.0, audio_sec = 0.0;
+	long long    bytes = 0, max_bytes = 0;
+	int          samplerate, channels, ret = 1;
+
+	wall_start = get_time(CLOCK_MONOTONIC);
+	cpu_start  = get_time(CLOCK_PROCESS_CPUTIME_ID);
+	if (!(gd = decloader_get_decoder_for_file(file, &r))) {
+		print_file_error(file, "no decoder", first);
+		return;
+	}
+	if (gd->set_reader_handle) (*gd->set_reader_handle)(r);
+	if ((gd->set_reader_handle && !r) || !(*gd->open_file)(file)) {
+		print_file_error(file, "cannot open file", first);
+		if (r) reader_close(r);
+		if (gd->set_reader_handle) (*gd->set_reader_handle)(NULL);
+		return;
+	}
+	samplerate = gd->get_samplerate ? (*gd->get_samplerate)() : 44100;
+	channels   = gd->get_channels ? (*gd->get_channels)() : 2;
+	if (max_seconds > 0.0 && samplerate > 0 && channels > 0)
+		max_bytes = (long long)(max_seconds * samplerate) * channels * 2;
+
+	while (ret > 0 && (max_bytes == 0 || bytes < max_bytes)) {
+		if (gd->decode_data_direct) {
+			const char *data;
+			ret = (*gd->decode_data_direct)(&data, BENCH_BUF_SIZE / 2);
+		} else {
+			ret = (*gd->decode_data)(buf, BENCH_BUF_SIZE);
+		}
+		if (ret > 0) {
+			if (first_sample < 0.0) first_sample = get_time(CLOCK_MONOTONIC) - wall_start;
+			bytes += ret;
+		}
+	}
+	(*gd->close_file)();
+	if (r) reader_close(r);
+	if (gd->set_reader_handle) (*gd->set_reader_handle)(NULL);
+	wall = get_time(CLOCK_MONOTONIC) - wall_start;
+	cpu  = get_time(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+	if (samplerate > 0 && channels > 0)
+		audio_sec = (double)bytes / (samplerate * channels * 2);
+
+	if ((bt = get_totals(gd->identifier))) {
+		bt->files++;
+		bt->audio_sec += audio_sec;
+		bt->cpu_sec   += cpu;
+		bt->wall_sec  += wall;
+	}
+	fprintf(out, "%s\n    { \"file\": ", first ? "" : ",");
+	json_print_string(file);
+	fprintf(out, ", \"decoder\": ");
+	json_print_string(gd->identifier);
+	fprintf(out, ", \"samplerate\": %d, \"channels\": %d, \"audio_seconds\": %.3f, "
+	        "\"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, \"x_realtime\": %.2f, "
+	        "\"x_realtime_wall\": %.2f, \"first_sample_ms\": %.3f, \"decoder_error\": %s, "
+	        "\"peak_rss_kb\": %ld }",
+	        samplerate, channels, audio_sec, wall, cpu,
+	        cpu > 0.0 ? audio_sec / cpu : 0.0, wall > 0.0 ? audio_sec / wall : 0.0,
+	        first_sample >= 0.0 ? first_sample * 1000.0 : -1.0, ret < 0 ? "true" : "false",
+	        get_peak_rss_kb());
+}
+
+/* Loads the meta data of all files 'passes' times, returns the number of files read */
+static int bench_meta_data(int passes, double *seconds)
+{
+	int    i, p, count = 0;
+	double start = get_time(CLOCK_MONOTONIC);
+
+	for (p = 0; p < passes; p++) {
+		for (i = 0; i < num_files; i++) {
+			const char  *ext = get_file_extension(files[i]);
+			GmuDecoder  *gd = ext ? decloader_get_decoder_for_extension(ext) : NULL;
+			BenchTotals *bt;
+			double       t;
+
+			if (!gd || !gd->meta_data_load) continue;
+			t = get_time(CLOCK_MONOTONIC);
+			if ((*gd->meta_data_load)(files[i])) count++;
+			if (gd->meta_data_close) (*gd->meta_data_close)();
+			if ((bt = get_totals(gd->identifier))) {
+				bt->meta_files++;
+				bt->meta_sec += get_time(CLOCK_MONOTONIC) - t;
+			}
+		}
+	}
+	*seconds = get_time(CLOCK_MONOTONIC) - start;
+	return count;
+}
+
+/* Measures the sample format conversion kernels of each available implementation */
+static void bench_pcmconv(void)
+{
+	static int32_t  src32[BENCH_PCMCONV_SAMPLES];
+	static float    srcf[BENCH_PCMCONV_SAMPLES];
+	static int16_t  target[BENCH_PCMCONV_SAMPLES * 2];
+	const int32_t  *planes[2] = { src32, src32 + BENCH_PCMCONV_SAMPLES / 2 };
+	const char     *kernel_names[] = { "s32_planar_to_s16", "s32_to_s16", "float_to_s16", "8bit_to_s16" };
+	PcmConvImpl     impls[] = { PCMCONV_IMPL_SCALAR, PCMCONV_IMPL_SSE2, PCMCONV_IMPL_NEON };
+	int             i, k, first = 1;
+
+	for (i = 0; i < BENCH_PCMCONV_SAMPLES; i++) {
+		src32[i] = (int32_t)((i * 2654435761U) >> 8) - (1 << 23);
+		srcf[i]  = (float)src32[i] / (1 << 23);
+	}
+	fprintf(out, ",\n  \"pcmconv\": [");
+	for (i = 0; i < (int)(sizeof(impls) / sizeof(impls[0])); i++) {
+		if (!pcmconv_set_implementation(impls[i])) continue;
+		for (k = 0; k < (int)(sizeof(kernel_names) / sizeof(kernel_names[0])); k++) {
+			double    start = get_time(CLOCK_PROCESS_CPUTIME_ID), t;
+			long long samples = 0;
+			do {
+				switch (k) {
+					case 0:
+						pcmconv_s32_planar_to_s16(target, planes, 2, BENCH_PCMCONV_SAMPLES / 2, 8);
+						break;
+					case 1:
+						pcmconv_s32_to_s16(target, src32, BENCH_PCMCONV_SAMPLES, 8);
+						break;
+					case 2:
+						pcmconv_float_to_s16(target, srcf, BENCH_PCMCONV_SAMPLES);
+						break;
+					case 3:
+						pcmconv_8bit_to_s16(target, (const unsigned char *)src32, BENCH_PCMCONV_SAMPLES, 1);
+						break;
+				}
+				samples += BENCH_PCMCONV_SAMPLES;
+				t = get_time(CLOCK_PROCESS_CPUTIME_ID) - start;
+			} while (t < BENCH_PCMCONV_SECONDS);
+			fprintf(out, "%s\n    { \"implementation\": \"%s\", \"kernel\": \"%s\", \"msamples_per_second\": %.1f }",
+			        first ? "" : ",", pcmconv_get_implementation_name(), kernel_names[k], samples / t / 1000000.0);
+			first = 0;
+		}
+	}
+	fprintf(out, "\n  ]");
+	pcmconv_set_implementation(PCMCONV_IMPL_AUTO);
+}
+
+/* Adds the file or all files in the directory (recursively) to the file list */
+static void add_path(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		fprintf(stderr, "Cannot access %s\n", path);
+	} else if (S_ISDIR(st.st_mode)) {
+		DIR           *dir = opendir(path);
+		struct dirent *de;
+		while (dir && (de = readdir(dir))) {
+			if (de->d_name[0] != '.') {
+				size_t len = strlen(path) + strlen(de->d_name) + 2;
+				char  *sub = malloc(len);
+				if (sub) {
+					snprintf(sub, len, "%s/%s", path, de->d_name);
+					add_path(sub);
+					free(sub);
+				}
+			}
+		}
+		if (dir) closedir(dir);
+	} else if (num_files < BENCH_MAX_FILES) {
+		files[num_files] = malloc(strlen(path) + 1);
+		if (files[num_files]) strcpy(files[num_files++], path);
+	}
+}
+
+static int compare_strings(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void help(const char *prog)
+{
+	fprintf(stderr, "Gmu decoder benchmark %s\n", VERSION_NUMBER);
+	fprintf(stderr, "Usage: %s [options] file|directory ...\n", prog);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  -d <dir>      Decoder directory (default: ./decoders)\n");
+	fprintf(stderr, "  -l <seconds>  Decode at most this much audio per file\n");
+	fprintf(stderr, "  -m <passes>   Meta data loading passes over all files (default: 1, 0 to skip)\n");
+	fprintf(stderr, "  -p            Benchmark the PCM conversion kernels\n");
+	fprintf(stderr, "  -o <file>     Write the results to a file instead of stdout\n");
+	fprintf(stderr, "  -v            Print debug messages (to stdout)\n");
+	fprintf(stderr, "The results are written in JSON format.\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char    *decoder_dir = "./decoders", *out_file = NULL;
+	double         max_seconds = 0.0, meta_sec = 0.0;
+	int            i, meta_passes = 1, pcmconv = 0, verbose = 0, meta_count = 0;
+	struct utsname un;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		char opt = argv[i][1];
+		if ((opt == 'd' || opt == 'l' || opt == 'm' || opt == 'o') && i + 1 >= argc) opt = 'h';
+		switch (opt) {
+			case 'd': decoder_dir = argv[++i]; break;
+			case 'l': max_seconds = atof(argv[++i]); break;
+			case 'm': meta_passes = atoi(argv[++i]); break;
+			case 'o': out_file = argv[++i]; break;
+			case 'p': pcmconv = 1; break;
+			case 'v': verbose = 1; break;
+			default:
+				help(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	for (; i < argc; i++) add_path(argv[i]);
+	if (num_files == 0 && !pcmconv) {
+		help(argv[0]);
+		return EXIT_FAILURE;
+	}
+	qsort(files, num_files, sizeof(char *), compare_strings);
+
+	out = stdout;
+	if (out_file && !(out = fopen(out_file, "w"))) {
+		fprintf(stderr, "Cannot open %s for writing.\n", out_file);
+		return EXIT_FAILURE;
+	}
+	/* Log messages go to stdout, so they are only enabled on request */
+	wdprintf_set_verbosity(verbose ? V_DEBUG : V_SILENT);
+	pcmconv_init();
+	reader_set_cache_size_kb(512, 256);
+#if STATIC
+	decloader_load_builtin_decoders();
+#else
+	if (decloader_load_all(decoder_dir) <= 0 && num_files > 0)
+		fprintf(stderr, "No decoders found in %s.\n", decoder_dir);
+#endif
+
+	fprintf(out, "{\n  \"version\": \"%s\",\n  \"machine\": ", VERSION_NUMBER);
+	json_print_string(uname(&un) == 0 ? un.machine : "unknown");
+	fprintf(out, ",\n  \"pcmconv_implementation\": \"%s\",\n  \"files\": [", pcmconv_get_implementation_name());
+	for (i = 0; i < num_files; i++) {
+		bench_decode(files[i], max_seconds, i == 0);
+		fflush(out);
+	}
+	fprintf(out, "\n  ]");
+
+	/* The files have just been decoded, so this measures warm cache performance */
+	if (meta_passes > 0 && num_files > 0) {
+		meta_count = bench_meta_data(meta_passes, &meta_sec);
+		fprintf(out, ",\n  \"meta_data\": { \"files\": %d, \"seconds\": %.6f, \"files_per_second\": %.1f }",
+		        meta_count, meta_sec, meta_sec > 0.0 ? meta_count / meta_sec : 0.0);
+	}
+
+	fprintf(out, ",\n  \"decoders\": [");
+	for (i = 0; i < num_totals; i++) {
+		BenchTotals *bt = totals + i;
+		fprintf(out, "%s\n    { \"decoder\": ", i == 0 ? "" : ",");
+		json_print_string(bt->decoder);
+		fprintf(out, ", \"files\": %d, \"audio_seconds\": %.3f, \"cpu_seconds\": %.6f, \"x_realtime\": %.2f, "
+		        "\"meta_data_files_per_second\": %.1f }",
+		        bt->files, bt->audio_sec, bt->cpu_sec, bt->cpu_sec > 0.0 ? bt->audio_sec / bt->cpu_sec : 0.0,
+		        bt->meta_sec > 0.0 ? bt->meta_files / bt->meta_sec : 0.0);
+	}
+	fprintf(out, "\n  ]");
+
+	if (pcmconv) bench_pcmconv();
+	fprintf(out, ",\n  \"peak_rss_kb\": %ld\n}\n", get_peak_rss_kb());
+
+	if (out != stdout) fclose(out);
+	decloader_free();
+	for (i = 0; i < num_files; i++) free(files[i]);
+	return EXIT_SUCCESS;
+}
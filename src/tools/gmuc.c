@@ -235,17 +235,44 @@ static void cmd_trackinfo(UI *ui, JSON_Object *json)
 	ui_refresh_active_window(ui);
 }
 
-static void cmd_playlist_change(UI *ui, JSON_Object *json, int sock)
+/* Number of playlist entries and their total length in seconds */
+static int pl_entries, pl_time, pl_time_unknown;
+
+static void update_playlist_title(UI *ui)
 {
 	char title[64];
+
+	if (pl_entries > 0 && pl_time > 0) {
+		int h = pl_time / 3600, m = pl_time / 60 % 60, s = pl_time % 60;
+		/* '+' marks the time as incomplete, as long as some lengths are unknown */
+		if (h > 0)
+			snprintf(title, 64, "Playlist (%d, %d:%02d:%02d%s)", pl_entries, h, m, s, pl_time_unknown > 0 ? "+" : "");
+		else
+			snprintf(title, 64, "Playlist (%d, %d:%02d%s)", pl_entries, m, s, pl_time_unknown > 0 ? "+" : "");
+	} else {
+		snprintf(title, 64, "Playlist (%d)", pl_entries);
+	}
+	window_update_title(ui->lw_pl->win, title);
+}
+
+static void cmd_playlist_time(UI *ui, JSON_Object *json)
+{
+	pl_time         = (int)json_get_number_value_for_key(json, "time");
+	pl_time_unknown = (int)json_get_number_value_for_key(json, "unknown");
+	update_playlist_title(ui);
+	ui_refresh_active_window(ui);
+}
+
+static void cmd_playlist_change(UI *ui, JSON_Object *json, int sock)
+{
 	int  length     = (int)json_get_number_value_for_key(json, "length");
 	int  changed_at = (int)json_get_number_value_for_key(json, "changed_at_position");
 	wprintw(ui->win_cmd->win, "Playlist has been changed!\n");
 	wprintw(ui->win_cmd->win, "Length=%d Pos=%d\n", length, changed_at);
 	if (length < 0) length = 0;
 	listwidget_set_length(ui->lw_pl, length);
-	snprintf(title, 64, "Playlist (%d)", length);
-	window_update_title(ui->lw_pl->win, title);
+	pl_entries = length;
+	update_playlist_title(ui);
 	ui_refresh_active_window(ui);
 	if (listwidget_get_selection(ui->lw_pl) > changed_at)
 		listwidget_set_cursor(ui->lw_pl, changed_at);
@@ -265,10 +292,16 @@ static void cmd_playlist_item(UI *ui, JSON_Object *json, int sock)
 	char  str[128];
 	char *title = json_get_string_value_for_key(json, "title");
 	int   pos = (int)json_get_number_value_for_key(json, "position");
+	int   length = (int)json_get_number_value_for_key(json, "length");
 	if (pos >= 0 && title) {
 		snprintf(str, 127, "%5d", pos+1);
 		listwidget_set_cell_data(ui->lw_pl, pos, 0, str);
 		listwidget_set_cell_data(ui->lw_pl, pos, 1, title);
+		if (length > 0)
+			snprintf(str, 127, "%2d:%02d", length / 60, length % 60);
+		else
+			str[0] = '\0';
+		listwidget_set_cell_data(ui->lw_pl, pos, 2, str);
 		if (pos >= ui->lw_pl->first_visible_row &&
 		    pos < ui->lw_pl->first_visible_row + ui->lw_pl->win->height-2)
 			ui_refresh_active_window(ui);
@@ -338,38 +371,39 @@ static char *cmd_dir_read(UI *ui, JSON_Object *json)
 	return cur_dir;
 }
 
-static void cmd_mlib_result(UI *ui, JSON_Object *json)
+static void cmd_mlib_results(UI *ui, JSON_Object *json)
 {
-	int pos = (int)json_get_number_value_for_key(json, "pos");
+	int          pos = (int)json_get_number_value_for_key(json, "pos");
+	JSON_Object *item;
 
 	if (pos == 0) listwidget_clear_all_rows(ui->lw_mlib_search);
-	if (pos >= 0) {
+	for (item = json_get_array_for_key(json, "items"); item && pos >= 0; item = item->next) {
 		int   row;
-		int   id     = json_get_number_value_for_key(json, "id");
-		char *artist = json_get_string_value_for_key(json, "artist");
-		char *album  = json_get_string_value_for_key(json, "album");
-		char *title  = json_get_string_value_for_key(json, "title");
-		char  tmpid[8];
+		int   id     = json_get_number_value_for_key(item, "id");
+		char *artist = json_get_string_value_for_key(item, "artist");
+		char *album  = json_get_string_value_for_key(item, "album");
+		char *title  = json_get_string_value_for_key(item, "title");
+		char  tmpid[16];
 
-		snprintf(tmpid, 8, "%d", id);
+		snprintf(tmpid, 16, "%d", id);
 		row = listwidget_add_row(ui->lw_mlib_search) - 1;
 		listwidget_set_cell_data(ui->lw_mlib_search, row, 0, artist);
 		listwidget_set_cell_data(ui->lw_mlib_search, row, 1, album);
 		listwidget_set_cell_data(ui->lw_mlib_search, row, 2, title);
 		listwidget_set_cell_data(ui->lw_mlib_search, row, 3, tmpid);
-		ui_refresh_active_window(ui);
 	}
+	ui_refresh_active_window(ui);
 }
 
-static void cmd_mlib_browse_result(UI *ui, JSON_Object *json)
+static void cmd_mlib_browse_results(UI *ui, JSON_Object *json)
 {
-	int pos = (int)json_get_number_value_for_key(json, "pos");
+	int          pos = (int)json_get_number_value_for_key(json, "pos");
+	JSON_Object *item;
 
-	if (pos >= 0) {
+	for (item = json_get_array_for_key(json, "items"); item && pos >= 0; item = item->next, pos++) {
 		int   row;
-		/*int   id     = json_get_number_value_for_key(json, "id");*/
-		char *artist = json_get_string_value_for_key(json, "artist");
-		char *genre  = json_get_string_value_for_key(json, "genre");
+		char *artist = json_get_string_value_for_key(item, "artist");
+		char *genre  = json_get_string_value_for_key(item, "genre");
 
 		if (artist) {
 			if (pos == 0) listwidget_clear_all_rows(ui->lw_mlib_artists);
@@ -382,7 +416,39 @@ static void cmd_mlib_browse_result(UI *ui, JSON_Object *json)
 			listwidget_set_cell_data(ui->lw_mlib_genres, row, 0, genre);
 			ui_mlib_set_state(ui, MLIB_STATE_BROWSE_GENRES);
 		}
-		ui_refresh_active_window(ui);
+	}
+	ui_refresh_active_window(ui);
+}
+
+/* Requests the next page of search or browse results, if there is one */
+static void cmd_mlib_done(JSON_Object *json, int sock)
+{
+	char *cursor = json_get_string_value_for_key(json, "cursor");
+	char *cmd    = json_get_string_value_for_key(json, "cmd");
+
+	if (cursor && cursor[0] && cmd) {
+		char *cursor_esc = json_string_escape_alloc(cursor);
+		char *str_esc = NULL, *msg = NULL;
+		int   len;
+
+		if (strcmp(cmd, "mlib_search_done") == 0) {
+			str_esc = json_string_escape_alloc(json_get_string_value_for_key(json, "str"));
+			len = strlen(cursor_esc) + (str_esc ? strlen(str_esc) : 0) + 80;
+			msg = malloc(len);
+			if (msg) snprintf(msg, len, "{\"cmd\":\"medialib_search\",\"type\":\"0\",\"str\":\"%s\",\"cursor\":\"%s\"}",
+			                  str_esc ? str_esc : "", cursor_esc);
+		} else {
+			char *column = json_get_string_value_for_key(json, "column");
+			str_esc = json_string_escape_alloc(json_get_string_value_for_key(json, "artist"));
+			len = strlen(cursor_esc) + (str_esc ? strlen(str_esc) : 0) + 80;
+			msg = column ? malloc(len) : NULL;
+			if (msg) snprintf(msg, len, "{\"cmd\":\"medialib_browse\",\"column\":\"%s\",\"artist\":\"%s\",\"cursor\":\"%s\"}",
+			                  column, str_esc ? str_esc : "", cursor_esc);
+		}
+		if (msg) websocket_send_str(sock, msg, 1);
+		free(msg);
+		free(str_esc);
+		free(cursor_esc);
 	}
 }
 
@@ -493,6 +559,8 @@ static int handle_data_in_ringbuffer(RingBuffer *rb, UI *ui, int sock, char *pas
 							screen_update = cmd_login(ui, json, sock, *cur_dir);
 						} else if (strcmp(cmd, "playlist_info") == 0) {
 							wprintw(ui->win_cmd->win, "Playlist info received!\n");
+						} else if (strcmp(cmd, "playlist_time") == 0) {
+							cmd_playlist_time(ui, json);
 						} else if (strcmp(cmd, "playlist_change") == 0) {
 							cmd_playlist_change(ui, json, sock);
 							screen_update = 1;
@@ -508,14 +576,17 @@ static int handle_data_in_ringbuffer(RingBuffer *rb, UI *ui, int sock, char *pas
 							cmd_playmode_info(ui, json);
 						} else if (strcmp(cmd, "volume_info") == 0) {
 							cmd_volume_info(ui, json);
-						} else if (strcmp(cmd, "mlib_result") == 0) {
-							cmd_mlib_result(ui, json);
+						} else if (strcmp(cmd, "mlib_results") == 0) {
+							cmd_mlib_results(ui, json);
 						} else if (strcmp(cmd, "mlib_search_start") == 0) {
 							cmd_busy(ui, 1);
 						} else if (strcmp(cmd, "mlib_search_done") == 0) {
 							cmd_busy(ui, 0);
-						} else if (strcmp(cmd, "mlib_browse_result") == 0) {
-							cmd_mlib_browse_result(ui, json);
+							cmd_mlib_done(json, sock);
+						} else if (strcmp(cmd, "mlib_browse_results") == 0) {
+							cmd_mlib_browse_results(ui, json);
+						} else if (strcmp(cmd, "mlib_browse_done") == 0) {
+							cmd_mlib_done(json, sock);
 						}
 						if (screen_update) ui_refresh_active_window(ui);
 						ui_cursor_text_input(ui, input);
@@ -75,7 +75,7 @@ void trackinfo_init(TrackInfo *ti, int with_locking)
 	ti->file_type[0] = '\0';
 	ti->file_name[0] = '\0';
 	ti->tracknr[0] = '\0';
-	ti->lyrics[0] = '\0';
+	ti->lyrics = NULL;
 	ti->bitrate = 0;
 	ti->recent_bitrate = 0;
 	ti->samplerate = 0;
@@ -112,7 +112,8 @@ void trackinfo_clear(TrackInfo *ti)
 	ti->file_type[0] = '\0';
 	ti->file_name[0] = '\0';
 	ti->tracknr[0] = '\0';
-	ti->lyrics[0] = '\0';
+	if (ti->lyrics != NULL) free(ti->lyrics);
+	ti->lyrics = NULL;
 	ti->bitrate = 0;
 	ti->recent_bitrate = 0;
 	ti->samplerate = 0;
@@ -186,7 +187,7 @@ char *trackinfo_get_tracknr(TrackInfo *ti)
 
 char *trackinfo_get_lyrics(TrackInfo *ti)
 {
-	return ti->lyrics;
+	return ti->lyrics ? ti->lyrics : "";
 }
 
 int trackinfo_has_lyrics(TrackInfo *ti)
@@ -194,6 +195,25 @@ int trackinfo_has_lyrics(TrackInfo *ti)
 	return ti->has_lyrics;
 }
 
+int trackinfo_set_lyrics(TrackInfo *ti, const char *lyrics)
+{
+	size_t len = strlen(lyrics);
+	char  *tmp;
+	int    res = 0;
+
+	if (len > SIZE_LYRICS-1) len = SIZE_LYRICS-1;
+	if ((tmp = malloc(len+1)) != NULL) {
+		memcpy(tmp, lyrics, len);
+		tmp[len] = '\0';
+		if (ti->lyrics != NULL) free(ti->lyrics);
+		ti->lyrics = tmp;
+		ti->has_lyrics = 1;
+		ti->updated = 1;
+		res = 1;
+	}
+	return res;
+}
+
 long trackinfo_get_bitrate(TrackInfo *ti)
 {
 	return ti->bitrate;
@@ -279,17 +299,20 @@ int trackinfo_load_lyrics_from_file(TrackInfo *ti, const char *file_name)
 		}
 		fclose(file);
 		if (charset_is_valid_utf8_string(buffer)) {
-			strncpy(ti->lyrics, buffer, SIZE_LYRICS);
-			ti->lyrics[SIZE_LYRICS-1] = '\0';
 			wdprintf(V_DEBUG, "trackinfo", "Lyrics text looks like it is UTF-8 encoded.\n");
+			result = trackinfo_set_lyrics(ti, buffer);
 		} else { /* Try to convert ISO-8859-1 to UTF-8. */
+			char *utf8 = malloc(SIZE_LYRICS);
+
 			wdprintf(V_DEBUG, "trackinfo", "Lyrics text looks like it is ISO-8859-1 encoded.\n");
-			if (!charset_iso8859_1_to_utf8(ti->lyrics, buffer, SIZE_LYRICS-1)) {
+			if (utf8 && charset_iso8859_1_to_utf8(utf8, buffer, SIZE_LYRICS-1)) {
+				result = trackinfo_set_lyrics(ti, utf8);
+			} else {
 				wdprintf(V_WARNING, "trackinfo", "ERROR: Failed to convert lyrics text to UTF-8.\n");
-				snprintf(ti->lyrics, SIZE_LYRICS-1, "[Text file file with unknown encoding found.]");
+				result = trackinfo_set_lyrics(ti, "[Text file file with unknown encoding found.]");
 			}
+			free(utf8);
 		}
-		ti->has_lyrics = 1;
 	} else {
 		result = 0;
 	}
@@ -353,7 +376,7 @@ int trackinfo_copy(TrackInfo *dest, TrackInfo *src)
 	strncpy(dest->file_type, src->file_type, SIZE_FILE_TYPE);
 	strncpy(dest->file_name, src->file_name, SIZE_FILE_NAME);
 	strncpy(dest->tracknr, src->tracknr, SIZE_TRACKNR);
-	strncpy(dest->lyrics, src->lyrics, SIZE_LYRICS);
+	dest->lyrics = src->lyrics;
 	dest->image = src->image;
 	dest->bitrate = src->bitrate;
 	dest->recent_bitrate = src->recent_bitrate;
@@ -26,7 +26,7 @@
 #define SIZE_MIME_TYPE 64
 #define SIZE_FILE_NAME 256
 #define SIZE_TRACKNR   32
-#define SIZE_LYRICS    16384
+#define SIZE_LYRICS    16384 /* Maximum size of the (heap allocated) lyrics text */
 
 typedef struct Image
 {
@@ -45,7 +45,7 @@ struct _TrackInfo
 	char   file_type[SIZE_FILE_TYPE];
 	char   file_name[SIZE_FILE_NAME];
 	char   tracknr[SIZE_TRACKNR];
-	char   lyrics[SIZE_LYRICS];
+	char  *lyrics; /* NULL unless lyrics have been attached */
 	Image  image;
 
 	long   bitrate, recent_bitrate;
@@ -64,6 +64,21 @@ struct _TrackInfo
 
 typedef struct _TrackInfo TrackInfo;
 
+/* Compact track description used for lists and search results. The
+ * strings are owned by whoever returned the TrackSummary and are only
+ * valid until the next call to the function that returned it. */
+typedef struct TrackSummary
+{
+	int         id;
+	const char *artist;
+	const char *title;
+	const char *album;
+	const char *date;
+	const char *file_name;
+	int         length;
+	int         rating;
+} TrackSummary;
+
 void  trackinfo_init(TrackInfo *ti, int with_locking);
 /* When the locking capability is enabled, trackinfo_destroy() must be
  * called when done with the TrackInfo object to clean up properly */
@@ -98,6 +113,9 @@ int   trackinfo_get_samplerate(TrackInfo *ti);
 int   trackinfo_get_channels(TrackInfo *ti);
 void  trackinfo_get_full_title(TrackInfo *ti, char *target, size_t length);
 int   trackinfo_has_lyrics(TrackInfo *ti);
+/* Attaches a copy of the given lyrics text (truncated to SIZE_LYRICS-1 bytes)
+ * to the TrackInfo object, replacing existing lyrics. Returns 1 on success. */
+int   trackinfo_set_lyrics(TrackInfo *ti, const char *lyrics);
 void  trackinfo_set_image(
 	TrackInfo  *ti,
 	const char *image_data,
@@ -120,6 +138,7 @@ char *trackinfo_get_image_mime_type(TrackInfo *ti);
  * initialized with locking enabled. */
 int   trackinfo_acquire_lock(TrackInfo *ti);
 int   trackinfo_release_lock(TrackInfo *ti);
-/* Copies the content of a TrackInfo object */
+/* Copies the content of a TrackInfo object; Image and lyrics data
+ * are not duplicated but shared with the source object */
 int   trackinfo_copy(TrackInfo *dest, TrackInfo *src);
 #endif